@@ -19,6 +19,8 @@
 
 /* disabled by default */
 #cmakedefine01 PANIC_SHOW_REGS
+#cmakedefine01 KERNEL_LOCKSTAT
+#cmakedefine01 KERNEL_IRQSOFF_TRACER
 
 
 /*
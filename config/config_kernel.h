@@ -48,3 +48,6 @@
 #define WTH_MAX_PRIO_QUEUE_SIZE                    32
 #define WTH_KB_QUEUE_SIZE                          32
 #define WTH_SERIAL_QUEUE_SIZE                      32
+#define WTH_IO_URING_QUEUE_SIZE                    64
+#define WTH_RAMFS_QUEUE_SIZE                        4
+#define WTH_RECLAIM_QUEUE_SIZE                      4
@@ -14,6 +14,7 @@
 
 #cmakedefine01 KMALLOC_FREE_MEM_POISONING
 #cmakedefine01 KMALLOC_HEAVY_STATS
+#cmakedefine01 KMALLOC_SITE_PROF
 #cmakedefine01 KMALLOC_SUPPORT_DEBUG_LOG
 #cmakedefine01 KMALLOC_SUPPORT_LEAK_DETECTOR
 
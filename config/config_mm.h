@@ -16,6 +16,8 @@
 
 #cmakedefine01 FORK_NO_COW
 #cmakedefine01 MMAP_NO_COW
+#cmakedefine01 MMAP_BIG_PAGES
+#cmakedefine01 KERNEL_HIGHMEM
 
 
 /*
@@ -39,9 +41,32 @@
 #define USERMODE_VADDR_END   (KERNEL_BASE_VA) /* biggest user vaddr + 1 */
 #define MAX_BRK                  (0x40000000) /* +1 GB (virtual memory) */
 #define USER_MMAP_BEGIN               MAX_BRK /* +1 GB (virtual memory) */
-#define USER_MMAP_MIN_SZ            (16 * MB)
-#define USER_MMAP_MAX_SZ          (1024 * MB)
 #define USERMODE_STACK_ALIGN              16u
 
 #define USERMODE_STACK_MAX \
    ((USERMODE_VADDR_END - 1) & ALIGNED_MASK(USERMODE_STACK_ALIGN))
+
+/*
+ * The user stack grows on-demand down to USER_STACK_BOTTOM. Below that, at
+ * least USER_STACK_GUARD_GAP bytes of virtual memory are never mapped, so
+ * that a stack overflow always causes a SIGSEGV instead of silently
+ * corrupting the mmap area.
+ */
+#define USER_STACK_BOTTOM \
+   (USERMODE_VADDR_END - USER_STACK_PAGES * PAGE_SIZE)
+#define USER_STACK_GUARD_GAP                  (1 * MB)
+
+/*
+ * The mmap area goes from USER_MMAP_BEGIN up to the stack's guard gap. Its
+ * virtual address space is managed by the per-process tree of user mappings
+ * and free gaps: see kernel/mm/user_vas.c.
+ */
+#define USER_MMAP_END           (USER_STACK_BOTTOM - USER_STACK_GUARD_GAP)
+#define USER_MMAP_MAX_SZ            (USER_MMAP_END - USER_MMAP_BEGIN)
+
+/*
+ * Default and max number of pages mapped by a single page fault on a file
+ * mapping, when the neighbour pages are resident. See `fault_around_pages`.
+ */
+#define FAULT_AROUND_PAGES                         16u
+#define FAULT_AROUND_MAX_PAGES                    256u
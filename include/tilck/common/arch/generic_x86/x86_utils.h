@@ -11,6 +11,26 @@
 
 #include <x86intrin.h>
 
+#ifdef __TILCK_KERNEL__
+   #include <tilck_gen_headers/config_debug.h>
+#endif
+
+#if defined(__TILCK_KERNEL__) && KERNEL_IRQSOFF_TRACER
+
+   /* See <tilck/kernel/irqsoff.h> */
+   void irqsoff_trace_irqs_off(ulong site);
+   void irqsoff_trace_irqs_on(ulong site);
+
+   #define TRACE_IRQS_OFF()         irqsoff_trace_irqs_off(0)
+   #define TRACE_IRQS_ON()          irqsoff_trace_irqs_on(0)
+
+#else
+
+   #define TRACE_IRQS_OFF()
+   #define TRACE_IRQS_ON()
+
+#endif
+
 #define X86_PC_TIMER_IRQ           0
 #define X86_PC_KEYBOARD_IRQ        1
 #define X86_PC_COM2_COM4_IRQ       3
@@ -209,6 +229,7 @@ static ALWAYS_INLINE void set_eflags(ulong f)
 
 static ALWAYS_INLINE void enable_interrupts_forced(void)
 {
+   TRACE_IRQS_ON();
 #ifndef UNIT_TEST_ENVIRONMENT
    asmVolatile("sti");
 #endif
@@ -219,6 +240,7 @@ static ALWAYS_INLINE void disable_interrupts_forced(void)
 #ifndef UNIT_TEST_ENVIRONMENT
    asmVolatile("cli");
 #endif
+   TRACE_IRQS_OFF();
 }
 
 static ALWAYS_INLINE bool are_interrupts_enabled(void)
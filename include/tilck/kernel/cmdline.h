@@ -10,6 +10,7 @@ extern const char *cmd_args[MAX_CMD_ARGS];
 extern void (*self_test_to_run)(void);
 
 extern long kopt_ttys;
+extern const char *kopt_trace_stream;
 extern bool kopt_sercon;
 extern bool kopt_sched_alive_thread;
 extern bool kopt_noacpi;
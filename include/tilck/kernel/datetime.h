@@ -30,6 +30,9 @@ static inline bool is_leap_year(u32 year)
 
 u64 get_sys_time(void);
 s64 get_timestamp(void);
+
+/* TSC cycles per microsecond, measured against the system time since boot */
+ulong get_tsc_cycles_per_us(void);
 void init_system_time(void);
 int clock_get_second_drift(void);
 bool clock_in_resync(void);
@@ -11,6 +11,15 @@ extern const ulong init_st_end;
 size_t stackwalk32(void **frames, size_t count,
                    void *ebp, pdir_t *pdir);
 
+/*
+ * Fault-safe stack walk of the current task, interrupted by an IRQ in the state
+ * `r`, for sampling. It saves in `frames` the interrupted instruction and the
+ * return addresses on its kernel stack (when interrupted in kernel mode), then
+ * the ones on its user stack. Returns the number of frames and, in *kframes,
+ * how many of them are kernel addresses. Requires frame pointers.
+ */
+size_t stackwalk_irq(regs_t *r, ulong *frames, size_t count, size_t *kframes);
+
 void dump_stacktrace(void *ebp, pdir_t *pdir);
 void dump_regs(regs_t *r);
 
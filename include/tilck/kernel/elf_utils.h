@@ -18,4 +18,10 @@ ulong find_addr_of_symbol(const char *searched_sym);
 const char *find_sym_at_addr(ulong vaddr, long *off, u32 *sym_size);
 const char *find_sym_at_addr_safe(ulong vaddr, long *off, u32 *sym_size);
 
+/*
+ * Writes in `buf` "sym+off" for the kernel symbol containing `vaddr`, or just
+ * the address when there is none. Returns the value of snprintk().
+ */
+int format_sym_at_addr(char *buf, size_t buf_size, ulong vaddr);
+
 int foreach_symbol(int (*cb)(struct elf_symbol_info *, void *), void *arg);
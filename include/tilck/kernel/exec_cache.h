@@ -0,0 +1,93 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/atomics.h>
+#include <tilck/common/elf_types.h>
+
+#include <tilck/kernel/list.h>
+#include <tilck/kernel/elf_loader.h>
+#include <tilck/kernel/sys_types.h>
+#include <tilck/kernel/fs/vfs_base.h>
+
+/*
+ * Exec image cache: for the recently executed programs, it keeps the ELF
+ * headers and the pageframes of the segments loaded by copy (the writable
+ * ones and, when the file cannot be mmap-ed, all of them) with their initial
+ * content. The next execve() of the same file skips the parsing and maps those
+ * pageframes in the new process, copy-on-write for the writable segments,
+ * instead of reading them again. The pages past the file content of each
+ * segment (bss) are mapped to the zero page.
+ *
+ * The images are keyed by inode and validated by the inode number, size and
+ * mtime of the file. They're dropped when the file is opened for writing or
+ * truncated (see acquire_subsys_flock()), in LRU order when the cache is full
+ * and by the "exec_cache" shrinker, on memory pressure.
+ */
+
+struct exec_image_seg {
+
+   bool cached;            /* loaded from the cache instead of the file */
+   u32 page_count;         /* pages with file content in `paddrs` */
+   ulong *paddrs;
+};
+
+struct exec_image {
+
+   REF_COUNTED_OBJECT;
+
+   struct list_node node;
+
+   /* Key */
+   struct mnt_fs *fs;
+   vfs_inode_ptr_t inode;
+
+   /* Validation */
+   u64 ino;
+   s64 size;
+   s64 mtime_sec;
+   long mtime_nsec;
+
+   char header[ELF_RAW_HEADER_SIZE];
+   Elf_Phdr *phdrs;
+   u32 phnum;
+   u32 tot_pages;
+   struct exec_image_seg *segs;     /* one per program header */
+};
+
+struct exec_cache_info {
+
+   bool enabled;                    /* tunable */
+   ulong entries;
+   ulong pages;
+   ulong hits;
+   ulong misses;
+   ulong invalidations;
+};
+
+extern struct exec_cache_info exec_cache_info;
+
+void init_exec_cache(void);
+
+struct exec_image *exec_image_alloc(struct mnt_fs *fs,
+                                    vfs_inode_ptr_t inode,
+                                    struct k_stat64 *st,
+                                    u32 phnum);
+void exec_image_free(struct exec_image *img);
+
+/* Returns the image of the file, retained, or NULL */
+struct exec_image *exec_cache_get(struct mnt_fs *fs,
+                                  vfs_inode_ptr_t inode,
+                                  struct k_stat64 *st);
+
+/* Release an image returned by exec_cache_get() */
+void exec_cache_put(struct exec_image *img);
+
+/* Add a new image to the cache, which takes its ownership */
+void exec_cache_add(struct exec_image *img);
+
+/* Drop the image of the given file, if any */
+void exec_cache_invalidate(struct mnt_fs *fs, vfs_inode_ptr_t inode);
+
+/* Drop all the images (e.g. after disabling the cache) */
+void exec_cache_flush(void);
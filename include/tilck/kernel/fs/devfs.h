@@ -74,6 +74,7 @@ void init_devfs(void);
 int register_driver(struct driver_info *info, int major);
 
 int create_dev_file(const char *filename, u16 major, u16 minor, void **devfile);
+int create_dev_mountpoint(const char *dirname);
 struct mnt_fs *get_devfs(void);
 struct driver_info *get_driver_info(u16 major);
 
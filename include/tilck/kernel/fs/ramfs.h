@@ -0,0 +1,30 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+#include <tilck/kernel/fs/vfs_base.h>
+
+/*
+ * Optional, per-instance, compression of the cold file blocks: when `age_ms`
+ * is not 0, the blocks not accessed for that long are compressed in the
+ * background by the "ramfs" worker thread and decompressed on their next
+ * read, write or mmap fault. The blocks mapped in memory are never compressed.
+ */
+struct ramfs_compr_info {
+
+   ulong age_ms;              /* tunable: 0 means no compression */
+   ulong compr_pages;         /* blocks currently compressed */
+   ulong bytes_saved;         /* memory saved by the compressed blocks */
+   ulong compressions;
+   ulong decompressions;
+};
+
+struct mnt_fs *ramfs_create(void);
+struct ramfs_compr_info *ramfs_get_compr_info(struct mnt_fs *fs);
+
+/*
+ * Make the instance reclaimable on memory pressure (see shrinker.h) and start
+ * the worker thread, if needed: call it after creating the instance and after
+ * changing `age_ms`.
+ */
+int ramfs_compr_update(struct mnt_fs *fs);
@@ -0,0 +1,21 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/kernel/fs/vfs_base.h>
+
+/*
+ * shmfs: a flat, memory-only filesystem mounted at /dev/shm, where each file
+ * is backed by a shared-page object (see <tilck/kernel/shmem.h>). Unlike
+ * ramfs files, shmfs mappings are bound to the object and not to the handle,
+ * so they survive close().
+ */
+
+#define SHMFS_NAME_MAX        249       /* same as memfd's MFD_NAME_MAX */
+
+void init_shmfs(void);
+
+/*
+ * Create an anonymous (never linked) shmfs file and open it in O_RDWR mode.
+ * That's what memfd_create() is built upon.
+ */
+int shmfs_create_unlinked(const char *name, fs_handle *out);
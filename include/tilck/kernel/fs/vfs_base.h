@@ -131,9 +131,16 @@ struct fs_handle_base {
  * VFS_MM_DONT_MMAP flag play a role. At the same way, in other exceptional
  * situations we might not want the FS to register the mapping, but to do it
  * anyway.
+ *
+ * File-systems having a `handle_fault` func (e.g. ramfs) might just register
+ * the mapping and let the page fault handler map the pages on-demand. The
+ * VFS_MM_POPULATE flag asks them to map all of the resident pages immediately
+ * instead. It's required when the mapping is not registered (because there's
+ * no user_mapping to handle a fault with) and it's used for MAP_POPULATE.
  */
 #define VFS_MM_DONT_MMAP            (1 << 0)
 #define VFS_MM_DONT_REGISTER        (1 << 1)
+#define VFS_MM_POPULATE             (1 << 2)
 
 int vfs_mmap(struct user_mapping *um, pdir_t *pdir, int flags);
 int vfs_munmap(struct user_mapping *um, void *vaddr, size_t len);
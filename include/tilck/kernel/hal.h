@@ -59,6 +59,8 @@ int get_int_num(regs_t *context);
 void on_first_pdir_update(void);
 void hw_read_clock(struct datetime *out);
 u32 hw_timer_setup(u32 hz);
+u32 hw_rtc_periodic_irq_setup(u32 hz);
+void hw_rtc_periodic_irq_ack(void);
 
 bool allocate_fpu_regs(arch_task_members_t *arch_fields);
 void copy_main_tss_on_regs(regs_t *ctx);
@@ -0,0 +1,53 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+#include <tilck/kernel/paging.h>
+
+/*
+ * Highmem: the usable physical memory above LINEAR_MAPPING_SIZE (and below
+ * 4 GB). The kernel cannot access it directly, so it's used only for the
+ * pageframes accessed either through user mappings or through temporary
+ * kernel mappings (see kmap() below): anonymous user pages, ramfs blocks and
+ * the pages of vmalloc(). Everything else keeps using the linear mapping.
+ *
+ * The highmem pageframes are managed by a simple bitmap allocator: they're
+ * always allocated one by one, through pageframe_alloc().
+ */
+
+extern ulong highmem_total_pages;
+extern ulong highmem_free_pages;
+
+void init_highmem(void);
+
+/* End of the highmem (0 if there's no highmem at all) */
+ulong get_highmem_end(void);
+
+/* Returns INVALID_PADDR when there are no free highmem pageframes */
+ulong highmem_alloc_page(void);
+void highmem_free_page(ulong paddr);
+
+static ALWAYS_INLINE bool is_highmem_paddr(ulong paddr)
+{
+   return paddr >= LINEAR_MAPPING_SIZE;
+}
+
+/*
+ * Temporarily map the pageframe at `paddr` in the kernel's virtual space and
+ * return its address. Pageframes in the linear mapping are just translated.
+ *
+ * Like Linux's kmap_local_page(), the mappings use a small stack of slots:
+ * they must be released with kunmap() in reverse order and preemption stays
+ * disabled in between, so the code using them cannot sleep.
+ */
+void *kmap(ulong paddr);
+void kunmap(void *vaddr);
+
+/*
+ * Allocate a pageframe (with ref-count 0) for user memory or for file data,
+ * preferring the highmem. Returns INVALID_PADDR on failure.
+ */
+ulong pageframe_alloc(bool zero);
+
+/* Free a pageframe allocated with pageframe_alloc() */
+void pageframe_free(ulong paddr);
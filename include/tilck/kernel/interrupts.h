@@ -15,6 +15,16 @@ static ALWAYS_INLINE bool in_irq(void)
    return atomic_load_explicit(&__in_irq_count, mo_relaxed) > 0;
 }
 
+/*
+ * The registers saved on entry of the innermost IRQ being handled (the state
+ * of the interrupted code), NULL when not in IRQ context.
+ */
+static ALWAYS_INLINE regs_t *get_irq_regs(void)
+{
+   extern regs_t *__irq_regs;
+   return __irq_regs;
+}
+
 #if KRN_TRACK_NESTED_INTERR
    void check_not_in_irq_handler(void);
    void check_in_irq_handler(void);
@@ -0,0 +1,145 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/kernel/fs/vfs_base.h>
+
+/*
+ * Minimal io_uring: submission and completion rings shared with user space,
+ * binary compatible with the Linux ABI for the subset of features below.
+ *
+ * Supported opcodes: NOP, READ, WRITE, READV, WRITEV, FSYNC, POLL_ADD,
+ * TIMEOUT, OPENAT and CLOSE. The only supported SQE flag is IOSQE_ASYNC.
+ *
+ * Completions are posted only in the context of io_uring_enter(), like with
+ * Linux's IORING_SETUP_DEFER_TASKRUN: an application waiting for completions
+ * has to call io_uring_enter() with IORING_ENTER_GETEVENTS.
+ */
+
+#define IO_URING_MAX_ENTRIES            16384
+
+/* Max size of an async READ or WRITE (bigger ones fail with -EINVAL) */
+#define IO_URING_MAX_ASYNC_IO           (64 * KB)
+
+/* io_uring_setup() flags */
+#define IORING_SETUP_CQSIZE             (1u << 3)
+
+/* io_uring_params->features */
+#define IORING_FEAT_SINGLE_MMAP         (1u << 0)
+#define IORING_FEAT_NODROP              (1u << 1)
+
+/* Magic offsets for mmap() */
+#define IORING_OFF_SQ_RING              0x00000000u
+#define IORING_OFF_CQ_RING              0x08000000u
+#define IORING_OFF_SQES                 0x10000000u
+
+/* io_uring_enter() flags */
+#define IORING_ENTER_GETEVENTS          (1u << 0)
+
+/* io_uring_sqe->flags */
+#define IOSQE_ASYNC                     (1u << 4)
+
+/* io_uring_sqe->timeout_flags */
+#define IORING_TIMEOUT_ABS              (1u << 0)
+
+enum io_uring_op {
+
+   IORING_OP_NOP        = 0,
+   IORING_OP_READV      = 1,
+   IORING_OP_WRITEV     = 2,
+   IORING_OP_FSYNC      = 3,
+   IORING_OP_POLL_ADD   = 6,
+   IORING_OP_TIMEOUT    = 11,
+   IORING_OP_OPENAT     = 18,
+   IORING_OP_CLOSE      = 19,
+   IORING_OP_READ       = 22,
+   IORING_OP_WRITE      = 23,
+};
+
+struct io_sqring_offsets {
+
+   u32 head;
+   u32 tail;
+   u32 ring_mask;
+   u32 ring_entries;
+   u32 flags;
+   u32 dropped;
+   u32 array;
+   u32 resv1;
+   u64 resv2;
+};
+
+struct io_cqring_offsets {
+
+   u32 head;
+   u32 tail;
+   u32 ring_mask;
+   u32 ring_entries;
+   u32 overflow;
+   u32 cqes;
+   u32 flags;
+   u32 resv1;
+   u64 resv2;
+};
+
+struct io_uring_params {
+
+   u32 sq_entries;
+   u32 cq_entries;
+   u32 flags;
+   u32 sq_thread_cpu;
+   u32 sq_thread_idle;
+   u32 features;
+   u32 wq_fd;
+   u32 resv[3];
+   struct io_sqring_offsets sq_off;
+   struct io_cqring_offsets cq_off;
+};
+
+struct io_uring_sqe {
+
+   u8 opcode;
+   u8 flags;           /* IOSQE_* flags */
+   u16 ioprio;
+   s32 fd;
+   u64 off;            /* file offset, (u64)-1 for the current position */
+   u64 addr;           /* buffer, iovec array, path or timespec */
+   u32 len;            /* buffer size, iovec count or open mode */
+
+   union {
+      u32 rw_flags;
+      u32 fsync_flags;
+      u32 poll32_events;
+      u32 timeout_flags;
+      u32 open_flags;
+   };
+
+   u64 user_data;      /* copied as-is in the completion entry */
+   u16 buf_index;
+   u16 personality;
+   s32 splice_fd_in;
+   u64 __pad2[2];
+};
+
+struct io_uring_cqe {
+
+   u64 user_data;
+   s32 res;
+   u32 flags;
+};
+
+/* Same as Linux's struct __kernel_timespec */
+struct k_io_timespec {
+
+   s64 tv_sec;
+   s64 tv_nsec;
+};
+
+STATIC_ASSERT(sizeof(struct io_uring_params) == 120);
+STATIC_ASSERT(sizeof(struct io_uring_sqe) == 64);
+STATIC_ASSERT(sizeof(struct io_uring_cqe) == 16);
+
+int io_uring_create(u32 entries, struct io_uring_params *p, fs_handle *out);
+bool is_io_uring_handle(fs_handle h);
+
+int
+io_uring_enter(fs_handle h, u32 to_submit, u32 min_complete, u32 flags);
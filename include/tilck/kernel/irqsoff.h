@@ -0,0 +1,52 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck_gen_headers/config_debug.h>
+#include <tilck/common/basic_defs.h>
+
+/*
+ * IRQs-off / preemption-off latency tracer (KERNEL_IRQSOFF_TRACER=1).
+ *
+ * The transitions of the interrupts flag in disable_interrupts_forced() and
+ * enable_interrupts_forced() and the ones of the preemption disable counter
+ * from and to 0 are timestamped with the TSC: for each kind of window, the
+ * tracer keeps the longest one along with the call sites that opened and
+ * closed it. The hooks are called with a `site` equal to 0 from the inline
+ * functions, in which case the return address of the hook itself is used.
+ */
+
+enum irqsoff_kind {
+
+   irqsoff_irqs,
+   irqsoff_preempt,
+
+   IRQSOFF_KINDS,
+};
+
+struct irqsoff_max {
+
+   u64 max_cycles;
+   ulong start_site;          /* where the longest window was opened */
+   ulong end_site;            /* where the longest window was closed */
+   ulong windows;             /* number of measured windows */
+};
+
+struct irqsoff_info {
+
+   bool enabled;
+};
+
+#if KERNEL_IRQSOFF_TRACER
+
+extern struct irqsoff_info irqsoff_info;
+
+void irqsoff_trace_irqs_off(ulong site);
+void irqsoff_trace_irqs_on(ulong site);
+void irqsoff_trace_preempt_off(ulong site);
+void irqsoff_trace_preempt_on(ulong site);
+
+void irqsoff_get_max(enum irqsoff_kind kind, struct irqsoff_max *m);
+void irqsoff_reset(void);
+const char *irqsoff_get_kind_name(enum irqsoff_kind kind);
+
+#endif
@@ -70,18 +70,22 @@ kmalloc_create_regular_heap(ulong vaddr,
 void
 kmalloc_destroy_heap(struct kmalloc_heap *h);
 
-struct kmalloc_heap *
-kmalloc_heap_dup(struct kmalloc_heap *h);
-
-struct kmalloc_heap *
-kmalloc_heap_dup_expanded(struct kmalloc_heap *h, size_t sz);
-
 void *
 per_heap_kmalloc(struct kmalloc_heap *h, size_t *size, u32 flags);
 
 void
 per_heap_kfree(struct kmalloc_heap *h, void *ptr, size_t *size, u32 flags);
 
+/*
+ * Allocate exactly the range [ptr, ptr + size) in the heap `h`, if all of it is
+ * free. Both `ptr` and `size` must be multiples of the heap's min block size.
+ * The range is always allocated in multiple steps, as with
+ * KMALLOC_FL_MULTI_STEP: it can be freed, also partially, with
+ * KFREE_FL_MULTI_STEP | KFREE_FL_ALLOW_SPLIT.
+ */
+bool
+per_heap_kmalloc_at(struct kmalloc_heap *h, void *ptr, size_t size, u32 flags);
+
 struct kmalloc_acc {
 
    u32 elem_size;
@@ -132,12 +136,27 @@ kmalloc_get_heap_struct_size(void);
 size_t
 kmalloc_get_max_tot_heap_free(void);
 
+/* Current free memory in the main heaps (the small heaps live inside them) */
+size_t
+kmalloc_get_tot_heap_free(void);
+
 void *
 aligned_kmalloc(size_t size, u32 align);
 
 void
 aligned_kfree2(void *ptr, size_t size);
 
+/*
+ * Allocate `size` bytes (a power of 2, bigger than KMALLOC_MAX_ALIGN) aligned
+ * at `size`, like a 4 MB page. The heaps don't guarantee such alignment, so
+ * all the suitably aligned addresses in them are tried, one by one: that's
+ * slow and meant only for big blocks. The `flags` are the same as for
+ * per_heap_kmalloc_at(): with a sub-block size, the block can be freed also
+ * partially, like with KMALLOC_FL_MULTI_STEP.
+ */
+void *
+kmalloc_big_aligned(size_t size, u32 flags);
+
 void *
 vmalloc(size_t size);
 
@@ -60,3 +60,39 @@ void debug_kmalloc_stop_leak_detector(bool show_leaks);
 
 void debug_kmalloc_start_log(void);
 void debug_kmalloc_stop_log(void);
+
+
+/* Allocation-site profiler (KMALLOC_SITE_PROF) */
+
+#define KMALLOC_SITE_FRAMES                        4
+
+struct kmalloc_site {
+
+   void *frames[KMALLOC_SITE_FRAMES];  /* return addresses, innermost first */
+   ulong live_bytes;
+   ulong live_count;
+   ulong peak_bytes;
+   ulong allocs;
+   ulong frees;
+   ulong snap_bytes;                   /* live_bytes at the last snapshot */
+   ulong snap_count;                   /* live_count at the last snapshot */
+};
+
+struct kmalloc_site_prof_info {
+
+   bool backtrace;      /* sites are call stacks, not just the callers */
+   ulong sites;
+   ulong max_sites;
+   ulong blocks;        /* live blocks being tracked */
+   ulong max_blocks;
+   ulong dropped;       /* allocations not tracked: no more room */
+   ulong snapshots;
+};
+
+extern struct kmalloc_site_prof_info kmalloc_site_prof_info;
+
+/* Copy up to `max` sites in `buf` and return how many they are */
+ulong debug_kmalloc_get_sites(struct kmalloc_site *buf, ulong max);
+
+/* Save the live bytes and count of all the sites, for diffing */
+void debug_kmalloc_sites_snapshot(void);
@@ -0,0 +1,61 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck_gen_headers/config_debug.h>
+#include <tilck/common/basic_defs.h>
+
+/*
+ * Lock contention statistics (KERNEL_LOCKSTAT=1), keyed by the address of the
+ * lock and by the call site that acquired it. All the times are in TSC cycles.
+ */
+
+#define LOCKSTAT_MAX_ENTRIES                    256
+
+enum lockstat_type {
+
+   lockstat_kmutex,
+   lockstat_rwlock_sh,
+   lockstat_rwlock_ex,
+};
+
+struct lockstat_entry {
+
+   const void *lock;
+   ulong site;
+   enum lockstat_type type;
+   u32 acquisitions;
+   u32 contended;
+   u64 tot_wait;
+   u64 max_wait;
+   u64 max_hold;
+};
+
+#if KERNEL_LOCKSTAT
+
+/*
+ * Accounts an acquisition of `lock` from `site`, started at `start`. Returns
+ * the current TSC value, to be stored in the lock and passed later to
+ * lockstat_released() in order to account the hold time.
+ */
+u64
+lockstat_acquired(const void *lock,
+                  ulong site,
+                  enum lockstat_type type,
+                  u64 start,
+                  bool contended);
+
+void
+lockstat_released(const void *lock, ulong site, u64 acquired);
+
+/* Copies up to `max` entries in `buf`. Returns the number of copied entries */
+u32
+lockstat_get_entries(struct lockstat_entry *buf, u32 max);
+
+/* Number of acquisitions not accounted because the table was full */
+ulong
+lockstat_get_dropped(void);
+
+void
+lockstat_reset(void);
+
+#endif
@@ -0,0 +1,31 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+
+/*
+ * Minimal implementation of the LZ4 block format: a greedy compressor, fast
+ * but with a lower ratio than the reference one (no acceleration knob, no HC
+ * mode), and a decompressor validating its input. Meant for small buffers like
+ * single pages: the input size cannot exceed LZ4_MAX_INPUT_SIZE.
+ */
+
+#define LZ4_MAX_INPUT_SIZE                         (64 * KB)
+#define LZ4_HASH_LOG                                      12
+#define LZ4_WRKMEM_SIZE             ((1 << LZ4_HASH_LOG) * 2)
+
+/*
+ * Compress `len` bytes from `src` into `dst`. Returns the compressed size or 0
+ * when it does not fit in `dst_cap` bytes. `wrkmem` must point to a buffer of
+ * LZ4_WRKMEM_SIZE bytes (no alignment requirements beyond 2 bytes).
+ */
+size_t
+lz4_compress(const void *src, size_t len,
+             void *dst, size_t dst_cap, void *wrkmem);
+
+/*
+ * Decompress `len` bytes from `src` into `dst`. Returns the decompressed size
+ * or -EINVAL when the input is corrupted or does not fit in `dst_cap` bytes.
+ */
+long
+lz4_decompress(const void *src, size_t len, void *dst, size_t dst_cap);
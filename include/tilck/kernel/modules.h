@@ -30,6 +30,9 @@ void register_module(struct module *m);
 #define MOD_acpi_prio                         30
 #define MOD_kb_prio                           50
 #define MOD_tracing_prio                     100
+#define MOD_zram_prio                        120
+#define MOD_prof_prio                        130
+#define MOD_sysstat_prio                     140
 #define MOD_tty_prio                         200
 #define MOD_fbdev_prio                       300
 #define MOD_serial_prio                      400
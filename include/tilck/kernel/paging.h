@@ -8,6 +8,9 @@
 
 #ifdef __i386__
    #define PAGE_DIR_SIZE (PAGE_SIZE)
+   #define BIG_PAGE_SIZE (4 * MB)
+#else
+   #define BIG_PAGE_SIZE (2 * MB)
 #endif
 
 #define OFFSET_IN_PAGE_MASK                        (PAGE_SIZE - 1)
@@ -24,6 +27,7 @@
 #define PAGING_FL_SHARED                                  (1 << 3)
 #define PAGING_FL_DO_ALLOC                                (1 << 4)
 #define PAGING_FL_ZERO_PG                                 (1 << 5)
+#define PAGING_FL_COW                                     (1 << 6)
 
 /* Combo values */
 #define PAGING_FL_RWUS               (PAGING_FL_RW | PAGING_FL_US)
@@ -40,6 +44,8 @@ extern char zero_page[PAGE_SIZE] ALIGNED_AT(PAGE_SIZE);
 
 void early_init_paging();
 bool handle_potential_cow(void *r);
+bool handle_potential_lazy_page(void *r);
+bool handle_potential_swap_in(void *r);
 
 /*
  * Map a pageframe at `paddr` at the virtual address `vaddr` in the page
@@ -89,11 +95,80 @@ int get_mapping2(pdir_t *pdir, void *vaddrp, ulong *pa_ref);
 pdir_t *pdir_clone(pdir_t *pdir);
 pdir_t *pdir_deep_clone(pdir_t *pdir);
 void pdir_destroy(pdir_t *pdir);
+
+/*
+ * Number of user pages in `pdir` backed by a pageframe (the RSS), including
+ * the shared CoW ones and excluding the zero page. It walks all the user page
+ * tables, so it's not meant to be called on hot paths.
+ */
+size_t get_user_rss_pages(pdir_t *pdir);
+
 void invalidate_page(ulong vaddr);
 void set_page_rw(pdir_t *pdir, void *vaddr, bool rw);
+
+/*
+ * Apply the mmap()-like protection `prot` (PROT_* flags) to the user pages
+ * mapped in [vaddr, vaddr + page_count * PAGE_SIZE). Pages not mapped are
+ * skipped. Private pages made writable become CoW pages.
+ */
+void set_pages_prot(pdir_t *pdir, void *vaddr, size_t page_count, int prot);
+
+/*
+ * Exchange the page table entries of two ranges of mapped user pages, moving
+ * the pageframes (and their flags) without copying any data.
+ */
+void swap_pages_mappings(pdir_t *pdir, void *va1, void *va2, size_t count);
+
+/*
+ * madvise(MADV_FREE) support. mark_pages_lazyfree() marks the private user
+ * pages in the range as reclaimable until the next write on them, while
+ * reclaim_lazyfree_pages() frees the marked pages still untouched, replacing
+ * them with the zero page. Both return the number of affected pages.
+ */
+size_t mark_pages_lazyfree(pdir_t *pdir, void *vaddr, size_t page_count);
+size_t reclaim_lazyfree_pages(pdir_t *pdir, void *vaddr, size_t page_count);
+
+/*
+ * Big pages for private anonymous user memory (MMAP_BIG_PAGES).
+ *
+ * map_big_user_page() replaces the mappings of the BIG_PAGE_SIZE-aligned user
+ * block at `vaddr` with a single, zeroed, writable big page. It fails (without
+ * side effects) when anything other than the zero page is mapped there, or on
+ * out-of-memory.
+ *
+ * split_big_user_pages() turns all the big pages overlapping with the given
+ * range into regular pages, keeping their content and protection. It can fail
+ * only with -ENOMEM. All the functions above working on ranges of user pages
+ * expect the big pages not fully contained in the range to be already split.
+ */
+bool map_big_user_page(pdir_t *pdir, void *vaddr);
+int split_big_user_pages(pdir_t *pdir, void *vaddr, size_t page_count);
+
+/*
+ * Swap support (see <tilck/kernel/swap.h>): swap_out_pages() scans the private
+ * user pages in the range, giving a second chance to the ones accessed since
+ * the previous scan, and swaps out up to `max` pages, splitting the cold big
+ * pages if necessary. swap_in_pages() brings back the swapped-out pages in the
+ * range and stops on out-of-memory. Both return the number of pages swapped.
+ */
+size_t swap_out_pages(pdir_t *pdir, void *vaddr, size_t page_count, size_t max);
+size_t swap_in_pages(pdir_t *pdir, void *vaddr, size_t page_count);
+
 void retain_pageframes_mapped_at(pdir_t *pdir, void *vaddr, size_t len);
 void release_pageframes_mapped_at(pdir_t *pdir, void *vaddr, size_t len);
 
+/*
+ * Take an extra reference on the private user page mapped at `vaddr` and make
+ * its mapping copy-on-write, so that the pageframe can be used read-only by the
+ * kernel (e.g. in a pipe) while the user still sees its own private copy.
+ * The caller owns the new reference and must drop it with release_pageframe().
+ * Preemption must be disabled.
+ */
+int retain_user_page_cow(pdir_t *pdir, void *vaddr, ulong *pa_ref);
+void retain_pageframe(ulong paddr);
+void release_pageframe(ulong paddr);
+u32 get_pageframe_ref_count(ulong paddr);
+
 static ALWAYS_INLINE pdir_t *get_kernel_pdir(void)
 {
    extern pdir_t *__kernel_pdir;
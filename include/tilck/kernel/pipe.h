@@ -1,11 +1,29 @@
 /* SPDX-License-Identifier: BSD-2-Clause */
 
 #pragma once
-#define PIPE_BUF_SIZE   4096
+#include <tilck/kernel/fs/vfs_base.h>
+
+/*
+ * Pipes store their data in page-sized buffers, allocated on demand.
+ * PIPE_BUF_SIZE is the default capacity, while F_SETPIPE_SZ can change it
+ * in the range [PIPE_MIN_SIZE, PIPE_MAX_SIZE], always rounding the requested
+ * size up to a power-of-two number of pages.
+ */
+#define PIPE_MIN_SIZE   (PAGE_SIZE)
+#define PIPE_BUF_SIZE   (16 * PAGE_SIZE)
+#define PIPE_MAX_SIZE   (256 * PAGE_SIZE)
 
 struct pipe;
+struct iovec;
 
 struct pipe *create_pipe(void);
 void destroy_pipe(struct pipe *p);
 fs_handle pipe_create_read_handle(struct pipe *p);
 fs_handle pipe_create_write_handle(struct pipe *p);
+
+bool is_pipe_handle(fs_handle h);
+int pipe_get_size(fs_handle h);
+int pipe_set_size(fs_handle h, size_t size);
+
+ssize_t
+pipe_vmsplice(fs_handle h, const struct iovec *iov, u32 iovcnt, u32 flags);
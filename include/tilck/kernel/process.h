@@ -26,11 +26,18 @@ struct kernel_alloc {
    size_t size;
 };
 
-struct mappings_info {
-
-   struct kmalloc_heap *mmap_heap;
-   size_t mmap_heap_size;
-   struct list mappings;
+struct mappings_info;
+
+/*
+ * Resource usage of the terminated children, once waited. Allocated by the
+ * first fork() of the process, as most processes never have children.
+ */
+struct children_rusage {
+
+   struct task_rusage ru;        /* the sum of their counters */
+   u64 ticks;                    /* the sum of their sched ticks */
+   u64 kernel_ticks;             /* the sum of their kernel sched ticks */
+   ulong maxrss;                 /* the largest of their peak RSS, in pages */
 };
 
 struct process {
@@ -53,7 +60,7 @@ struct process {
    bool did_call_execve;
    bool automatic_reaping;       /* the parent explicitly ignored SIGCHLD */
    bool vforked;                 /* after vfork(), before execve() */
-   bool inherited_mmap_heap;
+   bool inherited_mi;            /* got `mi` from the parent on fork */
    bool did_set_tty_medium_raw;
 
    int *set_child_tid;                    /* NOTE: this is an user pointer */
@@ -64,6 +71,9 @@ struct process {
    struct vfs_path cwd;                   /* CWD as a struct vfs_path */
    char *debug_cmdline;                   /* debug field used by debugpanel */
 
+   ulong maxrss;                          /* peak RSS, in pages: see below */
+   struct children_rusage *children_ru;   /* NULL until the first fork */
+
    struct locked_file *elf;
    fs_handle handles[MAX_HANDLES];        /* just a small fixed-size array */
 
@@ -145,6 +155,19 @@ void arch_specific_free_proc(struct process *pi);
 void wake_up_tasks_waiting_on(struct task *ti, enum wakeup_reason r);
 void init_process_lists(struct process *pi);
 
+/*
+ * The peak RSS is not tracked on each page mapping. Instead, the resident
+ * pages are counted by process_update_maxrss() right before the RSS of the
+ * process can shrink (munmap, brk, madvise, execve, exit) and when the value
+ * is reported. Preemption must be disabled.
+ */
+void process_update_maxrss(struct process *pi);
+void process_account_waited_child(struct process *pi, struct task *child);
+void task_get_rusage(struct task *ti,
+                     bool self,
+                     bool children,
+                     struct k_rusage *ru);
+
 void process_set_cwd2_nolock(struct vfs_path *tp);
 void process_set_cwd2_nolock_raw(struct process *pi, struct vfs_path *tp);
 void terminate_process(int exit_code, int term_sig);
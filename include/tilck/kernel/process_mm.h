@@ -5,14 +5,28 @@
 #include <tilck/kernel/fs/vfs_base.h>
 #include <tilck/kernel/paging.h>
 #include <tilck/kernel/list.h>
+#include <tilck/kernel/bintree.h>
+
+struct shmem;
+
+/* A range of free virtual memory in the mmap area */
+struct mmap_gap {
+
+   struct bintree_node node;     /* in mappings_info->gaps_tree, by size */
+   ulong start;
+   size_t size;
+};
 
 struct user_mapping {
 
    struct list_node pi_node;
    struct list_node inode_node;
+   struct bintree_node tree_node;   /* in mappings_info->tree, by vaddr */
+   struct mmap_gap gap;             /* the free gap right after the mapping */
    struct process *pi;
 
    fs_handle h;
+   struct shmem *shm;            /* shared-page object backing the mapping */
    size_t len;
    size_t off;
 
@@ -22,7 +36,16 @@ struct user_mapping {
    };
 
    int prot;
+   int advice;                   /* MADV_{NORMAL,RANDOM,SEQUENTIAL} */
+
+};
+
+struct mappings_info {
 
+   struct list mappings;
+   struct user_mapping *tree;       /* all the mappings, by vaddr */
+   struct mmap_gap *gaps_tree;      /* the non-empty gaps, by (size, start) */
+   struct mmap_gap head_gap;        /* gap starting at USER_MMAP_BEGIN */
 };
 
 struct user_mapping *
@@ -36,6 +59,54 @@ void remove_all_file_mappings(struct process *pi);
 struct mappings_info *
 duplicate_mappings_info(struct process *new_pi, struct mappings_info *mi);
 
+/*
+ * Virtual address space of the mmap area (see kernel/mm/user_vas.c). The
+ * mappings are kept in a tree ordered by address, while each of the free gaps
+ * between them belongs to the mapping right before it and is kept in a second
+ * tree ordered by size. That allows the best-fit allocation of a free range
+ * with just one tree lookup and makes duplicating the whole address space just
+ * a matter of inserting the copied mappings in new trees.
+ */
+void user_vas_init(struct mappings_info *mi);
+void user_vas_insert(struct mappings_info *mi, struct user_mapping *um);
+void user_vas_remove(struct mappings_info *mi, struct user_mapping *um);
+void user_vas_resize(struct mappings_info *mi,
+                     struct user_mapping *um,
+                     ulong vaddr,
+                     size_t len);
+
+/* The mapping containing `vaddr`, if any */
+struct user_mapping *user_vas_find(struct mappings_info *mi, ulong vaddr);
+
+/* The first mapping ending after `vaddr`, if any */
+struct user_mapping *user_vas_find_next(struct mappings_info *mi, ulong vaddr);
+
+/* Start of the smallest free range of at least `len` bytes, or 0 */
+ulong user_vas_get_free_range(struct mappings_info *mi, size_t len);
+bool user_vas_is_range_free(struct mappings_info *mi, ulong vaddr, size_t len);
+size_t user_vas_largest_gap(struct mappings_info *mi);
+
+/*
+ * Returns true if `vaddr` belongs to the brk heap or to the user stack: those
+ * regions are populated lazily, on the first access, by the page fault
+ * handler.
+ */
+bool is_lazy_user_vaddr(struct process *pi, void *vaddr);
+
+/*
+ * Max number of pages (including the faulting one) mapped by a page fault on
+ * a file mapping: the neighbour pages are mapped only if already resident.
+ * Tunable at runtime through sysfs, clamped to FAULT_AROUND_MAX_PAGES.
+ */
+extern ulong fault_around_pages;
+
+/*
+ * Free all the pages passed to madvise(MADV_FREE) and not written since then,
+ * in all the processes. Called when we're out of memory while allocating user
+ * pages. Returns the number of freed pages.
+ */
+size_t reclaim_lazyfree_memory(void);
+
 
 /* Internal functions */
 bool user_valloc_and_map(ulong user_vaddr, size_t page_count);
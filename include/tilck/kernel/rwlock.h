@@ -51,6 +51,11 @@ struct rwlock_wp {
    bool w;    /* writer waiting */
    bool rec;  /* is exlock operation recursive */
    u16 rc;    /* recursive locking count */
+
+#if KERNEL_LOCKSTAT
+   ulong ls_site;       /* call site of the exclusive owner, if any */
+   u64 ls_acquired;     /* TSC value at the exclusive acquisition */
+#endif
 };
 
 void rwlock_wp_init(struct rwlock_wp *rw, bool recursive);
@@ -10,6 +10,7 @@
 #include <tilck/kernel/sync.h>
 #include <tilck/kernel/worker_thread.h>
 #include <tilck/kernel/signal.h>
+#include <tilck/kernel/irqsoff.h>
 
 #include <tilck_gen_headers/config_sched.h>
 
@@ -44,6 +45,23 @@ struct sched_ticks {
    u64 vruntime;        /* a brutal approx. of Linux's vruntime */
 };
 
+/*
+ * Resource usage counters, reported by getrusage(), wait4() and /syst/rusage.
+ * They're updated only by the task itself (or by the scheduler, on its behalf)
+ * so they need no locking.
+ */
+struct task_rusage {
+
+   ulong minflt;        /* page faults served without any I/O */
+   ulong majflt;        /* page faults that required a swap-in */
+   ulong cow_copies;    /* pages copied by handle_potential_cow() */
+   ulong nvcsw;         /* voluntary context switches (the task blocked) */
+   ulong nivcsw;        /* involuntary context switches (preemption) */
+   ulong syscalls;      /* number of syscalls */
+   u64 rchar;           /* bytes read by read(), pread64() and readv() */
+   u64 wchar;           /* bytes written by write(), pwrite64() and writev() */
+};
+
 STATIC_ASSERT(sizeof(enum sig_state) == 1);
 
 struct task {
@@ -85,6 +103,8 @@ struct task {
 
    s32 wstatus;                       /* waitpid's wstatus  */
    struct sched_ticks ticks;          /* scheduler counters */
+   struct task_rusage rusage;         /* resource usage counters */
+   u32 traced_sys_enter_us;           /* time of the last traced ENTER, in us */
 
    void *kernel_stack;
    void *args_copybuf;
@@ -180,12 +200,24 @@ static ALWAYS_INLINE bool need_reschedule(void)
 static ALWAYS_INLINE void disable_preemption(void)
 {
    extern ATOMIC(int) __disable_preempt; /* see docs/atomics.md */
+
+#if KERNEL_IRQSOFF_TRACER
+   if (!atomic_fetch_add_explicit(&__disable_preempt, 1, mo_relaxed))
+      irqsoff_trace_preempt_off(0);
+#else
    atomic_fetch_add_explicit(&__disable_preempt, 1, mo_relaxed);
+#endif
 }
 
 static ALWAYS_INLINE void enable_preemption_nosched(void)
 {
    extern ATOMIC(int) __disable_preempt; /* see docs/atomics.md */
+
+#if KERNEL_IRQSOFF_TRACER
+   if (atomic_load_explicit(&__disable_preempt, mo_relaxed) == 1)
+      irqsoff_trace_preempt_on(0);
+#endif
+
    atomic_fetch_sub_explicit(&__disable_preempt, 1, mo_relaxed);
 }
 
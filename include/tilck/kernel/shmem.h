@@ -0,0 +1,66 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+#include <tilck/kernel/paging.h>
+#include <tilck/kernel/sync.h>
+
+struct user_mapping;
+
+#define SHMEM_MAX_SIZE       ((size_t)PAGE_MASK)
+
+/*
+ * Shared-page object: a sparse array of page frames, allocated on first use
+ * and mapped with PAGING_FL_SHARED in every address space referring to it.
+ * Therefore, pdir_clone() keeps those pages shared (not CoW) across fork().
+ *
+ * The object holds one reference on each of its frames: a page dropped by a
+ * truncate (or by the destruction of the object) stays alive as long as some
+ * page directory still maps it.
+ *
+ * It backs memfd_create(), the files in /dev/shm and the anonymous MAP_SHARED
+ * memory mappings.
+ */
+struct shmem {
+
+   REF_COUNTED_OBJECT;
+
+   struct kmutex lock;       /* serializes read, write and truncate */
+   size_t size;              /* logical size in bytes */
+   size_t nr_slots;          /* capacity of the `pages` array */
+   size_t nr_pages;          /* number of actually allocated pages */
+   void **pages;             /* kernel VAs, NULL for never-touched pages */
+};
+
+struct shmem *shmem_create(size_t size);
+void shmem_release(struct shmem *s);
+int shmem_truncate(struct shmem *s, size_t size);
+
+ssize_t shmem_read(struct shmem *s, char *buf, size_t len, size_t off);
+ssize_t shmem_write(struct shmem *s, const char *buf, size_t len, size_t off);
+
+/*
+ * Allocate all the pages of `s` upfront. After that, as long as the object is
+ * not truncated, shmem_kva() can be used to access its contents directly.
+ */
+int shmem_populate(struct shmem *s);
+
+static ALWAYS_INLINE void *shmem_kva(struct shmem *s, size_t off)
+{
+   ASSERT(off < s->size);
+   return s->pages[off >> PAGE_SHIFT] + (off & OFFSET_IN_PAGE_MASK);
+}
+
+/*
+ * Map in `pdir` the pages of `s` covered by `um`, allocating them if needed.
+ * Pages past the end of the object are left unmapped: they're handled by
+ * shmem_handle_fault(), after a truncate has grown the object.
+ */
+int shmem_map(struct shmem *s, pdir_t *pdir, struct user_mapping *um);
+void shmem_unmap(pdir_t *pdir, void *vaddr, size_t len);
+bool shmem_handle_fault(struct user_mapping *um, void *vaddr, bool p, bool rw);
+
+static ALWAYS_INLINE void shmem_retain(struct shmem *s)
+{
+   retain_obj(s);
+}
@@ -0,0 +1,64 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+#include <tilck/kernel/list.h>
+
+/*
+ * Shrinkers: callbacks freeing the memory used by the kernel's caches (and,
+ * in general, by anything that can be re-created or moved elsewhere) when
+ * the memory is running low. They're called in two cases:
+ *
+ *    - Direct reclaim: when kmalloc() fails, by the allocating task itself,
+ *      with the preemption disabled. Only the shrinkers that don't sleep are
+ *      called, after which the allocation is retried once.
+ *
+ *    - Background reclaim: when the free memory (kmalloc heaps + highmem)
+ *      goes below the low watermark, the "reclaim" worker thread calls all
+ *      the shrinkers until it gets back above the high watermark.
+ *
+ * The shrinkers cannot be unregistered.
+ */
+
+struct shrinker {
+
+   const char *name;
+
+   /*
+    * Try to free about `bytes` bytes of memory. Returns the number of bytes
+    * actually freed. Unless `may_sleep` is set, it's called with preemption
+    * disabled and it must not sleep. A kmalloc() failing inside it doesn't
+    * trigger a nested direct reclaim.
+    */
+   size_t (*scan)(size_t bytes);
+   bool may_sleep;
+
+   ulong reclaimed_bytes;
+   ulong calls;
+
+   struct list_node node;
+};
+
+struct reclaim_info {
+
+   ulong wmark_low_kb;           /* tunable: 0 means no background reclaim */
+   ulong wmark_high_kb;          /* tunable */
+   ulong free_kb;                /* updated by get_free_memory() */
+   ulong direct_reclaims;
+   ulong bg_reclaims;
+};
+
+extern struct list shrinkers_list;
+extern struct reclaim_info reclaim_info;
+
+void init_shrinkers(void);
+void register_shrinker(struct shrinker *s);
+
+/* Free memory: kmalloc heaps + highmem */
+size_t get_free_memory(void);
+
+/* Direct reclaim: returns the number of bytes freed */
+size_t shrink_memory(size_t bytes);
+
+/* Wake up the reclaim thread, if the free memory is below the low watermark */
+void check_memory_watermarks(void);
@@ -0,0 +1,54 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+
+/*
+ * Swap for the private anonymous user pages (the pages of the mmap() regions
+ * without a file behind, not shared). The kernel itself has no storage for
+ * them: that's provided by a backend, like the zram module, compressing them
+ * in memory.
+ *
+ * The pages are swapped out on out-of-memory, by reclaim_user_memory(), and
+ * on memory pressure, by the "swap" shrinker, choosing the ones not accessed
+ * since the previous scan (second-chance), and swapped in by the page fault
+ * handler. Only the pages mapped just once are swapped out: the ones shared
+ * with other processes after fork() are not.
+ */
+
+#define SWAP_SLOT_BITS                                     20
+
+struct swap_backend {
+
+   const char *name;
+
+   /* Can the backend store more pages right now? */
+   bool (*can_store)(void);
+
+   /*
+    * Save the content of the pageframe at `paddr` and return its slot,
+    * always > 0 and < 2^SWAP_SLOT_BITS, or 0 on failure. The backend can keep
+    * the pageframe for itself, setting *keep_frame: otherwise, it gets freed.
+    */
+   u32 (*store)(ulong paddr, bool *keep_frame);
+
+   /* Load the content of `slot` in the pageframe at `paddr` */
+   int (*load)(u32 slot, ulong paddr);
+
+   void (*dup)(u32 slot);        /* add a reference to `slot` (fork)  */
+   void (*release)(u32 slot);    /* drop a reference, freeing it at 0 */
+};
+
+extern const struct swap_backend *swap_backend;
+
+void register_swap_backend(const struct swap_backend *be);
+
+/* Register the "lazyfree" and "swap" shrinkers (see shrinker.h) */
+void init_swap(void);
+
+/*
+ * Free memory for the user pages, on out-of-memory: reclaim the MADV_FREE
+ * pages, if any, and then swap out the cold pages. Returns the number of
+ * pages freed (or swapped out).
+ */
+size_t reclaim_user_memory(void);
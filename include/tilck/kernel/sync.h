@@ -2,6 +2,7 @@
 
 #pragma once
 
+#include <tilck_gen_headers/config_debug.h>
 #include <tilck/common/basic_defs.h>
 #include <tilck/common/atomics.h>
 #include <tilck/kernel/list.h>
@@ -151,6 +152,11 @@ struct kmutex {
    u32 num_waiters;
    u32 max_num_waiters;
 #endif
+
+#if KERNEL_LOCKSTAT
+   ulong ls_site;       /* call site of the current owner, 0 if untracked */
+   u64 ls_acquired;     /* TSC value at the acquisition */
+#endif
 };
 
 #define STATIC_KMUTEX_INIT(m, fl)                 \
@@ -163,6 +169,12 @@ struct kmutex {
 
 #define KMUTEX_FL_RECURSIVE                                (1 << 0)
 
+/*
+ * Don't account the mutex in the lock statistics (see lockstat.h): used for
+ * the internal mutex of higher-level locks, accounted on their own.
+ */
+#define KMUTEX_FL_NO_LOCKSTAT                              (1 << 2)
+
 #if KERNEL_SELFTESTS
 
    /*
@@ -179,6 +191,11 @@ bool kmutex_trylock(struct kmutex *m);
 void kmutex_unlock(struct kmutex *m);
 void kmutex_destroy(struct kmutex *m);
 
+#if KERNEL_LOCKSTAT
+/* Like kmutex_lock(), but accounts the acquisition to the given call site */
+void kmutex_lock_at(struct kmutex *m, ulong site);
+#endif
+
 #if DEBUG_CHECKS
 bool kmutex_is_curr_task_holding_lock(struct kmutex *m);
 #endif
@@ -134,7 +134,7 @@ CREATE_STUB_SYSCALL_IMPL(sys_sigpending)
 CREATE_STUB_SYSCALL_IMPL(sys_sethostname)
 CREATE_STUB_SYSCALL_IMPL(sys_setrlimit)
 CREATE_STUB_SYSCALL_IMPL(sys_old_getrlimit)
-CREATE_STUB_SYSCALL_IMPL(sys_getrusage)
+int sys_getrusage(int who, struct k_rusage *user_usage);
 
 int sys_gettimeofday(struct k_timeval *tv, struct timezone *tz);
 
@@ -200,7 +200,8 @@ int sys_newuname(struct utsname *buf);
 
 CREATE_STUB_SYSCALL_IMPL(sys_modify_ldt)
 CREATE_STUB_SYSCALL_IMPL(sys_adjtimex_time32)
-CREATE_STUB_SYSCALL_IMPL(sys_mprotect)
+
+int sys_mprotect(void *vaddr, size_t len, int prot);
 
 int sys_sigprocmask(ulong a1, ulong a2, ulong a3); // deprecated interface
 
@@ -229,6 +230,7 @@ CREATE_STUB_SYSCALL_IMPL(sys_msync)
 
 int sys_readv(int fd, const struct iovec *iov, int iovcnt);
 int sys_writev(int fd, const struct iovec *iov, int iovcnt);
+int sys_vmsplice(int fd, const struct iovec *iov, ulong nr_segs, u32 flags);
 int sys_getsid(int pid);
 int sys_fdatasync(int fd);
 
@@ -251,7 +253,9 @@ CREATE_STUB_SYSCALL_IMPL(sys_sched_rr_get_interval_time32)
 int sys_nanosleep_time32(const struct k_timespec32 *req,
                          struct k_timespec32 *rem);
 
-CREATE_STUB_SYSCALL_IMPL(sys_mremap)
+long sys_mremap(void *old_vaddr, size_t old_len,
+                size_t new_len, int flags, void *new_vaddr);
+
 CREATE_STUB_SYSCALL_IMPL(sys_setresuid16)
 CREATE_STUB_SYSCALL_IMPL(sys_getresuid16)
 CREATE_STUB_SYSCALL_IMPL(sys_vm86)
@@ -443,7 +447,6 @@ CREATE_STUB_SYSCALL_IMPL(sys_get_robust_list)
 CREATE_STUB_SYSCALL_IMPL(sys_splice)
 CREATE_STUB_SYSCALL_IMPL(sys_ia32_sync_file_range)
 CREATE_STUB_SYSCALL_IMPL(sys_tee)
-CREATE_STUB_SYSCALL_IMPL(sys_vmsplice)
 CREATE_STUB_SYSCALL_IMPL(sys_move_pages)
 CREATE_STUB_SYSCALL_IMPL(sys_getcpu)
 CREATE_STUB_SYSCALL_IMPL(sys_epoll_pwait)
@@ -463,6 +466,13 @@ CREATE_STUB_SYSCALL_IMPL(sys_epoll_create1)
 CREATE_STUB_SYSCALL_IMPL(sys_dup3)
 
 int sys_pipe2(int u_pipefd[2], int flags);
+int sys_memfd_create(const char *u_name, u32 flags);
+
+struct io_uring_params;
+int sys_io_uring_setup(u32 entries, struct io_uring_params *u_params);
+int sys_io_uring_enter(int fd, u32 to_submit, u32 min_complete,
+                       u32 flags, const void *u_sig, size_t sigsz);
+int sys_io_uring_register(int fd, u32 opcode, void *u_arg, u32 nr_args);
 
 CREATE_STUB_SYSCALL_IMPL(sys_inotify_init1)
 CREATE_STUB_SYSCALL_IMPL(sys_preadv)
@@ -491,7 +501,6 @@ CREATE_STUB_SYSCALL_IMPL(sys_sched_getattr)
 CREATE_STUB_SYSCALL_IMPL(sys_renameat2)
 CREATE_STUB_SYSCALL_IMPL(sys_seccomp)
 CREATE_STUB_SYSCALL_IMPL(sys_getrandom)
-CREATE_STUB_SYSCALL_IMPL(sys_memfd_create)
 CREATE_STUB_SYSCALL_IMPL(sys_bpf)
 CREATE_STUB_SYSCALL_IMPL(sys_execveat)
 CREATE_STUB_SYSCALL_IMPL(sys_socket)
@@ -558,9 +567,6 @@ CREATE_STUB_SYSCALL_IMPL(sys_rt_sigtimedwait)
 CREATE_STUB_SYSCALL_IMPL(sys_futex)
 CREATE_STUB_SYSCALL_IMPL(sys_sched_rr_get_interval)
 CREATE_STUB_SYSCALL_IMPL(sys_pidfd_send_signal)
-CREATE_STUB_SYSCALL_IMPL(sys_io_uring_setup)
-CREATE_STUB_SYSCALL_IMPL(sys_io_uring_enter)
-CREATE_STUB_SYSCALL_IMPL(sys_io_uring_register)
 CREATE_STUB_SYSCALL_IMPL(sys_open_tree)
 CREATE_STUB_SYSCALL_IMPL(sys_move_mount)
 CREATE_STUB_SYSCALL_IMPL(sys_fsopen)
@@ -0,0 +1,106 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+
+/*
+ * Static tracepoints.
+ *
+ * Each call site of the tracepoint() macro is a 5-byte NOP instruction,
+ * recorded in the .tracepoints section together with the address of the code
+ * that fires the event. Enabling a tracepoint hot-patches all of its sites
+ * replacing the NOP with a JMP to that code, so that disabled tracepoints cost
+ * nothing more than a NOP. The tracing module registers the handler that
+ * feeds the events into the trace buffer (see tracepoint_set_handler()).
+ */
+
+enum tracepoint_id {
+
+   tp_sched_switch,        /* prev tid, next tid, prev state */
+   tp_sched_wakeup,        /* tid */
+   tp_irq_entry,           /* irq */
+   tp_irq_exit,            /* irq */
+   tp_page_fault,          /* vaddr, error code, eip */
+   tp_cow_copy,            /* vaddr, original paddr, new paddr */
+   tp_kmalloc_fail,        /* size, flags */
+   tp_wth_job_start,       /* worker thread prio, func, arg */
+   tp_wth_job_end,         /* worker thread prio, func, arg */
+
+   TP_COUNT,
+};
+
+struct tracepoint_site {
+   ulong addr;             /* address of the 5-byte NOP */
+   ulong target;           /* address of the code firing the event */
+   ulong id;               /* enum tracepoint_id */
+};
+
+typedef void (*tracepoint_handler)(enum tracepoint_id id,
+                                   ulong a0,
+                                   ulong a1,
+                                   ulong a2);
+
+void
+tracepoint_fire(enum tracepoint_id id, ulong a0, ulong a1, ulong a2);
+
+/* Returns the previous handler */
+tracepoint_handler
+tracepoint_set_handler(tracepoint_handler h);
+
+const char *
+tracepoint_get_name(enum tracepoint_id id);
+
+void
+tracepoint_set_enabled(enum tracepoint_id id, bool enabled);
+
+static ALWAYS_INLINE bool
+tracepoint_is_enabled(enum tracepoint_id id)
+{
+   extern bool __tracepoints_on[TP_COUNT];
+   return __tracepoints_on[id];
+}
+
+/* Patches the site `s`: JMP to its target when enabled, NOP otherwise */
+void
+arch_patch_tracepoint_site(const struct tracepoint_site *s, bool enabled);
+
+#ifndef UNIT_TEST_ENVIRONMENT
+
+#if NBITS == 32
+   #define __TP_ASM_PTR       ".long"
+   #define __TP_ASM_ALIGN     "4"
+#else
+   #define __TP_ASM_PTR       ".quad"
+   #define __TP_ASM_ALIGN     "8"
+#endif
+
+#define tracepoint(id, a0, a1, a2)                                             \
+   do {                                                                        \
+      __label__ __tp_on, __tp_off;                                             \
+      asm goto("1:\n\t"                                                        \
+               ".byte 0x0f, 0x1f, 0x44, 0x00, 0x00\n\t"                        \
+               ".pushsection .tracepoints, \"a\"\n\t"                          \
+               ".balign " __TP_ASM_ALIGN "\n\t"                                \
+               __TP_ASM_PTR " 1b, %l[__tp_on], %c0\n\t"                        \
+               ".popsection\n\t"                                               \
+               : /* no outputs */                                              \
+               : "i" (id)                                                      \
+               : /* no clobbers */                                             \
+               : __tp_on);                                                     \
+      goto __tp_off;                                                           \
+   __tp_on:                                                                    \
+      tracepoint_fire((id), (ulong)(a0), (ulong)(a1), (ulong)(a2));            \
+   __tp_off:                                                                   \
+      ;                                                                        \
+   } while (0)
+
+#else
+
+/* The kernel's code is not patched when running the unit tests */
+#define tracepoint(id, a0, a1, a2)                                             \
+   do {                                                                        \
+      if (UNLIKELY(tracepoint_is_enabled(id)))                                 \
+         tracepoint_fire((id), (ulong)(a0), (ulong)(a1), (ulong)(a2));         \
+   } while (0)
+
+#endif
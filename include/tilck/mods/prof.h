@@ -0,0 +1,32 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck_gen_headers/mod_prof.h>
+#include <tilck/common/basic_defs.h>
+
+#define PROF_DEF_HZ                      1024
+#define PROF_MAX_HZ                      8192
+
+struct prof_info {
+
+   bool running;
+   ulong hz;            /* sampling rate, rounded to a power of 2 on start */
+   ulong samples;       /* samples in the buffer */
+   ulong dropped;       /* samples lost because the buffer was full */
+   ulong max_samples;
+};
+
+extern struct prof_info prof_info;
+
+/* Start sampling at prof_info.hz, keeping the samples already taken */
+int prof_start(void);
+void prof_stop(void);
+
+/* Drop all the samples */
+void prof_reset(void);
+
+/* Change the sampling rate, also while running */
+void prof_set_hz(ulong hz);
+
+/* Create /dev/kmalloc_sites*, when KMALLOC_SITE_PROF is enabled */
+void init_kmalloc_sites(void);
@@ -0,0 +1,86 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck_gen_headers/mod_sysstat.h>
+#include <tilck/common/basic_defs.h>
+#include <tilck/kernel/hal.h>
+#include <tilck/kernel/datetime.h>
+
+/*
+ * Number of log2 latency buckets: bucket `i` counts the syscalls that took
+ * [2^i, 2^(i+1)) TSC cycles. The last one counts all the slower ones.
+ */
+#define SYSSTAT_BUCKETS                    40
+
+struct sysstat_entry {
+
+   ulong calls;
+   ulong errors;
+   u64 tot_cycles;
+   u64 max_cycles;
+   u32 hist[SYSSTAT_BUCKETS];
+};
+
+struct sysstat_info {
+
+   bool enabled;
+   long pid;            /* if > 0, account only the syscalls of this process */
+};
+
+extern struct sysstat_info sysstat_info;
+
+void
+sysstat_account_int(u32 sn, long retval, u64 cycles);
+
+/* Copies the entry of the syscall `sn`. Returns false if it has no calls */
+bool
+sysstat_get_entry(u32 sn, struct sysstat_entry *e);
+
+/* Upper bound, in cycles, of the bucket containing the `pct` percentile */
+u64
+sysstat_get_percentile(const struct sysstat_entry *e, u32 pct);
+
+void
+sysstat_reset(void);
+
+/* The name of the syscall, without "sys_". Uses `buf` only as a fall-back */
+const char *
+sysstat_get_syscall_name(u32 sn, char *buf, size_t buf_sz);
+
+static inline u64
+sysstat_cycles_to_ns(u64 cycles)
+{
+   const ulong cycles_per_us = get_tsc_cycles_per_us();
+   return cycles_per_us ? cycles * 1000 / cycles_per_us : 0;
+}
+
+#if MOD_sysstat
+
+static ALWAYS_INLINE u64
+sysstat_syscall_begin(void)
+{
+   return LIKELY(sysstat_info.enabled) ? RDTSC() : 0;
+}
+
+static ALWAYS_INLINE void
+sysstat_syscall_end(u32 sn, long retval, u64 start)
+{
+   if (start)
+      sysstat_account_int(sn, retval, RDTSC() - start);
+}
+
+#else
+
+static ALWAYS_INLINE u64
+sysstat_syscall_begin(void)
+{
+   return 0;
+}
+
+static ALWAYS_INLINE void
+sysstat_syscall_end(u32 sn, long retval, u64 start)
+{
+   /* do nothing */
+}
+
+#endif
@@ -8,6 +8,7 @@
 #define INVALID_SYSCALL           ((u32) -1)
 #define NO_SLOT                           -1
 #define TRACED_SYSCALLS_STR_LEN         128u
+#define TRACE_FILTER_STR_LEN            128u
 
 enum trace_event_type {
    te_invalid,
@@ -16,6 +17,7 @@ enum trace_event_type {
    te_printk,
    te_signal_delivered,
    te_killed,
+   te_tracepoint,
 };
 
 struct syscall_event_data {
@@ -50,6 +52,11 @@ struct signal_event_data {
    int signum;
 };
 
+struct tracepoint_event_data {
+   u32 id;           /* enum tracepoint_id */
+   ulong args[3];
+};
+
 struct trace_event {
 
    enum trace_event_type type;
@@ -61,6 +68,7 @@ struct trace_event {
       struct syscall_event_data sys_ev;
       struct printk_event_data p_ev;
       struct signal_event_data sig_ev;
+      struct tracepoint_event_data tp_ev;
    };
 };
 
@@ -150,6 +158,13 @@ struct syscall_info {
 void
 init_tracing(void);
 
+void
+init_trace_stream(void);
+
+/* The port where the events are streamed to (see trace_stream.c) or NULL */
+const char *
+tracing_get_stream_port_name(void);
+
 bool
 read_trace_event(struct trace_event *e, u32 timeout_ticks);
 
@@ -220,6 +235,47 @@ set_traced_syscalls(const char *str);
 int
 tracing_get_in_buffer_events_count(void);
 
+/* Events dropped because the buffer was full, since boot */
+ulong
+tracing_get_dropped_events_count(void);
+
+/* Syscall events passed and rejected by the trace filter (trace_filter.c) */
+struct trace_filter_stats {
+
+   ulong passed;
+   ulong rejected;
+   u64 pass_cycles;        /* TSC cycles spent on the passed events */
+   u64 reject_cycles;      /* TSC cycles spent on the rejected events */
+};
+
+void
+init_trace_filter(void);
+
+int
+set_trace_filter(const char *str);
+
+void
+get_trace_filter_str(char *buf, size_t len);
+
+/* `dur` is the syscall's duration in microseconds, 0 for the ENTER events */
+bool
+trace_filter_match(struct trace_event *e,
+                   const struct syscall_info *si,
+                   long dur);
+
+/* True if the filter must run after saving the params of the events */
+bool
+trace_filter_needs_params(void);
+
+void
+trace_filter_account(bool passed, u64 cycles);
+
+void
+trace_filter_get_stats(struct trace_filter_stats *s);
+
+void
+trace_filter_reset_stats(void);
+
 extern const struct syscall_info *tracing_metadata;
 extern const struct sys_param_type ptype_int;
 extern const struct sys_param_type ptype_voidp;
@@ -270,6 +326,20 @@ tracing_is_enabled(void)
    return __tracing_on;
 }
 
+static ALWAYS_INLINE void
+tracing_set_all_tasks_traced(bool val)
+{
+   extern bool __tracing_all_tasks;
+   __tracing_all_tasks = val;
+}
+
+static ALWAYS_INLINE bool
+tracing_is_task_traced(struct task *ti)
+{
+   extern bool __tracing_all_tasks;
+   return __tracing_all_tasks || ti->traced;
+}
+
 static ALWAYS_INLINE void
 tracing_set_force_exp_block(bool enabled)
 {
@@ -315,14 +385,14 @@ tracing_set_printk_lvl(int lvl)
 
 #define trace_sys_enter(sn, ...)                                               \
    if (MOD_tracing && UNLIKELY(tracing_is_enabled())) {                        \
-      if (UNLIKELY(get_curr_task()->traced))                                   \
+      if (UNLIKELY(tracing_is_task_traced(get_curr_task())))                   \
          if (UNLIKELY(tracing_is_enabled_on_sys(sn)))                          \
             trace_syscall_enter_int(sn, __VA_ARGS__);                          \
    }
 
 #define trace_sys_exit(sn, ret, ...)                                           \
    if (MOD_tracing && UNLIKELY(tracing_is_enabled())) {                        \
-      if (UNLIKELY(get_curr_task()->traced))                                   \
+      if (UNLIKELY(tracing_is_task_traced(get_curr_task())))                   \
          if (UNLIKELY(tracing_is_enabled_on_sys(sn)))                          \
             trace_syscall_exit_int(sn, (long)(ret), __VA_ARGS__);              \
    }
@@ -18,8 +18,16 @@
 
 #define REG_STATUS_REG_A                  0x0A
 #define REG_STATUS_REG_B                  0x0B
+#define REG_STATUS_REG_C                  0x0C
 
 #define STATUS_REG_A_UPDATE_IN_PROGRESS   0x80
+#define STATUS_REG_A_RATE_MASK            0x0F
+#define STATUS_REG_B_PERIODIC_INT         0x40
+
+/* The periodic interrupt runs at (RTC_BASE_HZ >> (rate - 1)) Hz */
+#define RTC_BASE_HZ                     32768u
+#define RTC_MIN_RATE                         3      /* 8192 Hz */
+#define RTC_MAX_RATE                        15      /*    2 Hz */
 
 static inline u8 bcd_to_dec(u8 bcd)
 {
@@ -33,6 +41,12 @@ static inline u32 cmos_read_reg(u8 reg)
    return inb(CMOS_DATA_PORT);
 }
 
+static inline void cmos_write_reg(u8 reg, u8 val)
+{
+   outb(CMOS_CONTROL_PORT, reg);
+   outb(CMOS_DATA_PORT, val);
+}
+
 static inline bool cmos_is_update_in_progress(void)
 {
    return cmos_read_reg(REG_STATUS_REG_A) & STATUS_REG_A_UPDATE_IN_PROGRESS;
@@ -109,3 +123,49 @@ void hw_read_clock(struct datetime *out)
    d.year = (u16)(d.year + (d.year < 70 ? 2000 : 1900));
    *out = d;
 }
+
+/*
+ * Program the RTC's periodic interrupt (IRQ 8) at the smallest power of 2 not
+ * below `hz`, in the range [2, 8192], and return the actual frequency. With
+ * hz == 0, the periodic interrupt is disabled. The caller is expected to
+ * install an IRQ handler calling hw_rtc_periodic_irq_ack(): otherwise, the RTC
+ * won't raise any other interrupts.
+ */
+u32 hw_rtc_periodic_irq_setup(u32 hz)
+{
+   u32 rate = RTC_MAX_RATE;
+   ulong var;
+   u8 reg;
+
+   if (hz) {
+      while (rate > RTC_MIN_RATE && (RTC_BASE_HZ >> (rate - 1)) < hz)
+         rate--;
+   }
+
+   disable_interrupts(&var);
+   {
+      reg = (u8)cmos_read_reg(REG_STATUS_REG_A);
+      reg = (reg & ~STATUS_REG_A_RATE_MASK) | (u8)rate;
+      cmos_write_reg(REG_STATUS_REG_A, reg);
+
+      reg = (u8)cmos_read_reg(REG_STATUS_REG_B);
+
+      if (hz)
+         reg |= STATUS_REG_B_PERIODIC_INT;
+      else
+         reg &= ~STATUS_REG_B_PERIODIC_INT;
+
+      cmos_write_reg(REG_STATUS_REG_B, reg);
+
+      /* Discard any pending interrupt */
+      cmos_read_reg(REG_STATUS_REG_C);
+   }
+   enable_interrupts(&var);
+   return hz ? RTC_BASE_HZ >> (rate - 1) : 0;
+}
+
+void hw_rtc_periodic_irq_ack(void)
+{
+   /* Reading the register C is required to get the next interrupt */
+   cmos_read_reg(REG_STATUS_REG_C);
+}
@@ -0,0 +1,37 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/hal.h>
+#include <tilck/kernel/tracepoint.h>
+
+#define TP_SITE_SIZE                                  5
+#define X86_JMP_REL32                              0xE9
+
+static const u8 nop5[TP_SITE_SIZE] = { 0x0f, 0x1f, 0x44, 0x00, 0x00 };
+
+/*
+ * Like simple_hot_patch() in fpu_memcpy.c, just memcpy() the new code over the
+ * old one: the kernel's text is writable. Replacing a single instruction with
+ * another one of the same size keeps the rest of the code untouched.
+ */
+void
+arch_patch_tracepoint_site(const struct tracepoint_site *s, bool enabled)
+{
+   u8 *site = (u8 *)s->addr;
+   u8 jmp[TP_SITE_SIZE];
+   s32 rel;
+
+   ASSERT(!are_interrupts_enabled());
+
+   if (!enabled) {
+      memcpy(site, nop5, TP_SITE_SIZE);
+      return;
+   }
+
+   rel = (s32)(s->target - (s->addr + TP_SITE_SIZE));
+   jmp[0] = X86_JMP_REL32;
+   memcpy(&jmp[1], &rel, sizeof(rel));
+   memcpy(site, jmp, TP_SITE_SIZE);
+}
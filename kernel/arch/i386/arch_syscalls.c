@@ -16,6 +16,7 @@
 #include <tilck/kernel/elf_utils.h>
 #include <tilck/kernel/signal.h>
 #include <tilck/mods/tracing.h>
+#include <tilck/mods/sysstat.h>
 
 #include "idt_int.h"
 
@@ -545,6 +546,7 @@ static void do_special_syscall(regs_t *r)
    const bool signals = ~fl & SYSFL_NO_SIG;
    const bool preemptable = ~fl & SYSFL_NO_PREEMPT;
    const bool traceable = ~fl & SYSFL_NO_TRACE;
+   u64 start;
 
    if (signals)
       process_signals(curr, sig_pre_syscall, r);
@@ -555,7 +557,9 @@ static void do_special_syscall(regs_t *r)
    if (traceable)
       trace_sys_enter(sn,r->ebx,r->ecx,r->edx,r->esi,r->edi,r->ebp);
 
+   start = sysstat_syscall_begin();
    r->eax = (u32) fptr(r->ebx,r->ecx,r->edx,r->esi,r->edi,r->ebp);
+   sysstat_syscall_end(sn, (s32)r->eax, start);
 
    if (traceable)
       trace_sys_exit(sn,r->eax,r->ebx,r->ecx,r->edx,r->esi,r->edi,r->ebp);
@@ -572,12 +576,15 @@ static void do_syscall(regs_t *r)
    struct task *curr = get_curr_task();
    const u32 sn = r->eax;
    const syscall_type fptr = syscalls[sn].fptr;
+   u64 start;
 
    process_signals(curr, sig_pre_syscall, r);
    enable_preemption();
    {
       trace_sys_enter(sn,r->ebx,r->ecx,r->edx,r->esi,r->edi,r->ebp);
+      start = sysstat_syscall_begin();
       r->eax = (u32) fptr(r->ebx,r->ecx,r->edx,r->esi,r->edi,r->ebp);
+      sysstat_syscall_end(sn, (s32)r->eax, start);
       trace_sys_exit(sn,r->eax,r->ebx,r->ecx,r->edx,r->esi,r->edi,r->ebp);
    }
    disable_preemption();
@@ -598,6 +605,7 @@ void handle_syscall(regs_t *r)
 
    save_current_task_state(r);
    set_current_task_in_kernel();
+   get_curr_task()->rusage.syscalls++;
 
    if (LIKELY(sn < ARRAY_SIZE(syscalls))) {
 
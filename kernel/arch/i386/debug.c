@@ -60,6 +60,90 @@ size_t stackwalk32(void **frames,
    return i;
 }
 
+static bool read_user_ulong(pdir_t *pdir, ulong va, ulong *val)
+{
+   ulong pa;
+
+   if (va >= KERNEL_BASE_VA || (va & (sizeof(ulong) - 1)))
+      return false;
+
+   /* Only present pages: we cannot afford a page fault here */
+   if (get_mapping2(pdir, (void *)va, &pa) < 0)
+      return false;
+
+   *val = *(ulong *)va;
+   return true;
+}
+
+size_t stackwalk_irq(regs_t *r, ulong *frames, size_t count, size_t *kframes)
+{
+   struct task *curr = get_curr_task();
+   const ulong kstack = (ulong)curr->kernel_stack;
+   const ulong kstack_end = kstack + KERNEL_STACK_SIZE;
+   pdir_t *pdir = get_curr_pdir();
+   ulong ebp, next, ret;
+   size_t n = 0;
+
+   *kframes = 0;
+
+   if (!count)
+      return 0;
+
+   if ((r->cs & 3) != 3) {
+
+      frames[n++] = r->eip;
+      ebp = r->ebp;
+
+      while (n < count && ebp >= kstack && ebp + 8 <= kstack_end) {
+
+         next = ((ulong *)ebp)[0];
+         ret = ((ulong *)ebp)[1];
+
+         if (!ret)
+            break;
+
+         frames[n++] = ret;
+
+         if (next <= ebp)
+            break;
+
+         ebp = next;
+      }
+
+      *kframes = n;
+
+      if (is_kernel_thread(curr))
+         return n;
+
+      /* The user state saved on the kernel stack on syscall/fault entry */
+      r = (regs_t *)((kstack_end - 1) & POINTER_ALIGN_MASK) - 1;
+
+      if ((r->cs & 3) != 3)
+         return n;
+   }
+
+   if (n < count)
+      frames[n++] = r->eip;
+
+   ebp = r->ebp;
+
+   while (n < count &&
+          read_user_ulong(pdir, ebp, &next) &&
+          read_user_ulong(pdir, ebp + 4, &ret))
+   {
+      if (!ret)
+         break;
+
+      frames[n++] = ret;
+
+      if (next <= ebp)
+         break;
+
+      ebp = next;
+   }
+
+   return n;
+}
 
 void dump_stacktrace(void *ebp, pdir_t *pdir)
 {
@@ -116,21 +116,46 @@ static void fault_in_panic(regs_t *r)
    while (true) { halt(); }
 }
 
+/*
+ * The page faults handled here are accounted as minor ones, except for the
+ * swap-ins: Tilck has no page cache, so they're the only faults doing I/O.
+ */
+static bool handle_page_fault_fast_paths(regs_t *r)
+{
+   struct task_rusage *ru = &get_curr_task()->rusage;
+
+   if (handle_potential_cow(r)) {
+      ru->minflt++;
+      return true;
+   }
+
+   if (handle_potential_swap_in(r)) {
+      ru->majflt++;
+      return true;
+   }
+
+   if (handle_potential_lazy_page(r)) {
+      ru->minflt++;
+      return true;
+   }
+
+   return false;
+}
+
 void handle_fault(regs_t *r)
 {
    const int int_num = r->int_num;
-   bool cow = false;
+   bool handled = false;
 
    ASSERT(is_fault(int_num));
 
    if (UNLIKELY(in_panic()))
       return fault_in_panic(r);
 
-   if (LIKELY(int_num == FAULT_PAGE_FAULT)) {
-      cow = handle_potential_cow(r);
-   }
+   if (LIKELY(int_num == FAULT_PAGE_FAULT))
+      handled = handle_page_fault_fast_paths(r);
 
-   if (!cow) {
+   if (!handled) {
 
       if (is_fault_resumable(int_num))
          return handle_resumable_fault(r);
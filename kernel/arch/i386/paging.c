@@ -21,8 +21,12 @@
 #include <tilck/kernel/signal.h>
 #include <tilck/kernel/process_mm.h>
 #include <tilck/kernel/process.h>
+#include <tilck/kernel/shmem.h>
+#include <tilck/kernel/highmem.h>
+#include <tilck/kernel/swap.h>
 #include <tilck/kernel/vdso.h>
 #include <tilck/kernel/cmdline.h>
+#include <tilck/kernel/tracepoint.h>
 
 #include <tilck/mods/tracing.h>
 
@@ -43,6 +47,22 @@
  */
 #define PAGE_SHARED                            (1 << 1)
 
+/*
+ * When this flag is set in the 'avail' bits in page_t, it means that the page
+ * has been passed to madvise(MADV_FREE) and it has not been written since
+ * then: it can be replaced with the zero page at any time. Such pages are
+ * always read-only, so the first write goes through handle_potential_cow(),
+ * which clears the flag.
+ */
+#define PAGE_LAZYFREE                          (1 << 2)
+
+/*
+ * Swapped-out pages have a non-present PTE keeping their protection bits (rw,
+ * us and the avail ones) and, instead of the pageframe, their swap slot, which
+ * is never 0. All the other non-present PTEs are just zero.
+ */
+#define SWAP_PTE_KEPT_BITS       (PG_RW_BIT | PG_US_BIT | PG_CUSTOM_BITS)
+
 
 /* ---------------------------------------------- */
 
@@ -52,9 +72,29 @@ pdir_t *__kernel_pdir;
 
 static char kpdir_buf[sizeof(pdir_t)] ALIGNED_AT(PAGE_SIZE);
 
+/*
+ * Number of kmap() slots: a kmap() cannot sleep, so at most one task at a time
+ * (plus the nested calls) can use them.
+ */
+#define KMAP_SLOTS                                     8
+
 static u32 *pageframes_refcount;
 static ulong phys_mem_lim;
 static struct kmalloc_heap *hi_vmem_heap;
+static page_t *kmap_ptes;      /* PTEs of the kmap() slots, in the hi vmem */
+static ulong kmap_vaddr;       /* vaddr of the first kmap() slot */
+static u32 kmap_depth;         /* number of kmap() slots in use */
+
+/*
+ * A page table kept aside for splitting the big pages on out-of-memory, which
+ * is exactly when that's needed the most (e.g. for swapping them out).
+ */
+static page_table_t *reserved_pt;
+
+static ALWAYS_INLINE bool is_swap_pte(page_t p)
+{
+   return !p.present && p.raw;
+}
 
 static ALWAYS_INLINE u32 __pf_ref_count_inc(u32 paddr)
 {
@@ -97,6 +137,223 @@ pdir_get_page_table(pdir_t *pdir, u32 i)
    return KERNEL_PA_TO_VA(pdir->entries[i].ptaddr << PAGE_SHIFT);
 }
 
+static inline bool in_big_4mb_page(pdir_t *pdir, void *vaddrp)
+{
+   const u32 vaddr = (u32) vaddrp;
+   const u32 pd_index = (vaddr >> BIG_PAGE_SHIFT);
+
+   page_dir_entry_t *e = &pdir->entries[pd_index];
+   return e->present && e->psize;
+}
+
+/*
+ * Big user pages (MMAP_BIG_PAGES) are made of BIG_PAGE_SIZE / PAGE_SIZE
+ * regular pageframes, allocated at once with kmalloc_big_aligned(). Each
+ * mapping of a big page holds a reference on *each* one of its pageframes:
+ * this way, splitting a big page does not require touching the ref-counts
+ * and, after that, the pageframes can be freed independently from each other.
+ */
+#define BIG_PAGE_PAGES                  (BIG_PAGE_SIZE >> PAGE_SHIFT)
+
+STATIC_ASSERT(BIG_PAGE_SIZE == (1u << BIG_PAGE_SHIFT));
+
+static ALWAYS_INLINE bool is_big_user_page(pdir_t *pdir, ulong vaddr)
+{
+   return vaddr < KERNEL_BASE_VA && in_big_4mb_page(pdir, (void *)vaddr);
+}
+
+static ALWAYS_INLINE ulong big_page_paddr(page_dir_entry_t *e)
+{
+   return (ulong)e->big_4mb_page.paddr << BIG_PAGE_SHIFT;
+}
+
+static void invalidate_big_page(ulong vaddr)
+{
+   vaddr &= ~(BIG_PAGE_SIZE - 1);
+
+   /* Flush also the TLB entries of the regular pages mapped there before */
+   for (u32 i = 0; i < BIG_PAGE_PAGES; i++)
+      invalidate_page_hw(vaddr + (i << PAGE_SHIFT));
+}
+
+static void big_page_ref_inc(ulong paddr)
+{
+   for (u32 i = 0; i < BIG_PAGE_PAGES; i++)
+      __pf_ref_count_inc(paddr + (i << PAGE_SHIFT));
+}
+
+/* Is the big page at `paddr` mapped only once and not split anywhere? */
+static bool is_big_page_exclusive(ulong paddr)
+{
+   for (u32 i = 0; i < BIG_PAGE_PAGES; i++) {
+      if (pf_ref_count_get(paddr + (i << PAGE_SHIFT)) != 1)
+         return false;
+   }
+
+   return true;
+}
+
+static void big_page_release(ulong paddr)
+{
+   size_t size = BIG_PAGE_SIZE;
+   ulong pa;
+
+   if (is_big_page_exclusive(paddr)) {
+
+      /* Common case: free the whole big page at once */
+      bzero(&pageframes_refcount[paddr >> PAGE_SHIFT],
+            BIG_PAGE_PAGES * sizeof(pageframes_refcount[0]));
+
+      general_kfree(KERNEL_PA_TO_VA(paddr),
+                    &size,
+                    KFREE_FL_ALLOW_SPLIT | KFREE_FL_MULTI_STEP);
+      return;
+   }
+
+   for (u32 i = 0; i < BIG_PAGE_PAGES; i++) {
+
+      pa = paddr + (i << PAGE_SHIFT);
+
+      if (!__pf_ref_count_dec(pa))
+         kfree2(KERNEL_PA_TO_VA(pa), PAGE_SIZE);
+   }
+}
+
+static void unmap_big_user_page(pdir_t *pdir, ulong vaddr)
+{
+   page_dir_entry_t *e = &pdir->entries[vaddr >> BIG_PAGE_SHIFT];
+   const ulong paddr = big_page_paddr(e);
+
+   ASSERT(!(vaddr & (BIG_PAGE_SIZE - 1)));
+
+   e->raw = 0;
+   invalidate_big_page(vaddr);
+   big_page_release(paddr);
+}
+
+static int split_big_user_page(pdir_t *pdir, ulong vaddr)
+{
+   page_dir_entry_t *e = &pdir->entries[vaddr >> BIG_PAGE_SHIFT];
+   const ulong paddr = big_page_paddr(e);
+   page_table_t *pt;
+   u32 flags;
+
+   ASSERT(e->present && e->psize);
+   ASSERT(!e->big_4mb_page.pat);
+
+   if (!(pt = kalloc_obj(page_table_t))) {
+
+      if (!(pt = reserved_pt))
+         return -ENOMEM;
+
+      reserved_pt = NULL;
+   }
+
+   /* The lower bits (but the page size) have the same meaning in both */
+   flags = e->raw & (PG_PRESENT_BIT |
+                     PG_RW_BIT      |
+                     PG_US_BIT      |
+                     PG_ACC_BIT     |
+                     PG_DIRTY_BIT   |
+                     PG_CUSTOM_BITS);
+
+   for (u32 i = 0; i < BIG_PAGE_PAGES; i++)
+      pt->pages[i].raw = flags | (paddr + (i << PAGE_SHIFT));
+
+   e->raw = PG_PRESENT_BIT | PG_RW_BIT | PG_US_BIT | KERNEL_VA_TO_PA(pt);
+   invalidate_big_page(vaddr);
+   return 0;
+}
+
+int split_big_user_pages(pdir_t *pdir, void *vaddrp, size_t page_count)
+{
+   const ulong vend = (ulong)vaddrp + (page_count << PAGE_SHIFT);
+   ulong vaddr = (ulong)vaddrp & ~(BIG_PAGE_SIZE - 1);
+   int rc;
+
+   ASSERT(vend <= KERNEL_BASE_VA);
+
+   for (; vaddr < vend; vaddr += BIG_PAGE_SIZE) {
+
+      if (!is_big_user_page(pdir, vaddr))
+         continue;
+
+      if ((rc = split_big_user_page(pdir, vaddr)))
+         return rc;
+   }
+
+   return 0;
+}
+
+bool map_big_user_page(pdir_t *pdir, void *vaddrp)
+{
+   const ulong zero_paddr = KERNEL_VA_TO_PA(zero_page);
+   const ulong vaddr = (ulong)vaddrp;
+   page_dir_entry_t *e = &pdir->entries[vaddr >> BIG_PAGE_SHIFT];
+   page_table_t *pt = NULL;
+   u32 zero_pages = 0;
+   void *big_page;
+   ulong paddr;
+   page_t p;
+
+   ASSERT(!(vaddr & (BIG_PAGE_SIZE - 1)));
+   ASSERT(vaddr < KERNEL_BASE_VA);
+
+   if (!MMAP_BIG_PAGES)
+      return false;
+
+   if (e->present) {
+
+      if (e->psize)
+         return false;
+
+      pt = pdir_get_page_table(pdir, vaddr >> BIG_PAGE_SHIFT);
+
+      for (u32 i = 0; i < BIG_PAGE_PAGES; i++) {
+
+         p = pt->pages[i];
+
+         if (!p.present) {
+
+            /* Swapped-out pages are not zero pages */
+            if (is_swap_pte(p))
+               return false;
+
+            continue;
+         }
+
+         /* Only writable (via CoW) zero pages can be replaced */
+         if (((ulong)p.pageAddr << PAGE_SHIFT) != zero_paddr)
+            return false;
+
+         if (!p.us || !(p.avail & PAGE_COW_ORIG_RW))
+            return false;
+
+         zero_pages++;
+      }
+   }
+
+   if (!(big_page = kmalloc_big_aligned(BIG_PAGE_SIZE, PAGE_SIZE)))
+      return false;
+
+   bzero(big_page, BIG_PAGE_SIZE);
+   paddr = KERNEL_VA_TO_PA(big_page);
+   big_page_ref_inc(paddr);
+
+   e->raw = PG_PRESENT_BIT | PG_RW_BIT | PG_US_BIT | PG_4MB_BIT | paddr;
+   invalidate_big_page(vaddr);
+
+   if (pt) {
+
+      for (u32 i = 0; i < zero_pages; i++)
+         pf_ref_count_dec(zero_paddr);
+
+      kfree_obj(pt, page_table_t);
+   }
+
+   return true;
+}
+
 void retain_pageframes_mapped_at(pdir_t *pdir, void *vaddrp, size_t len)
 {
    ASSERT(IS_PAGE_ALIGNED(vaddrp));
@@ -133,14 +390,215 @@ void release_pageframes_mapped_at(pdir_t *pdir, void *vaddrp, size_t len)
    }
 }
 
+int retain_user_page_cow(pdir_t *pdir, void *vaddrp, ulong *pa_ref)
+{
+   const ulong vaddr = (ulong)vaddrp;
+   const u32 pt_index = (vaddr >> PAGE_SHIFT) & 1023;
+   const u32 pd_index = (vaddr >> BIG_PAGE_SHIFT);
+   page_dir_entry_t *e = &pdir->entries[pd_index];
+   page_table_t *pt;
+   page_t *p;
+   ulong paddr;
+
+   ASSERT(IS_PAGE_ALIGNED(vaddrp));
+   ASSERT(!is_preemption_enabled());
+
+   if (!e->present || e->psize)
+      return -EFAULT;
+
+   pt = pdir_get_page_table(pdir, pd_index);
+   p = &pt->pages[pt_index];
+
+   if (!p->present || !p->us)
+      return -EFAULT;
+
+   /*
+    * Only private pages that the user can write to (directly or via CoW) can
+    * be shared this way: shared mappings and read-only pages (like ELF's text)
+    * cannot be kept around after the user changes them.
+    */
+   if ((p->avail & PAGE_SHARED) || !(p->rw || (p->avail & PAGE_COW_ORIG_RW)))
+      return -EINVAL;
+
+   paddr = (ulong)p->pageAddr << PAGE_SHIFT;
+
+   /* The kernel will access the page through the linear mapping */
+   if (paddr >= phys_mem_lim || is_highmem_paddr(paddr))
+      return -EINVAL;
+
+   if (p->rw) {
+      p->rw = false;
+      p->avail |= PAGE_COW_ORIG_RW;
+      invalidate_page_hw(vaddr);
+   }
+
+   __pf_ref_count_inc(paddr);
+   *pa_ref = paddr;
+   return 0;
+}
+
+void retain_pageframe(ulong paddr)
+{
+   pf_ref_count_inc(paddr);
+}
+
+void release_pageframe(ulong paddr)
+{
+   if (!pf_ref_count_dec(paddr)) {
+      ASSERT(paddr != KERNEL_VA_TO_PA(zero_page));
+      pageframe_free(paddr);
+   }
+}
+
+u32 get_pageframe_ref_count(ulong paddr)
+{
+   return pf_ref_count_get(paddr);
+}
+
+ulong pageframe_alloc(bool zero)
+{
+   ulong paddr = highmem_alloc_page();
+   void *va;
+
+   if (paddr != INVALID_PADDR) {
+
+      if (zero) {
+         va = kmap(paddr);
+         bzero(va, PAGE_SIZE);
+         kunmap(va);
+      }
+
+      return paddr;
+   }
+
+   if (!(va = zero ? kzmalloc(PAGE_SIZE) : kmalloc(PAGE_SIZE)))
+      return INVALID_PADDR;
+
+   ASSERT(IS_PAGE_ALIGNED(va));
+   return KERNEL_VA_TO_PA(va);
+}
+
+void pageframe_free(ulong paddr)
+{
+   if (is_highmem_paddr(paddr))
+      highmem_free_page(paddr);
+   else
+      kfree2(KERNEL_PA_TO_VA(paddr), PAGE_SIZE);
+}
+
+static page_t *get_user_pte(pdir_t *pdir, ulong vaddr)
+{
+   const u32 pt_index = (vaddr >> PAGE_SHIFT) & 1023;
+   const u32 pd_index = (vaddr >> BIG_PAGE_SHIFT);
+   page_dir_entry_t *e = &pdir->entries[pd_index];
+
+   ASSERT(vaddr < KERNEL_BASE_VA);
+
+   if (!e->present)
+      return NULL;
+
+   ASSERT(!e->psize);
+   return &pdir_get_page_table(pdir, pd_index)->pages[pt_index];
+}
+
 void invalidate_page(ulong vaddr)
 {
    invalidate_page_hw(vaddr);
 }
 
+static bool handle_cow_out_of_memory(void)
+{
+   struct task *curr = get_curr_task();
+
+   // Free the MADV_FREE pages or swap out some pages and retry, if possible
+   if (reclaim_user_memory())
+      return true;
+
+   if (!curr->running_in_kernel) {
+
+      // The task was not running in kernel: we can safely kill it.
+      printk("Out-of-memory: killing pid %d\n", get_curr_pid());
+      send_signal(get_curr_pid(), SIGKILL, SIG_FL_PROCESS | SIG_FL_FAULT);
+      return true;
+
+   } else {
+
+      // We cannot kill a task running in kernel during a CoW page fault
+      // In this case (but in the one above too), Linux puts the process to
+      // sleep, while the OOM killer runs and frees some memory.
+      panic("Out-of-memory: can't copy a CoW page [pid %d]", get_curr_pid());
+   }
+}
+
+/*
+ * CoW fault on a big page. If nobody else maps any part of it, just make it
+ * writable. Otherwise, copy it into a new big page or, when there's no memory
+ * for that, split it: the caller will copy only the faulting page.
+ */
+static bool handle_big_page_cow(pdir_t *pdir, ulong vaddr, bool *split)
+{
+   page_dir_entry_t *e = &pdir->entries[vaddr >> BIG_PAGE_SHIFT];
+   const ulong paddr = big_page_paddr(e);
+   void *big_page;
+
+   if (!(e->avail & PAGE_COW_ORIG_RW))
+      return false; /* Not a COW page */
+
+   if (is_big_page_exclusive(paddr)) {
+      e->rw = true;
+      e->avail = 0;
+      invalidate_big_page(vaddr);
+      return true;
+   }
+
+   if ((big_page = kmalloc_big_aligned(BIG_PAGE_SIZE, PAGE_SIZE))) {
+
+      memcpy32(big_page, KERNEL_PA_TO_VA(paddr), BIG_PAGE_SIZE / 4);
+      big_page_ref_inc(KERNEL_VA_TO_PA(big_page));
+
+      e->big_4mb_page.paddr =
+         SHR_BITS(KERNEL_VA_TO_PA(big_page), BIG_PAGE_SHIFT, u32);
+
+      e->rw = true;
+      e->avail = 0;
+      invalidate_big_page(vaddr);
+
+      /* Drop our references: the other mappings keep the original block */
+      big_page_release(paddr);
+      get_curr_task()->rusage.cow_copies += BIG_PAGE_PAGES;
+      return true;
+   }
+
+   if (split_big_user_page(pdir, vaddr & ~(BIG_PAGE_SIZE - 1)))
+      return handle_cow_out_of_memory();
+
+   *split = true;
+   return true;
+}
+
+/*
+ * First write on a zero page of a private anonymous mapping covering the whole
+ * big-page-aligned block around `vaddr`: back the whole block with a big page.
+ */
+static bool cow_zero_page_to_big_page(pdir_t *pdir, ulong vaddr)
+{
+   const ulong block = vaddr & ~(BIG_PAGE_SIZE - 1);
+   struct user_mapping *um = process_get_user_mapping((void *)vaddr);
+
+   if (!um || um->h || um->shm || !(um->prot & PROT_WRITE))
+      return false;
+
+   if (block < um->vaddr || block + BIG_PAGE_SIZE > um->vaddr + um->len)
+      return false;
+
+   return map_big_user_page(pdir, (void *)block);
+}
+
 bool handle_potential_cow(void *context)
 {
    regs_t *r = context;
+   pdir_t *pdir = get_curr_pdir();
+   bool split = false;
    u32 vaddr;
 
    if ((r->err_code & PAGE_FAULT_FL_COW) != PAGE_FAULT_FL_COW)
@@ -148,10 +606,19 @@ bool handle_potential_cow(void *context)
 
    asmVolatile("movl %%cr2, %0" : "=r"(vaddr));
 
+   if (is_big_user_page(pdir, vaddr)) {
+
+      if (!handle_big_page_cow(pdir, vaddr, &split))
+         return false;
+
+      if (!split)
+         return true;
+   }
+
    const u32 pt_index = (vaddr >> PAGE_SHIFT) & 1023;
    const u32 pd_index = (vaddr >> BIG_PAGE_SHIFT);
    const void *const page_vaddr = (void *)(vaddr & PAGE_MASK);
-   page_table_t *pt = pdir_get_page_table(get_curr_pdir(), pd_index);
+   page_table_t *pt = pdir_get_page_table(pdir, pd_index);
 
    if (!(pt->pages[pt_index].avail & PAGE_COW_ORIG_RW))
       return false; /* Not a COW page */
@@ -176,37 +643,23 @@ bool handle_potential_cow(void *context)
       return true;
    }
 
-   // Allocate a new page.
-   void *new_page_vaddr = kmalloc(PAGE_SIZE);
-
-   if (!new_page_vaddr) {
-
-      // Out-of-memory case
-      struct task *curr = get_curr_task();
-
-      if (!curr->running_in_kernel) {
-
-         // The task was not running in kernel: we can safely kill it.
-         printk("Out-of-memory: killing pid %d\n", get_curr_pid());
-         send_signal(get_curr_pid(), SIGKILL, SIG_FL_PROCESS | SIG_FL_FAULT);
+   if (orig_page_paddr == KERNEL_VA_TO_PA(zero_page)) {
+      if (MMAP_BIG_PAGES && cow_zero_page_to_big_page(pdir, vaddr))
          return true;
-
-      } else {
-
-         // We cannot kill a task running in kernel during a CoW page fault
-         // In this case (but in the one above too), Linux puts the process to
-         // sleep, while the OOM killer runs and frees some memory.
-         panic("Out-of-memory: can't copy a CoW page [pid %d]", get_curr_pid());
-      }
    }
 
-   ASSERT(IS_PAGE_ALIGNED(new_page_vaddr));
+   // Allocate a new page.
+   const ulong paddr = pageframe_alloc(false);
+
+   if (paddr == INVALID_PADDR)
+      return handle_cow_out_of_memory();
 
    // Copy page's contents
+   void *new_page_vaddr = kmap(paddr);
    memcpy32(new_page_vaddr, page_vaddr, PAGE_SIZE / 4);
-
-   // Get the paddr of the new page
-   const ulong paddr = KERNEL_VA_TO_PA(new_page_vaddr);
+   kunmap(new_page_vaddr);
+   tracepoint(tp_cow_copy, vaddr, orig_page_paddr, paddr);
+   get_curr_task()->rusage.cow_copies++;
 
    // A just-allocated pageframe MUST have ref-count == 0
    ASSERT(pf_ref_count_get(paddr) == 0);
@@ -226,10 +679,149 @@ bool handle_potential_cow(void *context)
    return true;
 }
 
-static void kernel_page_fault_panic(regs_t *r, u32 vaddr, bool rw, bool p)
+STATIC_ASSERT(USER_MMAP_BEGIN + 1024 * MB <= USER_MMAP_END);
+
+/*
+ * Out-of-memory while allocating a page for the user, on page fault. Returns
+ * true when the fault has been handled (the task might have been killed).
+ */
+static bool handle_user_page_out_of_memory(void)
 {
-   long off = 0;
-   const char *sym_name = find_sym_at_addr_safe(r->eip, &off, NULL);
+   struct task *curr = get_curr_task();
+
+   /* Free the MADV_FREE pages or swap out some pages and retry, if possible */
+   if (reclaim_user_memory())
+      return true;
+
+   if (curr->running_in_kernel) {
+
+      /*
+       * Let the fault-resumable code (e.g. copy_to_user()) fail with -EFAULT.
+       * In any other case, we'll panic in handle_page_fault_int().
+       */
+      return false;
+   }
+
+   printk("Out-of-memory: killing pid %d\n", get_curr_pid());
+   send_signal(get_curr_pid(), SIGKILL, SIG_FL_PROCESS | SIG_FL_FAULT);
+   return true;
+}
+
+/*
+ * Populate on-demand the brk heap and the user stack: see is_lazy_user_vaddr().
+ * A read access maps the zero page (unless MMAP_NO_COW is set), while a write
+ * access allocates a new zeroed page.
+ */
+bool handle_potential_lazy_page(void *context)
+{
+   regs_t *r = context;
+   struct task *curr = get_curr_task();
+   void *page_vaddr;
+   ulong paddr;
+   u32 vaddr;
+   int rc;
+
+   if (r->err_code & PAGE_FAULT_FL_PRESENT)
+      return false;
+
+   if (is_kernel_thread(curr))
+      return false;
+
+   asmVolatile("movl %%cr2, %0" : "=r"(vaddr));
+
+   if (!is_lazy_user_vaddr(curr->pi, TO_PTR(vaddr)))
+      return false;
+
+   page_vaddr = TO_PTR(vaddr & PAGE_MASK);
+
+   if (!MMAP_NO_COW && !(r->err_code & PAGE_FAULT_FL_RW)) {
+
+      if (!map_zero_page(get_curr_pdir(), page_vaddr, PAGING_FL_RWUS))
+         return true;
+
+   } else if ((paddr = pageframe_alloc(true)) != INVALID_PADDR) {
+
+      rc = map_page(get_curr_pdir(), page_vaddr, paddr, PAGING_FL_RWUS);
+
+      if (!rc)
+         return true;
+
+      pageframe_free(paddr);
+   }
+
+   return handle_user_page_out_of_memory();
+}
+
+/*
+ * Swap in the page at `vaddr`, given its PTE `p`. Returns 0 on success or
+ * -ENOMEM or -EIO (the backend failed to load the page).
+ */
+static int swap_in_page(pdir_t *pdir, ulong vaddr, page_t *p)
+{
+   const u32 slot = p->pageAddr;
+   ulong paddr;
+
+   if ((paddr = pageframe_alloc(false)) == INVALID_PADDR)
+      return -ENOMEM;
+
+   if (swap_backend->load(slot, paddr) < 0) {
+      pageframe_free(paddr);
+      return -EIO;
+   }
+
+   swap_backend->release(slot);
+   pf_ref_count_inc(paddr);
+   p->raw = (p->raw & SWAP_PTE_KEPT_BITS) | PG_PRESENT_BIT | paddr;
+
+   /* The new pageframe is not shared: no need for copying it on write */
+   if (p->avail & PAGE_COW_ORIG_RW) {
+      p->rw = true;
+      p->avail &= ~PAGE_COW_ORIG_RW;
+   }
+
+   if (pdir == get_curr_pdir())
+      invalidate_page_hw(vaddr);
+
+   return 0;
+}
+
+bool handle_potential_swap_in(void *context)
+{
+   regs_t *r = context;
+   pdir_t *pdir = get_curr_pdir();
+   page_t *p;
+   u32 vaddr;
+   int rc;
+
+   if (!swap_backend || (r->err_code & PAGE_FAULT_FL_PRESENT))
+      return false;
+
+   asmVolatile("movl %%cr2, %0" : "=r"(vaddr));
+
+   if (vaddr >= KERNEL_BASE_VA || is_big_user_page(pdir, vaddr))
+      return false;
+
+   if (!(p = get_user_pte(pdir, vaddr)) || !is_swap_pte(*p))
+      return false;
+
+   rc = swap_in_page(pdir, vaddr & PAGE_MASK, p);
+
+   if (!rc)
+      return true;
+
+   if (rc == -EIO) {
+      printk("swap: unable to load the page at %p [pid %d]\n",
+             TO_PTR(vaddr), get_curr_pid());
+      return false;
+   }
+
+   return handle_user_page_out_of_memory();
+}
+
+static void kernel_page_fault_panic(regs_t *r, u32 vaddr, bool rw, bool p)
+{
+   long off = 0;
+   const char *sym_name = find_sym_at_addr_safe(r->eip, &off, NULL);
    panic("PAGE FAULT in attempt to %s %p from %s%s\nEIP: %p [%s + %d]\n",
          rw ? "WRITE" : "READ",
          vaddr,
@@ -242,6 +834,7 @@ void handle_page_fault_int(regs_t *r)
 {
    u32 vaddr;
    asmVolatile("movl %%cr2, %0" : "=r"(vaddr));
+   tracepoint(tp_page_fault, vaddr, r->err_code, r->eip);
 
    bool p  = !!(r->err_code & PAGE_FAULT_FL_PRESENT);
    bool rw = !!(r->err_code & PAGE_FAULT_FL_RW);
@@ -259,113 +852,451 @@ void handle_page_fault_int(regs_t *r)
       kernel_page_fault_panic(r, vaddr, rw, p);
    }
 
-   um = process_get_user_mapping((void *)vaddr);
+   um = process_get_user_mapping((void *)vaddr);
+
+   /*
+    * Anonymous private mappings are always fully mapped (or swapped out, see
+    * handle_potential_swap_in()): a fault on them can only be caused by a
+    * protection violation.
+    */
+   if (um && (um->h || um->shm)) {
+
+      /*
+       * Call the fault handler only if in first place the mapping allowed
+       * writing or if it didn't but the memory access type was a READ.
+       */
+      if (!!(um->prot & PROT_WRITE) || (!rw && (um->prot & PROT_READ))) {
+
+         const bool handled = um->shm
+            ? shmem_handle_fault(um, (void *)vaddr, p, rw)
+            : vfs_handle_fault(um, (void *)vaddr, p, rw);
+
+         if (handled) {
+
+            get_curr_task()->rusage.minflt++;
+
+            /* Fault handlers might map the page as writable: fix that */
+            if (!(um->prot & PROT_WRITE))
+               set_pages_prot(get_curr_pdir(),
+                              (void *)(vaddr & PAGE_MASK), 1, um->prot);
+
+            return;
+         }
+
+         sig = SIGBUS;
+      }
+   }
+
+   if (KRN_PAGE_FAULT_PRINTK) {
+
+      printk("[%d] USER PAGE FAULT in attempt to %s %p%s\n",
+             get_curr_pid(),
+             rw ? "WRITE" : "READ", TO_PTR(vaddr),
+             !p ? " (NON present)." : ".");
+
+      printk("EIP: %p\n", TO_PTR(r->eip));
+
+      if (get_curr_proc()->debug_cmdline)
+         printk("Cmdline: %s\n", get_curr_proc()->debug_cmdline);
+   }
+
+   trace_printk(
+      5, "USER PAGE FAULT in attempt to %s %p%s, EIP: %p, Cmdline: '%s'",
+      rw ? "WRITE" : "READ", TO_PTR(vaddr),
+      !p ? " (NON present)" : "",
+      TO_PTR(r->eip),
+      get_curr_proc()->debug_cmdline
+   );
+
+   send_signal(get_curr_tid(), sig, SIG_FL_PROCESS | SIG_FL_FAULT);
+}
+
+void handle_page_fault(regs_t *r)
+{
+   if (in_panic()) {
+
+      printk("Page fault while already in panic state.\n");
+
+      while (true) {
+         halt();
+      }
+   }
+
+   ASSERT(!is_preemption_enabled());
+   handle_page_fault_int(r);
+}
+
+bool is_mapped(pdir_t *pdir, void *vaddrp)
+{
+   page_table_t *pt;
+   const ulong vaddr = (ulong) vaddrp;
+   const u32 pt_index = (vaddr >> PAGE_SHIFT) & 1023;
+   const u32 pd_index = (vaddr >> BIG_PAGE_SHIFT);
+
+   page_dir_entry_t *e = &pdir->entries[pd_index];
+
+   if (!e->present)
+      return false;
+
+   if (e->psize) /* 4-MB page */
+      return e->present;
+
+   pt = KERNEL_PA_TO_VA(pdir->entries[pd_index].ptaddr << PAGE_SHIFT);
+   return pt->pages[pt_index].present;
+}
+
+bool is_rw_mapped(pdir_t *pdir, void *vaddrp)
+{
+   page_table_t *pt;
+   const ulong vaddr = (ulong) vaddrp;
+   const u32 pt_index = (vaddr >> PAGE_SHIFT) & 1023;
+   const u32 pd_index = (vaddr >> BIG_PAGE_SHIFT);
+
+   page_dir_entry_t *e = &pdir->entries[pd_index];
+   page_t page;
+
+   if (!e->present)
+      return false;
+
+   if (e->psize) /* 4-MB page */
+      return e->present && e->rw;
+
+   pt = KERNEL_PA_TO_VA(pdir->entries[pd_index].ptaddr << PAGE_SHIFT);
+   page = pt->pages[pt_index];
+   return page.present && page.rw;
+}
+
+void set_page_rw(pdir_t *pdir, void *vaddrp, bool rw)
+{
+   page_table_t *pt;
+   const ulong vaddr = (ulong) vaddrp;
+   const u32 pt_index = (vaddr >> PAGE_SHIFT) & 1023;
+   const u32 pd_index = (vaddr >> BIG_PAGE_SHIFT);
+
+   pt = KERNEL_PA_TO_VA(pdir->entries[pd_index].ptaddr << PAGE_SHIFT);
+   ASSERT(KERNEL_VA_TO_PA(pt) != 0);
+   pt->pages[pt_index].rw = rw;
+   invalidate_page_hw(vaddr);
+}
+
+static void set_page_prot(page_t *p, bool none, bool write)
+{
+   /*
+    * PROT_NONE pages stay mapped (the kernel still needs to track their
+    * pageframes) but they become supervisor-only.
+    */
+   p->us = !none;
+
+   if (none || !write) {
+
+      p->rw = false;
+      p->avail &= ~PAGE_COW_ORIG_RW;
+
+   } else if (!p->rw) {
+
+      if (p->avail & PAGE_SHARED) {
+
+         p->rw = true;
+
+      } else {
+
+         /*
+          * The pageframe might be shared with other processes or be the
+          * zero page: let the CoW fault handler decide whether it has to
+          * be copied or it can just be made writable.
+          */
+         p->avail |= PAGE_COW_ORIG_RW;
+      }
+   }
+}
+
+void set_pages_prot(pdir_t *pdir, void *vaddrp, size_t page_count, int prot)
+{
+   const bool none = !(prot & (PROT_READ | PROT_WRITE));
+   const bool write = !!(prot & PROT_WRITE);
+   ulong vaddr = (ulong)vaddrp;
+   page_t *p;
+
+   ASSERT(IS_PAGE_ALIGNED(vaddrp));
+
+   for (size_t i = 0; i < page_count; i++, vaddr += PAGE_SIZE) {
+
+      if (is_big_user_page(pdir, vaddr)) {
+
+         ASSERT(!(vaddr & (BIG_PAGE_SIZE - 1)));
+         ASSERT(page_count - i >= BIG_PAGE_PAGES);
+
+         /* The bits touched by set_page_prot() are the same in the PDE */
+         p = (page_t *)&pdir->entries[vaddr >> BIG_PAGE_SHIFT];
+         set_page_prot(p, none, write);
+         invalidate_big_page(vaddr);
+
+         i += BIG_PAGE_PAGES - 1;
+         vaddr += BIG_PAGE_SIZE - PAGE_SIZE;
+         continue;
+      }
+
+      if (!(p = get_user_pte(pdir, vaddr)))
+         continue;
+
+      /* Swapped-out pages keep their protection bits in the PTE */
+      if (!p->present && !is_swap_pte(*p))
+         continue;
+
+      set_page_prot(p, none, write);
+      invalidate_page_hw(vaddr);
+   }
+}
+
+size_t mark_pages_lazyfree(pdir_t *pdir, void *vaddrp, size_t page_count)
+{
+   const ulong zero_paddr = KERNEL_VA_TO_PA(zero_page);
+   ulong vaddr = (ulong)vaddrp;
+   size_t count = 0;
+   page_t *p;
+
+   ASSERT(IS_PAGE_ALIGNED(vaddrp));
+
+   for (size_t i = 0; i < page_count; i++, vaddr += PAGE_SIZE) {
+
+      if (!(p = get_user_pte(pdir, vaddr)) || !p->present)
+         continue;
+
+      if (p->avail & PAGE_SHARED)
+         continue;
+
+      if (((ulong)p->pageAddr << PAGE_SHIFT) == zero_paddr)
+         continue;
+
+      if (p->rw) {
+         p->rw = false;
+         p->avail |= PAGE_COW_ORIG_RW;
+      }
+
+      p->avail |= PAGE_LAZYFREE;
+      invalidate_page_hw(vaddr);
+      count++;
+   }
+
+   return count;
+}
+
+size_t reclaim_lazyfree_pages(pdir_t *pdir, void *vaddrp, size_t page_count)
+{
+   const ulong zero_paddr = KERNEL_VA_TO_PA(zero_page);
+   const bool curr_pdir = pdir == get_curr_pdir();
+   ulong vaddr = (ulong)vaddrp;
+   size_t count = 0;
+   ulong paddr;
+   page_t *p;
+
+   ASSERT(IS_PAGE_ALIGNED(vaddrp));
+   ASSERT(!is_preemption_enabled());
+
+   for (size_t i = 0; i < page_count; i++, vaddr += PAGE_SIZE) {
+
+      if (is_big_user_page(pdir, vaddr)) {
+
+         /* Never lazy-free: madvise() splits the big pages before */
+         ASSERT(!(vaddr & (BIG_PAGE_SIZE - 1)));
+         i += BIG_PAGE_PAGES - 1;
+         vaddr += BIG_PAGE_SIZE - PAGE_SIZE;
+         continue;
+      }
+
+      if (!(p = get_user_pte(pdir, vaddr)) || !p->present)
+         continue;
+
+      if (!(p->avail & PAGE_LAZYFREE))
+         continue;
+
+      /*
+       * Keep all the other bits as they are (in particular, `us` and the
+       * PAGE_COW_ORIG_RW flag): this way, the page keeps its protection.
+       */
+      paddr = (ulong)p->pageAddr << PAGE_SHIFT;
+      p->pageAddr = SHR_BITS(zero_paddr, PAGE_SHIFT, u32);
+      p->avail &= ~PAGE_LAZYFREE;
+      pf_ref_count_inc(zero_paddr);
+
+      if (!pf_ref_count_dec(paddr))
+         pageframe_free(paddr);
+
+      if (curr_pdir)
+         invalidate_page_hw(vaddr);
+
+      count++;
+   }
+
+   return count;
+}
 
-   if (um) {
+void swap_pages_mappings(pdir_t *pdir, void *va1, void *va2, size_t count)
+{
+   ulong v1 = (ulong)va1;
+   ulong v2 = (ulong)va2;
+   page_t *p1, *p2;
+   page_t tmp;
 
-      /*
-       * Call vfs_handle_fault() only if in first place the mapping allowed
-       * writing or if it didn't but the memory access type was a READ.
-       */
-      if (!!(um->prot & PROT_WRITE) || !rw) {
+   ASSERT(IS_PAGE_ALIGNED(va1));
+   ASSERT(IS_PAGE_ALIGNED(va2));
 
-         if (vfs_handle_fault(um, (void *)vaddr, p, rw))
-            return;
+   for (size_t i = 0; i < count; i++, v1 += PAGE_SIZE, v2 += PAGE_SIZE) {
 
-         sig = SIGBUS;
-      }
+      p1 = get_user_pte(pdir, v1);
+      p2 = get_user_pte(pdir, v2);
+
+      ASSERT(p1 && (p1->present || is_swap_pte(*p1)));
+      ASSERT(p2 && (p2->present || is_swap_pte(*p2)));
+
+      tmp = *p1;
+      *p1 = *p2;
+      *p2 = tmp;
+
+      invalidate_page_hw(v1);
+      invalidate_page_hw(v2);
    }
+}
 
-   if (KRN_PAGE_FAULT_PRINTK) {
+/*
+ * Split the big page at `vaddr`, if it's cold and not shared, so that its
+ * pages can be swapped out one by one. Otherwise, give it a second chance.
+ */
+static bool split_cold_big_page(pdir_t *pdir, ulong vaddr, bool curr_pdir)
+{
+   page_dir_entry_t *e = &pdir->entries[vaddr >> BIG_PAGE_SHIFT];
 
-      printk("[%d] USER PAGE FAULT in attempt to %s %p%s\n",
-             get_curr_pid(),
-             rw ? "WRITE" : "READ", TO_PTR(vaddr),
-             !p ? " (NON present)." : ".");
+   if (e->accessed) {
 
-      printk("EIP: %p\n", TO_PTR(r->eip));
+      e->accessed = false;
 
-      if (get_curr_proc()->debug_cmdline)
-         printk("Cmdline: %s\n", get_curr_proc()->debug_cmdline);
+      if (curr_pdir)
+         invalidate_page_hw(vaddr);
+
+      return false;
    }
 
-   trace_printk(
-      5, "USER PAGE FAULT in attempt to %s %p%s, EIP: %p, Cmdline: '%s'",
-      rw ? "WRITE" : "READ", TO_PTR(vaddr),
-      !p ? " (NON present)" : "",
-      TO_PTR(r->eip),
-      get_curr_proc()->debug_cmdline
-   );
+   if (!is_big_page_exclusive(big_page_paddr(e)))
+      return false;
 
-   send_signal(get_curr_tid(), sig, SIG_FL_PROCESS | SIG_FL_FAULT);
+   return !split_big_user_page(pdir, vaddr);
 }
 
-void handle_page_fault(regs_t *r)
+size_t swap_out_pages(pdir_t *pdir, void *vaddrp, size_t page_count, size_t max)
 {
-   if (in_panic()) {
+   const bool curr_pdir = pdir == get_curr_pdir();
+   ulong vaddr = (ulong)vaddrp;
+   size_t count = 0;
+   bool keep_frame;
+   ulong paddr;
+   page_t *p;
+   u32 slot;
 
-      printk("Page fault while already in panic state.\n");
+   ASSERT(IS_PAGE_ALIGNED(vaddrp));
+   ASSERT(!is_preemption_enabled());
 
-      while (true) {
-         halt();
+   for (size_t i = 0; i < page_count && count < max; i++, vaddr += PAGE_SIZE) {
+
+      if (is_big_user_page(pdir, vaddr)) {
+
+         /* Big pages are always fully inside the mapping */
+         ASSERT(!(vaddr & (BIG_PAGE_SIZE - 1)));
+
+         if (!split_cold_big_page(pdir, vaddr, curr_pdir)) {
+            i += BIG_PAGE_PAGES - 1;
+            vaddr += BIG_PAGE_SIZE - PAGE_SIZE;
+            continue;
+         }
       }
-   }
 
-   ASSERT(!is_preemption_enabled());
-   handle_page_fault_int(r);
-}
+      if (!(p = get_user_pte(pdir, vaddr)) || !p->present)
+         continue;
 
-bool is_mapped(pdir_t *pdir, void *vaddrp)
-{
-   page_table_t *pt;
-   const ulong vaddr = (ulong) vaddrp;
-   const u32 pt_index = (vaddr >> PAGE_SHIFT) & 1023;
-   const u32 pd_index = (vaddr >> BIG_PAGE_SHIFT);
+      if (p->avail & (PAGE_SHARED | PAGE_LAZYFREE))
+         continue;
 
-   page_dir_entry_t *e = &pdir->entries[pd_index];
+      paddr = (ulong)p->pageAddr << PAGE_SHIFT;
 
-   if (!e->present)
-      return false;
+      /* Pages mapped more than once (e.g. the zero page) cannot be swapped */
+      if (pf_ref_count_get(paddr) != 1)
+         continue;
 
-   if (e->psize) /* 4-MB page */
-      return e->present;
+      if (p->accessed) {
 
-   pt = KERNEL_PA_TO_VA(pdir->entries[pd_index].ptaddr << PAGE_SHIFT);
-   return pt->pages[pt_index].present;
-}
+         /* Second chance: swap it out only if not accessed until next scan */
+         p->accessed = false;
 
-bool is_rw_mapped(pdir_t *pdir, void *vaddrp)
-{
-   page_table_t *pt;
-   const ulong vaddr = (ulong) vaddrp;
-   const u32 pt_index = (vaddr >> PAGE_SHIFT) & 1023;
-   const u32 pd_index = (vaddr >> BIG_PAGE_SHIFT);
+         if (curr_pdir)
+            invalidate_page_hw(vaddr);
 
-   page_dir_entry_t *e = &pdir->entries[pd_index];
-   page_t page;
+         continue;
+      }
 
-   if (!e->present)
-      return false;
+      keep_frame = false;
 
-   if (e->psize) /* 4-MB page */
-      return e->present && e->rw;
+      if (!(slot = swap_backend->store(paddr, &keep_frame))) {
 
-   pt = KERNEL_PA_TO_VA(pdir->entries[pd_index].ptaddr << PAGE_SHIFT);
-   page = pt->pages[pt_index];
-   return page.present && page.rw;
+         if (!swap_backend->can_store())
+            break;
+
+         continue; /* e.g. the page could not be compressed enough */
+      }
+
+      ASSERT(slot < (1u << SWAP_SLOT_BITS));
+      p->raw = (p->raw & SWAP_PTE_KEPT_BITS) | (slot << PAGE_SHIFT);
+
+      if (curr_pdir)
+         invalidate_page_hw(vaddr);
+
+      __pf_ref_count_dec(paddr);
+
+      if (!keep_frame)
+         pageframe_free(paddr);
+
+      count++;
+   }
+
+   /* We've just freed some memory: take back the reserve, if used */
+   if (MMAP_BIG_PAGES && !reserved_pt)
+      reserved_pt = kalloc_obj(page_table_t);
+
+   return count;
 }
 
-void set_page_rw(pdir_t *pdir, void *vaddrp, bool rw)
+size_t swap_in_pages(pdir_t *pdir, void *vaddrp, size_t page_count)
 {
-   page_table_t *pt;
-   const ulong vaddr = (ulong) vaddrp;
-   const u32 pt_index = (vaddr >> PAGE_SHIFT) & 1023;
-   const u32 pd_index = (vaddr >> BIG_PAGE_SHIFT);
+   ulong vaddr = (ulong)vaddrp;
+   size_t count = 0;
+   size_t skip;
+   page_t *p;
 
-   pt = KERNEL_PA_TO_VA(pdir->entries[pd_index].ptaddr << PAGE_SHIFT);
-   ASSERT(KERNEL_VA_TO_PA(pt) != 0);
-   pt->pages[pt_index].rw = rw;
-   invalidate_page_hw(vaddr);
+   ASSERT(IS_PAGE_ALIGNED(vaddrp));
+   ASSERT(!is_preemption_enabled());
+
+   if (!swap_backend)
+      return 0;
+
+   for (size_t i = 0; i < page_count; i++, vaddr += PAGE_SIZE) {
+
+      if (is_big_user_page(pdir, vaddr)) {
+
+         /* Never swapped out as a whole: skip to its end */
+         skip = BIG_PAGE_PAGES - 1 - ((vaddr >> PAGE_SHIFT) & 1023);
+         i += skip;
+         vaddr += skip << PAGE_SHIFT;
+         continue;
+      }
+
+      if (!(p = get_user_pte(pdir, vaddr)) || !is_swap_pte(*p))
+         continue;
+
+      if (swap_in_page(pdir, vaddr, p))
+         break;
+
+      count++;
+   }
+
+   return count;
 }
 
 static inline int
@@ -376,6 +1307,14 @@ __unmap_page(pdir_t *pdir, void *vaddrp, bool free_pageframe, bool permissive)
    const u32 pt_index = (vaddr >> PAGE_SHIFT) & 1023;
    const u32 pd_index = (vaddr >> BIG_PAGE_SHIFT);
 
+   if (UNLIKELY(is_big_user_page(pdir, vaddr))) {
+
+      /* Callers are expected to split the big pages they partially unmap */
+      if (split_big_user_page(pdir, vaddr & ~(BIG_PAGE_SIZE - 1)))
+         panic("Out-of-memory: can't split a big page [pid %d]",
+               get_curr_pid());
+   }
+
    pt = KERNEL_PA_TO_VA(pdir->entries[pd_index].ptaddr << PAGE_SHIFT);
 
    if (permissive) {
@@ -383,11 +1322,24 @@ __unmap_page(pdir_t *pdir, void *vaddrp, bool free_pageframe, bool permissive)
       if (KERNEL_VA_TO_PA(pt) == 0)
          return -EINVAL;
 
+   } else {
+      ASSERT(KERNEL_VA_TO_PA(pt) != 0);
+   }
+
+   if (UNLIKELY(is_swap_pte(pt->pages[pt_index]))) {
+
+      /* Its content is unreachable from now on: always drop it */
+      swap_backend->release(pt->pages[pt_index].pageAddr);
+      pt->pages[pt_index].raw = 0;
+      return 0;
+   }
+
+   if (permissive) {
+
       if (!pt->pages[pt_index].present)
          return -EINVAL;
 
    } else {
-      ASSERT(KERNEL_VA_TO_PA(pt) != 0);
       ASSERT(pt->pages[pt_index].present);
    }
 
@@ -399,7 +1351,7 @@ __unmap_page(pdir_t *pdir, void *vaddrp, bool free_pageframe, bool permissive)
 
    if (!pf_ref_count_dec(paddr) && free_pageframe) {
       ASSERT(paddr != KERNEL_VA_TO_PA(zero_page));
-      kfree2(KERNEL_PA_TO_VA(paddr), PAGE_SIZE);
+      pageframe_free(paddr);
    }
 
    return 0;
@@ -417,6 +1369,19 @@ unmap_page_permissive(pdir_t *pdir, void *vaddrp, bool free_pageframe)
    return __unmap_page(pdir, vaddrp, free_pageframe, true);
 }
 
+/* Un-map the big page at `vaddr`, if any, and if [vaddr, +count) covers it */
+static bool unmap_big_page_in_range(pdir_t *pdir, ulong vaddr, size_t count)
+{
+   if (!is_big_user_page(pdir, vaddr))
+      return false;
+
+   if ((vaddr & (BIG_PAGE_SIZE - 1)) || count < BIG_PAGE_PAGES)
+      return false;
+
+   unmap_big_user_page(pdir, vaddr);
+   return true;
+}
+
 void
 unmap_pages(pdir_t *pdir,
             void *vaddr,
@@ -424,7 +1389,15 @@ unmap_pages(pdir_t *pdir,
             bool do_free)
 {
    for (size_t i = 0; i < page_count; i++) {
-      unmap_page(pdir, (char *)vaddr + (i << PAGE_SHIFT), do_free);
+
+      char *va = (char *)vaddr + (i << PAGE_SHIFT);
+
+      if (unmap_big_page_in_range(pdir, (ulong)va, page_count - i)) {
+         i += BIG_PAGE_PAGES - 1;
+         continue;
+      }
+
+      unmap_page(pdir, va, do_free);
    }
 }
 
@@ -438,11 +1411,16 @@ unmap_pages_permissive(pdir_t *pdir,
    int rc;
 
    for (size_t i = 0; i < page_count; i++) {
-      rc = unmap_page_permissive(
-         pdir,
-         (char *)vaddr + (i << PAGE_SHIFT),
-         do_free
-      );
+
+      char *va = (char *)vaddr + (i << PAGE_SHIFT);
+
+      if (unmap_big_page_in_range(pdir, (ulong)va, page_count - i)) {
+         i += BIG_PAGE_PAGES - 1;
+         unmapped_pages += BIG_PAGE_PAGES;
+         continue;
+      }
+
+      rc = unmap_page_permissive(pdir, va, do_free);
       unmapped_pages += (rc == 0);
    }
 
@@ -466,6 +1444,12 @@ ulong get_mapping(pdir_t *pdir, void *vaddrp)
 
    e.raw = pdir->entries[pd_index].raw;
    ASSERT(e.present);
+
+   if (e.psize) {
+      return ((ulong) e.big_4mb_page.paddr << BIG_PAGE_SHIFT) |
+             (vaddr & (4 * MB - 1));
+   }
+
    ASSERT(e.ptaddr != 0);
 
    pt = KERNEL_PA_TO_VA(e.ptaddr << PAGE_SHIFT);
@@ -529,6 +1513,7 @@ map_page_int(pdir_t *pdir, void *vaddrp, ulong paddr, u32 hw_flags)
 
    ASSERT(!(vaddr & OFFSET_IN_PAGE_MASK)); // the vaddr must be page-aligned
    ASSERT(!(paddr & OFFSET_IN_PAGE_MASK)); // the paddr must be page-aligned
+   ASSERT(!pdir->entries[pd_index].psize); // no big page there
 
    pt = KERNEL_PA_TO_VA(pdir->entries[pd_index].ptaddr << PAGE_SHIFT);
    ASSERT(IS_PAGE_ALIGNED(pt));
@@ -623,7 +1608,7 @@ out:
 NODISCARD int
 map_page(pdir_t *pdir, void *vaddrp, ulong paddr, u32 pg_flags)
 {
-   const bool rw = !!(pg_flags & PAGING_FL_RW);
+   bool rw = !!(pg_flags & PAGING_FL_RW);
    const bool us = !!(pg_flags & PAGING_FL_US);
    u32 avail_bits = 0;
    int rc;
@@ -631,19 +1616,22 @@ map_page(pdir_t *pdir, void *vaddrp, ulong paddr, u32 pg_flags)
    if (pg_flags & PAGING_FL_SHARED)
       avail_bits |= PAGE_SHARED;
 
+   if (pg_flags & PAGING_FL_COW) {
+
+      /* Writable, but the pageframe is copied on the first write */
+      ASSERT(~pg_flags & PAGING_FL_SHARED);
+      avail_bits |= PAGE_COW_ORIG_RW;
+      rw = false;
+   }
+
    if (pg_flags & PAGING_FL_DO_ALLOC) {
 
-      void *va;
       ASSERT(paddr == 0);
+      paddr = pageframe_alloc(!!(pg_flags & PAGING_FL_ZERO_PG));
 
-      if (!(va = kmalloc(PAGE_SIZE)))
+      if (paddr == INVALID_PADDR)
          return -ENOMEM;
 
-      if (pg_flags & PAGING_FL_ZERO_PG)
-         bzero(va, PAGE_SIZE);
-
-      paddr = KERNEL_VA_TO_PA(va);
-
    } else {
 
       /* PAGING_FL_ZERO_PG cannot be used without PAGING_FL_DO_ALLOC */
@@ -661,7 +1649,7 @@ map_page(pdir_t *pdir, void *vaddrp, ulong paddr, u32 pg_flags)
                    /* Kernel pages are global */
 
    if (UNLIKELY(rc != 0) && (pg_flags & PAGING_FL_DO_ALLOC)) {
-      kfree2(KERNEL_PA_TO_VA(paddr), PAGE_SIZE);
+      pageframe_free(paddr);
    }
 
    return rc;
@@ -748,10 +1736,7 @@ pdir_t *pdir_clone(pdir_t *pdir)
 
    for (u32 i = 0; i < KERNEL_BASE_PD_IDX; i++) {
 
-      /* User-space cannot use 4-MB pages */
-      ASSERT(!pdir->entries[i].psize);
-
-      if (!pdir->entries[i].present)
+      if (!pdir->entries[i].present || pdir->entries[i].psize)
          continue;
 
       page_table_t *pt = kalloc_obj(page_table_t);
@@ -759,8 +1744,11 @@ pdir_t *pdir_clone(pdir_t *pdir)
       if (UNLIKELY(!pt)) {
 
          for (; i > 0; i--) {
-            if (pdir->entries[i - 1].present)
-               kfree_obj(pdir_get_page_table(pdir, i - 1), page_table_t);
+
+            page_dir_entry_t *e = &new_pdir->entries[i - 1];
+
+            if (e->present && !e->psize)
+               kfree_obj(pdir_get_page_table(new_pdir, i - 1), page_table_t);
          }
 
          kfree_obj(new_pdir, pdir_t);
@@ -773,9 +1761,23 @@ pdir_t *pdir_clone(pdir_t *pdir)
 
    for (u32 i = 0; i < KERNEL_BASE_PD_IDX; i++) {
 
-      if (!pdir->entries[i].present)
+      page_dir_entry_t *e = &pdir->entries[i];
+
+      if (!e->present)
          continue;
 
+      if (e->psize) {
+
+         /* Big page: make it CoW as a whole, like the regular ones below */
+         if (e->rw)
+            e->avail |= PAGE_COW_ORIG_RW;
+
+         e->rw = false;
+         big_page_ref_inc(big_page_paddr(e));
+         new_pdir->entries[i] = *e;
+         continue;
+      }
+
       page_table_t *orig_pt = pdir_get_page_table(pdir, i);
       page_table_t *new_pt = pdir_get_page_table(new_pdir, i);
 
@@ -784,8 +1786,14 @@ pdir_t *pdir_clone(pdir_t *pdir)
 
          page_t *const p = &orig_pt->pages[j];
 
-         if (!p->present)
+         if (!p->present) {
+
+            /* Swapped-out page: share its slot, like a pageframe */
+            if (is_swap_pte(*p))
+               swap_backend->dup(p->pageAddr);
+
             continue;
+         }
 
          const ulong orig_paddr = (ulong)p->pageAddr << PAGE_SHIFT;
 
@@ -830,12 +1838,29 @@ pdir_deep_clone(pdir_t *pdir)
 
       new_pdir->entries[i].raw = pdir->entries[i].raw;
 
-      /* User-space cannot use 4-MB pages */
-      ASSERT(!pdir->entries[i].psize);
-
       if (!pdir->entries[i].present)
          continue;
 
+      if (pdir->entries[i].psize) {
+
+         void *big_page = kmalloc_big_aligned(BIG_PAGE_SIZE, PAGE_SIZE);
+
+         if (!big_page) {
+            new_pdir->entries[i].raw = 0;
+            goto oom_exit;
+         }
+
+         memcpy32(big_page,
+                  KERNEL_PA_TO_VA(big_page_paddr(&pdir->entries[i])),
+                  BIG_PAGE_SIZE / 4);
+
+         big_page_ref_inc(KERNEL_VA_TO_PA(big_page));
+         new_pdir->entries[i].big_4mb_page.paddr =
+            SHR_BITS(KERNEL_VA_TO_PA(big_page), BIG_PAGE_SHIFT, u32);
+
+         continue;
+      }
+
       page_table_t *orig_pt = pdir_get_page_table(pdir, i);
       page_table_t *new_pt = kmalloc_accelerator_get_elem(&acc);
 
@@ -848,8 +1873,14 @@ pdir_deep_clone(pdir_t *pdir)
 
          new_pt->pages[j].raw = orig_pt->pages[j].raw;
 
-         if (!orig_pt->pages[j].present)
+         if (!orig_pt->pages[j].present) {
+
+            /* Swapped-out page: share its slot, it's copied on swap-in */
+            if (is_swap_pte(orig_pt->pages[j]))
+               swap_backend->dup(orig_pt->pages[j].pageAddr);
+
             continue;
+         }
 
          void *new_page = kmalloc_accelerator_get_elem(&acc);
 
@@ -861,13 +1892,14 @@ pdir_deep_clone(pdir_t *pdir)
          ulong orig_page_paddr =
             (ulong)orig_pt->pages[j].pageAddr << PAGE_SHIFT;
 
-         void *orig_page = KERNEL_PA_TO_VA(orig_page_paddr);
+         void *orig_page = kmap(orig_page_paddr);
 
          u32 new_page_paddr = KERNEL_VA_TO_PA(new_page);
          ASSERT(pf_ref_count_get(new_page_paddr) == 0);
          pf_ref_count_inc(new_page_paddr);
 
          memcpy32(new_page, orig_page, PAGE_SIZE / 4);
+         kunmap(orig_page);
          new_pt->pages[j].pageAddr = SHR_BITS(new_page_paddr, PAGE_SHIFT, u32);
       }
 
@@ -902,17 +1934,27 @@ void pdir_destroy(pdir_t *pdir)
       if (!pdir->entries[i].present)
          continue;
 
+      if (pdir->entries[i].psize) {
+         big_page_release(big_page_paddr(&pdir->entries[i]));
+         continue;
+      }
+
       page_table_t *pt = pdir_get_page_table(pdir, i);
 
       for (u32 j = 0; j < 1024; j++) {
 
-         if (!pt->pages[j].present)
+         if (!pt->pages[j].present) {
+
+            if (is_swap_pte(pt->pages[j]))
+               swap_backend->release(pt->pages[j].pageAddr);
+
             continue;
+         }
 
          const ulong paddr = (ulong)pt->pages[j].pageAddr << PAGE_SHIFT;
 
          if (pf_ref_count_dec(paddr) == 0)
-            kfree2(KERNEL_PA_TO_VA(paddr), PAGE_SIZE);
+            pageframe_free(paddr);
       }
 
       // We freed all the pages, now free the whole page-table.
@@ -923,6 +1965,32 @@ void pdir_destroy(pdir_t *pdir)
    kfree_obj(pdir, pdir_t);
 }
 
+size_t get_user_rss_pages(pdir_t *pdir)
+{
+   const u32 zero_pa_idx = KERNEL_VA_TO_PA(zero_page) >> PAGE_SHIFT;
+   size_t count = 0;
+
+   for (u32 i = 0; i < KERNEL_BASE_PD_IDX; i++) {
+
+      if (!pdir->entries[i].present)
+         continue;
+
+      if (pdir->entries[i].psize) {
+         count += BIG_PAGE_PAGES;
+         continue;
+      }
+
+      page_table_t *pt = pdir_get_page_table(pdir, i);
+
+      for (u32 j = 0; j < 1024; j++) {
+         if (pt->pages[j].present && pt->pages[j].pageAddr != zero_pa_idx)
+            count++;
+      }
+   }
+
+   return count;
+}
+
 
 void map_4mb_page_int(pdir_t *pdir,
                       void *vaddrp,
@@ -944,15 +2012,6 @@ void map_4mb_page_int(pdir_t *pdir,
    pdir->entries[pd_index].raw = flags | paddr;
 }
 
-static inline bool in_big_4mb_page(pdir_t *pdir, void *vaddrp)
-{
-   const u32 vaddr = (u32) vaddrp;
-   const u32 pd_index = (vaddr >> BIG_PAGE_SHIFT);
-
-   page_dir_entry_t *e = &pdir->entries[pd_index];
-   return e->present && e->psize;
-}
-
 static void set_big_4mb_page_pat_wc(pdir_t *pdir, void *vaddrp)
 {
    const u32 vaddr = (u32) vaddrp;
@@ -1059,10 +2118,14 @@ void init_paging(void)
    int rc;
    void *user_vdso_vaddr;
    size_t pagesframes_refcount_bufsize;
+   page_table_t *pt;
 
    phys_mem_lim = (ulong)MIN(get_phys_mem_size(),
                              (u64)LINEAR_MAPPING_SIZE);
 
+   /* The highmem's pageframes need a ref-count as well */
+   phys_mem_lim = MAX(phys_mem_lim, get_highmem_end());
+
    /*
     * Allocate the buffer used for keeping a ref-count for each pageframe.
     * This is necessary for COW.
@@ -1083,6 +2146,9 @@ void init_paging(void)
 
    pf_ref_count_inc(KERNEL_VA_TO_PA(zero_page));
 
+   if (MMAP_BIG_PAGES && !(reserved_pt = kalloc_obj(page_table_t)))
+      panic("Unable to allocate the reserved page table");
+
    /* Initialize the kmalloc heap used for the "hi virtual mem" area */
    init_hi_vmem_heap();
 
@@ -1095,6 +2161,18 @@ void init_paging(void)
    if (user_vdso_vaddr != (void *)USER_VDSO_VADDR)
       panic("user_vdso_vaddr != USER_VDSO_VADDR");
 
+   /*
+    * Reserve the kmap() slots. The block is naturally aligned, so all of its
+    * PTEs are in the same page table, pre-allocated by init_hi_vmem_heap().
+    */
+   kmap_vaddr = (ulong)hi_vmem_reserve(KMAP_SLOTS * PAGE_SIZE);
+
+   if (!kmap_vaddr)
+      panic("Unable to reserve hi vmem for kmap()");
+
+   pt = pdir_get_page_table(__kernel_pdir, kmap_vaddr >> BIG_PAGE_SHIFT);
+   kmap_ptes = &pt->pages[(kmap_vaddr >> PAGE_SHIFT) & 1023];
+
    /*
     * Map a special vdso-like page used for the sysenter interface.
     * This is the only user-mapped page with a vaddr in the kernel space.
@@ -1272,6 +2350,42 @@ void hi_vmem_release(void *ptr, size_t size)
    enable_preemption();
 }
 
+void *kmap(ulong paddr)
+{
+   ulong va;
+
+   ASSERT(IS_PAGE_ALIGNED(paddr));
+   disable_preemption();
+
+   if (!is_highmem_paddr(paddr))
+      return KERNEL_PA_TO_VA(paddr);
+
+   if (UNLIKELY(kmap_depth == KMAP_SLOTS))
+      panic("kmap: no free slots");
+
+   va = kmap_vaddr + (kmap_depth << PAGE_SHIFT);
+   kmap_ptes[kmap_depth++].raw = PG_PRESENT_BIT | PG_RW_BIT | paddr;
+   invalidate_page_hw(va);
+   return (void *)va;
+}
+
+void kunmap(void *vaddr)
+{
+   const ulong va = (ulong)vaddr;
+
+   if (va >= kmap_vaddr && va < kmap_vaddr + KMAP_SLOTS * PAGE_SIZE) {
+
+      /* The slots are used as a stack */
+      ASSERT(kmap_depth > 0);
+      ASSERT(va == kmap_vaddr + ((kmap_depth - 1) << PAGE_SHIFT));
+
+      kmap_ptes[--kmap_depth].raw = 0;
+      invalidate_page_hw(va);
+   }
+
+   enable_preemption();
+}
+
 static int
 virtual_read_unsafe(pdir_t *pdir, void *extern_va, void *dest, size_t len)
 {
@@ -1289,8 +2403,9 @@ virtual_read_unsafe(pdir_t *pdir, void *extern_va, void *dest, size_t len)
       pgoff = ((ulong)extern_va) & OFFSET_IN_PAGE_MASK;
       to_read = MIN(PAGE_SIZE - pgoff, len - tot);
 
-      va = KERNEL_PA_TO_VA(pa);
-      memcpy(dest + tot, va, to_read);
+      va = kmap(pa & PAGE_MASK);
+      memcpy(dest + tot, va + pgoff, to_read);
+      kunmap(va);
    }
 
    return (int)tot;
@@ -1313,8 +2428,9 @@ virtual_write_unsafe(pdir_t *pdir, void *extern_va, void *src, size_t len)
       pgoff = ((ulong)extern_va) & OFFSET_IN_PAGE_MASK;
       to_write = MIN(PAGE_SIZE - pgoff, len - tot);
 
-      va = KERNEL_PA_TO_VA(pa);
-      memcpy(va, src + tot, to_write);
+      va = kmap(pa & PAGE_MASK);
+      memcpy(va + pgoff, src + tot, to_write);
+      kunmap(va);
    }
 
    return (int)tot;
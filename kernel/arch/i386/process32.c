@@ -517,6 +517,7 @@ int setup_process(struct elf_program_info *pinfo,
       pi = ti->pi;
 
       if (!pi->vforked) {
+         process_update_maxrss(pi);
          remove_all_user_zero_mem_mappings(pi);
          remove_all_file_mappings(pi);
          process_free_mappings_info(pi);
@@ -702,6 +703,7 @@ switch_to_task(struct task *ti)
    set_curr_task(ti);
    ti->timer_ready = false;
    set_kernel_stack((ulong)ti->state_regs);
+   TRACE_IRQS_ON(); /* context_switch() re-enables the interrupts */
    context_switch(state);
 }
 
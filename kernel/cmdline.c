@@ -139,6 +139,7 @@ ALL_KOPTS_BEGIN
    /*          name              ,alias, type, default            */
    DEFINE_KOPT(ttys              ,     , long, TTY_COUNT)
    DEFINE_KOPT(selftest          ,     , wordstr, NULL)
+   DEFINE_KOPT(trace_stream      ,     , wordstr, NULL)
 
    DEFINE_KOPT(sched_alive_thread, sat , bool, false)
    DEFINE_KOPT(sercon            ,     , bool, !MOD_console)
@@ -42,6 +42,7 @@ const char *months3[12] =
 };
 
 static s64 boot_timestamp;
+static u64 boot_tsc;
 static bool in_full_resync;
 
 #if KRN_CLOCK_DRIFT_COMP
@@ -419,6 +420,7 @@ void init_system_time(void)
       panic("Invalid boot-time UNIX timestamp: %d\n", boot_timestamp);
 
    __time_ns = 0;
+   boot_tsc = RDTSC();
 }
 
 u64 get_sys_time(void)
@@ -433,6 +435,12 @@ u64 get_sys_time(void)
    return ts;
 }
 
+ulong get_tsc_cycles_per_us(void)
+{
+   const u64 us = get_sys_time() / (TS_SCALE / MILLION);
+   return us ? (ulong)((RDTSC() - boot_tsc) / us) : 0;
+}
+
 s64 get_timestamp(void)
 {
    const u64 ts = get_sys_time();
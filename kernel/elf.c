@@ -5,6 +5,7 @@
 
 #include <tilck/common/string_util.h>
 #include <tilck/common/utils.h>
+#include <tilck/common/printk.h>
 
 #include <tilck/kernel/elf_loader.h>
 #include <tilck/kernel/paging.h>
@@ -16,6 +17,7 @@
 #include <tilck/kernel/elf_utils.h>
 #include <tilck/kernel/fault_resumable.h>
 #include <tilck/kernel/fs/flock.h>
+#include <tilck/kernel/exec_cache.h>
 
 #include <sys/mman.h>      // system header
 
@@ -206,7 +208,7 @@ load_segment_by_mmap(fs_handle *elf_h,
    um.prot = PROT_READ;
 
    *end_vaddr_ref = um.vaddr + um.len;
-   return vfs_mmap(&um, pdir, VFS_MM_DONT_REGISTER);
+   return vfs_mmap(&um, pdir, VFS_MM_DONT_REGISTER | VFS_MM_POPULATE);
 }
 
 struct elf_headers {
@@ -305,31 +307,32 @@ alloc_and_map_stack_page(pdir_t *pdir, void *stack_top, u32 i)
 }
 
 static int
-open_elf_file(const char *filepath, fs_handle *elf_file_ref)
+open_elf_file(const char *filepath,
+              fs_handle *elf_file_ref,
+              struct k_stat64 *statbuf)
 {
-   struct k_stat64 statbuf;
    fs_handle h;
    int rc;
 
    if ((rc = vfs_open(filepath, &h, O_RDONLY, 0)))
       return rc;           /* The file does not exist (typical case) */
 
-   if ((rc = vfs_fstat64(h, &statbuf))) {
+   if ((rc = vfs_fstat64(h, statbuf))) {
       vfs_close(h);
       return rc;           /* Cannot stat() the file */
    }
 
-   if ((statbuf.st_mode & S_IFREG) != S_IFREG) {
+   if ((statbuf->st_mode & S_IFREG) != S_IFREG) {
 
       vfs_close(h);
 
-      if ((statbuf.st_mode & S_IFDIR) == S_IFDIR)
+      if ((statbuf->st_mode & S_IFDIR) == S_IFDIR)
          return -EISDIR;   /* Cannot execute a directory! */
 
       return -EACCES;      /* Not a regular file */
    }
 
-   if ((statbuf.st_mode & S_IXUSR) != S_IXUSR) {
+   if ((statbuf->st_mode & S_IXUSR) != S_IXUSR) {
       vfs_close(h);
       return -EACCES;      /* Doesn't have exec permission */
    }
@@ -354,32 +357,192 @@ is_dyn_exec(struct elf_headers *eh)
    return false;
 }
 
+/* Map a segment loaded by copy in a previous execve() of the same file */
+static int
+map_cached_segment(pdir_t *pdir,
+                   Elf_Phdr *phdr,
+                   struct exec_image_seg *seg,
+                   ulong *end_vaddr_ref)
+{
+   const bool rw = !!(phdr->p_flags & PF_W);
+   char *vaddr = (char *) (phdr->p_vaddr & PAGE_MASK);
+   const size_t memsz = phdr->p_vaddr + phdr->p_memsz - (ulong)vaddr;
+   const size_t page_count = (memsz + PAGE_SIZE - 1) / PAGE_SIZE;
+   int rc;
+
+   *end_vaddr_ref = (ulong)vaddr + (page_count << PAGE_SHIFT);
+
+   for (u32 j = 0; j < page_count; j++, vaddr += PAGE_SIZE) {
+
+      if (j < seg->page_count) {
+
+         rc = map_page(pdir,
+                       vaddr,
+                       seg->paddrs[j],
+                       PAGING_FL_US | (rw ? PAGING_FL_COW : 0));
+
+      } else {
+
+         /* Past the file content: bss */
+         rc = map_zero_page(pdir, vaddr, PAGING_FL_US | (rw ? PAGING_FL_RW:0));
+      }
+
+      if (rc)
+         return rc;
+   }
+
+   return 0;
+}
+
+/*
+ * Take a reference on the pages with file content of a segment just loaded
+ * by copy. The writable pages become copy-on-write.
+ */
+static int
+retain_segment_pages(pdir_t *pdir, Elf_Phdr *phdr, struct exec_image_seg *seg)
+{
+   const ulong va = phdr->p_vaddr & PAGE_MASK;
+   const ulong file_end = phdr->p_vaddr + phdr->p_filesz;
+   const u32 n = (u32)((round_up_at(file_end, PAGE_SIZE) - va) >> PAGE_SHIFT);
+   int rc = 0;
+
+   seg->cached = true;
+
+   if (!phdr->p_filesz)
+      return 0;
+
+   if (!(seg->paddrs = kalloc_array_obj(ulong, n)))
+      return -ENOMEM;
+
+   disable_preemption();
+
+   for (u32 j = 0; j < n; j++) {
+
+      void *vaddr = (void *)(va + (j << PAGE_SHIFT));
+      ulong paddr;
+
+      if (phdr->p_flags & PF_W) {
+
+         if ((rc = retain_user_page_cow(pdir, vaddr, &paddr)))
+            break;
+
+      } else {
+
+         if ((rc = get_mapping2(pdir, vaddr, &paddr)))
+            break;
+
+         retain_pageframe(paddr);
+      }
+
+      seg->paddrs[seg->page_count++] = paddr;
+   }
+
+   enable_preemption();
+   return rc;
+}
+
+/* Save the image of a program just loaded in the exec cache */
+static void
+cache_exec_image(fs_handle elf_h,
+                 struct k_stat64 *st,
+                 const char *header_buf,
+                 struct elf_headers *eh,
+                 pdir_t *pdir,
+                 bool mmap_supported)
+{
+   struct fs_handle_base *hb = elf_h;
+   const u32 phnum = eh->header->e_phnum;
+   struct exec_image *img;
+   ulong prev_end = 0;
+
+   img = exec_image_alloc(hb->fs, hb->fs->fsops->get_inode(elf_h), st, phnum);
+
+   if (!img)
+      return;
+
+   if (!(img->phdrs = kalloc_array_obj(Elf_Phdr, phnum)))
+      goto fail;
+
+   memcpy(img->header, header_buf, ELF_RAW_HEADER_SIZE);
+   memcpy(img->phdrs, eh->phdrs, sizeof(Elf_Phdr) * phnum);
+
+   for (u32 i = 0; i < phnum; i++) {
+
+      Elf_Phdr *phdr = eh->phdrs + i;
+      const ulong va = phdr->p_vaddr & PAGE_MASK;
+
+      if (phdr->p_type != PT_LOAD || !phdr->p_memsz)
+         continue;
+
+      /* The segments sharing pages cannot be mapped separately */
+      if (va < prev_end)
+         goto fail;
+
+      prev_end = round_up_at(phdr->p_vaddr + phdr->p_memsz, PAGE_SIZE);
+
+      if (mmap_supported && !(phdr->p_flags & PF_W))
+         continue; /* Mapped from the file: nothing to cache */
+
+      if (retain_segment_pages(pdir, phdr, &img->segs[i]))
+         goto fail;
+
+      img->tot_pages += img->segs[i].page_count;
+   }
+
+   exec_cache_add(img);
+   return;
+
+fail:
+   exec_image_free(img);
+}
+
 int
 load_elf_program(const char *filepath,
                  char *header_buf,
                  struct elf_program_info *pinfo)
 {
    load_segment_func load_seg = NULL;
+   struct exec_image *img = NULL;
+   struct fs_handle_base *hb;
    fs_handle elf_h = NULL;
+   struct k_stat64 st;
    struct elf_headers eh;
+   bool mmap_supported;
    ulong brk = 0;
-   size_t count;
    int rc;
 
    pinfo->wrong_arch = false;
    pinfo->dyn_exec = false;
 
-   if ((rc = open_elf_file(filepath, &elf_h)))
+   if ((rc = open_elf_file(filepath, &elf_h, &st)))
       return rc;
 
+   hb = elf_h;
+
    if ((rc = acquire_subsys_flock_h(elf_h, SUBSYS_PROCMGNT, &pinfo->lf))) {
       vfs_close(elf_h);
       return rc == -EBADF ? -ENOEXEC : rc;
    }
 
-   if ((rc = load_elf_headers(elf_h, header_buf, &eh, &pinfo->wrong_arch))) {
-      vfs_close(elf_h);
-      return rc;
+   if ((img = exec_cache_get(hb->fs, hb->fs->fsops->get_inode(elf_h), &st))) {
+
+      /* Only the valid, static, executables get in the cache */
+      memcpy(header_buf, img->header, ELF_RAW_HEADER_SIZE);
+
+      eh = (struct elf_headers) {
+         .header_buf = header_buf,
+         .header = (void *)header_buf,
+         .phdrs = img->phdrs,            /* owned by the cache */
+      };
+
+   } else {
+
+      rc = load_elf_headers(elf_h, header_buf, &eh, &pinfo->wrong_arch);
+
+      if (rc) {
+         vfs_close(elf_h);
+         return rc;
+      }
    }
 
    if (is_dyn_exec(&eh)) {
@@ -388,7 +551,8 @@ load_elf_program(const char *filepath,
       goto out;
    }
 
-   load_seg = is_mmap_supported(elf_h)
+   mmap_supported = is_mmap_supported(elf_h);
+   load_seg = mmap_supported
       ? &load_segment_by_mmap
       : &load_segment_by_copy;
 
@@ -412,7 +576,10 @@ load_elf_program(const char *filepath,
       if (rc < 0)
          goto out;
 
-      rc = load_seg(elf_h, pinfo->pdir, phdr, &end_vaddr);
+      if (img && img->segs[i].cached)
+         rc = map_cached_segment(pinfo->pdir, phdr, img->segs + i, &end_vaddr);
+      else
+         rc = load_seg(elf_h, pinfo->pdir, phdr, &end_vaddr);
 
       if (rc < 0)
          goto out;
@@ -424,32 +591,23 @@ load_elf_program(const char *filepath,
    /*
     * Mapping the user stack.
     *
-    * In the "NOCOW" case, all the pages are pre-allocated.
-    * In the default case instead, most of the pages are zero-mapped and so,
-    * therefore, allocated on-demand. But, `USER_ARGS_PAGE_COUNT` pages are
-    * pre-allocated anyway.
+    * Only the top `USER_ARGS_PAGE_COUNT` pages, where execve() copies the
+    * arguments and the environment, are pre-allocated. The rest of the stack,
+    * down to USER_STACK_BOTTOM, is populated on-demand by the page fault
+    * handler as the stack grows: see handle_potential_lazy_page().
     */
 
-   const size_t pre_allocated_pages =
-      MMAP_NO_COW ? USER_STACK_PAGES : USER_ARGS_PAGE_COUNT;
-
-   const size_t zero_mapped_pages = USER_STACK_PAGES - pre_allocated_pages;
-   const ulong stack_top = (USERMODE_VADDR_END - USER_STACK_PAGES * PAGE_SIZE);
+   const ulong args_va =
+      USERMODE_VADDR_END - USER_ARGS_PAGE_COUNT * PAGE_SIZE;
 
-   count = map_zero_pages(pinfo->pdir,
-                          (void *)stack_top,
-                          zero_mapped_pages,
-                          PAGING_FL_US | PAGING_FL_RW);
-
-   if (count != zero_mapped_pages) {
-      unmap_pages(pinfo->pdir, (void *)stack_top, count, true);
-      rc = -ENOMEM;
-      goto out;
+   for (u32 i = 0; i < USER_ARGS_PAGE_COUNT; i++) {
+      if ((rc = alloc_and_map_stack_page(pinfo->pdir, (void *)args_va, i)))
+         goto out;
    }
 
-   for (u32 i = zero_mapped_pages; i < USER_STACK_PAGES; i++) {
-      if ((rc = alloc_and_map_stack_page(pinfo->pdir, (void *)stack_top, i)))
-         goto out;
+   if (!img && exec_cache_info.enabled) {
+      cache_exec_image(elf_h, &st, header_buf, &eh, pinfo->pdir,
+                       mmap_supported);
    }
 
 
@@ -463,6 +621,9 @@ out:
    vfs_close(elf_h);
    free_elf_headers(&eh);
 
+   if (img)
+      exec_cache_put(img);
+
    if (UNLIKELY(rc != 0)) {
 
       if (pinfo->pdir) {
@@ -607,6 +768,17 @@ find_sym_at_addr_safe(ulong vaddr, long *offset, u32 *sym_size)
    return sym_name;
 }
 
+int format_sym_at_addr(char *buf, size_t buf_size, ulong vaddr)
+{
+   const char *name;
+   long off;
+
+   if (!(name = find_sym_at_addr(vaddr, &off, NULL)))
+      return snprintk(buf, buf_size, "%p", TO_PTR(vaddr));
+
+   return snprintk(buf, buf_size, "%s+%ld", name, off);
+}
+
 static Elf_Shdr *kernel_elf_get_section(const char *section_name)
 {
    Elf_Ehdr *h = (Elf_Ehdr*)(KERNEL_PA_TO_VA(KERNEL_PADDR));
@@ -0,0 +1,238 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/exec_cache.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/paging.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/shrinker.h>
+
+#define EXEC_CACHE_MAX_ENTRIES                 16
+
+struct exec_cache_info exec_cache_info = {
+   .enabled = true,
+};
+
+/* The most recently used images first */
+static struct list exec_cache_list = STATIC_LIST_INIT(exec_cache_list);
+
+struct exec_image *
+exec_image_alloc(struct mnt_fs *fs,
+                 vfs_inode_ptr_t inode,
+                 struct k_stat64 *st,
+                 u32 phnum)
+{
+   struct exec_image *img;
+
+   if (!(img = kzalloc_obj(struct exec_image)))
+      return NULL;
+
+   if (!(img->segs = kzalloc_array_obj(struct exec_image_seg, phnum))) {
+      kfree_obj(img, struct exec_image);
+      return NULL;
+   }
+
+   list_node_init(&img->node);
+   img->fs = fs;
+   img->inode = inode;
+   img->ino = st->st_ino;
+   img->size = st->st_size;
+   img->mtime_sec = st->st_mtim.tv_sec;
+   img->mtime_nsec = st->st_mtim.tv_nsec;
+   img->phnum = phnum;
+   return img;
+}
+
+void exec_image_free(struct exec_image *img)
+{
+   struct exec_image_seg *seg;
+
+   for (u32 i = 0; i < img->phnum; i++) {
+
+      seg = &img->segs[i];
+
+      for (u32 j = 0; j < seg->page_count; j++)
+         release_pageframe(seg->paddrs[j]);
+
+      if (seg->paddrs)
+         kfree(seg->paddrs); /* page_count might be less than its size */
+   }
+
+   if (img->phdrs)
+      kfree_array_obj(img->phdrs, Elf_Phdr, img->phnum);
+
+   kfree_array_obj(img->segs, struct exec_image_seg, img->phnum);
+   kfree_obj(img, struct exec_image);
+}
+
+/* Returns true if the image has been freed as well */
+static bool exec_cache_remove(struct exec_image *img)
+{
+   ASSERT(!is_preemption_enabled());
+
+   list_remove(&img->node);
+   exec_cache_info.entries--;
+   exec_cache_info.pages -= img->tot_pages;
+
+   if (release_obj(img) == 0) {
+      exec_image_free(img);
+      return true;
+   }
+
+   return false;
+}
+
+static struct exec_image *
+exec_cache_find(struct mnt_fs *fs, vfs_inode_ptr_t inode)
+{
+   struct exec_image *img;
+
+   list_for_each_ro(img, &exec_cache_list, node) {
+      if (img->fs == fs && img->inode == inode)
+         return img;
+   }
+
+   return NULL;
+}
+
+struct exec_image *
+exec_cache_get(struct mnt_fs *fs, vfs_inode_ptr_t inode, struct k_stat64 *st)
+{
+   struct exec_image *img;
+
+   disable_preemption();
+
+   if (!(img = exec_cache_find(fs, inode)))
+      goto out;
+
+   /* The inode might have been destroyed and its memory reused */
+   if (img->ino != st->st_ino ||
+       img->size != st->st_size ||
+       img->mtime_sec != st->st_mtim.tv_sec ||
+       img->mtime_nsec != st->st_mtim.tv_nsec)
+   {
+      exec_cache_remove(img);
+      img = NULL;
+      goto out;
+   }
+
+   list_remove(&img->node);
+   list_add_head(&exec_cache_list, &img->node);
+   retain_obj(img);
+
+out:
+   if (img)
+      exec_cache_info.hits++;
+   else
+      exec_cache_info.misses++;
+
+   enable_preemption();
+   return img;
+}
+
+void exec_cache_put(struct exec_image *img)
+{
+   disable_preemption();
+   {
+      if (release_obj(img) == 0)
+         exec_image_free(img);
+   }
+   enable_preemption();
+}
+
+void exec_cache_add(struct exec_image *img)
+{
+   struct exec_image *old;
+
+   disable_preemption();
+
+   if (!exec_cache_info.enabled) {
+      exec_image_free(img);
+      goto out;
+   }
+
+   /* Another task might have added the same image in the meanwhile */
+   if ((old = exec_cache_find(img->fs, img->inode)))
+      exec_cache_remove(old);
+
+   if (exec_cache_info.entries == EXEC_CACHE_MAX_ENTRIES) {
+      old = list_last_obj(&exec_cache_list, struct exec_image, node);
+      exec_cache_remove(old);
+   }
+
+   retain_obj(img);
+   list_add_head(&exec_cache_list, &img->node);
+   exec_cache_info.entries++;
+   exec_cache_info.pages += img->tot_pages;
+
+out:
+   enable_preemption();
+}
+
+void exec_cache_invalidate(struct mnt_fs *fs, vfs_inode_ptr_t inode)
+{
+   struct exec_image *img;
+
+   disable_preemption();
+   {
+      if ((img = exec_cache_find(fs, inode))) {
+         exec_cache_remove(img);
+         exec_cache_info.invalidations++;
+      }
+   }
+   enable_preemption();
+}
+
+void exec_cache_flush(void)
+{
+   disable_preemption();
+   {
+      while (!list_is_empty(&exec_cache_list))
+         exec_cache_remove(list_first_obj(&exec_cache_list,
+                                          struct exec_image,
+                                          node));
+   }
+   enable_preemption();
+}
+
+/* Drop the least recently used images: only their unshared pages are freed */
+static size_t exec_cache_shrink(size_t bytes)
+{
+   struct exec_image *img;
+   struct exec_image_seg *seg;
+   size_t freed = 0, img_bytes;
+
+   while (freed < bytes && !list_is_empty(&exec_cache_list)) {
+
+      img = list_last_obj(&exec_cache_list, struct exec_image, node);
+      img_bytes = 0;
+
+      for (u32 i = 0; i < img->phnum; i++) {
+
+         seg = &img->segs[i];
+
+         for (u32 j = 0; j < seg->page_count; j++) {
+            if (get_pageframe_ref_count(seg->paddrs[j]) == 1)
+               img_bytes += PAGE_SIZE;
+         }
+      }
+
+      /* When an execve() is still using it, it will be freed later */
+      if (exec_cache_remove(img))
+         freed += img_bytes;
+   }
+
+   return freed;
+}
+
+static struct shrinker exec_cache_shrinker = {
+   .name = "exec_cache",
+   .scan = &exec_cache_shrink,
+};
+
+void init_exec_cache(void)
+{
+   register_shrinker(&exec_cache_shrinker);
+}
@@ -266,6 +266,7 @@ void terminate_process(int exit_code, int term_sig)
 
    call_on_task_exit_callbacks();
    task_free_all_kernel_allocs(ti);
+   process_update_maxrss(pi);
 
    if (!vforked) {
 
@@ -309,7 +310,7 @@ void terminate_process(int exit_code, int term_sig)
       handle_vforked_child_move_on(pi);
       pi->vforked = true; /* handle_vforked_child_move_on() unsets this */
 
-      if (!pi->inherited_mmap_heap) {
+      if (!pi->inherited_mi) {
 
          /* We're in a vfork-ed child: the parent cannot die */
          ASSERT(parent != NULL);
@@ -68,6 +68,11 @@ int do_fork(bool vfork)
    disable_preemption();
    ASSERT_TASK_STATE(curr->state, TASK_STATE_RUNNING);
 
+   if (!curr_pi->children_ru) {
+      if (!(curr_pi->children_ru = kzalloc_obj(struct children_rusage)))
+         goto oom_case;
+   }
+
    if ((pid = create_new_pid()) < 0)
       goto out; /* NOTE: rc is already set to -EAGAIN */
 
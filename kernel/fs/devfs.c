@@ -151,6 +151,31 @@ create_dev_file(const char *filename, u16 major, u16 minor, void **devfile)
    return 0;
 }
 
+/*
+ * Create an empty directory in devfs, for the only purpose of mounting there
+ * another filesystem (e.g. /dev/shm). Nothing can be created inside it.
+ */
+int
+create_dev_mountpoint(const char *dirname)
+{
+   struct devfs_data *d;
+   struct devfs_file *f;
+
+   ASSERT(devfs != NULL);
+
+   if (!(f = kzalloc_obj(struct devfs_file)))
+      return -ENOMEM;
+
+   d = devfs->device_data;
+
+   f->type = VFS_DIR;
+   f->inode = devfs_get_next_inode(d);
+   f->name = dirname;
+   list_node_init(&f->dir_node);
+   list_add_tail(&d->root_dir.files_list, &f->dir_node);
+   return 0;
+}
+
 static ssize_t
 devfs_dir_read(fs_handle h, char *buf, size_t len, offt *pos)
 {
@@ -210,9 +235,10 @@ devfs_stat(struct mnt_fs *fs, vfs_inode_ptr_t i, struct k_stat64 *statbuf)
    switch (df->type) {
 
       case VFS_DIR:
-         ASSERT(i == &ddata->root_dir);
          statbuf->st_mode = 0555 | S_IFDIR;
-         statbuf->st_ino = ddata->root_dir.inode;
+         statbuf->st_ino = i == &ddata->root_dir
+            ? ddata->root_dir.inode
+            : df->inode;        /* a mountpoint, see create_dev_mountpoint() */
          break;
 
       case VFS_CHAR_DEV:
@@ -422,6 +448,9 @@ devfs_get_entry(struct mnt_fs *fs,
    dir = dir_inode;
    bzero(fs_path, sizeof(*fs_path));
 
+   if (dir != &d->root_dir)
+      return; /* mountpoint directories are always empty */
+
    list_for_each_ro(pos, &dir->files_list, dir_node) {
       if (!strncmp(pos->name, name, (size_t)nl))
          if (!pos->name[nl])
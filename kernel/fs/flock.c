@@ -6,6 +6,7 @@
 #include <tilck/kernel/errno.h>
 #include <tilck/kernel/kmalloc.h>
 #include <tilck/kernel/bintree.h>
+#include <tilck/kernel/exec_cache.h>
 
 struct locked_file {
 
@@ -27,6 +28,13 @@ acquire_subsys_flock(struct mnt_fs *fs,
    struct locked_file *lf;
    int rc;
 
+   /*
+    * The VFS takes the lock to write or truncate the file: if that's a program
+    * which has been executed, its cached image is going to become stale.
+    */
+   if (subsys == SUBSYS_VFS)
+      exec_cache_invalidate(fs, i);
+
    disable_preemption();
    {
       lf = bintree_find_ptr(fs->pss_lock_root,
@@ -6,14 +6,21 @@
 #include <tilck/kernel/hal.h>
 #include <tilck/kernel/fs/vfs.h>
 #include <tilck/kernel/fs/kernelfs.h>
+#include <tilck/kernel/fs/shmfs.h>
 #include <tilck/kernel/errno.h>
 #include <tilck/kernel/user.h>
 #include <tilck/kernel/fault_resumable.h>
 #include <tilck/kernel/syscalls.h>
 #include <tilck/kernel/pipe.h>
+#include <tilck/kernel/io_uring.h>
 
 #include <fcntl.h>      // system header
 
+#ifndef F_SETPIPE_SZ
+   #define F_SETPIPE_SZ          1031
+   #define F_GETPIPE_SZ          1032
+#endif
+
 static inline bool is_fd_in_valid_range(int fd)
 {
    return IN_RANGE(fd, 0, MAX_HANDLES);
@@ -213,6 +220,9 @@ int sys_read(int fd, void *u_buf, size_t count)
       }
    }
 
+   if (ret > 0)
+      curr->rusage.rchar += (u64)ret;
+
    return ret;
 }
 
@@ -241,6 +251,9 @@ int sys_write(int fd, const void *u_buf, size_t count)
          ret = -EFAULT;
    }
 
+   if (ret > 0)
+      curr->rusage.wchar += (u64)ret;
+
    return ret;
 }
 
@@ -275,6 +288,9 @@ int sys_pread64(int fd, void *u_buf, size_t count, s64 off)
       }
    }
 
+   if (ret > 0)
+      curr->rusage.rchar += (u64)ret;
+
    return ret;
 }
 
@@ -306,6 +322,9 @@ int sys_pwrite64(int fd, const void *u_buf, size_t count, s64 off)
          ret = -EFAULT;
    }
 
+   if (ret > 0)
+      curr->rusage.wchar += (u64)ret;
+
    return ret;
 }
 
@@ -340,6 +359,7 @@ int sys_writev(int fd, const struct iovec *u_iov, int u_iovcnt)
    struct iovec *iov = (void *)curr->args_copybuf;
    const u32 iovcnt = (u32) u_iovcnt;
    fs_handle handle;
+   int ret;
 
    if (u_iovcnt <= 0)
       return -EINVAL;
@@ -356,7 +376,10 @@ int sys_writev(int fd, const struct iovec *u_iov, int u_iovcnt)
    if (!(handle = get_fs_handle(fd)))
       return -EBADF;
 
-   return (int)vfs_writev(handle, iov, u_iovcnt);
+   if ((ret = (int)vfs_writev(handle, iov, u_iovcnt)) > 0)
+      curr->rusage.wchar += (u64)ret;
+
+   return ret;
 }
 
 int sys_readv(int fd, const struct iovec *u_iov, int u_iovcnt)
@@ -365,6 +388,7 @@ int sys_readv(int fd, const struct iovec *u_iov, int u_iovcnt)
    struct iovec *iov = (void *)curr->args_copybuf;
    const u32 iovcnt = (u32) u_iovcnt;
    fs_handle handle;
+   int ret;
 
    if (u_iovcnt <= 0)
       return -EINVAL;
@@ -381,7 +405,42 @@ int sys_readv(int fd, const struct iovec *u_iov, int u_iovcnt)
    if (!(handle = get_fs_handle(fd)))
       return -EBADF;
 
-   return (int)vfs_readv(handle, iov, u_iovcnt);
+   if ((ret = (int)vfs_readv(handle, iov, u_iovcnt)) > 0)
+      curr->rusage.rchar += (u64)ret;
+
+   return ret;
+}
+
+int sys_vmsplice(int fd, const struct iovec *u_iov, ulong nr_segs, u32 flags)
+{
+   struct task *curr = get_curr_task();
+   struct iovec *iov = (void *)curr->args_copybuf;
+   struct fs_handle_base *hb;
+
+   if (!nr_segs)
+      return 0;
+
+   if (sizeof(struct iovec) * nr_segs > ARGS_COPYBUF_SIZE)
+      return -EINVAL;
+
+   if (copy_from_user(iov, u_iov, sizeof(struct iovec) * nr_segs))
+      return -EFAULT;
+
+   if (iov_len_overflow(iov, (int)nr_segs))
+      return -EINVAL;
+
+   if (!(hb = get_fs_handle(fd)))
+      return -EBADF;
+
+   /*
+    * Only splicing user pages into the write side of a pipe is supported.
+    * With SPLICE_F_GIFT, whole and page-aligned pages get moved into the pipe
+    * without copying their contents (they become CoW for the caller).
+    */
+   if (!is_pipe_handle(hb) || !(hb->fl_flags & O_WRONLY))
+      return -EBADF;
+
+   return (int)pipe_vmsplice(hb, iov, (u32)nr_segs, flags);
 }
 
 static int
@@ -792,6 +851,23 @@ int sys_fcntl64(int fd, int cmd, int arg)
       case F_GETFL:
          return hb->fl_flags;
 
+      case F_SETPIPE_SZ:
+
+         if (!is_pipe_handle(hb))
+            return -EBADF;
+
+         if (arg < 0)
+            return -EINVAL;
+
+         return pipe_set_size(hb, (size_t)arg);
+
+      case F_GETPIPE_SZ:
+
+         if (!is_pipe_handle(hb))
+            return -EBADF;
+
+         return pipe_get_size(hb);
+
       default:
          printk("fcntl64: Ignored unknown cmd %d\n", cmd);
    }
@@ -1047,3 +1123,120 @@ no_fds:
    ret = -EMFILE;
    goto err_end;
 }
+
+#ifndef MFD_CLOEXEC
+   #define MFD_CLOEXEC            0x0001U
+   #define MFD_ALLOW_SEALING      0x0002U
+#endif
+
+int sys_memfd_create(const char *u_name, u32 flags)
+{
+   struct task *curr = get_curr_task();
+   char *name = curr->args_copybuf;
+   struct fs_handle_base *h = NULL;
+   int rc, fd;
+
+   STATIC_ASSERT(ARGS_COPYBUF_SIZE >= SHMFS_NAME_MAX + 1);
+
+   /*
+    * File sealing is not supported: accept MFD_ALLOW_SEALING anyway, as the
+    * only effect of a missing seal is a less protected buffer.
+    */
+   if (flags & ~(MFD_CLOEXEC | MFD_ALLOW_SEALING))
+      return -EINVAL;
+
+   rc = copy_str_from_user(name, u_name, SHMFS_NAME_MAX + 1, NULL);
+
+   if (rc < 0)
+      return -EFAULT;
+
+   if (rc > 0)
+      return -EINVAL; /* name too long */
+
+   kmutex_lock(&curr->pi->fslock);
+
+   if ((fd = get_free_handle_num(curr->pi)) < 0) {
+      rc = -EMFILE;
+      goto out;
+   }
+
+   if ((rc = shmfs_create_unlinked(name, (fs_handle *)&h)))
+      goto out;
+
+   if (flags & MFD_CLOEXEC)
+      h->fd_flags |= FD_CLOEXEC;
+
+   curr->pi->handles[fd] = h;
+   rc = fd;
+
+out:
+   kmutex_unlock(&curr->pi->fslock);
+   return rc;
+}
+
+int sys_io_uring_setup(u32 entries, struct io_uring_params *u_params)
+{
+   struct task *curr = get_curr_task();
+   struct fs_handle_base *h = NULL;
+   struct io_uring_params params;
+   int rc, fd;
+
+   if (copy_from_user(&params, u_params, sizeof(params)))
+      return -EFAULT;
+
+   kmutex_lock(&curr->pi->fslock);
+
+   if ((fd = get_free_handle_num(curr->pi)) < 0) {
+      rc = -EMFILE;
+      goto out;
+   }
+
+   if ((rc = io_uring_create(entries, &params, (fs_handle *)&h)))
+      goto out;
+
+   if (copy_to_user(u_params, &params, sizeof(params))) {
+      vfs_close(h);
+      rc = -EFAULT;
+      goto out;
+   }
+
+   /* Like on Linux, io_uring file descriptors are always close-on-exec */
+   h->fd_flags |= FD_CLOEXEC;
+   curr->pi->handles[fd] = h;
+   rc = fd;
+
+out:
+   kmutex_unlock(&curr->pi->fslock);
+   return rc;
+}
+
+int sys_io_uring_enter(int fd, u32 to_submit, u32 min_complete,
+                       u32 flags, const void *u_sig, size_t sigsz)
+{
+   fs_handle h;
+
+   if (!(h = get_fs_handle(fd)))
+      return -EBADF;
+
+   if (!is_io_uring_handle(h))
+      return -EOPNOTSUPP;
+
+   if (u_sig)
+      return -EINVAL; /* Temporary signal masks are not supported */
+
+   return io_uring_enter(h, to_submit, min_complete, flags);
+}
+
+int sys_io_uring_register(int fd, u32 opcode, void *u_arg, u32 nr_args)
+{
+   fs_handle h;
+
+   if (!(h = get_fs_handle(fd)))
+      return -EBADF;
+
+   if (!is_io_uring_handle(h))
+      return -EOPNOTSUPP;
+
+   /* Registered buffers, files, eventfds etc. are not supported */
+   return -EINVAL;
+}
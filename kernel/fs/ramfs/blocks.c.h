@@ -9,27 +9,40 @@ static struct ramfs_block *ramfs_new_block(offt page)
       return NULL;
 
    /* Allocate block's data */
-   if (!(b->vaddr = kzmalloc(PAGE_SIZE))) {
+   if ((b->paddr = pageframe_alloc(true)) == INVALID_PADDR) {
       kfree_obj(b, struct ramfs_block);
       return NULL;
    }
 
    /* Retain the pageframe used by this block */
-   retain_pageframes_mapped_at(get_kernel_pdir(), b->vaddr, PAGE_SIZE);
+   retain_pageframe(b->paddr);
 
    /* Init the block object */
    bintree_node_init(&b->node);
    b->offset = page;
+   b->cdata = NULL;
+   ramfs_block_touch(b);
    return b;
 }
 
-static void ramfs_destroy_block(struct ramfs_block *b)
+static void ramfs_destroy_block(struct ramfs_data *d, struct ramfs_block *b)
 {
-   /* Release the pageframe used by this block */
-   release_pageframes_mapped_at(get_kernel_pdir(), b->vaddr, PAGE_SIZE);
+   if (b->cdata) {
 
-   /* Free the memory pointed by this block */
-   kfree2(b->vaddr, PAGE_SIZE);
+      disable_preemption();
+      {
+         ramfs_block_free_cdata(d, b);
+      }
+      enable_preemption();
+
+   } else {
+
+      /*
+       * Release the pageframe used by this block: that frees it, as all the
+       * user mappings of the block are already gone.
+       */
+      release_pageframe(b->paddr);
+   }
 
    /* Free the memory used by the block object itself */
    kfree_obj(b, struct ramfs_block);
@@ -0,0 +1,319 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/*
+ * Compression of the cold file blocks (see struct ramfs_compr_info).
+ *
+ * A compressed block has no pageframe: its LZ4-compressed content lives in a
+ * kmalloc() buffer instead, and only the blocks compressing to at most half of
+ * their size are kept that way. The worker thread scans the files of each
+ * ramfs instance in passes of at most RAMFS_COMPR_BATCH blocks, holding the
+ * instance's lock in shared mode and each inode's lock in exclusive mode:
+ * that's enough to exclude read(), write() and the creation and destruction
+ * of the inodes. The fault handler doesn't take locks but it runs with the
+ * preemption disabled and it might add blocks: the same is done by the walk
+ * of the blocks of an inode and by the decompression of the single blocks.
+ */
+
+#define RAMFS_COMPR_SCAN_MS                1000
+#define RAMFS_COMPR_BATCH                    64
+#define RAMFS_COMPR_MAX_SIZE      (PAGE_SIZE / 2)
+
+/* On memory pressure, the blocks older than this are compressed as well */
+#define RAMFS_SHRINK_AGE_MS                1000
+
+/* The instances passed to ramfs_compr_update() */
+static struct list ramfs_compr_list = STATIC_LIST_INIT(ramfs_compr_list);
+static struct worker_thread *ramfs_wth;
+static bool ramfs_compr_running;
+
+/*
+ * Shared by the worker thread and by the shrinker (ramfs_shrink()), running
+ * in the reclaim thread: that's safe only because ramfs_block_compress(), the
+ * only user of both the buffers, always runs with preemption disabled.
+ */
+static u8 ramfs_compr_buf[RAMFS_COMPR_MAX_SIZE];
+static u16 ramfs_lz4_wrkmem[LZ4_WRKMEM_SIZE / 2];
+
+static ALWAYS_INLINE void ramfs_block_touch(struct ramfs_block *b)
+{
+   b->atime = (u32)get_ticks();
+}
+
+static void ramfs_block_free_cdata(struct ramfs_data *d, struct ramfs_block *b)
+{
+   ASSERT(!is_preemption_enabled());
+
+   kfree2(b->cdata, b->csize);
+   d->compr.compr_pages--;
+   d->compr.bytes_saved -= PAGE_SIZE - b->csize;
+   b->cdata = NULL;
+}
+
+/*
+ * Give back a pageframe to a compressed block. When no pageframe is free, it
+ * runs the direct reclaim and retries once. Returns -ENOMEM on failure,
+ * leaving the block compressed.
+ */
+static int ramfs_block_decompress(struct ramfs_data *d, struct ramfs_block *b)
+{
+   ulong paddr = INVALID_PADDR;
+   void *va;
+   long rc;
+
+   disable_preemption();
+
+   if (!b->cdata)
+      goto out; /* Not compressed or decompressed by another reader */
+
+   if ((paddr = pageframe_alloc(false)) == INVALID_PADDR) {
+
+      if (!shrink_memory(PAGE_SIZE))
+         goto out;
+
+      if ((paddr = pageframe_alloc(false)) == INVALID_PADDR)
+         goto out;
+   }
+
+   va = kmap(paddr);
+   rc = lz4_decompress(b->cdata, b->clen, va, PAGE_SIZE);
+   kunmap(va);
+
+   VERIFY(rc == PAGE_SIZE);
+   retain_pageframe(paddr);
+
+   ramfs_block_free_cdata(d, b);
+   b->paddr = paddr;
+   d->compr.decompressions++;
+
+out:
+   enable_preemption();
+   return b->cdata ? -ENOMEM : 0;
+}
+
+/* Returns true if the block has been compressed */
+static bool ramfs_block_compress(struct ramfs_data *d, struct ramfs_block *b)
+{
+   size_t len, size;
+   void *va, *cdata;
+
+   ASSERT(!is_preemption_enabled());
+
+   va = kmap(b->paddr);
+   len = lz4_compress(va, PAGE_SIZE,
+                      ramfs_compr_buf, sizeof(ramfs_compr_buf),
+                      ramfs_lz4_wrkmem);
+   kunmap(va);
+
+   if (!len)
+      return false;
+
+   size = len;
+
+   if (!(cdata = general_kmalloc(&size, 0)))
+      return false;
+
+   memcpy(cdata, ramfs_compr_buf, len);
+   release_pageframe(b->paddr);
+
+   b->paddr = INVALID_PADDR;
+   b->cdata = cdata;
+   b->clen = (u16)len;
+   b->csize = (u16)size;
+
+   d->compr.compr_pages++;
+   d->compr.bytes_saved += PAGE_SIZE - size;
+   d->compr.compressions++;
+   return true;
+}
+
+/* Returns the number of blocks the compression has been attempted on */
+static u32
+ramfs_inode_compress_cold_blocks(struct ramfs_inode *i, u32 age, u32 max)
+{
+   struct bintree_walk_ctx ctx;
+   struct ramfs_block *b;
+   u32 now, count = 0;
+
+   ASSERT(rwlock_wp_holding_exlock(&i->rwlock));
+   disable_preemption();
+
+   bintree_in_order_visit_start(&ctx,
+                                i->blocks_tree_root,
+                                struct ramfs_block,
+                                node,
+                                false);
+
+   while (count < max && (b = bintree_in_order_visit_next(&ctx))) {
+
+      now = (u32)get_ticks();
+
+      if (b->cdata || now - b->atime < age)
+         continue;
+
+      if (get_pageframe_ref_count(b->paddr) > 1) {
+
+         /* Mapped in memory: it's pinned and, likely, in use */
+         b->atime = now;
+         continue;
+      }
+
+      /* If not compressible, retry only after another `age` ticks */
+      if (!ramfs_block_compress(i->fs_data, b))
+         b->atime = now;
+
+      count++;
+   }
+
+   enable_preemption();
+   return count;
+}
+
+/* Returns true when the pass stopped because of the batch limit */
+static bool ramfs_compr_pass(struct ramfs_data *d, ulong age_ms)
+{
+   const u32 age = (u32)MAX(ms_to_ticks(age_ms), 1u);
+   struct ramfs_inode *i;
+   u32 count = 0;
+
+   rwlock_wp_shlock(&d->rwlock);
+   {
+      list_for_each_ro(i, &d->files_list, files_node) {
+
+         rwlock_wp_exlock(&i->rwlock);
+         {
+            count += ramfs_inode_compress_cold_blocks(i,
+                                                      age,
+                                                      RAMFS_COMPR_BATCH-count);
+         }
+         rwlock_wp_exunlock(&i->rwlock);
+
+         if (count == RAMFS_COMPR_BATCH)
+            break;
+      }
+   }
+   rwlock_wp_shunlock(&d->rwlock);
+   return count == RAMFS_COMPR_BATCH;
+}
+
+static bool ramfs_compr_any_active(void)
+{
+   struct ramfs_data *d;
+
+   list_for_each_ro(d, &ramfs_compr_list, compr_node) {
+      if (d->compr.age_ms)
+         return true;
+   }
+
+   return false;
+}
+
+static void ramfs_compr_job(void *unused)
+{
+   struct ramfs_data *d;
+
+   while (true) {
+
+      disable_preemption();
+      {
+         if (!ramfs_compr_any_active()) {
+            ramfs_compr_running = false;
+            enable_preemption();
+            break;
+         }
+      }
+      enable_preemption();
+
+      list_for_each_ro(d, &ramfs_compr_list, compr_node) {
+
+         /* Release the locks between the passes: open() needs them */
+         while (d->compr.age_ms && ramfs_compr_pass(d, d->compr.age_ms))
+            kernel_yield();
+      }
+
+      kernel_sleep_ms(RAMFS_COMPR_SCAN_MS);
+   }
+}
+
+/*
+ * Shrinker: compress the blocks not accessed in the last RAMFS_SHRINK_AGE_MS,
+ * also in the instances with the compression disabled. It takes the locks,
+ * so it runs only in the background reclaim.
+ */
+static size_t ramfs_shrink(size_t bytes)
+{
+   struct ramfs_data *d;
+   size_t saved = 0;
+   ulong before;
+   bool more;
+
+   list_for_each_ro(d, &ramfs_compr_list, compr_node) {
+
+      do {
+
+         before = d->compr.bytes_saved;
+         more = ramfs_compr_pass(d, RAMFS_SHRINK_AGE_MS);
+
+         /* Concurrent decompressions might have reduced bytes_saved */
+         if (d->compr.bytes_saved > before)
+            saved += d->compr.bytes_saved - before;
+
+      } while (more && saved < bytes);
+
+      if (saved >= bytes)
+         break;
+   }
+
+   return saved;
+}
+
+static struct shrinker ramfs_shrinker = {
+   .name = "ramfs",
+   .scan = &ramfs_shrink,
+   .may_sleep = true,
+};
+
+struct ramfs_compr_info *ramfs_get_compr_info(struct mnt_fs *fs)
+{
+   struct ramfs_data *d = fs->device_data;
+   ASSERT(!strcmp(fs->fs_type_name, "ramfs"));
+   return &d->compr;
+}
+
+int ramfs_compr_update(struct mnt_fs *fs)
+{
+   struct ramfs_data *d = fs->device_data;
+   bool start = false;
+   int rc = 0;
+
+   if (!list_is_node_in_list(&ramfs_shrinker.node))
+      register_shrinker(&ramfs_shrinker);
+
+   disable_preemption();
+   {
+      if (!list_is_node_in_list(&d->compr_node))
+         list_add_tail(&ramfs_compr_list, &d->compr_node);
+
+      if (!ramfs_compr_running && ramfs_compr_any_active()) {
+
+         /* Created on first use, with the lowest priority */
+         if (!ramfs_wth) {
+            ramfs_wth = wth_create_thread("ramfs",
+                                          WTH_PRIO_LOWEST,
+                                          WTH_RAMFS_QUEUE_SIZE);
+         }
+
+         if (ramfs_wth)
+            ramfs_compr_running = start = true;
+         else
+            rc = -ENOMEM;
+      }
+   }
+   enable_preemption();
+
+   if (start && !wth_enqueue_on(ramfs_wth, &ramfs_compr_job, NULL)) {
+      ramfs_compr_running = false;
+      rc = -ENOMEM;
+   }
+
+   return rc;
+}
@@ -75,6 +75,8 @@ ramfs_create_inode_file(struct ramfs_data *d,
 
    i->type = VFS_FILE;
    i->mode = (mode & 0777) | S_IFREG;
+   i->fs_data = d;
+   list_add_tail(&d->files_list, &i->files_node);
 
    i->parent_dir = parent;
    real_time_get_timespec(&i->ctime);
@@ -100,6 +102,7 @@ static int ramfs_destroy_inode(struct ramfs_data *d, struct ramfs_inode *i)
 
       case VFS_FILE:
          ASSERT(i->blocks_tree_root == NULL);
+         list_remove(&i->files_node);
          break;
 
       case VFS_DIR:
@@ -10,9 +10,9 @@ ramfs_mmap(struct user_mapping *um, pdir_t *pdir, int flags)
 {
    struct ramfs_handle *rh = um->h;
    struct ramfs_inode *i = rh->inode;
-   ulong vaddr = um->vaddr;
    struct bintree_walk_ctx ctx;
    struct ramfs_block *b;
+   ulong vaddr;
    u32 pg_flags;
    int rc;
 
@@ -27,6 +27,14 @@ ramfs_mmap(struct user_mapping *um, pdir_t *pdir, int flags)
    if (flags & VFS_MM_DONT_MMAP)
       goto register_mapping;
 
+   /*
+    * Unless explicitly asked to populate the mapping, map nothing here: the
+    * pages will be mapped on the first access by ramfs_handle_fault(), along
+    * with their resident neighbours.
+    */
+   if (!(flags & VFS_MM_POPULATE))
+      goto register_mapping;
+
    bintree_in_order_visit_start(&ctx,
                                 i->blocks_tree_root,
                                 struct ramfs_block,
@@ -35,7 +43,7 @@ ramfs_mmap(struct user_mapping *um, pdir_t *pdir, int flags)
 
    pg_flags = PAGING_FL_US | PAGING_FL_SHARED;
 
-   if ((rh->fl_flags & O_RDWR) == O_RDWR)
+   if (um->prot & PROT_WRITE)
       pg_flags |= PAGING_FL_RW;
 
    while ((b = bintree_in_order_visit_next(&ctx))) {
@@ -46,24 +54,35 @@ ramfs_mmap(struct user_mapping *um, pdir_t *pdir, int flags)
       if ((size_t)b->offset >= off_end)
          break;
 
-      rc = map_page(pdir,
-                    (void *)vaddr,
-                    KERNEL_VA_TO_PA(b->vaddr),
-                    pg_flags);
+      /*
+       * Holes are left un-mapped and the pages already mapped (the mapping
+       * might be populated again by madvise(MADV_WILLNEED)) are skipped.
+       */
+      vaddr = um->vaddr + ((size_t)b->offset - off_begin);
+
+      if (is_mapped(pdir, (void *)vaddr))
+         continue;
+
+      /* Once mapped, the block cannot be compressed again */
+      disable_preemption();
+      {
+         rc = b->cdata ? ramfs_block_decompress(i->fs_data, b) : 0;
+
+         if (!rc) {
+            ramfs_block_touch(b);
+            rc = map_page(pdir, (void *)vaddr, b->paddr, pg_flags);
+         }
+      }
+      enable_preemption();
 
       if (rc) {
 
          /* mmap failed, we have to unmap the pages already mapped */
-         vaddr -= PAGE_SIZE;
-
-         for (; vaddr >= um->vaddr; vaddr -= PAGE_SIZE) {
+         for (vaddr -= PAGE_SIZE; vaddr >= um->vaddr; vaddr -= PAGE_SIZE)
             unmap_page_permissive(pdir, (void *)vaddr, false);
-         }
 
          return rc;
       }
-
-      vaddr += PAGE_SIZE;
    }
 
 register_mapping:
@@ -74,6 +93,77 @@ register_mapping:
    return 0;
 }
 
+/*
+ * Map the resident blocks around `vaddr` (which has already been mapped), in
+ * a window of `fault_around_pages` pages aligned at its size. Holes are just
+ * skipped: they'll be allocated on their first access. The madvise() access
+ * pattern hints change the window: MADV_RANDOM disables it, while with
+ * MADV_SEQUENTIAL it's the largest possible one, starting at `vaddr`.
+ */
+static void
+ramfs_fault_around(struct process *pi,
+                   struct user_mapping *um,
+                   ulong vaddr,
+                   u32 pg_flags)
+{
+   struct ramfs_handle *rh = um->h;
+   struct ramfs_inode *i = rh->inode;
+   const ulong um_end = um->vaddr + um->len;
+   struct ramfs_block *block;
+   ulong va, start, end, nr;
+   ulong abs_off;
+   int rc;
+
+   if (um->advice == MADV_RANDOM)
+      return;
+
+   if (um->advice == MADV_SEQUENTIAL) {
+
+      nr = FAULT_AROUND_MAX_PAGES;
+      start = vaddr;
+
+   } else {
+
+      nr = MIN(fault_around_pages, FAULT_AROUND_MAX_PAGES);
+
+      if (nr <= 1)
+         return;
+
+      start = vaddr - (((vaddr >> PAGE_SHIFT) % nr) << PAGE_SHIFT);
+      start = MAX(start, um->vaddr);
+   }
+
+   end = MIN(start + (nr << PAGE_SHIFT), um_end);
+
+   for (va = start; va < end; va += PAGE_SIZE) {
+
+      abs_off = um->off + (va - um->vaddr);
+
+      if (abs_off >= (ulong)i->fsize)
+         break;
+
+      if (va == vaddr || is_mapped(pi->pdir, (void *)va))
+         continue;
+
+      block = bintree_find_ptr(i->blocks_tree_root,
+                               (offt)abs_off,
+                               struct ramfs_block,
+                               node,
+                               offset);
+
+      if (!block || block->cdata)
+         continue; /* Holes and compressed blocks are not mapped in advance */
+
+      rc = map_page(pi->pdir,
+                    (void *)va,
+                    block->paddr,
+                    pg_flags);
+
+      if (rc)
+         break; /* Out of memory for the page tables: it's fine to stop here */
+   }
+}
+
 static bool
 ramfs_handle_fault_int(struct process *pi,
                        struct user_mapping *um,
@@ -82,9 +172,10 @@ ramfs_handle_fault_int(struct process *pi,
                        bool rw)
 {
    struct ramfs_handle *rh = um->h;
-   ulong vaddr = (ulong) vaddrp;
-   ulong abs_off;
+   const ulong vaddr = (ulong)vaddrp & PAGE_MASK;
+   u32 pg_flags = PAGING_FL_US | PAGING_FL_SHARED;
    struct ramfs_block *block;
+   ulong abs_off;
    int rc;
 
    ASSERT(um != NULL);
@@ -107,23 +198,49 @@ ramfs_handle_fault_int(struct process *pi,
    if (abs_off >= (ulong)rh->inode->fsize)
       return false; /* Read/write past EOF */
 
-   if (rw) {
-      /* Create and map on-the-fly a struct ramfs_block */
-      if (!(block = ramfs_new_block((offt)(abs_off & PAGE_MASK))))
+   if (um->prot & PROT_WRITE)
+      pg_flags |= PAGING_FL_RW;
+
+   block = bintree_find_ptr(rh->inode->blocks_tree_root,
+                            (offt)abs_off,
+                            struct ramfs_block,
+                            node,
+                            offset);
+
+   if (!block) {
+
+      /*
+       * Accessing a hole: create on-the-fly a struct ramfs_block. That's
+       * needed even for reads, because the page is shared: mapping the zero
+       * page here would make any later write on the file invisible to us.
+       */
+      if (!(block = ramfs_new_block((offt)abs_off)))
          panic("Out-of-memory: unable to alloc a ramfs_block. No OOM killer");
 
       ramfs_append_new_block(rh->inode, block);
+
+   } else if (block->cdata) {
+
+      /*
+       * The shrinker compresses also the blocks mapped but not faulted-in yet
+       * and their first access needs a pageframe exactly when the memory is
+       * tight. Don't panic: just fail the fault (SIGBUS for the task).
+       */
+      if (ramfs_block_decompress(rh->inode->fs_data, block))
+         return false;
    }
 
+   ramfs_block_touch(block);
    rc = map_page(pi->pdir,
-                 (void *)(vaddr & PAGE_MASK),
-                 KERNEL_VA_TO_PA(rw ? block->vaddr : &zero_page),
-                 PAGING_FL_US | PAGING_FL_RW | PAGING_FL_SHARED);
+                 (void *)vaddr,
+                 block->paddr,
+                 pg_flags);
 
    if (rc)
       panic("Out-of-memory: unable to map a ramfs_block. No OOM killer");
 
    invalidate_page(vaddr);
+   ramfs_fault_around(pi, um, vaddr, pg_flags);
    return true;
 }
 
@@ -1,12 +1,19 @@
 /* SPDX-License-Identifier: BSD-2-Clause */
 
+#include <tilck_gen_headers/config_mm.h>
+
 #include <tilck/common/basic_defs.h>
 #include <tilck/common/string_util.h>
 #include <tilck/common/printk.h>
 #include <tilck/common/utils.h>
 
 #include <tilck/kernel/process.h>
+#include <tilck/kernel/highmem.h>
 #include <tilck/kernel/fs/flock.h>
+#include <tilck/kernel/worker_thread.h>
+#include <tilck/kernel/timer.h>
+#include <tilck/kernel/lz4.h>
+#include <tilck/kernel/shrinker.h>
 
 #include <sys/mman.h>      // system header
 
@@ -16,6 +23,7 @@
 #include "dir_entries.c.h"
 #include "inodes.c.h"
 #include "stat.c.h"
+#include "compr.c.h"
 #include "blocks.c.h"
 #include "mmap.c.h"
 #include "rw_ops.c.h"
@@ -77,6 +85,7 @@ static void ramfs_on_close_last_handle(fs_handle h)
 {
    struct ramfs_handle *rh = h;
    struct ramfs_inode *i = rh->inode;
+   struct ramfs_data *d = rh->fs->device_data;
 
    if (!i->nlink) {
 
@@ -90,10 +99,15 @@ static void ramfs_on_close_last_handle(fs_handle h)
        * it.
        */
 
-      if (i->type == VFS_FILE)
-         ramfs_inode_truncate_safe(i, 0, true);
+      rwlock_wp_exlock(&d->rwlock);
+      {
+         /* The exlock keeps the compression worker away from the inode */
+         if (i->type == VFS_FILE)
+            ramfs_inode_truncate_safe(i, 0, true);
 
-      ramfs_destroy_inode(rh->fs->device_data, i);
+         ramfs_destroy_inode(d, i);
+      }
+      rwlock_wp_exunlock(&d->rwlock);
    }
 }
 
@@ -354,6 +368,8 @@ struct mnt_fs *ramfs_create(void)
    }
 
    rwlock_wp_init(&d->rwlock, false);
+   list_init(&d->files_list);
+   list_node_init(&d->compr_node);
    d->next_inode_num = 1;
    d->root = ramfs_create_inode_dir(d, 0777, NULL);
 
@@ -15,16 +15,22 @@
 #include <tilck/kernel/bintree.h>
 #include <tilck/kernel/paging.h>
 #include <tilck/kernel/process_mm.h>
+#include <tilck/kernel/fs/ramfs.h>
 
 #include <dirent.h> // system header
 
 struct ramfs_inode;
+struct ramfs_data;
 
 struct ramfs_block {
 
    struct bintree_node node;
    offt offset;                  /* MUST BE divisible by PAGE_SIZE */
-   void *vaddr;
+   ulong paddr;                  /* might be in highmem: use kmap() */
+   void *cdata;                  /* compressed data (then, no paddr) */
+   u16 clen;                     /* size of the compressed data */
+   u16 csize;                    /* size of the `cdata` allocation */
+   u32 atime;                    /* last access, in ticks (truncated) */
 };
 
 /*
@@ -76,6 +82,8 @@ struct ramfs_inode {
       struct {
          offt fsize;
          struct ramfs_block *blocks_tree_root;
+         struct ramfs_data *fs_data;
+         struct list_node files_node;  /* node in ramfs_data->files_list */
       };
 
       /* valid when type == VFS_DIR */
@@ -121,6 +129,10 @@ struct ramfs_data {
 
    tilck_ino_t next_inode_num;
    struct ramfs_inode *root;
+
+   struct list files_list;             /* all the file inodes */
+   struct list_node compr_node;        /* node in ramfs_compr_list */
+   struct ramfs_compr_info compr;
 };
 
 CREATE_FS_PATH_STRUCT(ramfs_path, struct ramfs_inode *, struct ramfs_entry *);
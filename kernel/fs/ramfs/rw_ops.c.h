@@ -212,7 +212,7 @@ static int ramfs_inode_truncate(struct ramfs_inode *i, offt len)
                          node,
                          offset);
 
-      ramfs_destroy_block(b);
+      ramfs_destroy_block(i->fs_data, b);
    }
 
    i->fsize = len;
@@ -284,8 +284,17 @@ ramfs_read_nolock(struct ramfs_handle *rh, char *buf, size_t len, offt *pos)
                                offset);
 
       if (block) {
-         /* reading a regular block */
-         memcpy(buf + tot_read, block->vaddr + page_off, (size_t)to_read);
+
+         /* reading a regular block, decompressing it if necessary */
+         void *va;
+
+         if (block->cdata && ramfs_block_decompress(inode->fs_data, block))
+            return tot_read ? (ssize_t)tot_read : -ENOMEM;
+
+         ramfs_block_touch(block);
+         va = kmap(block->paddr);
+         memcpy(buf + tot_read, va + page_off, (size_t)to_read);
+         kunmap(va);
       } else {
          /* reading a hole */
          memset(buf + tot_read, 0, (size_t)to_read);
@@ -328,6 +337,7 @@ ramfs_write_nolock(struct ramfs_handle *rh, char *buf, size_t len, offt *pos)
    while (buf_rem > 0) {
 
       struct ramfs_block *block;
+      void *va;
       const offt page     = *pos & (offt)PAGE_MASK;
       const offt page_off = *pos & (offt)OFFSET_IN_PAGE_MASK;
       const offt page_rem = (offt)PAGE_SIZE - page_off;
@@ -350,9 +360,19 @@ ramfs_write_nolock(struct ramfs_handle *rh, char *buf, size_t len, offt *pos)
             break;
 
          ramfs_append_new_block(inode, block);
+
+      } else if (block->cdata) {
+
+         if (ramfs_block_decompress(inode->fs_data, block))
+            break;
       }
 
-      memcpy(block->vaddr + page_off, buf + tot_written, (size_t)to_write);
+      ramfs_block_touch(block);
+
+      va = kmap(block->paddr);
+      memcpy(va + page_off, buf + tot_written, (size_t)to_write);
+      kunmap(va);
+
       tot_written += to_write;
       buf_rem     -= to_write;
       *pos     += to_write;
@@ -0,0 +1,621 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+#include <tilck/common/printk.h>
+
+#include <tilck/kernel/fs/shmfs.h>
+#include <tilck/kernel/fs/devfs.h>
+#include <tilck/kernel/fs/vfs.h>
+#include <tilck/kernel/process.h>
+#include <tilck/kernel/process_mm.h>
+#include <tilck/kernel/shmem.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/errno.h>
+#include <tilck/kernel/list.h>
+#include <tilck/kernel/datetime.h>
+#include <tilck/kernel/rwlock.h>
+
+#include <dirent.h> // system header
+
+struct shmfs_inode {
+
+   /*
+    * Inode's ref-count is the number of file handles currently pointing to
+    * this inode.
+    */
+   REF_COUNTED_OBJECT;
+
+   enum vfs_entry_type type;
+   struct list_node node;           /* node in shmfs_data->files */
+   tilck_ino_t ino;
+   nlink_t nlink;
+   mode_t mode;
+   struct shmem *shm;               /* valid only if type == VFS_FILE */
+   char *name;
+   struct k_timespec64 mtime;
+   struct k_timespec64 ctime;
+};
+
+struct shmfs_handle {
+
+   /* struct fs_handle_base */
+   FS_HANDLE_BASE_FIELDS
+
+   /* shmfs-specific fields */
+   struct shmfs_inode *inode;
+};
+
+STATIC_ASSERT(sizeof(struct shmfs_handle) <= MAX_FS_HANDLE_SIZE);
+
+struct shmfs_data {
+
+   /*
+    * Yes, sub-directories are NOT supported by shmfs, exactly like in devfs.
+    * The whole filesystem is just one flat directory.
+    */
+   struct shmfs_inode root;
+   struct list files;
+   struct rwlock_wp rwlock;
+   tilck_ino_t next_inode;
+};
+
+CREATE_FS_PATH_STRUCT(shmfs_path, struct shmfs_inode *, struct shmfs_inode *);
+
+static struct mnt_fs *shmfs;
+
+static struct shmfs_inode *
+shmfs_create_inode(struct shmfs_data *d, const char *name, mode_t mode)
+{
+   const size_t name_len = strlen(name);
+   struct shmfs_inode *i;
+
+   if (name_len > SHMFS_NAME_MAX)
+      return NULL;
+
+   if (!(i = kzalloc_obj(struct shmfs_inode)))
+      return NULL;
+
+   if (!(i->name = kmalloc(name_len + 1))) {
+      kfree_obj(i, struct shmfs_inode);
+      return NULL;
+   }
+
+   if (!(i->shm = shmem_create(0))) {
+      kfree2(i->name, name_len + 1);
+      kfree_obj(i, struct shmfs_inode);
+      return NULL;
+   }
+
+   memcpy(i->name, name, name_len + 1);
+   list_node_init(&i->node);
+   i->type = VFS_FILE;
+   i->ino = d->next_inode++;
+   i->mode = (mode & 0777) | S_IFREG;
+   real_time_get_timespec(&i->ctime);
+   i->mtime = i->ctime;
+   return i;
+}
+
+static void shmfs_destroy_inode(struct shmfs_inode *i)
+{
+   ASSERT(i->type == VFS_FILE);
+   ASSERT(!i->nlink);
+   ASSERT(!get_ref_count(i));
+
+   shmem_release(i->shm);
+   kfree2(i->name, strlen(i->name) + 1);
+   kfree_obj(i, struct shmfs_inode);
+}
+
+static ssize_t
+shmfs_read(fs_handle h, char *buf, size_t len, offt *pos)
+{
+   struct shmfs_handle *sh = h;
+   ssize_t rc;
+
+   if (sh->inode->type == VFS_DIR)
+      return -EISDIR;
+
+   if (*pos >= (offt)SHMEM_MAX_SIZE)
+      return 0;
+
+   if ((rc = shmem_read(sh->inode->shm, buf, len, (size_t)*pos)) > 0)
+      *pos += rc;
+
+   return rc;
+}
+
+static ssize_t
+shmfs_write(fs_handle h, char *buf, size_t len, offt *pos)
+{
+   struct shmfs_handle *sh = h;
+   struct shmfs_inode *i = sh->inode;
+   ssize_t rc;
+
+   if (i->type == VFS_DIR)
+      return -EISDIR;
+
+   if (sh->fl_flags & O_APPEND)
+      *pos = (offt)i->shm->size;
+
+   if (*pos + (offt)len > (offt)SHMEM_MAX_SIZE)
+      return -EFBIG;
+
+   if ((rc = shmem_write(i->shm, buf, len, (size_t)*pos)) > 0) {
+      *pos += rc;
+      real_time_get_timespec(&i->mtime);
+   }
+
+   return rc;
+}
+
+static offt
+shmfs_seek(fs_handle h, offt off, int whence)
+{
+   struct shmfs_handle *sh = h;
+   offt new_pos;
+
+   if (sh->inode->type == VFS_DIR) {
+
+      /* Dirents offsets are opaque values: accept only SEEK_SET */
+      if (whence != SEEK_SET || off < 0)
+         return -EINVAL;
+
+      sh->dir_pos = off;
+      return sh->dir_pos;
+   }
+
+   switch (whence) {
+
+      case SEEK_SET:
+         new_pos = off;
+         break;
+
+      case SEEK_CUR:
+         new_pos = sh->h_fpos + off;
+         break;
+
+      case SEEK_END:
+         new_pos = (offt)sh->inode->shm->size + off;
+         break;
+
+      default:
+         return -EINVAL;
+   }
+
+   if (new_pos < 0)
+      return -EINVAL;
+
+   sh->h_fpos = new_pos;
+   return sh->h_fpos;
+}
+
+static int
+shmfs_mmap(struct user_mapping *um, pdir_t *pdir, int flags)
+{
+   struct shmfs_handle *sh = um->h;
+   struct shmem *shm = sh->inode->shm;
+   int rc;
+
+   if (sh->inode->type != VFS_FILE)
+      return -EACCES;
+
+   /*
+    * Mappings are split only after they've been bound to the shared-page
+    * object (see below), therefore the VFS_MM_* flags are never used here.
+    */
+   ASSERT(flags == 0);
+
+   if ((rc = shmem_map(shm, pdir, um)))
+      return rc;
+
+   /*
+    * Bind the mapping to the shared-page object instead of to the handle:
+    * this way it survives close(), like on Linux, and it's handled exactly
+    * like an anonymous MAP_SHARED mapping from now on.
+    */
+   disable_preemption();
+   {
+      shmem_retain(shm);
+      um->shm = shm;
+      um->h = NULL;
+   }
+   enable_preemption();
+   return 0;
+}
+
+static int
+shmfs_munmap(struct user_mapping *um, void *vaddrp, size_t len)
+{
+   /* Unreachable in practice: see shmfs_mmap() */
+   shmem_unmap(um->pi->pdir, vaddrp, len);
+   return 0;
+}
+
+static const struct file_ops static_ops_shmfs =
+{
+   .read = shmfs_read,
+   .write = shmfs_write,
+   .seek = shmfs_seek,
+   .mmap = shmfs_mmap,
+   .munmap = shmfs_munmap,
+};
+
+static int
+shmfs_open_int(struct mnt_fs *fs, struct shmfs_inode *i, fs_handle *out, int fl)
+{
+   struct shmfs_handle *h;
+   int rc;
+
+   if (i->type == VFS_FILE && (fl & O_TRUNC)) {
+      if ((rc = shmem_truncate(i->shm, 0)))
+         return rc;
+   }
+
+   if (!(h = vfs_create_new_handle(fs, &static_ops_shmfs)))
+      return -ENOMEM;
+
+   h->inode = i;
+   h->spec_flags = VFS_SPFL_NO_LF;
+
+   if (i->type == VFS_FILE)
+      h->spec_flags |= VFS_SPFL_MMAP_SUPPORTED;
+
+   retain_obj(i);
+   *out = h;
+   return 0;
+}
+
+static int shmfs_open_existing_checks(int fl, struct shmfs_inode *i)
+{
+   if (!(fl & O_WRONLY) && (i->mode & 0400) != 0400)
+      return -EACCES;
+
+   if ((fl & O_WRONLY) && (i->mode & 0200) != 0200)
+      return -EACCES;
+
+   if ((fl & O_RDWR) && (i->mode & 0600) != 0600)
+      return -EACCES;
+
+   if ((fl & O_CREAT) && (fl & O_EXCL))
+      return -EEXIST;
+
+   if ((fl & (O_WRONLY | O_RDWR)) && i->type == VFS_DIR)
+      return -EISDIR;
+
+   if ((fl & O_TRUNC) && !(fl & (O_WRONLY | O_RDWR)))
+      return -EINVAL;
+
+   return 0;
+}
+
+static int
+shmfs_open(struct vfs_path *p, fs_handle *out, int fl, mode_t mod)
+{
+   struct shmfs_path *sp = (struct shmfs_path *) &p->fs_path;
+   struct shmfs_data *d = p->fs->device_data;
+   struct shmfs_inode *i = sp->inode;
+   int rc;
+
+   if (i) {
+
+      if ((rc = shmfs_open_existing_checks(fl, i)))
+         return rc;
+
+      return shmfs_open_int(p->fs, i, out, fl);
+   }
+
+   if (!(fl & O_CREAT))
+      return -ENOENT;
+
+   if (!(i = shmfs_create_inode(d, p->last_comp, mod)))
+      return -ENOSPC;
+
+   if ((rc = shmfs_open_int(p->fs, i, out, fl))) {
+      shmfs_destroy_inode(i);
+      return rc;
+   }
+
+   i->nlink = 1;
+   list_add_tail(&d->files, &i->node);
+   return 0;
+}
+
+static int shmfs_unlink(struct vfs_path *p)
+{
+   struct shmfs_inode *i = p->fs_path.inode;
+
+   DEBUG_ONLY_UNSAFE(struct shmfs_data *d = p->fs->device_data);
+   ASSERT(rwlock_wp_holding_exlock(&d->rwlock));
+
+   if (i->type == VFS_DIR)
+      return -EISDIR;
+
+   list_remove(&i->node);
+   i->nlink = 0;
+
+   if (!get_ref_count(i))
+      shmfs_destroy_inode(i);
+
+   return 0;
+}
+
+static void shmfs_on_close_last_handle(fs_handle h)
+{
+   struct shmfs_handle *sh = h;
+   struct shmfs_inode *i = sh->inode;
+
+   /* Unlinked file (or memfd) with no handles left: nobody can reach it */
+   if (i->type == VFS_FILE && !i->nlink)
+      shmfs_destroy_inode(i);
+}
+
+static int
+shmfs_stat(struct mnt_fs *fs, vfs_inode_ptr_t inode, struct k_stat64 *statbuf)
+{
+   struct shmfs_inode *i = inode;
+
+   if (!i)
+      return -ENOENT;
+
+   bzero(statbuf, sizeof(struct k_stat64));
+
+   statbuf->st_dev = fs->device_id;
+   statbuf->st_ino = i->ino;
+   statbuf->st_mode = i->mode;
+   statbuf->st_nlink = i->nlink;
+   statbuf->st_uid = 0; /* root */
+   statbuf->st_gid = 0; /* root */
+   statbuf->st_blksize = PAGE_SIZE;
+
+   if (i->type == VFS_FILE) {
+      statbuf->st_size = (typeof(statbuf->st_size)) i->shm->size;
+      statbuf->st_blocks =
+         (typeof(statbuf->st_blocks))(i->shm->nr_pages * (PAGE_SIZE / 512));
+   }
+
+   statbuf->st_ctim = to_stat_timespec(i->ctime);
+   statbuf->st_mtim = to_stat_timespec(i->mtime);
+   statbuf->st_atim = to_stat_timespec(i->mtime);
+   return 0;
+}
+
+static int
+shmfs_truncate(struct mnt_fs *fs, vfs_inode_ptr_t inode, offt len)
+{
+   struct shmfs_inode *i = inode;
+   int rc;
+
+   if (i->type == VFS_DIR)
+      return -EISDIR;
+
+   if (len < 0)
+      return -EINVAL;
+
+   if (len > (offt)SHMEM_MAX_SIZE)
+      return -EFBIG;
+
+   if (!(rc = shmem_truncate(i->shm, (size_t)len)))
+      real_time_get_timespec(&i->mtime);
+
+   return rc;
+}
+
+static int
+shmfs_getdents(fs_handle h, get_dents_func_cb vfs_cb, void *arg)
+{
+   struct shmfs_handle *sh = h;
+   struct shmfs_data *d = sh->fs->device_data;
+   struct shmfs_inode *pos;
+   offt idx = 0;
+   int rc = 0;
+
+   if (sh->inode->type != VFS_DIR)
+      return -ENOTDIR;
+
+   /*
+    * The position in the directory is just the index of the entry: the VFS
+    * layer increments `dir_pos` for each entry returned.
+    */
+   list_for_each_ro(pos, &d->files, node) {
+
+      if (idx++ < sh->dir_pos)
+         continue;
+
+      struct vfs_dent64 dent = {
+         .ino  = pos->ino,
+         .type = pos->type,
+         .name_len = (u8) strlen(pos->name) + 1,
+         .name = pos->name,
+      };
+
+      if ((rc = vfs_cb(&dent, arg)))
+         break;
+   }
+
+   return rc;
+}
+
+static void
+shmfs_get_entry(struct mnt_fs *fs,
+                void *dir_inode,
+                const char *name,
+                ssize_t nl,
+                struct fs_path *fs_path)
+{
+   struct shmfs_data *d = fs->device_data;
+   struct shmfs_inode *pos;
+
+   if (!dir_inode || is_dot_or_dotdot(name, (int)nl)) {
+
+      *fs_path = (struct fs_path) {
+         .inode      = &d->root,
+         .dir_inode  = &d->root,
+         .dir_entry  = NULL,
+         .type       = VFS_DIR,
+      };
+
+      return;
+   }
+
+   *fs_path = (struct fs_path) {
+      .inode      = NULL,
+      .dir_inode  = &d->root,
+      .dir_entry  = NULL,
+      .type       = VFS_NONE,
+   };
+
+   if (dir_inode != &d->root)
+      return;
+
+   list_for_each_ro(pos, &d->files, node) {
+
+      if (!strncmp(pos->name, name, (size_t)nl) && !pos->name[nl]) {
+         fs_path->inode = pos;
+         fs_path->dir_entry = pos;
+         fs_path->type = pos->type;
+         break;
+      }
+   }
+}
+
+static vfs_inode_ptr_t
+shmfs_get_inode(fs_handle h)
+{
+   return ((struct shmfs_handle *)h)->inode;
+}
+
+static int
+shmfs_retain_inode(struct mnt_fs *fs, vfs_inode_ptr_t inode)
+{
+   ASSERT(inode != NULL);
+   return retain_obj((struct shmfs_inode *)inode);
+}
+
+static int
+shmfs_release_inode(struct mnt_fs *fs, vfs_inode_ptr_t inode)
+{
+   ASSERT(inode != NULL);
+   return release_obj((struct shmfs_inode *)inode);
+}
+
+static void
+shmfs_exclusive_lock(struct mnt_fs *fs)
+{
+   struct shmfs_data *d = fs->device_data;
+   rwlock_wp_exlock(&d->rwlock);
+}
+
+static void
+shmfs_exclusive_unlock(struct mnt_fs *fs)
+{
+   struct shmfs_data *d = fs->device_data;
+   rwlock_wp_exunlock(&d->rwlock);
+}
+
+static void
+shmfs_shared_lock(struct mnt_fs *fs)
+{
+   struct shmfs_data *d = fs->device_data;
+   rwlock_wp_shlock(&d->rwlock);
+}
+
+static void
+shmfs_shared_unlock(struct mnt_fs *fs)
+{
+   struct shmfs_data *d = fs->device_data;
+   rwlock_wp_shunlock(&d->rwlock);
+}
+
+static const struct fs_ops static_fsops_shmfs =
+{
+   .get_inode = shmfs_get_inode,
+   .open = shmfs_open,
+   .on_close_last_handle = shmfs_on_close_last_handle,
+   .getdents = shmfs_getdents,
+   .unlink = shmfs_unlink,
+   .truncate = shmfs_truncate,
+   .stat = shmfs_stat,
+   .get_entry = shmfs_get_entry,
+   .retain_inode = shmfs_retain_inode,
+   .release_inode = shmfs_release_inode,
+
+   .fs_exlock = shmfs_exclusive_lock,
+   .fs_exunlock = shmfs_exclusive_unlock,
+   .fs_shlock = shmfs_shared_lock,
+   .fs_shunlock = shmfs_shared_unlock,
+};
+
+static struct mnt_fs *
+create_shmfs(void)
+{
+   struct mnt_fs *fs;
+   struct shmfs_data *d;
+
+   if (!(d = kzalloc_obj(struct shmfs_data)))
+      return NULL;
+
+   fs = create_fs_obj("shmfs", &static_fsops_shmfs, d, VFS_FS_RW);
+
+   if (!fs) {
+      kfree_obj(d, struct shmfs_data);
+      return NULL;
+   }
+
+   d->next_inode = 1;
+   d->root.type = VFS_DIR;
+   d->root.ino = d->next_inode++;
+   d->root.nlink = 1;
+   d->root.mode = 0777 | S_IFDIR;
+   real_time_get_timespec(&d->root.ctime);
+   d->root.mtime = d->root.ctime;
+   list_init(&d->files);
+   rwlock_wp_init(&d->rwlock, false);
+   return fs;
+}
+
+int
+shmfs_create_unlinked(const char *name, fs_handle *out)
+{
+   struct shmfs_data *d = shmfs->device_data;
+   struct shmfs_handle *h;
+   struct shmfs_inode *i;
+   int rc;
+
+   vfs_fs_exlock(shmfs);
+   {
+      if (!(i = shmfs_create_inode(d, name, 0777))) {
+         rc = -ENOMEM;
+         goto out;
+      }
+
+      if ((rc = shmfs_open_int(shmfs, i, out, O_RDWR))) {
+         shmfs_destroy_inode(i);
+         goto out;
+      }
+
+      /* Do here what vfs_open() does after the fs-specific open() */
+      h = *out;
+      h->fl_flags = O_RDWR;
+      retain_obj(shmfs);
+   }
+out:
+   vfs_fs_exunlock(shmfs);
+   return rc;
+}
+
+void
+init_shmfs(void)
+{
+   int rc;
+
+   if ((rc = create_dev_mountpoint("shm")))
+      panic("create_dev_mountpoint(\"shm\") failed with error: %d", rc);
+
+   if (!(shmfs = create_shmfs()))
+      panic("Unable to create shmfs");
+
+   if ((rc = mp_add(shmfs, "/dev/shm")))
+      panic("mp_add() failed with error: %d", rc);
+}
@@ -11,6 +11,7 @@
 #include <tilck/kernel/sched.h>
 #include <tilck/kernel/irq.h>
 #include <tilck/kernel/hal.h>
+#include <tilck/kernel/tracepoint.h>
 
 void handle_syscall(regs_t *);
 void handle_fault(regs_t *);
@@ -25,6 +26,9 @@ void arch_irq_handling(regs_t *r);
  */
 ATOMIC(int) __in_irq_count;
 
+/* See get_irq_regs() */
+regs_t *__irq_regs;
+
 static ALWAYS_INLINE void inc_irq_count(void)
 {
    atomic_fetch_add_explicit(&__in_irq_count, 1, mo_relaxed);
@@ -193,11 +197,14 @@ static void irq_resched(regs_t *r)
 
 void irq_entry(regs_t *r)
 {
+   regs_t *prev_irq_regs;
+
    ASSERT(get_curr_task() != NULL);
    DEBUG_check_not_same_interrupt_nested(regs_intnum(r));
 
    /* We expect here that the CPU disabled the interrupts */
    ASSERT(!are_interrupts_enabled());
+   TRACE_IRQS_OFF();
 
    /* Disable the preemption */
    disable_preemption();
@@ -206,7 +213,12 @@ void irq_entry(regs_t *r)
    inc_irq_count();
 
    /* Call the arch-dependent IRQ handling logic */
+   tracepoint(tp_irq_entry, int_to_irq(regs_intnum(r)), 0, 0);
+   prev_irq_regs = __irq_regs;
+   __irq_regs = r;
    arch_irq_handling(r);
+   __irq_regs = prev_irq_regs;
+   tracepoint(tp_irq_exit, int_to_irq(regs_intnum(r)), 0, 0);
 
    /* Decrease the always-enabled in_irq_count counter */
    dec_irq_count();
@@ -226,6 +238,7 @@ void irq_entry(regs_t *r)
     * re-enable the preemption and return.
     */
    enable_preemption_nosched();
+   TRACE_IRQS_ON(); /* the interrupts will be re-enabled by the IRET */
 }
 
 void syscall_entry(regs_t *r)
@@ -237,6 +250,7 @@ void syscall_entry(regs_t *r)
     */
    ASSERT(!are_interrupts_enabled());
    ASSERT(is_preemption_enabled());
+   TRACE_IRQS_OFF();
 
    push_nested_interrupt(0x80);
    disable_preemption();
@@ -249,6 +263,7 @@ void syscall_entry(regs_t *r)
    pop_nested_interrupt();
 
    ASSERT(is_preemption_enabled());
+   TRACE_IRQS_ON(); /* the return to user space re-enables the interrupts */
 }
 
 void fault_entry(regs_t *r)
@@ -259,6 +274,7 @@ void fault_entry(regs_t *r)
     * while preemption is disabled.
     */
    ASSERT(!are_interrupts_enabled());
+   TRACE_IRQS_OFF();
 
    push_nested_interrupt(regs_intnum(r));
    disable_preemption();
@@ -275,5 +291,6 @@ void fault_entry(regs_t *r)
 
    enable_preemption();
    disable_interrupts_forced();
+   TRACE_IRQS_ON(); /* the IRET restores the interrupts state */
 }
 
@@ -0,0 +1,1121 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+#include <tilck/common/atomics.h>
+#include <tilck/common/utils.h>
+
+#include <tilck/kernel/io_uring.h>
+#include <tilck/kernel/fs/vfs.h>
+#include <tilck/kernel/fs/kernelfs.h>
+#include <tilck/kernel/shmem.h>
+#include <tilck/kernel/process.h>
+#include <tilck/kernel/process_mm.h>
+#include <tilck/kernel/worker_thread.h>
+#include <tilck/kernel/syscalls.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/user.h>
+#include <tilck/kernel/timer.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/sync.h>
+#include <tilck/kernel/errno.h>
+
+/*
+ * How it works
+ * ---------------
+ *
+ * The SQ ring, the CQ ring and the SQEs live in a single shared-page object,
+ * mapped by the user through the IORING_OFF_* offsets. io_uring_enter()
+ * consumes the SQEs and handles each request in one of these three ways:
+ *
+ *    - inline: the request cannot block, so it's executed immediately in the
+ *      context of the caller, through the regular syscall implementations.
+ *      That's the common case and no memory is allocated for it.
+ *
+ *    - parked: the request has to wait for a file to become ready (e.g. a
+ *      read from an empty pipe, a POLL_ADD) or for a timeout. It's retried by
+ *      io_uring_enter() every time the caller wakes up. Reads and writes
+ *      are always attempted in non-blocking mode and parked on EAGAIN: the
+ *      caller holds the ring's lock and must never sleep on a file.
+ *
+ *    - async: the request might block inside the kernel (FSYNC, IOSQE_ASYNC
+ *      reads and writes at a given offset). It's run on a dedicated worker
+ *      thread, on a private duplicate of the file handle. Because the worker
+ *      thread cannot access the user memory, the data passes through a kernel
+ *      bounce buffer.
+ *
+ * Every consumed request reserves a slot in the CQ ring, so the CQ ring can
+ * never overflow: when it's full, no more SQEs are consumed.
+ */
+
+#define IO_OFF_CURR                 ((u64)-1)  /* use the current position */
+#define IO_RINGS_ARRAY_OFF               64    /* offset of the SQ array */
+
+/*
+ * Header of the rings, at offset 0 of the shared-page object. The user space
+ * finds each field through the offsets in struct io_uring_params.
+ */
+struct io_rings_hdr {
+
+   volatile u32 sq_head;        /* written by the kernel */
+   volatile u32 sq_tail;        /* written by the user */
+   u32 sq_ring_mask;
+   u32 sq_ring_entries;
+   u32 sq_flags;
+   volatile u32 sq_dropped;
+
+   volatile u32 cq_head;        /* written by the user */
+   volatile u32 cq_tail;        /* written by the kernel */
+   u32 cq_ring_mask;
+   u32 cq_ring_entries;
+   volatile u32 cq_overflow;
+   u32 cq_flags;
+};
+
+STATIC_ASSERT(sizeof(struct io_rings_hdr) <= IO_RINGS_ARRAY_OFF);
+
+struct io_ring {
+
+   KOBJ_BASE_FIELDS
+
+   struct kmutex lock;          /* serializes the io_uring_enter() calls */
+   struct kcond async_done;     /* signaled when an async request completes */
+   struct shmem *shm;           /* rings and SQEs, shared with the user */
+   struct io_rings_hdr *hdr;
+
+   u32 sq_entries;
+   u32 cq_entries;
+   u32 cqes_off;                /* offset of the CQEs in `shm` */
+   u32 rings_size;              /* size of the rings, page-aligned */
+   u32 sqes_off;                /* offset of the SQEs in `shm` */
+
+   u32 inflight;                /* consumed, but not yet completed requests */
+   struct list parked;          /* waiting for readiness or for a timeout */
+   struct list done;            /* completed by the worker thread */
+};
+
+/* A request that could not be completed inline */
+struct io_req {
+
+   struct list_node node;
+   struct io_ring *r;
+   struct io_uring_sqe sqe;     /* private copy: the user can reuse the SQE */
+
+   u64 deadline;                /* timeout: expiration time, in ticks */
+   u32 cq_start;                /* timeout: cq_tail when it was armed */
+   u32 cq_count;                /* timeout: completions to wait for, if != 0 */
+
+   fs_handle h;                 /* async: private duplicate of the handle */
+   void *buf;                   /* async: bounce buffer */
+   size_t buf_size;
+   s32 res;                     /* async: the result */
+};
+
+static struct worker_thread *io_uring_wth;
+
+static ALWAYS_INLINE u32 *
+io_ring_sq_array(struct io_ring *r, u32 idx)
+{
+   return shmem_kva(r->shm, IO_RINGS_ARRAY_OFF + idx * sizeof(u32));
+}
+
+static ALWAYS_INLINE struct io_uring_sqe *
+io_ring_sqe(struct io_ring *r, u32 idx)
+{
+   return shmem_kva(r->shm, r->sqes_off + idx * sizeof(struct io_uring_sqe));
+}
+
+static ALWAYS_INLINE struct io_uring_cqe *
+io_ring_cqe(struct io_ring *r, u32 idx)
+{
+   return shmem_kva(r->shm, r->cqes_off + idx * sizeof(struct io_uring_cqe));
+}
+
+static void io_req_free(struct io_req *req)
+{
+   if (req->h)
+      vfs_close(req->h);
+
+   if (req->buf)
+      kfree2(req->buf, req->buf_size);
+
+   kfree_obj(req, struct io_req);
+}
+
+static struct io_req *io_req_alloc(struct io_ring *r, struct io_uring_sqe *sqe)
+{
+   struct io_req *req;
+
+   if (!(req = kzalloc_obj(struct io_req)))
+      return NULL;
+
+   list_node_init(&req->node);
+   req->r = r;
+   req->sqe = *sqe;
+   return req;
+}
+
+static void destroy_io_ring(struct io_ring *r)
+{
+   struct io_req *pos, *temp;
+
+   ASSERT(get_ref_count(r) == 0);
+
+   list_for_each(pos, temp, &r->parked, node)
+      io_req_free(pos);
+
+   list_for_each(pos, temp, &r->done, node)
+      io_req_free(pos);
+
+   shmem_release(r->shm);
+   kcond_destory(&r->async_done);
+   kmutex_destroy(&r->lock);
+   kfree_obj(r, struct io_ring);
+}
+
+static void io_ring_release(struct io_ring *r)
+{
+   if (release_obj(r) == 0)
+      destroy_io_ring(r);
+}
+
+/* Free CQ ring slots, not counting the ones reserved by in-flight requests */
+static u32 io_ring_cq_space(struct io_ring *r)
+{
+   const u32 used = r->hdr->cq_tail - r->hdr->cq_head;
+
+   if (used >= r->cq_entries || r->inflight >= r->cq_entries - used)
+      return 0;
+
+   return r->cq_entries - used - r->inflight;
+}
+
+static void io_ring_post(struct io_ring *r, u64 user_data, s32 res)
+{
+   struct io_rings_hdr *hdr = r->hdr;
+   const u32 tail = hdr->cq_tail;
+   struct io_uring_cqe *cqe;
+
+   if (tail - hdr->cq_head >= r->cq_entries) {
+
+      /* Possible only if the user moved cq_head backwards */
+      hdr->cq_overflow++;
+      return;
+   }
+
+   cqe = io_ring_cqe(r, tail & (r->cq_entries - 1));
+   cqe->user_data = user_data;
+   cqe->res = res;
+   cqe->flags = 0;
+
+   /* The CQE must be visible before the new tail */
+   atomic_thread_fence(mo_release);
+   hdr->cq_tail = tail + 1;
+}
+
+static u32 io_poll_revents(fs_handle h, u32 events)
+{
+   u32 revents = 0;
+   int rc;
+
+   if (events & (POLLIN | POLLRDNORM | POLLRDBAND | POLLPRI)) {
+      if (vfs_read_ready(h))
+         revents |= POLLIN;
+   }
+
+   if (events & (POLLOUT | POLLWRNORM | POLLWRBAND)) {
+      if (vfs_write_ready(h))
+         revents |= POLLOUT;
+   }
+
+   if ((rc = vfs_except_ready(h)))
+      revents |= rc > 0 ? (u32)rc : POLLERR;
+
+   return revents;
+}
+
+/*
+ * Tell if a request might have to wait for its file to become ready. Only
+ * handles able to signal their readiness (pipes, ttys, ...) can make a request
+ * wait: with all the others, reads and writes never block.
+ */
+static bool
+io_req_may_wait(struct fs_handle_base *h, struct io_uring_sqe *sqe)
+{
+   switch (sqe->opcode) {
+
+      case IORING_OP_READ:
+      case IORING_OP_READV:
+         return !(h->fl_flags & O_NONBLOCK) && vfs_get_rready_cond(h);
+
+      case IORING_OP_WRITE:
+      case IORING_OP_WRITEV:
+         return !(h->fl_flags & O_NONBLOCK) && vfs_get_wready_cond(h);
+
+      case IORING_OP_POLL_ADD:
+         return true;
+
+      default:
+         return false;
+   }
+}
+
+/*
+ * Tell if a request has to wait for its file to become ready. That's only a
+ * hint, as the file can change state right after: io_req_try_exec() is the
+ * only reliable way to find it out.
+ */
+static bool io_req_is_blocked(struct io_uring_sqe *sqe)
+{
+   struct fs_handle_base *h = get_fs_handle(sqe->fd);
+
+   if (!h || !io_req_may_wait(h, sqe))
+      return false;
+
+   switch (sqe->opcode) {
+
+      case IORING_OP_READ:
+      case IORING_OP_READV:
+         return !vfs_read_ready(h);
+
+      case IORING_OP_WRITE:
+      case IORING_OP_WRITEV:
+         return !vfs_write_ready(h);
+
+      case IORING_OP_POLL_ADD:
+         return !io_poll_revents(h, sqe->poll32_events);
+
+      default:
+         return false;
+   }
+}
+
+/* Get the conditions signaled when a blocked request might progress */
+static int io_req_get_conds(struct io_uring_sqe *sqe, struct kcond *conds[3])
+{
+   struct fs_handle_base *h = get_fs_handle(sqe->fd);
+   bool rd = false, wr = false, ex = false;
+   struct kcond *c;
+   int n = 0;
+
+   if (!h)
+      return 0;
+
+   switch (sqe->opcode) {
+
+      case IORING_OP_READ:
+      case IORING_OP_READV:
+         rd = true;
+         break;
+
+      case IORING_OP_WRITE:
+      case IORING_OP_WRITEV:
+         wr = true;
+         break;
+
+      case IORING_OP_POLL_ADD:
+         rd = !!(sqe->poll32_events & ~(POLLOUT | POLLWRNORM | POLLWRBAND));
+         wr = !!(sqe->poll32_events & (POLLOUT | POLLWRNORM | POLLWRBAND));
+         ex = true;
+         break;
+   }
+
+   if (rd && (c = vfs_get_rready_cond(h)))
+      conds[n++] = c;
+
+   if (wr && (c = vfs_get_wready_cond(h)))
+      conds[n++] = c;
+
+   if (ex && (c = vfs_get_except_cond(h)))
+      conds[n++] = c;
+
+   return n;
+}
+
+/* READV and WRITEV at a given offset: Tilck has no preadv() nor pwritev() */
+static int io_req_rw_vec_at(struct io_uring_sqe *sqe, bool write)
+{
+   const struct iovec *u_iov = (void *)(ulong)sqe->addr;
+   s64 off = (s64)sqe->off;
+   struct iovec iov;
+   int rc, tot = 0;
+
+   for (u32 i = 0; i < sqe->len; i++) {
+
+      if (copy_from_user(&iov, u_iov + i, sizeof(iov)))
+         return tot ? tot : -EFAULT;
+
+      rc = write
+         ? sys_pwrite64(sqe->fd, iov.iov_base, iov.iov_len, off)
+         : sys_pread64(sqe->fd, iov.iov_base, iov.iov_len, off);
+
+      if (rc < 0)
+         return tot ? tot : rc;
+
+      tot += rc;
+      off += rc;
+
+      if ((size_t)rc < iov.iov_len)
+         break;
+   }
+
+   return tot;
+}
+
+static int io_req_openat(struct io_uring_sqe *sqe)
+{
+   const char *u_path = (void *)(ulong)sqe->addr;
+   char c;
+
+   /* Tilck has no openat(): relative paths work only with AT_FDCWD */
+   if (sqe->fd != AT_FDCWD) {
+
+      if (copy_from_user(&c, u_path, 1))
+         return -EFAULT;
+
+      if (c != '/')
+         return -EOPNOTSUPP;
+   }
+
+   return sys_open(u_path, (int)sqe->open_flags, (mode_t)sqe->len);
+}
+
+/* Execute a request in the context of the caller of io_uring_enter() */
+static int io_req_exec(struct io_uring_sqe *sqe)
+{
+   void *u_buf = (void *)(ulong)sqe->addr;
+   const bool curr_pos = sqe->off == IO_OFF_CURR;
+   fs_handle h;
+
+   switch (sqe->opcode) {
+
+      case IORING_OP_NOP:
+         return 0;
+
+      case IORING_OP_READ:
+         return curr_pos
+            ? sys_read(sqe->fd, u_buf, sqe->len)
+            : sys_pread64(sqe->fd, u_buf, sqe->len, (s64)sqe->off);
+
+      case IORING_OP_WRITE:
+         return curr_pos
+            ? sys_write(sqe->fd, u_buf, sqe->len)
+            : sys_pwrite64(sqe->fd, u_buf, sqe->len, (s64)sqe->off);
+
+      case IORING_OP_READV:
+         return curr_pos
+            ? sys_readv(sqe->fd, u_buf, (int)sqe->len)
+            : io_req_rw_vec_at(sqe, false);
+
+      case IORING_OP_WRITEV:
+         return curr_pos
+            ? sys_writev(sqe->fd, u_buf, (int)sqe->len)
+            : io_req_rw_vec_at(sqe, true);
+
+      case IORING_OP_FSYNC:
+         return sys_fsync(sqe->fd);
+
+      case IORING_OP_POLL_ADD:
+
+         if (!(h = get_fs_handle(sqe->fd)))
+            return -EBADF;
+
+         return (int)io_poll_revents(h, sqe->poll32_events);
+
+      case IORING_OP_OPENAT:
+         return io_req_openat(sqe);
+
+      case IORING_OP_CLOSE:
+         return sys_close(sqe->fd);
+
+      default:
+         return -EINVAL;
+   }
+}
+
+/*
+ * Execute a request like io_req_exec(), but never block: the caller holds the
+ * ring's lock. A read or a write that might wait for its file runs with the
+ * handle temporarily in non-blocking mode. Returns false, without touching
+ * *rc, when the request has to wait for its file to become ready.
+ */
+static bool io_req_try_exec(struct io_uring_sqe *sqe, int *rc)
+{
+   struct fs_handle_base *h = get_fs_handle(sqe->fd);
+   int res;
+
+   if (!h || !io_req_may_wait(h, sqe)) {
+      *rc = io_req_exec(sqe);
+      return true;
+   }
+
+   if (sqe->opcode == IORING_OP_POLL_ADD) {
+
+      if (!(res = io_req_exec(sqe)))
+         return false;
+
+   } else {
+
+      /* There are no threads in Tilck: nobody else can see the flag */
+      h->fl_flags |= O_NONBLOCK;
+      res = io_req_exec(sqe);
+      h->fl_flags &= ~O_NONBLOCK;
+
+      if (res == -EAGAIN)
+         return false;
+   }
+
+   *rc = res;
+   return true;
+}
+
+static bool io_req_wants_worker(struct io_uring_sqe *sqe)
+{
+   switch (sqe->opcode) {
+
+      case IORING_OP_FSYNC:
+         return true;
+
+      case IORING_OP_READ:
+      case IORING_OP_WRITE:
+         return (sqe->flags & IOSQE_ASYNC) &&
+                sqe->len > 0 &&
+                sqe->off <= (u64)OFFT_MAX;
+
+      default:
+         return false;
+   }
+}
+
+static void io_async_job(void *arg)
+{
+   struct io_req *req = arg;
+   struct io_ring *r = req->r;
+   const offt off = (offt)req->sqe.off;
+
+   switch (req->sqe.opcode) {
+
+      case IORING_OP_FSYNC:
+         req->res = vfs_fsync(req->h);
+         break;
+
+      case IORING_OP_READ:
+         req->res = (s32)vfs_pread(req->h, req->buf, req->buf_size, off);
+         break;
+
+      case IORING_OP_WRITE:
+         req->res = (s32)vfs_pwrite(req->h, req->buf, req->buf_size, off);
+         break;
+
+      default:
+         NOT_REACHED();
+   }
+
+   disable_preemption();
+   {
+      list_add_tail(&r->done, &req->node);
+   }
+   enable_preemption();
+
+   kcond_signal_all(&r->async_done);
+   io_ring_release(r);
+}
+
+static int io_ring_queue_async(struct io_ring *r, struct io_uring_sqe *sqe)
+{
+   fs_handle h = get_fs_handle(sqe->fd);
+   struct io_req *req;
+   int rc;
+
+   if (!h)
+      return -EBADF;
+
+   /* The whole request must fit in the bounce buffer: no short counts */
+   if (sqe->opcode != IORING_OP_FSYNC && sqe->len > IO_URING_MAX_ASYNC_IO)
+      return -EINVAL;
+
+   if (!(req = io_req_alloc(r, sqe)))
+      return -ENOMEM;
+
+   if (sqe->opcode != IORING_OP_FSYNC) {
+
+      req->buf_size = sqe->len;
+
+      if (!(req->buf = kmalloc(req->buf_size))) {
+         rc = -ENOMEM;
+         goto err;
+      }
+
+      if (sqe->opcode == IORING_OP_WRITE) {
+         void *u_buf = (void *)(ulong)sqe->addr;
+
+         if (copy_from_user(req->buf, u_buf, req->buf_size)) {
+            rc = -EFAULT;
+            goto err;
+         }
+      }
+   }
+
+   /* The user is free to close `fd` while the worker thread is using it */
+   if ((rc = vfs_dup(h, &req->h)))
+      goto err;
+
+   retain_obj(r);
+   r->inflight++;
+
+   if (!wth_enqueue_on(io_uring_wth, &io_async_job, req)) {
+
+      /*
+       * The queue of the worker thread is full: run the job synchronously.
+       * The request will be completed exactly as if it ran asynchronously.
+       */
+      io_async_job(req);
+   }
+
+   return 0;
+
+err:
+   io_req_free(req);
+   return rc;
+}
+
+static int io_req_arm_timeout(struct io_ring *r, struct io_req *req)
+{
+   const struct io_uring_sqe *sqe = &req->sqe;
+   struct k_io_timespec ts;
+   u64 ms;
+
+   if (sqe->len != 1 || (sqe->timeout_flags & IORING_TIMEOUT_ABS))
+      return -EINVAL;
+
+   if (copy_from_user(&ts, (void *)(ulong)sqe->addr, sizeof(ts)))
+      return -EFAULT;
+
+   if (ts.tv_sec < 0 || ts.tv_nsec < 0 || ts.tv_nsec >= 1000000000)
+      return -EINVAL;
+
+   ms = (u64)ts.tv_sec * 1000 + (u64)ts.tv_nsec / 1000000;
+   req->deadline = get_ticks() + MAX(ms_to_ticks(ms), 1ull);
+   req->cq_start = r->hdr->cq_tail;
+   req->cq_count = (u32)sqe->off;
+   return 0;
+}
+
+static int io_ring_park(struct io_ring *r, struct io_uring_sqe *sqe)
+{
+   struct io_req *req;
+   int rc;
+
+   if (!(req = io_req_alloc(r, sqe)))
+      return -ENOMEM;
+
+   if (sqe->opcode == IORING_OP_TIMEOUT) {
+      if ((rc = io_req_arm_timeout(r, req))) {
+         io_req_free(req);
+         return rc;
+      }
+   }
+
+   list_add_tail(&r->parked, &req->node);
+   r->inflight++;
+   return 0;
+}
+
+static void io_ring_issue(struct io_ring *r, struct io_uring_sqe *sqe)
+{
+   int rc;
+
+   if (sqe->flags & ~IOSQE_ASYNC) {
+
+      /* Linked requests, fixed files etc. are not supported */
+      rc = -EINVAL;
+
+   } else if (sqe->opcode == IORING_OP_TIMEOUT) {
+
+      if (!(rc = io_ring_park(r, sqe)))
+         return;
+
+   } else if (io_req_wants_worker(sqe) && !io_req_is_blocked(sqe)) {
+
+      if (!(rc = io_ring_queue_async(r, sqe)))
+         return;
+
+   } else if (!io_req_try_exec(sqe, &rc)) {
+
+      if (!(rc = io_ring_park(r, sqe)))
+         return;
+   }
+
+   io_ring_post(r, sqe->user_data, rc);
+}
+
+static int io_ring_submit(struct io_ring *r, u32 to_submit)
+{
+   struct io_rings_hdr *hdr = r->hdr;
+   const u32 tail = hdr->sq_tail;
+   u32 head = hdr->sq_head;
+   struct io_uring_sqe sqe;
+   const u32 avail = MIN(tail - head, r->sq_entries);
+   u32 idx, i, n = 0;
+
+   /* Read the SQEs only after having read the tail */
+   atomic_thread_fence(mo_acquire);
+
+   /*
+    * The tail is written by the user space: never consume more than a ring's
+    * worth of entries, no matter its value. The dropped entries (invalid index)
+    * are consumed too, so that the loop is always bounded by `sq_entries`.
+    */
+   to_submit = MIN(to_submit, avail);
+
+   for (i = 0; i < to_submit; i++, head++) {
+
+      if (!io_ring_cq_space(r))
+         break;
+
+      idx = *io_ring_sq_array(r, head & (r->sq_entries - 1));
+
+      if (idx >= r->sq_entries) {
+         hdr->sq_dropped++;
+         continue;
+      }
+
+      memcpy(&sqe, io_ring_sqe(r, idx), sizeof(sqe));
+      io_ring_issue(r, &sqe);
+      n++;
+   }
+
+   hdr->sq_head = head;
+
+   if (!i && to_submit)
+      return -EBUSY; /* the CQ ring is full */
+
+   return (int)n;
+}
+
+/* Post the completions of the requests run by the worker thread */
+static void io_ring_reap_async(struct io_ring *r)
+{
+   struct io_req *req;
+
+   while (true) {
+
+      disable_preemption();
+      {
+         req = !list_is_empty(&r->done)
+            ? list_first_obj(&r->done, struct io_req, node)
+            : NULL;
+
+         if (req)
+            list_remove(&req->node);
+      }
+      enable_preemption();
+
+      if (!req)
+         break;
+
+      if (req->sqe.opcode == IORING_OP_READ && req->res > 0) {
+
+         void *u_buf = (void *)(ulong)req->sqe.addr;
+
+         if (copy_to_user(u_buf, req->buf, (size_t)req->res))
+            req->res = -EFAULT;
+      }
+
+      r->inflight--;
+      io_ring_post(r, req->sqe.user_data, req->res);
+      io_req_free(req);
+   }
+}
+
+/* Complete the parked requests now ready and the expired timeouts */
+static void io_ring_reap_parked(struct io_ring *r)
+{
+   const u64 now = get_ticks();
+   struct io_req *pos, *temp;
+   int rc;
+
+   list_for_each(pos, temp, &r->parked, node) {
+
+      if (pos->sqe.opcode == IORING_OP_TIMEOUT) {
+
+         if (now >= pos->deadline)
+            rc = -ETIME;
+         else if (pos->cq_count &&
+                  r->hdr->cq_tail - pos->cq_start >= pos->cq_count)
+            rc = 0;
+         else
+            continue;
+
+      } else {
+
+         if (!io_req_try_exec(&pos->sqe, &rc))
+            continue;
+      }
+
+      list_remove(&pos->node);
+      r->inflight--;
+      io_ring_post(r, pos->sqe.user_data, rc);
+      io_req_free(pos);
+   }
+}
+
+static void io_ring_reap(struct io_ring *r)
+{
+   io_ring_reap_async(r);
+   io_ring_reap_parked(r);
+}
+
+static bool io_ring_any_parked_ready(struct io_ring *r)
+{
+   struct io_req *pos;
+
+   list_for_each_ro(pos, &r->parked, node) {
+
+      if (pos->sqe.opcode == IORING_OP_TIMEOUT)
+         continue;
+
+      if (!io_req_is_blocked(&pos->sqe))
+         return true;
+   }
+
+   return false;
+}
+
+/*
+ * Sleep until an async request completes, a parked request might progress
+ * or the earliest timeout expires.
+ */
+static int io_ring_sleep(struct io_ring *r)
+{
+   struct task *curr = get_curr_task();
+   struct multi_obj_waiter *w;
+   struct kcond *conds[3];
+   struct io_req *pos;
+   u64 deadline = 0, now, ticks;
+   int cnt = 1, idx = 0, n;
+   bool signaled = false;
+
+   list_for_each_ro(pos, &r->parked, node) {
+
+      if (pos->sqe.opcode != IORING_OP_TIMEOUT)
+         cnt += io_req_get_conds(&pos->sqe, conds);
+      else if (!deadline || pos->deadline < deadline)
+         deadline = pos->deadline;
+   }
+
+   if (!(w = allocate_mobj_waiter(cnt)))
+      return -ENOMEM;
+
+   mobj_waiter_set(w, idx++, WOBJ_KCOND,
+                   &r->async_done, &r->async_done.wait_list);
+
+   list_for_each_ro(pos, &r->parked, node) {
+
+      if (pos->sqe.opcode == IORING_OP_TIMEOUT)
+         continue;
+
+      n = io_req_get_conds(&pos->sqe, conds);
+
+      for (int i = 0; i < n; i++) {
+         ASSERT(idx < cnt);
+         mobj_waiter_set(w, idx++, WOBJ_KCOND,
+                         conds[i], &conds[i]->wait_list);
+      }
+   }
+
+   /*
+    * Now that we're on all the wait lists, check again for ready requests:
+    * that closes the window between io_ring_reap() and mobj_waiter_set().
+    */
+   if (io_ring_any_parked_ready(r))
+      goto out;
+
+   disable_preemption();
+
+   /* A signal that came before going to sleep resets its wait object */
+   for (int i = 0; i < idx && !signaled; i++)
+      signaled = !wait_obj_get_ptr(&w->elems[i].wobj);
+
+   if (signaled || !list_is_empty(&r->done)) {
+      enable_preemption();
+      goto out;
+   }
+
+   prepare_to_wait_on_multi_obj(w);
+
+   if (deadline) {
+      now = get_ticks();
+      ticks = deadline > now ? MIN(deadline - now, (u64)INT32_MAX) : 1;
+      task_set_wakeup_timer(curr, (u32)ticks);
+   }
+
+   enter_sleep_wait_state();
+
+   if (deadline) {
+
+      /* See poll_wait_on_cond() */
+      if (curr->wobj.type)
+         wait_obj_reset(&curr->wobj);   /* we woke-up because of the timeout */
+      else
+         task_cancel_wakeup_timer(curr);
+   }
+
+out:
+   free_mobj_waiter(w);
+   return 0;
+}
+
+static int io_ring_wait(struct io_ring *r, u32 min_complete)
+{
+   int rc;
+
+   while (true) {
+
+      io_ring_reap(r);
+
+      if (r->hdr->cq_tail - r->hdr->cq_head >= min_complete)
+         return 0;
+
+      if (!r->inflight)
+         return 0; /* Nothing else could ever complete: don't wait forever */
+
+      if (pending_signals())
+         return -EINTR;
+
+      if ((rc = io_ring_sleep(r)))
+         return rc;
+   }
+}
+
+int
+io_uring_enter(fs_handle h, u32 to_submit, u32 min_complete, u32 flags)
+{
+   struct kfs_handle *kh = h;
+   struct io_ring *r = (void *)kh->kobj;
+   int submitted, rc = 0;
+
+   ASSERT(is_io_uring_handle(h));
+
+   if (flags & ~IORING_ENTER_GETEVENTS)
+      return -EINVAL;
+
+   /* An inline CLOSE request might close the ring's own file descriptor */
+   retain_obj(r);
+   kmutex_lock(&r->lock);
+   {
+      submitted = io_ring_submit(r, to_submit);
+
+      if (flags & IORING_ENTER_GETEVENTS)
+         rc = io_ring_wait(r, MIN(min_complete, r->cq_entries));
+      else
+         io_ring_reap(r);
+   }
+   kmutex_unlock(&r->lock);
+   io_ring_release(r);
+   return submitted ? submitted : rc;
+}
+
+static int
+io_uring_mmap(struct user_mapping *um, pdir_t *pdir, int flags)
+{
+   struct kfs_handle *kh = um->h;
+   struct io_ring *r = (void *)kh->kobj;
+   const size_t off = um->off;
+   size_t base, size, rel;
+   int rc;
+
+   /* See shmfs_mmap() */
+   ASSERT(flags == 0);
+
+   if (off >= IORING_OFF_SQES) {
+
+      base = r->sqes_off;
+      size = r->shm->size - r->sqes_off;
+      rel = off - IORING_OFF_SQES;
+
+   } else {
+
+      /* IORING_FEAT_SINGLE_MMAP: the SQ and the CQ rings are the same area */
+      base = 0;
+      size = r->rings_size;
+      rel = off >= IORING_OFF_CQ_RING ? off - IORING_OFF_CQ_RING : off;
+   }
+
+   if (rel >= size || um->len > size - rel)
+      return -EINVAL;
+
+   um->off = base + rel;
+
+   if ((rc = shmem_map(r->shm, pdir, um))) {
+      um->off = off;
+      return rc;
+   }
+
+   /* Like in shmfs_mmap(), the mapping survives close() */
+   disable_preemption();
+   {
+      shmem_retain(r->shm);
+      um->shm = r->shm;
+      um->h = NULL;
+   }
+   enable_preemption();
+   return 0;
+}
+
+static int
+io_uring_munmap(struct user_mapping *um, void *vaddrp, size_t len)
+{
+   /* Unreachable in practice: see io_uring_mmap() */
+   shmem_unmap(um->pi->pdir, vaddrp, len);
+   return 0;
+}
+
+static const struct file_ops static_ops_io_uring =
+{
+   .mmap = io_uring_mmap,
+   .munmap = io_uring_munmap,
+};
+
+bool is_io_uring_handle(fs_handle h)
+{
+   struct fs_handle_base *hb = h;
+   return hb->fops == &static_ops_io_uring;
+}
+
+static int io_uring_create_wth(void)
+{
+   disable_preemption();
+   {
+      /*
+       * Created on first use. Its priority is the lowest one, because bulk
+       * I/O must never delay the worker threads handling IRQs.
+       */
+      if (!io_uring_wth) {
+         io_uring_wth = wth_create_thread("io_uring",
+                                          WTH_PRIO_LOWEST,
+                                          WTH_IO_URING_QUEUE_SIZE);
+      }
+   }
+   enable_preemption();
+   return io_uring_wth ? 0 : -ENOMEM;
+}
+
+static int io_ring_init_mem(struct io_ring *r)
+{
+   const size_t sqes_size = r->sq_entries * sizeof(struct io_uring_sqe);
+   struct io_rings_hdr *hdr;
+   int rc;
+
+   r->cqes_off = IO_RINGS_ARRAY_OFF + r->sq_entries * sizeof(u32);
+   r->cqes_off = pow2_round_up_at(r->cqes_off, sizeof(struct io_uring_cqe));
+
+   r->rings_size = r->cqes_off + r->cq_entries * sizeof(struct io_uring_cqe);
+   r->rings_size = pow2_round_up_at(r->rings_size, PAGE_SIZE);
+   r->sqes_off = r->rings_size;
+
+   r->shm = shmem_create(r->sqes_off + pow2_round_up_at(sqes_size, PAGE_SIZE));
+
+   if (!r->shm)
+      return -ENOMEM;
+
+   /* The kernel accesses the rings directly, through shmem_kva() */
+   if ((rc = shmem_populate(r->shm))) {
+      shmem_release(r->shm);
+      return rc;
+   }
+
+   hdr = r->hdr = shmem_kva(r->shm, 0);
+   hdr->sq_ring_mask = r->sq_entries - 1;
+   hdr->sq_ring_entries = r->sq_entries;
+   hdr->cq_ring_mask = r->cq_entries - 1;
+   hdr->cq_ring_entries = r->cq_entries;
+   return 0;
+}
+
+static void io_ring_fill_params(struct io_ring *r, struct io_uring_params *p)
+{
+   p->sq_entries = r->sq_entries;
+   p->cq_entries = r->cq_entries;
+   p->features = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP;
+
+   p->sq_off = (struct io_sqring_offsets) {
+      .head = offsetof(struct io_rings_hdr, sq_head),
+      .tail = offsetof(struct io_rings_hdr, sq_tail),
+      .ring_mask = offsetof(struct io_rings_hdr, sq_ring_mask),
+      .ring_entries = offsetof(struct io_rings_hdr, sq_ring_entries),
+      .flags = offsetof(struct io_rings_hdr, sq_flags),
+      .dropped = offsetof(struct io_rings_hdr, sq_dropped),
+      .array = IO_RINGS_ARRAY_OFF,
+   };
+
+   p->cq_off = (struct io_cqring_offsets) {
+      .head = offsetof(struct io_rings_hdr, cq_head),
+      .tail = offsetof(struct io_rings_hdr, cq_tail),
+      .ring_mask = offsetof(struct io_rings_hdr, cq_ring_mask),
+      .ring_entries = offsetof(struct io_rings_hdr, cq_ring_entries),
+      .overflow = offsetof(struct io_rings_hdr, cq_overflow),
+      .cqes = r->cqes_off,
+      .flags = offsetof(struct io_rings_hdr, cq_flags),
+   };
+}
+
+int io_uring_create(u32 entries, struct io_uring_params *p, fs_handle *out)
+{
+   struct kfs_handle *h;
+   struct io_ring *r;
+   u32 sq = 1, cq = 1;
+   int rc;
+
+   if (!entries || entries > IO_URING_MAX_ENTRIES)
+      return -EINVAL;
+
+   if (p->flags & ~IORING_SETUP_CQSIZE)
+      return -EINVAL;
+
+   while (sq < entries)
+      sq <<= 1;
+
+   if (p->flags & IORING_SETUP_CQSIZE) {
+
+      if (p->cq_entries < sq || p->cq_entries > 2 * IO_URING_MAX_ENTRIES)
+         return -EINVAL;
+
+      while (cq < p->cq_entries)
+         cq <<= 1;
+
+   } else {
+
+      cq = 2 * sq;
+   }
+
+   if ((rc = io_uring_create_wth()))
+      return rc;
+
+   if (!(r = kzalloc_obj(struct io_ring)))
+      return -ENOMEM;
+
+   r->sq_entries = sq;
+   r->cq_entries = cq;
+
+   if ((rc = io_ring_init_mem(r))) {
+      kfree_obj(r, struct io_ring);
+      return rc;
+   }
+
+   kmutex_init(&r->lock, 0);
+   kcond_init(&r->async_done);
+   list_init(&r->parked);
+   list_init(&r->done);
+   r->destory_obj = (void *)&destroy_io_ring;
+
+   if (!(h = kfs_create_new_handle(&static_ops_io_uring, (void *)r, O_RDWR))) {
+      destroy_io_ring(r);
+      return -ENOMEM;
+   }
+
+   h->spec_flags = VFS_SPFL_MMAP_SUPPORTED;
+   io_ring_fill_params(r, p);
+   *out = h;
+   return 0;
+}
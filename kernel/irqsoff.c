@@ -0,0 +1,138 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/config_debug.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/irqsoff.h>
+#include <tilck/kernel/hal.h>
+
+#if KERNEL_IRQSOFF_TRACER
+
+/*
+ * NOTE: the hooks below are called from disable_preemption(),
+ * disable_interrupts_forced() and their counterparts. Therefore, they must not
+ * call any of those functions, directly or indirectly.
+ *
+ * No locking is needed: the IRQs hooks are always called with the interrupts
+ * disabled, while the preemption ones are called with the preemption disabled
+ * counter equal to 1, so a nested IRQ handler cannot make the counter go from
+ * or to 0 while we're here.
+ */
+
+struct irqsoff_open_window {
+
+   u64 start;
+   ulong site;
+};
+
+struct irqsoff_info irqsoff_info = { .enabled = true };
+
+static struct irqsoff_open_window open_windows[IRQSOFF_KINDS];
+static struct irqsoff_max max_windows[IRQSOFF_KINDS];
+
+static const char *const irqsoff_kind_names[IRQSOFF_KINDS] = {
+   [irqsoff_irqs] = "irqsoff",
+   [irqsoff_preempt] = "preemptoff",
+};
+
+static ALWAYS_INLINE void
+irqsoff_begin(enum irqsoff_kind kind, ulong site, bool overwrite)
+{
+   struct irqsoff_open_window *w = &open_windows[kind];
+
+   if (!irqsoff_info.enabled)
+      return;
+
+   if (w->start && !overwrite)
+      return; /* keep the oldest opening, it's the real one */
+
+   w->start = RDTSC();
+   w->site = site;
+}
+
+static ALWAYS_INLINE void
+irqsoff_end(enum irqsoff_kind kind, ulong site)
+{
+   struct irqsoff_open_window *w = &open_windows[kind];
+   struct irqsoff_max *m = &max_windows[kind];
+   u64 duration;
+
+   if (!w->start)
+      return;
+
+   duration = RDTSC() - w->start;
+   w->start = 0;
+   m->windows++;
+
+   if (duration > m->max_cycles) {
+      m->max_cycles = duration;
+      m->start_site = w->site;
+      m->end_site = site;
+   }
+}
+
+#define HOOK_SITE(site) \
+   ((site) ? (site) : (ulong)__builtin_return_address(0))
+
+/*
+ * The interrupts can be disabled more times in a row: by the CPU, when
+ * entering an interrupt handler, and then by disable_interrupts_forced(). The
+ * window starts at the first of them.
+ */
+void irqsoff_trace_irqs_off(ulong site)
+{
+   irqsoff_begin(irqsoff_irqs, HOOK_SITE(site), false);
+}
+
+void irqsoff_trace_irqs_on(ulong site)
+{
+   irqsoff_end(irqsoff_irqs, HOOK_SITE(site));
+}
+
+/*
+ * The preemption counter transitions are exact, with the only exception of
+ * force_enable_preemption() and the fault resumable calls, which restore the
+ * counter without calling enable_preemption(): in that case, the stale window
+ * is simply overwritten by the next one.
+ */
+void irqsoff_trace_preempt_off(ulong site)
+{
+   irqsoff_begin(irqsoff_preempt, HOOK_SITE(site), true);
+}
+
+void irqsoff_trace_preempt_on(ulong site)
+{
+   irqsoff_end(irqsoff_preempt, HOOK_SITE(site));
+}
+
+void irqsoff_get_max(enum irqsoff_kind kind, struct irqsoff_max *m)
+{
+   ulong var;
+   ASSERT(kind < IRQSOFF_KINDS);
+
+   disable_interrupts(&var);
+   {
+      *m = max_windows[kind];
+   }
+   enable_interrupts(&var);
+}
+
+void irqsoff_reset(void)
+{
+   ulong var;
+   disable_interrupts(&var);
+   {
+      bzero(max_windows, sizeof(max_windows));
+   }
+   enable_interrupts(&var);
+}
+
+const char *irqsoff_get_kind_name(enum irqsoff_kind kind)
+{
+   ASSERT(kind < IRQSOFF_KINDS);
+   return irqsoff_kind_names[kind];
+}
+
+#endif // #if KERNEL_IRQSOFF_TRACER
@@ -73,7 +73,13 @@ panic_retry_hack:
    ret = !wait_obj_reset(&curr->wobj);
 
    if (m) {
-      kmutex_lock(m); // Re-acquire the lock [if any]
+
+      /* Re-acquire the lock [if any] */
+#if KERNEL_LOCKSTAT
+      kmutex_lock_at(m, (ulong)__builtin_return_address(0));
+#else
+      kmutex_lock(m);
+#endif
    }
 
    if (UNLIKELY(in_panic())) {
@@ -91,10 +91,47 @@ main_heaps_kfree(void *ptr, size_t *size, u32 flags)
    return 0;
 }
 
-void *general_kmalloc(size_t *size, u32 flags)
+static void *general_kmalloc_int(size_t *size, u32 flags)
 {
-   void *res;
    const u32 sub_block_sz = flags & KMALLOC_FL_SUB_BLOCK_MIN_SIZE_MASK;
+   void *res;
+
+   if (*size <= SMALL_HEAP_MAX_ALLOC ||
+       UNLIKELY(sub_block_sz && sub_block_sz <= SMALL_HEAP_MAX_ALLOC))
+   {
+      /* Small DMA allocations are not allowed */
+      ASSERT(~flags & KMALLOC_FL_DMA);
+      return small_heaps_kmalloc(size, flags);
+   }
+
+   res = main_heaps_kmalloc(size, flags);
+
+   if (UNLIKELY(res == NULL && ~flags & KMALLOC_FL_DMA))
+      res = main_heaps_kmalloc(size, flags | KMALLOC_FL_DMA);
+
+   /* Only the big allocations check the watermarks: that's cheap enough */
+   if (res != NULL)
+      check_memory_watermarks();
+
+   return res;
+}
+
+#if KMALLOC_SITE_PROF
+   #define GENERAL_KMALLOC_INLINE         ALWAYS_INLINE
+#else
+   #define GENERAL_KMALLOC_INLINE         inline
+#endif
+
+/*
+ * The actual general_kmalloc(), used by all the allocation functions. With
+ * KMALLOC_SITE_PROF, the allocation is accounted to the caller of the function
+ * owning the frame `site_fp`, i.e. of the allocation function itself: that's
+ * why in that case this function must be always inlined.
+ */
+static GENERAL_KMALLOC_INLINE void *
+do_general_kmalloc(size_t *size, u32 flags, void *site_fp)
+{
+   void *res;
    ASSERT(kmalloc_initialized);
    ASSERT(size != NULL);
    ASSERT(*size);
@@ -103,29 +140,34 @@ void *general_kmalloc(size_t *size, u32 flags)
    {
       const size_t orig_size = *size;
 
-      if (*size <= SMALL_HEAP_MAX_ALLOC ||
-          UNLIKELY(sub_block_sz && sub_block_sz <= SMALL_HEAP_MAX_ALLOC))
-      {
-         /* Small DMA allocations are not allowed */
-         ASSERT(~flags & KMALLOC_FL_DMA);
-         res = small_heaps_kmalloc(size, flags);
-
-      } else {
-
-         res = main_heaps_kmalloc(size, flags);
+      res = general_kmalloc_int(size, flags);
 
-         if (UNLIKELY(res == NULL && ~flags & KMALLOC_FL_DMA))
-            res = main_heaps_kmalloc(size, flags | KMALLOC_FL_DMA);
+      /* Out of memory: free some memory from the caches and retry once */
+      if (UNLIKELY(res == NULL) && shrink_memory(orig_size)) {
+         *size = orig_size;
+         res = general_kmalloc_int(size, flags);
       }
 
+      if (UNLIKELY(res == NULL))
+         tracepoint(tp_kmalloc_fail, orig_size, flags, 0);
+
       if (KMALLOC_HEAVY_STATS && res != NULL)
          if (~flags & KMALLOC_FL_DONT_ACCOUNT)
             kmalloc_account_alloc(orig_size);
+
+      if (KMALLOC_SITE_PROF && res != NULL)
+         if (!(flags & SITE_PROF_SKIP_FLAGS))
+            kmalloc_site_prof_alloc(res, *size, site_fp);
    }
    enable_preemption();
    return res;
 }
 
+void *general_kmalloc(size_t *size, u32 flags)
+{
+   return do_general_kmalloc(size, flags, __builtin_frame_address(0));
+}
+
 void general_kfree(void *ptr, size_t *size, u32 flags)
 {
    int rc;
@@ -163,6 +205,9 @@ void general_kfree(void *ptr, size_t *size, u32 flags)
          if (rc)
             rc = main_heaps_kfree(ptr, size, flags);
       }
+
+      if (KMALLOC_SITE_PROF && !rc)
+         kmalloc_site_prof_free(ptr);
    }
    enable_preemption();
 
@@ -180,7 +225,7 @@ void general_kfree(void *ptr, size_t *size, u32 flags)
  */
 void *aligned_kmalloc(size_t size, u32 align)
 {
-   void *res = general_kmalloc(&size, 0);
+   void *res = do_general_kmalloc(&size, 0, __builtin_frame_address(0));
 
    ASSERT(align > 0);
    ASSERT(align <= size);
@@ -198,3 +243,127 @@ void aligned_kfree2(void *ptr, size_t size)
 {
    general_kfree(ptr, &size, 0);
 }
+
+void *kmalloc_big_aligned(size_t size, u32 flags)
+{
+   void *res = NULL;
+   struct kmalloc_heap *h;
+   ulong va, hend;
+
+   ASSERT(kmalloc_initialized);
+   ASSERT(size > KMALLOC_MAX_ALIGN);
+   ASSERT(roundup_next_power_of_2(size) == size);
+
+   disable_preemption();
+   {
+      for (int i = used_heaps - 1; i >= 0 && !res; i--) {
+
+         h = heaps[i];
+         hend = h->vaddr + h->size;
+
+         if (h->dma || h->size - h->mem_allocated < size)
+            continue;
+
+         for (va = pow2_round_up_at(h->vaddr, size);
+              va < hend && hend - va >= size;
+              va += size)
+         {
+            if (per_heap_kmalloc_at(h, (void *)va, size, flags)) {
+               res = (void *)va;
+               break;
+            }
+         }
+      }
+
+      if (res) {
+
+         if (KMALLOC_SUPPORT_LEAK_DETECTOR && leak_detector_enabled) {
+            debug_kmalloc_register_alloc(res, size);
+         }
+
+         if (KMALLOC_HEAVY_STATS && ~flags & KMALLOC_FL_DONT_ACCOUNT) {
+            kmalloc_account_alloc(size);
+         }
+      }
+   }
+   enable_preemption();
+   return res;
+}
+
+void *kzmalloc(size_t size)
+{
+   size_t actual_size = size;
+   void *res;
+
+   res = do_general_kmalloc(&actual_size, 0, __builtin_frame_address(0));
+
+   if (!res)
+      return NULL;
+
+   bzero(res, size);
+   return res;
+}
+
+static
+void vfree_internal(ulong va_begin, ulong va_end)
+{
+   for (ulong va = va_begin; va < va_end; va += PAGE_SIZE)
+      unmap_kernel_page(TO_PTR(va), true);
+}
+
+void *vmalloc(size_t size)
+{
+   size_t actual_sz = pow2_round_up_at(size, PAGE_SIZE);
+   void *const fp = __builtin_frame_address(0);
+   ulong va, va_begin, va_end;
+   void *ptr;
+
+   ptr = do_general_kmalloc(&size, 0, fp);
+
+   if (ptr || !hi_vmem_avail())
+      return ptr;
+
+   ptr = hi_vmem_reserve(actual_sz);
+
+   va_begin = (ulong)ptr;
+   va_end = va_begin + actual_sz;
+
+   for (va = va_begin; va < va_end; va += PAGE_SIZE) {
+      if (map_kernel_page(TO_PTR(va), 0, PAGING_FL_RW | PAGING_FL_DO_ALLOC))
+         goto oom_case;
+   }
+
+   if (KMALLOC_SITE_PROF)
+      kmalloc_site_prof_alloc(TO_PTR(va_begin), actual_sz, fp);
+
+   return TO_PTR(va_begin);
+
+oom_case:
+
+   va_end = va;
+   vfree_internal(va_begin, va_end);
+   hi_vmem_release(TO_PTR(va_begin), actual_sz);
+   return NULL;
+
+}
+
+void vfree2(void *ptr, size_t size)
+{
+   if (!ptr)
+      return;
+
+   if ((ulong)ptr < LINEAR_MAPPING_END)
+      return kfree2(ptr, size);
+
+   size_t actual_sz = pow2_round_up_at(size, PAGE_SIZE);
+   ulong va_begin, va_end;
+
+   va_begin = (ulong)ptr;
+   va_end = va_begin + actual_sz;
+
+   if (KMALLOC_SITE_PROF)
+      kmalloc_site_prof_free(ptr);
+
+   vfree_internal(va_begin, va_end);
+   hi_vmem_release(TO_PTR(va_begin), actual_sz);
+}
@@ -15,6 +15,8 @@
 #include <tilck/kernel/sort.h>
 #include <tilck/kernel/errno.h>
 #include <tilck/kernel/worker_thread.h>
+#include <tilck/kernel/shrinker.h>
+#include <tilck/kernel/tracepoint.h>
 
 #include <tilck_gen_headers/config_kmalloc.h>
 
@@ -655,6 +657,22 @@ debug_check_block_size(struct kmalloc_heap *h, ulong vaddr, size_t size)
    }
 }
 
+/*
+ * Size of the biggest block starting at `offset` (relative to the beginning of
+ * the heap) which is naturally aligned and not bigger than `max_size`.
+ */
+static size_t
+aligned_sub_block_size(struct kmalloc_heap *h, ulong offset, size_t max_size)
+{
+   size_t s = offset ? (offset & -offset) : h->size;
+
+   while (s > max_size)
+      s >>= 1;
+
+   ASSERT(s >= h->min_block_size);
+   return s;
+}
+
 static void
 per_heap_kfree_unsafe(struct kmalloc_heap *h,
                       void *ptr,
@@ -704,17 +722,21 @@ per_heap_kfree_unsafe(struct kmalloc_heap *h,
    ASSERT(vaddr + size - 1 <= h->heap_last_byte);
    ASSERT(pow2_round_up_at(size, h->min_block_size) == size);
 
-   size_t tot = 0;
+   /*
+    * Free the range as a sequence of naturally aligned blocks. For ranges
+    * returned by per_heap_kmalloc() that's exactly the sequence of blocks it
+    * allocated, while for partial frees (and ranges allocated with
+    * per_heap_kmalloc_at()) that's the only sequence of valid nodes.
+    */
 
-   for (int i = (int)h->heap_data_size_log2 - 1; i >= 0 && tot < size; i--) {
+   size_t tot = 0, sub_block_size;
 
-      const size_t sub_block_size = (1 << i);
+   for (; tot < size; tot += sub_block_size) {
 
-      if (!(size & sub_block_size))
-         continue;
+      sub_block_size =
+         aligned_sub_block_size(h, vaddr + tot - h->vaddr, size - tot);
 
       internal_kfree(h, ptr + tot, sub_block_size, allow_split, do_actual_free);
-      tot += sub_block_size;
    }
 
    ASSERT(tot == size);
@@ -845,79 +867,170 @@ per_heap_kfree(struct kmalloc_heap *h,
    atomic_store_explicit(&h->in_use, false, mo_relaxed);
 }
 
-void *kzmalloc(size_t size)
+static bool
+is_heap_block_free(struct kmalloc_heap *h, ulong vaddr, size_t size)
 {
-   void *res = kmalloc(size);
+   struct block_node *nodes = h->metadata_nodes;
+   ulong va = h->vaddr;
+   size_t s = h->size;
+   int n = 0;
 
-   if (!res)
-      return NULL;
+   while (s > size) {
 
-   bzero(res, size);
-   return res;
-}
+      /*
+       * A node which is not split is either entirely free, or entirely used:
+       * no need to look at its children.
+       */
+      if (!nodes[n].split)
+         return !nodes[n].full;
 
-static
-void vfree_internal(ulong va_begin, ulong va_end)
-{
-   for (ulong va = va_begin; va < va_end; va += PAGE_SIZE)
-      unmap_kernel_page(TO_PTR(va), true);
+      s >>= 1;
+
+      if (vaddr >= va + s) {
+         va += s;
+         n = NODE_RIGHT(n);
+      } else {
+         n = NODE_LEFT(n);
+      }
+   }
+
+   return is_block_node_free(nodes[n]);
 }
 
-void *vmalloc(size_t size)
+static bool
+kmalloc_block_at(struct kmalloc_heap *h,
+                 ulong vaddr,
+                 size_t size,
+                 u32 sub_blocks_min_size,
+                 bool do_actual_alloc)
 {
-   size_t actual_sz = pow2_round_up_at(size, PAGE_SIZE);
-   ulong va, va_begin, va_end;
+   struct block_node *nodes = h->metadata_nodes;
+   ulong va = h->vaddr;
+   size_t s = h->size;
    void *ptr;
+   bool success;
+   int n = 0;
+
+   /* Split all the nodes in the path from the root to our block */
+   while (s > size) {
 
-   if (!hi_vmem_avail())
-      return kmalloc(size);
+      nodes[n].split = true;
+      s >>= 1;
+
+      if (vaddr >= va + s) {
+         va += s;
+         n = NODE_RIGHT(n);
+      } else {
+         n = NODE_LEFT(n);
+      }
+   }
 
-   ptr = kmalloc(size);
+   ASSERT(va == vaddr);
+   ASSERT(is_block_node_free(nodes[n]));
 
-   if (ptr)
-      return ptr;
+   success = actual_allocate_node(h, size, n, &ptr, do_actual_alloc);
 
-   ptr = hi_vmem_reserve(actual_sz);
+   /* Mark the parent nodes as 'full', when necessary */
+   for (int p = n; p != 0; ) {
 
-   va_begin = (ulong)ptr;
-   va_end = va_begin + actual_sz;
+      p = NODE_PARENT(p);
 
-   for (va = va_begin; va < va_end; va += PAGE_SIZE) {
-      if (map_kernel_page(TO_PTR(va), 0, PAGING_FL_RW | PAGING_FL_DO_ALLOC))
-         goto oom_case;
+      if (!nodes[NODE_LEFT(p)].full || !nodes[NODE_RIGHT(p)].full)
+         break;
+
+      nodes[p].full = true;
    }
 
-   return TO_PTR(va_begin);
+   if (UNLIKELY(!success)) {
 
-oom_case:
+      /* Same as in internal_kmalloc(): restore the heap's metadata */
+      s = size;
+      per_heap_kfree_unsafe(h, ptr, &s, 0);
+      return false;
+   }
 
-   va_end = va;
-   vfree_internal(va_begin, va_end);
-   hi_vmem_release(TO_PTR(va_begin), actual_sz);
-   return NULL;
+   if (do_actual_alloc)
+      h->mem_allocated += size;
+
+   if (sub_blocks_min_size)
+      internal_kmalloc_split_block(h, ptr, size, sub_blocks_min_size);
 
+   return true;
 }
 
-void vfree2(void *ptr, size_t size)
+static bool
+per_heap_kmalloc_at_unsafe(struct kmalloc_heap *h,
+                           void *ptr,
+                           size_t size,
+                           u32 flags)
 {
-   if (!ptr)
-      return;
+   const ulong vaddr = (ulong)ptr;
+   const bool do_actual_alloc = !(flags & KMALLOC_FL_NO_ACTUAL_ALLOC);
+   const u32 sub_blocks_min_size = flags & KMALLOC_FL_SUB_BLOCK_MIN_SIZE_MASK;
+   size_t tot, s;
+
+   ASSERT(size != 0);
+   ASSERT(!is_preemption_enabled());
+   ASSERT(!sub_blocks_min_size || sub_blocks_min_size >= h->min_block_size);
 
-   if ((ulong)ptr < LINEAR_MAPPING_END)
-      return kfree2(ptr, size);
+   if (vaddr < h->vaddr || size > h->size)
+      return false;
 
-   size_t actual_sz = pow2_round_up_at(size, PAGE_SIZE);
-   ulong va_begin, va_end;
+   if (vaddr - h->vaddr > h->size - size)
+      return false;
 
-   va_begin = (ulong)ptr;
-   va_end = va_begin + actual_sz;
+   if ((vaddr | size) & (h->min_block_size - 1))
+      return false;
+
+   /* First, check that the whole range is free */
+   for (tot = 0; tot < size; tot += s) {
+
+      s = aligned_sub_block_size(h, vaddr + tot - h->vaddr, size - tot);
+
+      if (!is_heap_block_free(h, vaddr + tot, s))
+         return false;
+   }
 
-   vfree_internal(va_begin, va_end);
-   hi_vmem_release(TO_PTR(va_begin), actual_sz);
+   /* Then, allocate it as a sequence of naturally aligned blocks */
+   for (tot = 0; tot < size; tot += s) {
+
+      s = aligned_sub_block_size(h, vaddr + tot - h->vaddr, size - tot);
+
+      if (!kmalloc_block_at(h, vaddr + tot, s,
+                            sub_blocks_min_size, do_actual_alloc))
+      {
+         if (tot) {
+            per_heap_kfree_unsafe(h, ptr, &tot,
+                                  KFREE_FL_ALLOW_SPLIT |
+                                  KFREE_FL_MULTI_STEP  |
+                                  (do_actual_alloc ?
+                                     0 : KFREE_FL_NO_ACTUAL_FREE));
+         }
+
+         return false;
+      }
+   }
+
+   return true;
+}
+
+bool
+per_heap_kmalloc_at(struct kmalloc_heap *h, void *ptr, size_t size, u32 flags)
+{
+   bool expected = false;
+   bool res;
+
+   if (!atomic_cas_strong(&h->in_use, &expected, true, mo_relaxed, mo_relaxed))
+      return false; /* heap already in use (we're in IRQ context) */
+
+   res = per_heap_kmalloc_at_unsafe(h, ptr, size, flags);
+   atomic_store_explicit(&h->in_use, false, mo_relaxed);
+   return res;
 }
 
 /* Natural continuation of this source file. Purpose: make this file shorter. */
 #include "kmalloc_stats.c.h"
+#include "kmalloc_site_prof.c.h"
 #include "kmalloc_small_heaps.c.h"
 #include "kmalloc_heaps.c.h"
 #include "general_kmalloc.c.h"
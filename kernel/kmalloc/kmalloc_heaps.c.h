@@ -142,74 +142,6 @@ void kmalloc_destroy_heap(struct kmalloc_heap *h)
    bzero(h, sizeof(struct kmalloc_heap));
 }
 
-struct kmalloc_heap *
-kmalloc_heap_dup_expanded(struct kmalloc_heap *h, size_t new_size)
-{
-   struct kmalloc_heap *new_heap;
-
-   /* `new_size` must at least as big as the old one */
-   ASSERT(new_size >= h->size);
-
-   /* `new_size` must be a power of 2 */
-   ASSERT(roundup_next_power_of_2(new_size) == new_size);
-
-   if (!h)
-      return NULL;
-
-   if (!(new_heap = kalloc_obj(struct kmalloc_heap)))
-      return NULL;
-
-   memcpy(new_heap, h, sizeof(struct kmalloc_heap));
-
-   new_heap->size = new_size;
-   new_heap->metadata_size =
-      calculate_heap_metadata_size(new_size, new_heap->min_block_size);
-
-   new_heap->metadata_nodes = vmalloc(new_heap->metadata_size);
-
-   if (!new_heap->metadata_nodes) {
-      kfree_obj(new_heap, struct kmalloc_heap);
-      return NULL;
-   }
-
-   if (new_size == h->size) {
-      memcpy(new_heap->metadata_nodes, h->metadata_nodes, h->metadata_size);
-      return new_heap;
-   }
-
-   kmalloc_heap_set_pre_calculated_values(new_heap);
-   bzero(new_heap->metadata_nodes, new_heap->metadata_size);
-
-   struct block_node *new_nodes = new_heap->metadata_nodes;
-   struct block_node *old_nodes = h->metadata_nodes;
-   size_t nodes_per_row = 1;
-   int new_idx, old_idx;
-
-   for (size_t size = new_heap->size; size >= h->min_block_size; size /= 2) {
-
-      new_idx = ptr_to_node(new_heap, TO_PTR(h->vaddr), size);
-
-      if (size > h->size) {
-
-         new_nodes[new_idx].split = true;
-
-      } else {
-
-         old_idx = ptr_to_node(h, TO_PTR(h->vaddr), size);
-         memcpy(&new_nodes[new_idx], &old_nodes[old_idx], nodes_per_row);
-         nodes_per_row *= 2;
-      }
-   }
-
-   return new_heap;
-}
-
-struct kmalloc_heap *
-kmalloc_heap_dup(struct kmalloc_heap *h)
-{
-   return kmalloc_heap_dup_expanded(h, h->size);
-}
-
 static size_t find_biggest_heap_size(ulong vaddr, ulong limit)
 {
    ulong curr_max = 512 * MB;
@@ -408,6 +340,9 @@ void init_kmalloc(void)
 
       max_tot_heap_mem_free += (h->size - h->mem_allocated);
    }
+
+   if (KMALLOC_SITE_PROF)
+      kmalloc_init_site_prof();
 }
 
 size_t kmalloc_get_max_tot_heap_free(void)
@@ -415,6 +350,19 @@ size_t kmalloc_get_max_tot_heap_free(void)
    return max_tot_heap_mem_free;
 }
 
+size_t kmalloc_get_tot_heap_free(void)
+{
+   size_t tot = 0;
+
+   disable_preemption();
+   {
+      for (int i = 0; i < used_heaps; i++)
+         tot += heaps[i]->size - heaps[i]->mem_allocated;
+   }
+   enable_preemption();
+   return tot;
+}
+
 void
 debug_kmalloc_get_heap_info_by_ptr(struct kmalloc_heap *h,
                                    struct debug_kmalloc_heap_info *i)
@@ -0,0 +1,291 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#ifndef _KMALLOC_C_
+
+   #error This is NOT a header file and it is not meant to be included
+
+   /*
+    * The only purpose of this file is to keep kmalloc.c shorter.
+    * Yes, this file could be turned into a regular C source file, but at the
+    * price of making several static functions and variables in kmalloc.c to be
+    * just non-static. We don't want that. Code isolation is a GOOD thing.
+    */
+
+#endif
+
+#include <tilck/kernel/debug_utils.h>
+
+/*
+ * Allocation-site profiler. Each allocation is accounted to its site: the
+ * return address of the allocation function called by the kernel code (e.g.
+ * kmalloc(), kzmalloc() or vmalloc()) or, with `backtrace` set, the first
+ * KMALLOC_SITE_FRAMES return addresses of the call stack. A hash table maps
+ * each live block to its site, so that kfree() can subtract the block from it.
+ *
+ * The allocations with a sub-block size (the user pages) and the internal ones
+ * of kmalloc (KMALLOC_FL_DONT_ACCOUNT) are not tracked. The same applies to
+ * the blocks allocated before init_kmalloc() and to the new blocks when any of
+ * the two tables is 3/4 full: those are just counted as dropped.
+ */
+
+struct kmalloc_site_prof_info kmalloc_site_prof_info;
+
+#define SITE_PROF_SKIP_FLAGS  (KMALLOC_FL_DONT_ACCOUNT |                   \
+                               KMALLOC_FL_MULTI_STEP |                     \
+                               KMALLOC_FL_SUB_BLOCK_MIN_SIZE_MASK)
+
+#if KMALLOC_SITE_PROF
+
+#define SITE_PROF_SITES_BUF_SIZE                     (64 * KB)
+#define SITE_PROF_BLOCKS_BUF_SIZE                   (256 * KB)
+
+struct site_prof_block {
+
+   ulong ptr;           /* 0 means empty slot */
+   ulong size;
+   u16 site;
+};
+
+/* The site indexes must fit in site_prof_block.site */
+STATIC_ASSERT(SITE_PROF_SITES_BUF_SIZE / sizeof(struct kmalloc_site) <= 0xffff);
+
+static struct kmalloc_site *sp_sites;
+static struct site_prof_block *sp_blocks;
+
+static ulong site_prof_hash(void *const *v, int n)
+{
+   ulong h = 0;
+
+   for (int i = 0; i < n; i++)
+      h = (h ^ (ulong)v[i]) * 0x9e3779b1;
+
+   return h ^ (h >> 16);
+}
+
+static ALWAYS_INLINE ulong site_prof_block_home(ulong ptr)
+{
+   return site_prof_hash((void **)&ptr, 1) % kmalloc_site_prof_info.max_blocks;
+}
+
+static ALWAYS_INLINE ulong site_prof_next_block(ulong i)
+{
+   return (i + 1) % kmalloc_site_prof_info.max_blocks;
+}
+
+/* Return the slot of `ptr` or the empty slot where it would be inserted */
+static struct site_prof_block *site_prof_lookup_block(ulong ptr)
+{
+   ulong i = site_prof_block_home(ptr);
+
+   while (sp_blocks[i].ptr && sp_blocks[i].ptr != ptr)
+      i = site_prof_next_block(i);
+
+   return &sp_blocks[i];
+}
+
+/*
+ * Linear probing without tombstones: after emptying a slot, move back the
+ * following entries that could not be in their home slot because of it.
+ */
+static void site_prof_remove_block(struct site_prof_block *b)
+{
+   ulong i = (ulong)(b - sp_blocks);
+   ulong j = i, k;
+
+   while (sp_blocks[j = site_prof_next_block(j)].ptr) {
+
+      k = site_prof_block_home(sp_blocks[j].ptr);
+
+      /* The entry at `j` can stay there if its home is cyclically in (i, j] */
+      if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+         continue;
+
+      sp_blocks[i] = sp_blocks[j];
+      i = j;
+   }
+
+   sp_blocks[i].ptr = 0;
+   kmalloc_site_prof_info.blocks--;
+}
+
+static void site_prof_release_block(struct site_prof_block *b)
+{
+   struct kmalloc_site *s = &sp_sites[b->site];
+
+   s->live_bytes -= b->size;
+   s->live_count--;
+   s->frees++;
+   site_prof_remove_block(b);
+}
+
+static long site_prof_get_site(void *const *frames)
+{
+   struct kmalloc_site_prof_info *info = &kmalloc_site_prof_info;
+   ulong i = site_prof_hash(frames, KMALLOC_SITE_FRAMES) % info->max_sites;
+   struct kmalloc_site *s;
+
+   for (; sp_sites[i].frames[0]; i = (i + 1) % info->max_sites) {
+      if (!memcmp(sp_sites[i].frames, frames, sizeof(s->frames)))
+         return (long)i;
+   }
+
+   if (info->sites >= info->max_sites * 3 / 4)
+      return -1;
+
+   s = &sp_sites[i];
+   memcpy(s->frames, frames, sizeof(s->frames));
+   info->sites++;
+   return (long)i;
+}
+
+/*
+ * Account the new block `ptr` to the caller of the function owning the frame
+ * `site_fp`, plus its callers, when `backtrace` is set.
+ */
+static void kmalloc_site_prof_alloc(void *ptr, size_t size, void *site_fp)
+{
+   struct kmalloc_site_prof_info *info = &kmalloc_site_prof_info;
+   void *frames[KMALLOC_SITE_FRAMES] = {0};
+   struct site_prof_block *b;
+   struct kmalloc_site *s;
+   long site = -1;
+   ulong var;
+
+   if (!sp_blocks)
+      return;
+
+   stackwalk32(frames, info->backtrace ? KMALLOC_SITE_FRAMES : 1, site_fp, 0);
+
+   disable_interrupts(&var);
+   {
+      b = site_prof_lookup_block((ulong)ptr);
+
+      if (b->ptr) {
+         /* Stale entry: the block has been freed in a non-tracked way */
+         site_prof_release_block(b);
+         b = site_prof_lookup_block((ulong)ptr);
+      }
+
+      if (frames[0] && info->blocks < info->max_blocks * 3 / 4)
+         site = site_prof_get_site(frames);
+
+      if (site >= 0) {
+
+         *b = (struct site_prof_block) {
+            .ptr = (ulong)ptr,
+            .size = size,
+            .site = (u16)site,
+         };
+
+         info->blocks++;
+         s = &sp_sites[site];
+         s->allocs++;
+         s->live_count++;
+         s->live_bytes += size;
+         s->peak_bytes = MAX(s->peak_bytes, s->live_bytes);
+
+      } else {
+
+         info->dropped++;
+      }
+   }
+   enable_interrupts(&var);
+}
+
+static void kmalloc_site_prof_free(void *ptr)
+{
+   struct site_prof_block *b;
+   ulong var;
+
+   if (!sp_blocks)
+      return;
+
+   disable_interrupts(&var);
+   {
+      if ((b = site_prof_lookup_block((ulong)ptr))->ptr)
+         site_prof_release_block(b);
+   }
+   enable_interrupts(&var);
+}
+
+static void kmalloc_init_site_prof(void)
+{
+   struct kmalloc_site_prof_info *info = &kmalloc_site_prof_info;
+   struct kmalloc_site *sites;
+   struct site_prof_block *blocks;
+
+   if (KERNEL_TEST_INT) {
+      /* Frame pointers and stack walks don't fit the unit tests */
+      return;
+   }
+
+   sites = kzmalloc(SITE_PROF_SITES_BUF_SIZE);
+   blocks = kzmalloc(SITE_PROF_BLOCKS_BUF_SIZE);
+
+   if (!sites || !blocks)
+      panic("Unable to alloc memory for the kmalloc site profiler");
+
+   info->max_sites = SITE_PROF_SITES_BUF_SIZE / sizeof(*sites);
+   info->max_blocks = SITE_PROF_BLOCKS_BUF_SIZE / sizeof(*blocks);
+
+   sp_sites = sites;
+   sp_blocks = blocks;
+   printk("kmalloc: site profiler enabled (%lu sites, %lu blocks)\n",
+          info->max_sites, info->max_blocks);
+}
+
+ulong debug_kmalloc_get_sites(struct kmalloc_site *buf, ulong max)
+{
+   ulong n = 0;
+   ulong var;
+
+   if (!sp_sites)
+      return 0;
+
+   disable_interrupts(&var);
+   {
+      for (ulong i = 0; i < kmalloc_site_prof_info.max_sites && n < max; i++)
+         if (sp_sites[i].frames[0])
+            buf[n++] = sp_sites[i];
+   }
+   enable_interrupts(&var);
+   return n;
+}
+
+void debug_kmalloc_sites_snapshot(void)
+{
+   struct kmalloc_site *s;
+   ulong var;
+
+   if (!sp_sites)
+      return;
+
+   disable_interrupts(&var);
+   {
+      for (ulong i = 0; i < kmalloc_site_prof_info.max_sites; i++) {
+         s = &sp_sites[i];
+         s->snap_bytes = s->live_bytes;
+         s->snap_count = s->live_count;
+      }
+
+      kmalloc_site_prof_info.snapshots++;
+   }
+   enable_interrupts(&var);
+}
+
+#else
+
+static ALWAYS_INLINE void
+kmalloc_site_prof_alloc(void *ptr, size_t size, void *site_fp) { }
+
+static ALWAYS_INLINE void kmalloc_site_prof_free(void *ptr) { }
+static ALWAYS_INLINE void kmalloc_init_site_prof(void) { }
+
+ulong debug_kmalloc_get_sites(struct kmalloc_site *buf, ulong max)
+{
+   return 0;
+}
+
+void debug_kmalloc_sites_snapshot(void) { }
+
+#endif // #if KMALLOC_SITE_PROF
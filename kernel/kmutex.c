@@ -6,6 +6,8 @@
 #include <tilck/kernel/sync.h>
 #include <tilck/kernel/sched.h>
 #include <tilck/kernel/irq.h>
+#include <tilck/kernel/hal.h>
+#include <tilck/kernel/lockstat.h>
 
 bool kmutex_is_curr_task_holding_lock(struct kmutex *m)
 {
@@ -36,8 +38,60 @@ kmutex_lock_enable_preemption_wrapper(struct kmutex *m)
 #endif
 }
 
-void kmutex_lock(struct kmutex *m)
+#if KERNEL_LOCKSTAT
+
+static ALWAYS_INLINE u64
+kmutex_lockstat_start(void)
+{
+   return RDTSC();
+}
+
+static void
+kmutex_lockstat_acquired(struct kmutex *m, ulong site, u64 start, bool cont)
+{
+   if (m->flags & KMUTEX_FL_NO_LOCKSTAT) {
+      m->ls_site = 0;
+      return;
+   }
+
+   m->ls_site = site;
+   m->ls_acquired = lockstat_acquired(m, site, lockstat_kmutex, start, cont);
+}
+
+static void
+kmutex_lockstat_released(struct kmutex *m)
 {
+   lockstat_released(m, m->ls_site, m->ls_acquired);
+   m->ls_site = 0;
+}
+
+#else
+
+static ALWAYS_INLINE u64
+kmutex_lockstat_start(void)
+{
+   return 0;
+}
+
+static ALWAYS_INLINE void
+kmutex_lockstat_acquired(struct kmutex *m, ulong site, u64 start, bool cont)
+{
+   /* do nothing */
+}
+
+static ALWAYS_INLINE void
+kmutex_lockstat_released(struct kmutex *m)
+{
+   /* do nothing */
+}
+
+#endif
+
+static ALWAYS_INLINE void
+kmutex_lock_int(struct kmutex *m, ulong site)
+{
+   const u64 start = kmutex_lockstat_start();
+
    disable_preemption();
    DEBUG_ONLY(check_not_in_irq_handler());
 
@@ -51,6 +105,7 @@ void kmutex_lock(struct kmutex *m)
          m->lock_count++;
       }
 
+      kmutex_lockstat_acquired(m, site, start, false);
       kmutex_lock_enable_preemption_wrapper(m);
       enable_preemption();
       return;
@@ -92,6 +147,7 @@ void kmutex_lock(struct kmutex *m)
 
    /* Now for sure this task should hold the mutex */
    ASSERT(kmutex_is_curr_task_holding_lock(m));
+   kmutex_lockstat_acquired(m, site, start, true);
 
    /*
     * DEBUG check: in case we went to sleep with a recursive mutex, then the
@@ -102,8 +158,23 @@ void kmutex_lock(struct kmutex *m)
    }
 }
 
+void kmutex_lock(struct kmutex *m)
+{
+   kmutex_lock_int(m, (ulong)__builtin_return_address(0));
+}
+
+#if KERNEL_LOCKSTAT
+
+void kmutex_lock_at(struct kmutex *m, ulong site)
+{
+   kmutex_lock_int(m, site);
+}
+
+#endif
+
 bool kmutex_trylock(struct kmutex *m)
 {
+   const u64 start = kmutex_lockstat_start();
    bool success = false;
 
    disable_preemption();
@@ -118,6 +189,11 @@ bool kmutex_trylock(struct kmutex *m)
       if (m->flags & KMUTEX_FL_RECURSIVE)
          m->lock_count++;
 
+      kmutex_lockstat_acquired(m,
+                               (ulong)__builtin_return_address(0),
+                               start,
+                               false);
+
    } else {
 
       /*
@@ -157,6 +233,7 @@ void kmutex_unlock(struct kmutex *m)
       // m->lock_count == 0: we have to really unlock the mutex
    }
 
+   kmutex_lockstat_released(m);
    m->owner_task = NULL;
 
    /* Unlock one task waiting to acquire the mutex 'm' (if any) */
@@ -0,0 +1,148 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/config_debug.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/lockstat.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/hal.h>
+
+#if KERNEL_LOCKSTAT
+
+/*
+ * A fixed-size open addressing hash table, keyed by (lock, site). Entries are
+ * never removed, except by lockstat_reset(): when the table is full, the new
+ * (lock, site) pairs are just counted as dropped. All the accesses happen with
+ * preemption disabled, which is enough since locks are never used in IRQ
+ * context.
+ */
+
+static struct lockstat_entry lockstat_table[LOCKSTAT_MAX_ENTRIES];
+static u32 lockstat_used;
+static ulong lockstat_dropped;
+
+STATIC_ASSERT((LOCKSTAT_MAX_ENTRIES & (LOCKSTAT_MAX_ENTRIES - 1)) == 0);
+
+static u32
+lockstat_hash(const void *lock, ulong site)
+{
+   ulong h = (ulong)lock ^ (site * 31);
+   h ^= h >> 11;
+   return (u32)(h * 2654435761u) & (LOCKSTAT_MAX_ENTRIES - 1);
+}
+
+static struct lockstat_entry *
+lockstat_lookup(const void *lock, ulong site, bool create)
+{
+   struct lockstat_entry *e;
+   u32 i = lockstat_hash(lock, site);
+
+   ASSERT(!is_preemption_enabled());
+
+   for (u32 n = 0; n < LOCKSTAT_MAX_ENTRIES; n++) {
+
+      e = &lockstat_table[(i + n) & (LOCKSTAT_MAX_ENTRIES - 1)];
+
+      if (e->lock == lock && e->site == site)
+         return e;
+
+      if (!e->lock) {
+
+         if (!create || lockstat_used == LOCKSTAT_MAX_ENTRIES - 1)
+            break; /* keep always a free slot, to stop the lookups */
+
+         e->lock = lock;
+         e->site = site;
+         lockstat_used++;
+         return e;
+      }
+   }
+
+   return NULL;
+}
+
+u64
+lockstat_acquired(const void *lock,
+                  ulong site,
+                  enum lockstat_type type,
+                  u64 start,
+                  bool contended)
+{
+   struct lockstat_entry *e;
+   const u64 now = RDTSC();
+   const u64 wait = now - start;
+
+   disable_preemption();
+   {
+      if ((e = lockstat_lookup(lock, site, true))) {
+
+         e->type = type;
+         e->acquisitions++;
+         e->tot_wait += wait;
+         e->max_wait = MAX(e->max_wait, wait);
+
+         if (contended)
+            e->contended++;
+
+      } else {
+
+         lockstat_dropped++;
+      }
+   }
+   enable_preemption();
+   return now;
+}
+
+void
+lockstat_released(const void *lock, ulong site, u64 acquired)
+{
+   struct lockstat_entry *e;
+   const u64 hold = RDTSC() - acquired;
+
+   if (!site)
+      return; /* the acquisition was not accounted */
+
+   disable_preemption();
+   {
+      if ((e = lockstat_lookup(lock, site, false)))
+         e->max_hold = MAX(e->max_hold, hold);
+   }
+   enable_preemption();
+}
+
+u32
+lockstat_get_entries(struct lockstat_entry *buf, u32 max)
+{
+   u32 cnt = 0;
+
+   disable_preemption();
+   {
+      for (u32 i = 0; i < LOCKSTAT_MAX_ENTRIES && cnt < max; i++)
+         if (lockstat_table[i].lock)
+            buf[cnt++] = lockstat_table[i];
+   }
+   enable_preemption();
+   return cnt;
+}
+
+ulong
+lockstat_get_dropped(void)
+{
+   return lockstat_dropped;
+}
+
+void
+lockstat_reset(void)
+{
+   disable_preemption();
+   {
+      bzero(lockstat_table, sizeof(lockstat_table));
+      lockstat_used = 0;
+      lockstat_dropped = 0;
+   }
+   enable_preemption();
+}
+
+#endif // #if KERNEL_LOCKSTAT
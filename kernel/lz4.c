@@ -0,0 +1,233 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/lz4.h>
+#include <tilck/kernel/errno.h>
+
+/*
+ * LZ4 block format: a sequence of [token, literals, offset, match] where the
+ * token has the length of the literals in the high 4 bits and the length of
+ * the match, minus MIN_MATCH, in the low 4 bits. In both cases, 15 means that
+ * more bytes follow, each one added to the length until one is < 255. The last
+ * sequence has just the literals.
+ */
+
+#define MIN_MATCH              4
+#define LAST_LITERALS          5  /* the last 5 bytes are always literals */
+#define MF_LIMIT              12  /* no match starts in the last 12 bytes */
+#define SKIP_TRIGGER           6  /* go faster on incompressible data */
+
+static ALWAYS_INLINE u32 read32(const u8 *p)
+{
+   u32 v;
+   memcpy(&v, p, sizeof(v));
+   return v;
+}
+
+static ALWAYS_INLINE u32 lz4_hash(u32 seq)
+{
+   return (seq * 2654435761u) >> (32 - LZ4_HASH_LOG);
+}
+
+static u8 *write_extra_len(u8 *op, u8 *oend, size_t len)
+{
+   for (; len >= 255; len -= 255) {
+
+      if (op == oend)
+         return NULL;
+
+      *op++ = 255;
+   }
+
+   if (op == oend)
+      return NULL;
+
+   *op++ = (u8)len;
+   return op;
+}
+
+/* Returns NULL when the output buffer is too small. No match if mlen == 0 */
+static u8 *
+write_sequence(u8 *op, u8 *oend,
+               const u8 *lit, size_t lit_len,
+               size_t off, size_t mlen)
+{
+   u8 *token;
+
+   if (op == oend)
+      return NULL;
+
+   token = op++;
+   *token = (u8)(MIN(lit_len, 15u) << 4);
+
+   if (lit_len >= 15 && !(op = write_extra_len(op, oend, lit_len - 15)))
+      return NULL;
+
+   if ((size_t)(oend - op) < lit_len)
+      return NULL;
+
+   memcpy(op, lit, lit_len);
+   op += lit_len;
+
+   if (!mlen)
+      return op;
+
+   if (oend - op < 2)
+      return NULL;
+
+   *op++ = (u8)off;
+   *op++ = (u8)(off >> 8);
+
+   mlen -= MIN_MATCH;
+   *token |= (u8)MIN(mlen, 15u);
+
+   if (mlen >= 15 && !(op = write_extra_len(op, oend, mlen - 15)))
+      return NULL;
+
+   return op;
+}
+
+size_t
+lz4_compress(const void *src, size_t len,
+             void *dst, size_t dst_cap, void *wrkmem)
+{
+   const u8 *const base = src;
+   const u8 *const iend = base + len;
+   const u8 *ip = base;
+   const u8 *anchor = base;
+   const u8 *ref, *m;
+   u8 *op = dst;
+   u8 *const oend = op + dst_cap;
+   u16 *const table = wrkmem;   /* positions: they fit in 16 bits */
+   u32 seq, h;
+
+   ASSERT(len <= LZ4_MAX_INPUT_SIZE);
+   bzero(table, LZ4_WRKMEM_SIZE);
+
+   if (len > MF_LIMIT) {
+
+      const u8 *const mflimit = iend - MF_LIMIT;
+      const u8 *const mlimit = iend - LAST_LITERALS;
+
+      while (ip < mflimit) {
+
+         seq = read32(ip);
+         h = lz4_hash(seq);
+         ref = base + table[h];
+         table[h] = (u16)(ip - base);
+
+         if (ref >= ip || read32(ref) != seq) {
+            ip += 1 + ((size_t)(ip - anchor) >> SKIP_TRIGGER);
+            continue;
+         }
+
+         /* Extend the match backwards, then forwards */
+         while (ip > anchor && ref > base && ip[-1] == ref[-1]) {
+            ip--;
+            ref--;
+         }
+
+         for (m = ip + MIN_MATCH; m < mlimit && *m == ref[m - ip]; m++) { }
+
+         op = write_sequence(op, oend,
+                             anchor, (size_t)(ip - anchor),
+                             (size_t)(ip - ref), (size_t)(m - ip));
+         if (!op)
+            return 0;
+
+         anchor = ip = m;
+
+         /* Index the position just before: it helps with the short runs */
+         table[lz4_hash(read32(ip - 2))] = (u16)(ip - 2 - base);
+      }
+   }
+
+   op = write_sequence(op, oend, anchor, (size_t)(iend - anchor), 0, 0);
+   return op ? (size_t)(op - (u8 *)dst) : 0;
+}
+
+static bool read_extra_len(const u8 **ip_ref, const u8 *iend, size_t *len)
+{
+   const u8 *ip = *ip_ref;
+   u8 b;
+
+   do {
+
+      if (ip == iend)
+         return false;
+
+      b = *ip++;
+      *len += b;
+
+   } while (b == 255);
+
+   *ip_ref = ip;
+   return true;
+}
+
+long
+lz4_decompress(const void *src, size_t len, void *dst, size_t dst_cap)
+{
+   const u8 *ip = src;
+   const u8 *const iend = ip + len;
+   u8 *op = dst;
+   u8 *const oend = op + dst_cap;
+   size_t lit_len, mlen, off;
+   const u8 *ref;
+   u8 token;
+
+   while (ip < iend) {
+
+      token = *ip++;
+      lit_len = token >> 4;
+
+      if (lit_len == 15 && !read_extra_len(&ip, iend, &lit_len))
+         return -EINVAL;
+
+      if (lit_len > (size_t)(iend - ip) || lit_len > (size_t)(oend - op))
+         return -EINVAL;
+
+      memcpy(op, ip, lit_len);
+      op += lit_len;
+      ip += lit_len;
+
+      if (ip == iend)
+         break; /* The last sequence has no match */
+
+      if (iend - ip < 2)
+         return -EINVAL;
+
+      off = ip[0] | ((size_t)ip[1] << 8);
+      ip += 2;
+      mlen = token & 15;
+
+      if (mlen == 15 && !read_extra_len(&ip, iend, &mlen))
+         return -EINVAL;
+
+      mlen += MIN_MATCH;
+
+      if (!off || off > (size_t)(op - (u8 *)dst))
+         return -EINVAL;
+
+      if (mlen > (size_t)(oend - op))
+         return -EINVAL;
+
+      ref = op - off;
+
+      if (off >= mlen) {
+
+         memcpy(op, ref, mlen);
+         op += mlen;
+
+      } else {
+
+         /* Overlapping copy: that's how the runs are encoded */
+         for (; mlen > 0; mlen--)
+            *op++ = *ref++;
+      }
+   }
+
+   return (long)(op - (u8 *)dst);
+}
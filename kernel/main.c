@@ -22,9 +22,15 @@
 #include <tilck/kernel/worker_thread.h>
 #include <tilck/kernel/fs/fat32.h>
 #include <tilck/kernel/fs/devfs.h>
+#include <tilck/kernel/fs/shmfs.h>
+#include <tilck/kernel/fs/ramfs.h>
 #include <tilck/kernel/timer.h>
 #include <tilck/kernel/syscalls.h>
 #include <tilck/kernel/system_mmap.h>
+#include <tilck/kernel/highmem.h>
+#include <tilck/kernel/shrinker.h>
+#include <tilck/kernel/swap.h>
+#include <tilck/kernel/exec_cache.h>
 #include <tilck/kernel/elf_utils.h>
 #include <tilck/kernel/cmdline.h>
 #include <tilck/kernel/self_tests.h>
@@ -246,9 +252,6 @@ out:
 static void
 mount_initrd(void)
 {
-   /* declare the ramfs_create() function */
-   struct mnt_fs *ramfs_create(void);
-
    struct mnt_fs *initrd, *ramfs;
    void *ramdisk;
    size_t ramdisk_size;
@@ -263,6 +266,9 @@ mount_initrd(void)
    if ((rc = mp_init(ramfs)))
       panic("mp_init() failed with error: %d", rc);
 
+   if ((rc = ramfs_compr_update(ramfs)))
+      panic("ramfs_compr_update() failed with error: %d", rc);
+
    if ((rc = vfs_mkdir("/tmp", 0777)))
       panic("vfs_mkdir(\"/tmp\") failed with error: %d", rc);
 
@@ -326,6 +332,7 @@ static void do_async_init()
 
    mount_initrd();
    init_devfs();
+   init_shmfs();
    init_modules();
    init_extra_debug_features();
 
@@ -357,6 +364,7 @@ kmain(u32 multiboot_magic, u32 mbi_addr)
    init_segmentation();
    init_fpu_memcpy();
    init_kmalloc();
+   init_highmem();
    init_paging();
 
    acpi_mod_init_tables();
@@ -367,6 +375,9 @@ kmain(u32 multiboot_magic, u32 mbi_addr)
    init_sched();
    init_syscall_interfaces();
    init_worker_threads();
+   init_shrinkers();
+   init_swap();
+   init_exec_cache();
    init_timer();
    init_system_time();
    init_kernelfs();
@@ -0,0 +1,156 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/config_mm.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+#include <tilck/common/utils.h>
+
+#include <tilck/kernel/highmem.h>
+#include <tilck/kernel/system_mmap.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/sched.h>
+
+/* The last page is left out: this way, the end always fits in an ulong */
+#define HIGHMEM_LIMIT                   (4096ull * MB - PAGE_SIZE)
+
+ulong highmem_total_pages;
+ulong highmem_free_pages;
+
+static u32 *free_bitmap;        /* 1 bit per pageframe, set when free */
+static u32 bitmap_words;
+static u32 next_word;           /* where to start looking for a free page */
+static ulong highmem_end;
+
+static bool
+get_highmem_range(struct mem_region *r, ulong *begin, ulong *end)
+{
+   u64 b = MAX(r->addr, (u64)LINEAR_MAPPING_SIZE);
+   u64 e = MIN(r->addr + r->len, HIGHMEM_LIMIT);
+
+   /* Only regular RAM: no ramdisks, framebuffers, ACPI tables etc. */
+   if (r->type != MULTIBOOT_MEMORY_AVAILABLE || r->extra)
+      return false;
+
+   b = (b + PAGE_SIZE - 1) & ~(u64)OFFSET_IN_PAGE_MASK;
+   e &= ~(u64)OFFSET_IN_PAGE_MASK;
+
+   if (b >= e)
+      return false;
+
+   *begin = (ulong)b;
+   *end = (ulong)e;
+   return true;
+}
+
+static ALWAYS_INLINE u32 paddr_to_bit(ulong paddr)
+{
+   return (u32)((paddr - LINEAR_MAPPING_SIZE) >> PAGE_SHIFT);
+}
+
+void init_highmem(void)
+{
+   struct mem_region r;
+   ulong begin, end;
+
+   if (!KERNEL_HIGHMEM)
+      return;
+
+   for (int i = 0; i < get_mem_regions_count(); i++) {
+
+      get_mem_region(i, &r);
+
+      if (get_highmem_range(&r, &begin, &end))
+         highmem_end = MAX(highmem_end, end);
+   }
+
+   if (!highmem_end)
+      return; /* No highmem: typical case with less than 896 MB of RAM */
+
+   bitmap_words = (paddr_to_bit(highmem_end) + 31) / 32;
+   free_bitmap = kzalloc_array_obj(u32, bitmap_words);
+
+   if (!free_bitmap) {
+      printk("highmem: unable to allocate the bitmap. Highmem disabled\n");
+      highmem_end = 0;
+      return;
+   }
+
+   for (int i = 0; i < get_mem_regions_count(); i++) {
+
+      get_mem_region(i, &r);
+
+      if (!get_highmem_range(&r, &begin, &end))
+         continue;
+
+      for (ulong pa = begin; pa < end; pa += PAGE_SIZE) {
+         const u32 bit = paddr_to_bit(pa);
+         free_bitmap[bit / 32] |= (1u << (bit % 32));
+         highmem_total_pages++;
+      }
+   }
+
+   highmem_free_pages = highmem_total_pages;
+   printk("highmem: %lu MB usable above the linear mapping\n",
+          highmem_total_pages >> (20 - PAGE_SHIFT));
+}
+
+ulong get_highmem_end(void)
+{
+   return highmem_end;
+}
+
+ulong highmem_alloc_page(void)
+{
+   ulong paddr = INVALID_PADDR;
+   u32 w, bit;
+
+   disable_preemption();
+
+   if (!highmem_free_pages)
+      goto out;
+
+   for (u32 i = 0; i < bitmap_words; i++) {
+
+      w = next_word;
+
+      if (free_bitmap[w]) {
+
+         bit = get_first_set_bit_index32(free_bitmap[w]);
+         free_bitmap[w] &= ~(1u << bit);
+         highmem_free_pages--;
+
+         paddr = LINEAR_MAPPING_SIZE + ((ulong)(w * 32 + bit) << PAGE_SHIFT);
+         break;
+      }
+
+      next_word = (next_word + 1 == bitmap_words) ? 0 : next_word + 1;
+   }
+
+   /* highmem_free_pages > 0 guarantees that we found a free page */
+   ASSERT(paddr != INVALID_PADDR);
+
+out:
+   enable_preemption();
+   return paddr;
+}
+
+void highmem_free_page(ulong paddr)
+{
+   const u32 bit = paddr_to_bit(paddr);
+
+   ASSERT(is_highmem_paddr(paddr));
+   ASSERT(paddr < highmem_end);
+   ASSERT(IS_PAGE_ALIGNED(paddr));
+
+   disable_preemption();
+   {
+      ASSERT(!(free_bitmap[bit / 32] & (1u << (bit % 32))));
+      free_bitmap[bit / 32] |= (1u << (bit % 32));
+      highmem_free_pages++;
+
+      /* Prefer the pages just freed: they're more likely to be cached */
+      next_word = bit / 32;
+   }
+   enable_preemption();
+}
@@ -10,62 +10,65 @@
 #include <tilck/kernel/process_mm.h>
 #include <tilck/kernel/kmalloc.h>
 #include <tilck/kernel/errno.h>
+#include <tilck/kernel/fs/vfs.h>
 #include <tilck/kernel/fs/devfs.h>
 #include <tilck/kernel/syscalls.h>
+#include <tilck/kernel/shmem.h>
+#include <tilck/kernel/highmem.h>
 
 #include <sys/mman.h>      // system header
 
-char page_size_buf[PAGE_SIZE] ALIGNED_AT(PAGE_SIZE);
-
-static inline void sys_brk_internal(struct process *pi, void *new_brk)
-{
-   ASSERT(!is_preemption_enabled());
-
-   if (new_brk < pi->brk) {
-
-      /* we have to free pages */
-
-      for (void *vaddr = new_brk; vaddr < pi->brk; vaddr += PAGE_SIZE) {
-         unmap_page(pi->pdir, vaddr, true);
-      }
-
-      pi->brk = new_brk;
-      return;
-   }
-
-   void *vaddr = pi->brk;
+#ifndef MREMAP_MAYMOVE
+   #define MREMAP_MAYMOVE  1
+#endif
 
-   while (vaddr < new_brk) {
+#ifndef MADV_FREE
+   #define MADV_FREE       8
+#endif
 
-      if (is_mapped(pi->pdir, vaddr))
-         return; // error: vaddr is already mapped!
+#ifndef MAP_FIXED_NOREPLACE
+   #define MAP_FIXED_NOREPLACE   0x100000
+#endif
 
-      vaddr += PAGE_SIZE;
-   }
+#define PROT_RW   (PROT_READ | PROT_WRITE)
 
-   /* OK, everything looks good here */
+char page_size_buf[PAGE_SIZE] ALIGNED_AT(PAGE_SIZE);
+ulong fault_around_pages = FAULT_AROUND_PAGES;
 
-   vaddr = pi->brk;
+/* Pages marked by madvise(MADV_FREE): just a hint, they might be gone */
+static size_t lazyfree_pages;
 
-   while (vaddr < new_brk) {
+bool is_lazy_user_vaddr(struct process *pi, void *vaddr)
+{
+   if (IN_RANGE(vaddr, pi->initial_brk, pi->brk))
+      return true;
 
-      void *kernel_vaddr = kmalloc(PAGE_SIZE);
+   return IN_RANGE((ulong)vaddr, USER_STACK_BOTTOM, USERMODE_VADDR_END);
+}
 
-      if (!kernel_vaddr)
-         break; /* we've allocated as much as possible */
+static inline void sys_brk_internal(struct process *pi, void *new_brk)
+{
+   ASSERT(!is_preemption_enabled());
 
-      const ulong paddr = KERNEL_VA_TO_PA(kernel_vaddr);
+   if (new_brk < pi->brk) {
 
-      if (map_page(pi->pdir, vaddr, paddr, PAGING_FL_RWUS) != 0) {
-         kfree2(kernel_vaddr, PAGE_SIZE);
-         break;
-      }
+      process_update_maxrss(pi);
 
-      vaddr += PAGE_SIZE;
+      /*
+       * We have to free pages. Only the ones touched at least once are
+       * actually mapped: see handle_potential_lazy_page().
+       */
+      unmap_pages_permissive(pi->pdir,
+                             new_brk,
+                             (size_t)(pi->brk - new_brk) >> PAGE_SHIFT,
+                             true);
    }
 
-   /* We're done. */
-   pi->brk = vaddr;
+   /*
+    * When growing, nothing gets allocated nor mapped here: the new pages will
+    * be allocated on the first access by the page fault handler.
+    */
+   pi->brk = new_brk;
 }
 
 void *sys_brk(void *new_brk)
@@ -103,115 +106,235 @@ void *sys_brk(void *new_brk)
    return pi->brk;
 }
 
-static int create_process_mmap_heap(struct process *pi)
+static int create_process_mappings_info(struct process *pi)
 {
-   struct kmalloc_heap *mmap_heap;
    ASSERT(!pi->mi);
 
    if (!(pi->mi = kalloc_obj(struct mappings_info)))
       return -ENOMEM;
 
-   if (!(mmap_heap = kzmalloc(kmalloc_get_heap_struct_size()))) {
-      kfree_obj(pi->mi, struct mappings_info);
-      return -ENOMEM;
-   }
+   user_vas_init(pi->mi);
+   return 0;
+}
 
-   list_init(&pi->mi->mappings);
-   pi->mi->mmap_heap = mmap_heap;
-   pi->mi->mmap_heap_size = USER_MMAP_MIN_SZ;
-
-   bool success =
-      kmalloc_create_heap(mmap_heap,
-                          USER_MMAP_BEGIN,
-                          pi->mi->mmap_heap_size,
-                          PAGE_SIZE,
-                          KMALLOC_MAX_ALIGN,    /* alloc block size */
-                          false,                /* linear mapping */
-                          NULL,                 /* metadata_nodes */
-#if MMAP_NO_COW
-                          user_valloc_and_map,
-                          user_vfree_and_unmap);
-#else
-                          user_map_zero_page,
-                          user_unmap_zero_page);
-#endif
+static bool is_handle_writable(struct fs_handle_base *h)
+{
+   const int fl = h->fl_flags;
+   return (fl & O_WRONLY) || (fl & O_RDWR) == O_RDWR;
+}
 
-   if (!success)
-      return -ENOMEM;
+static void unmap_anon_pages(struct process *pi, ulong vaddr, size_t len)
+{
+   unmap_pages_permissive(pi->pdir, (void *)vaddr, len >> PAGE_SHIFT, true);
+}
 
-   return 0;
+/*
+ * With MMAP_NO_COW, private anonymous memory is allocated right away: use big
+ * pages for the BIG_PAGE_SIZE-aligned blocks in the range, when possible.
+ */
+static bool valloc_anon_pages(struct process *pi, ulong vaddr, size_t len)
+{
+   const ulong vend = vaddr + len;
+   ulong va, end;
+
+   if (!MMAP_BIG_PAGES)
+      return user_valloc_and_map(vaddr, len >> PAGE_SHIFT);
+
+   for (va = vaddr; va < vend; va = end) {
+
+      end = MIN(vend, pow2_round_up_at(va + 1, BIG_PAGE_SIZE));
+
+      if (end - va == BIG_PAGE_SIZE && map_big_user_page(pi->pdir, (void *)va))
+         continue;
+
+      if (!user_valloc_and_map(va, (end - va) >> PAGE_SHIFT)) {
+         unmap_anon_pages(pi, vaddr, va - vaddr);
+         return false;
+      }
+   }
+
+   return true;
 }
 
-static inline void
-mmap_err_case_free(struct process *pi, void *ptr, size_t actual_len)
+/*
+ * Private anonymous memory is mapped to the zero page (CoW) as soon as it gets
+ * allocated, unless MMAP_NO_COW is set. With MMAP_BIG_PAGES, the first write
+ * on a BIG_PAGE_SIZE-aligned block fully inside the mapping replaces all of
+ * its zero pages with a big page: see handle_potential_cow().
+ */
+static bool map_anon_pages(struct process *pi, ulong vaddr, size_t len)
 {
-   per_heap_kfree(pi->mi->mmap_heap,
-                  ptr,
-                  &actual_len,
-                  KFREE_FL_ALLOW_SPLIT |
-                  KFREE_FL_MULTI_STEP  |
-                  KFREE_FL_NO_ACTUAL_FREE);
+   if (MMAP_NO_COW)
+      return valloc_anon_pages(pi, vaddr, len);
+
+   return user_map_zero_page(vaddr, len >> PAGE_SHIFT);
 }
 
-static struct user_mapping *
-mmap_on_user_heap(struct process *pi,
-                  size_t *actual_len_ref,
-                  fs_handle handle,
-                  u32 per_heap_kmalloc_flags,
-                  size_t off,
-                  int prot)
-{
-   void *res;
-   struct user_mapping *um;
+/*
+ * Split the big pages crossing the boundaries of [vaddr, vaddr + len), before
+ * un-mapping that range or changing its protection. Can fail only with -ENOMEM.
+ */
+static int split_big_pages_at_edges(struct process *pi, ulong vaddr, size_t len)
+{
+   const ulong vend = vaddr + len;
 
-   while (true) {
+   if (!MMAP_BIG_PAGES)
+      return 0;
 
-      struct kmalloc_heap *new_heap;
-      struct kmalloc_heap *h = pi->mi->mmap_heap;
-      size_t heap_sz = pi->mi->mmap_heap_size;
+   if (vaddr & (BIG_PAGE_SIZE - 1)) {
+      if (split_big_user_pages(pi->pdir, (void *)vaddr, 1))
+         return -ENOMEM;
+   }
 
-      res = per_heap_kmalloc(h,
-                             actual_len_ref,
-                             per_heap_kmalloc_flags);
+   if (vend & (BIG_PAGE_SIZE - 1)) {
+      if (split_big_user_pages(pi->pdir, (void *)(vend - PAGE_SIZE), 1))
+         return -ENOMEM;
+   }
 
-      if (LIKELY(res != NULL))
-         break;        /* great! */
+   return 0;
+}
 
-      if (heap_sz == USER_MMAP_MAX_SZ)
-         return NULL; /* cannot expand the heap more than that */
+/*
+ * Pick the best-fitting free range for a new mapping. Big anonymous mappings
+ * get a range aligned at BIG_PAGE_SIZE, when possible, for the big pages.
+ */
+static ulong get_free_vrange(struct process *pi, size_t len, bool anon)
+{
+   ulong vaddr;
 
-      new_heap = kmalloc_heap_dup_expanded(h, heap_sz * 2);
+   if (MMAP_BIG_PAGES && anon && len >= BIG_PAGE_SIZE) {
 
-      if (!new_heap)
-         return NULL; /* no enough memory */
+      vaddr = user_vas_get_free_range(pi->mi, len + BIG_PAGE_SIZE - PAGE_SIZE);
 
-      pi->mi->mmap_heap_size = heap_sz * 2;
-      pi->mi->mmap_heap = new_heap;
-      kmalloc_destroy_heap(h);
+      if (vaddr)
+         return pow2_round_up_at(vaddr, BIG_PAGE_SIZE);
    }
 
+   return user_vas_get_free_range(pi->mi, len);
+}
+
+/*
+ * Create a new user mapping of `len` bytes at `vaddr` or, when `vaddr` is 0,
+ * at the best-fitting free range in the mmap area. The caller has to check
+ * that [vaddr, vaddr + len) is free.
+ */
+static struct user_mapping *
+mmap_user_vrange(struct process *pi,
+                 ulong vaddr,
+                 size_t len,
+                 fs_handle handle,
+                 bool anon,
+                 size_t off,
+                 int prot)
+{
+   struct user_mapping *um;
+
+   ASSERT(!is_preemption_enabled());
+
+   if (!vaddr && !(vaddr = get_free_vrange(pi, len, anon)))
+      return NULL;
+
+   if (anon && !map_anon_pages(pi, vaddr, len))
+      return NULL;
+
    /* NOTE: here `handle` might be NULL (zero-map case) and that's OK */
-   um = process_add_user_mapping(handle, res, *actual_len_ref, off, prot);
+   um = process_add_user_mapping(handle, (void *)vaddr, len, off, prot);
 
    if (!um) {
-      mmap_err_case_free(pi, res, *actual_len_ref);
+
+      if (anon)
+         unmap_anon_pages(pi, vaddr, len);
+
       return NULL;
    }
 
    return um;
 }
 
+/*
+ * MAP_POPULATE for private anonymous memory: replace the zero-page mappings
+ * with actual pages (big pages, when possible), in order to avoid a CoW fault
+ * on each first write. This is just an optimization: on out-of-memory, we just
+ * stop populating.
+ */
+static void populate_anon_pages(struct process *pi, ulong vaddr, size_t len)
+{
+   const ulong vend = vaddr + len;
+   ulong paddr;
+   int rc;
+
+   ASSERT(!is_preemption_enabled());
+
+   for (; vaddr < vend; vaddr += PAGE_SIZE) {
+
+      if (MMAP_BIG_PAGES &&
+          !(vaddr & (BIG_PAGE_SIZE - 1)) &&
+          vend - vaddr >= BIG_PAGE_SIZE &&
+          map_big_user_page(pi->pdir, (void *)vaddr))
+      {
+         vaddr += BIG_PAGE_SIZE - PAGE_SIZE;
+         continue;
+      }
+
+      if ((paddr = pageframe_alloc(true)) == INVALID_PADDR)
+         break;
+
+      unmap_page(pi->pdir, (void *)vaddr, false);
+
+      /* Cannot fail: the page table already exists */
+      rc = map_page(pi->pdir, (void *)vaddr, paddr, PAGING_FL_RWUS);
+
+      ASSERT(rc == 0);
+      (void) rc; /* prevent the "unused variable" Werror in release */
+   }
+}
+
+static int munmap_range(struct process *pi, ulong vaddr, ulong vend);
+
+/*
+ * Pick the address of a new mapping. Without MAP_FIXED, `addr` is just a hint,
+ * honored only if the whole range is free. With MAP_FIXED, the mappings
+ * overlapping with the range get un-mapped, unless MAP_FIXED_NOREPLACE is set.
+ */
+static int
+mmap_get_vaddr(struct process *pi, ulong addr, size_t len, int flags,
+               ulong *vaddr_ref)
+{
+   *vaddr_ref = 0;
+
+   if (!(flags & (MAP_FIXED | MAP_FIXED_NOREPLACE))) {
+
+      if (IS_PAGE_ALIGNED(addr) && user_vas_is_range_free(pi->mi, addr, len))
+         *vaddr_ref = addr;
+
+      return 0;
+   }
+
+   if (!user_vas_is_range_free(pi->mi, addr, len)) {
+
+      if (flags & MAP_FIXED_NOREPLACE)
+         return -EEXIST;
+
+      if (munmap_range(pi, addr, addr + len))
+         return -ENOMEM;
+   }
+
+   *vaddr_ref = addr;
+   return 0;
+}
+
 long
 sys_mmap_pgoff(void *addr, size_t len, int prot,
                int flags, int fd, size_t pgoffset)
 {
-   u32 per_heap_kmalloc_flags = KMALLOC_FL_MULTI_STEP | PAGE_SIZE;
    struct task *curr = get_curr_task();
    struct process *pi = curr->pi;
    struct fs_handle_base *handle = NULL;
    struct user_mapping *um = NULL;
+   struct shmem *shm = NULL;
    size_t actual_len;
-   int rc, fl;
+   ulong vaddr;
+   int rc;
 
    if ((flags & MAP_PRIVATE) && (flags & MAP_SHARED))
       return -EINVAL; /* non-sense parameters */
@@ -219,31 +342,53 @@ sys_mmap_pgoff(void *addr, size_t len, int prot,
    if (!len)
       return -EINVAL;
 
-   if (addr)
-      return -EINVAL; /* addr != NULL not supported */
-
-   if (!(prot & PROT_READ))
+   if (prot & ~(PROT_READ | PROT_WRITE | PROT_EXEC))
       return -EINVAL;
 
+   if (prot & PROT_WRITE)
+      prot |= PROT_READ;   /* write-only pages do not exist on x86 */
+
    actual_len = pow2_round_up_at(len, PAGE_SIZE);
 
-   if (fd == -1) {
+   if (!actual_len || actual_len > USER_MMAP_MAX_SZ)
+      return -ENOMEM;
 
-      if (!(flags & MAP_ANONYMOUS))
+   if (flags & (MAP_FIXED | MAP_FIXED_NOREPLACE)) {
+
+      if (!IS_PAGE_ALIGNED(addr))
          return -EINVAL;
 
-      if (flags & MAP_SHARED)
-         return -EINVAL; /* MAP_SHARED not supported for anonymous mappings */
+      /* Only the mmap area is supported for fixed mappings */
+      if ((ulong)addr < USER_MMAP_BEGIN ||
+          (ulong)addr + actual_len > USER_MMAP_END ||
+          (ulong)addr + actual_len < (ulong)addr)
+      {
+         return -ENOMEM;
+      }
+   }
 
-      if (!(flags & MAP_PRIVATE))
+   if (fd == -1) {
+
+      if (!(flags & MAP_ANONYMOUS))
          return -EINVAL;
 
-      if ((prot & (PROT_READ | PROT_WRITE)) != (PROT_READ | PROT_WRITE))
+      if (!(flags & (MAP_PRIVATE | MAP_SHARED)))
          return -EINVAL;
 
       if (pgoffset != 0)
          return -EINVAL; /* pgoffset != 0 does not make sense here */
 
+      if (flags & MAP_SHARED) {
+
+         /*
+          * Anonymous shared memory is backed by a shared-page object, exactly
+          * like the memfd and /dev/shm files: its pages are mapped as shared
+          * and, therefore, they're not CoW-ed by fork().
+          */
+         if (!(shm = shmem_create(actual_len)))
+            return -ENOMEM;
+      }
+
    } else {
 
       if (!(flags & MAP_SHARED))
@@ -254,45 +399,68 @@ sys_mmap_pgoff(void *addr, size_t len, int prot,
       if (!handle)
          return -EBADF;
 
-      fl = handle->fl_flags;
-
-      if ((prot & (PROT_READ | PROT_WRITE)) == 0)
+      if (!(prot & PROT_READ))
          return -EINVAL; /* nor read nor write prot */
 
-      if ((prot & (PROT_READ | PROT_WRITE)) == PROT_WRITE)
-         return -EINVAL; /* disallow write-only mappings */
-
-      if (prot & PROT_WRITE) {
-         if (!(fl & O_WRONLY) && (fl & O_RDWR) != O_RDWR)
-            return -EACCES;
-      }
-
-      per_heap_kmalloc_flags |= KMALLOC_FL_NO_ACTUAL_ALLOC;
+      if ((prot & PROT_WRITE) && !is_handle_writable(handle))
+         return -EACCES;
    }
 
-   if (!pi->mi)
-      if ((rc = create_process_mmap_heap(pi)))
+   if (!pi->mi) {
+      if ((rc = create_process_mappings_info(pi))) {
+         if (shm)
+            shmem_release(shm);
          return rc;
+      }
+   }
 
    disable_preemption();
    {
-      um = mmap_on_user_heap(pi,
-                             &actual_len,
-                             handle,
-                             per_heap_kmalloc_flags,
-                             pgoffset << PAGE_SHIFT,
-                             prot);
+      rc = mmap_get_vaddr(pi, (ulong)addr, actual_len, flags, &vaddr);
+
+      if (!rc) {
+
+         um = mmap_user_vrange(pi,
+                               vaddr,
+                               actual_len,
+                               handle,
+                               !handle && !shm,
+                               pgoffset << PAGE_SHIFT,
+                               prot);
+
+         if (um)
+            um->shm = shm;      /* the mapping takes over our reference */
+         else
+            rc = -ENOMEM;
+      }
    }
    enable_preemption();
 
-   if (!um)
-      return -ENOMEM;
+   if (!um) {
+      if (shm)
+         shmem_release(shm);
+      return rc;
+   }
+
+   if (shm) {
+
+      if ((rc = shmem_map(shm, pi->pdir, um))) {
+
+         disable_preemption();
+         {
+            process_remove_user_mapping(um);
+         }
+         enable_preemption();
+         return rc;
+      }
 
-   ASSERT(actual_len == pow2_round_up_at(len, PAGE_SIZE));
+   } else if (handle) {
 
-   if (handle) {
+      rc = vfs_mmap(um,
+                    pi->pdir,
+                    (flags & MAP_POPULATE) ? VFS_MM_POPULATE : 0);
 
-      if ((rc = vfs_mmap(um, pi->pdir, 0))) {
+      if (rc) {
 
          /*
           * Everything was apparently OK and the allocation in the user virtual
@@ -302,7 +470,6 @@ sys_mmap_pgoff(void *addr, size_t len, int prot,
 
          disable_preemption();
          {
-            mmap_err_case_free(pi, um->vaddrp, actual_len);
             process_remove_user_mapping(um);
          }
          enable_preemption();
@@ -314,14 +481,45 @@ sys_mmap_pgoff(void *addr, size_t len, int prot,
 
       if (MMAP_NO_COW)
          bzero(um->vaddrp, actual_len);
+      else if ((flags & MAP_POPULATE) && (prot & PROT_WRITE)) {
+
+         disable_preemption();
+         {
+            populate_anon_pages(pi, um->vaddr, actual_len);
+         }
+         enable_preemption();
+      }
+   }
+
+   if ((prot & PROT_RW) != PROT_RW) {
+
+      disable_preemption();
+      {
+         set_pages_prot(pi->pdir, um->vaddrp, actual_len >> PAGE_SHIFT, prot);
+      }
+      enable_preemption();
    }
 
    return (long)um->vaddr;
 }
 
+static void reset_anon_pages_range(pdir_t *pdir, ulong vaddr, ulong vend)
+{
+   int rc;
+
+   for (; vaddr < vend; vaddr += PAGE_SIZE) {
+
+      unmap_page(pdir, (void *)vaddr, true);
+
+      /* Cannot fail: the page table already exists */
+      rc = map_zero_page(pdir, (void *)vaddr, PAGING_FL_US | PAGING_FL_RW);
+      ASSERT(rc == 0);
+      (void) rc; /* prevent the "unused variable" Werror in release */
+   }
+}
+
 static int munmap_int(struct process *pi, void *vaddrp, size_t len)
 {
-   u32 kfree_flags = KFREE_FL_ALLOW_SPLIT | KFREE_FL_MULTI_STEP;
    struct user_mapping *um = NULL, *um2 = NULL;
    ulong vaddr = (ulong) vaddrp;
    size_t actual_len;
@@ -345,33 +543,36 @@ static int munmap_int(struct process *pi, void *vaddrp, size_t len)
    }
 
    const ulong um_vend = um->vaddr + um->len;
+   const bool full_unmap = actual_len == um->len;
+   const bool anon = !um->h && !um->shm;
 
-   if (actual_len == um->len) {
+   if (anon && (rc = split_big_pages_at_edges(pi, vaddr, actual_len)))
+      return rc;
 
-      process_remove_user_mapping(um);
-
-   } else {
+   if (!full_unmap) {
 
       /* partial un-map */
 
       if (vaddr == um->vaddr) {
 
          /* unmap the beginning of the chunk */
-         um->vaddr += actual_len;
+         user_vas_resize(pi->mi,
+                         um,
+                         um->vaddr + actual_len,
+                         um->len - actual_len);
          um->off += actual_len;
-         um->len -= actual_len;
 
       } else if (vaddr + actual_len == um_vend) {
 
          /* unmap the end of the chunk */
-         um->len -= actual_len;
+         user_vas_resize(pi->mi, um, um->vaddr, um->len - actual_len);
 
       } else {
 
          /* Unmap something at the middle of the chunk */
 
          /* Shrink the current struct user_mapping */
-         um->len = vaddr - um->vaddr;
+         user_vas_resize(pi->mi, um, um->vaddr, vaddr - um->vaddr);
 
          /* Create a new struct user_mapping for its 2nd part */
          um2 = process_add_user_mapping(
@@ -388,15 +589,25 @@ static int munmap_int(struct process *pi, void *vaddrp, size_t len)
              * Oops, we're out-of-memory! No problem, revert um->page_count
              * and return -ENOMEM. Linux is allowed to do that.
              */
-            um->len = um_vend - um->vaddr;
+            user_vas_resize(pi->mi, um, um->vaddr, um_vend - um->vaddr);
             return -ENOMEM;
          }
+
+         um2->advice = um->advice;
+
+         if (um->shm) {
+            um2->shm = um->shm;
+            shmem_retain(um2->shm);
+         }
       }
    }
 
-   if (um->h) {
+   if (um->shm) {
+
+      shmem_unmap(pi->pdir, vaddrp, actual_len);
+
+   } else if (um->h) {
 
-      kfree_flags |= KFREE_FL_NO_ACTUAL_FREE;
       rc = vfs_munmap(um, vaddrp, actual_len);
 
       /*
@@ -412,12 +623,36 @@ static int munmap_int(struct process *pi, void *vaddrp, size_t len)
          vfs_mmap(um2, pi->pdir, VFS_MM_DONT_MMAP);
    }
 
-   per_heap_kfree(pi->mi->mmap_heap,
-                  vaddrp,
-                  &actual_len,
-                  kfree_flags);
+   if (full_unmap)
+      process_remove_user_mapping(um);
+
+   if (anon)
+      unmap_anon_pages(pi, vaddr, actual_len);
+
+   return 0;
+}
+
+/* Un-map [vaddr, vend), which might span over multiple mappings and holes */
+static int munmap_range(struct process *pi, ulong vaddr, ulong vend)
+{
+   struct user_mapping *um;
+   ulong va, end;
+   int rc;
+
+   ASSERT(!is_preemption_enabled());
+
+   for (va = vaddr; va < vend; va = end) {
+
+      if (!(um = user_vas_find_next(pi->mi, va)) || um->vaddr >= vend)
+         break;
+
+      va = MAX(va, um->vaddr);
+      end = MIN(vend, um->vaddr + um->len);
+
+      if ((rc = munmap_int(pi, (void *)va, end - va)))
+         return rc;
+   }
 
-   ASSERT(actual_len == pow2_round_up_at(len, PAGE_SIZE));
    return 0;
 }
 
@@ -426,21 +661,560 @@ int sys_munmap(void *vaddrp, size_t len)
    struct task *curr = get_curr_task();
    struct process *pi = curr->pi;
    ulong vaddr = (ulong) vaddrp;
+   ulong vend;
+   int rc;
+
+   if (!len || !pi->mi || !IS_PAGE_ALIGNED(vaddr))
+      return -EINVAL;
+
+   vend = vaddr + pow2_round_up_at(len, PAGE_SIZE);
+
+   if (vaddr < USER_MMAP_BEGIN || vend > USER_MMAP_END || vend < vaddr)
+      return -EINVAL;
+
+   disable_preemption();
+   {
+      process_update_maxrss(pi);
+      rc = munmap_range(pi, vaddr, vend);
+   }
+   enable_preemption();
+   return rc;
+}
+
+static struct user_mapping *
+split_user_mapping(struct process *pi, struct user_mapping *um, ulong vaddr)
+{
+   const size_t off = vaddr - um->vaddr;
+   const size_t orig_len = um->len;
+   struct user_mapping *um2;
+
+   ASSERT(IS_PAGE_ALIGNED(vaddr));
+   ASSERT(um->vaddr < vaddr && vaddr < um->vaddr + um->len);
+
+   user_vas_resize(pi->mi, um, um->vaddr, off);
+   um2 = process_add_user_mapping(um->h,
+                                  (void *)vaddr,
+                                  orig_len - off,
+                                  um->off + off,
+                                  um->prot);
+
+   if (!um2) {
+      user_vas_resize(pi->mi, um, um->vaddr, orig_len);
+      return NULL;
+   }
+
+   um2->advice = um->advice;
+
+   if (um->shm) {
+      um2->shm = um->shm;
+      shmem_retain(um2->shm);
+   }
+
+   if (um->h)
+      vfs_mmap(um2, pi->pdir, VFS_MM_DONT_MMAP);
+
+   return um2;
+}
+
+/*
+ * Split `um` (containing `vaddr`) in order to make its part overlapping with
+ * [vaddr, vend) a user_mapping on its own, and return that. NULL means OOM.
+ */
+static struct user_mapping *
+isolate_user_mapping(struct process *pi,
+                     struct user_mapping *um,
+                     ulong vaddr,
+                     ulong vend)
+{
+   if (um->vaddr < vaddr) {
+      if (!(um = split_user_mapping(pi, um, vaddr)))
+         return NULL;
+   }
+
+   if (um->vaddr + um->len > vend) {
+      if (!split_user_mapping(pi, um, vend))
+         return NULL;
+   }
+
+   return um;
+}
+
+static int
+mprotect_int(struct process *pi, ulong vaddr, ulong vend, int prot)
+{
+   struct user_mapping *um;
+   ulong va;
+
+   ASSERT(!is_preemption_enabled());
+
+   /* First, check the whole range, in order to fail without side-effects */
+   for (va = vaddr; va < vend; va = um->vaddr + um->len) {
+
+      if (!(um = process_get_user_mapping((void *)va)))
+         return -ENOMEM;
+
+      if ((prot & PROT_WRITE) && um->h && !is_handle_writable(um->h))
+         return -EACCES;
+   }
+
+   if (split_big_pages_at_edges(pi, vaddr, vend - vaddr))
+      return -ENOMEM;
+
+   for (va = vaddr; va < vend; va = um->vaddr + um->len) {
+
+      um = process_get_user_mapping((void *)va);
+
+      if (um->prot == prot)
+         continue;
+
+      if (!(um = isolate_user_mapping(pi, um, va, vend)))
+         return -ENOMEM;
+
+      um->prot = prot;
+      set_pages_prot(pi->pdir, um->vaddrp, um->len >> PAGE_SHIFT, prot);
+   }
+
+   return 0;
+}
+
+int sys_mprotect(void *vaddrp, size_t len, int prot)
+{
+   struct process *pi = get_curr_proc();
+   const ulong vaddr = (ulong)vaddrp;
+   ulong vend;
    int rc;
 
-   if (!len || !pi->mi->mmap_heap)
+   if (!IS_PAGE_ALIGNED(vaddr))
+      return -EINVAL;
+
+   if (prot & ~(PROT_READ | PROT_WRITE | PROT_EXEC))
       return -EINVAL;
 
-   if (!IN_RANGE(vaddr,
-                 USER_MMAP_BEGIN,
-                 USER_MMAP_BEGIN + pi->mi->mmap_heap_size))
+   if (!len)
+      return 0;
+
+   if (prot & PROT_WRITE)
+      prot |= PROT_READ;   /* write-only pages do not exist on x86 */
+
+   vend = vaddr + pow2_round_up_at(len, PAGE_SIZE);
+
+   if (vend < vaddr || !pi->mi)
+      return -ENOMEM;
+
+   disable_preemption();
+   {
+      rc = mprotect_int(pi, vaddr, vend, prot);
+   }
+   enable_preemption();
+   return rc;
+}
+
+/*
+ * Zero the pages just added at the end of an anonymous mapping (only when they
+ * are not CoW zero pages) and apply them the protection of the mapping.
+ */
+static void
+mremap_init_new_pages(struct process *pi, struct user_mapping *um, size_t off)
+{
+   void *va = um->vaddrp + off;
+   const size_t len = um->len - off;
+
+   if (MMAP_NO_COW)
+      bzero(va, len);
+
+   if ((um->prot & PROT_RW) != PROT_RW)
+      set_pages_prot(pi->pdir, va, len >> PAGE_SHIFT, um->prot);
+}
+
+static bool
+mremap_grow_in_place(struct process *pi, struct user_mapping *um, size_t diff)
+{
+   const ulong vend = um->vaddr + um->len;
+   const size_t old_len = um->len;
+
+   if (!user_vas_is_range_free(pi->mi, vend, diff))
+      return false;
+
+   if (!map_anon_pages(pi, vend, diff))
+      return false;
+
+   user_vas_resize(pi->mi, um, um->vaddr, um->len + diff);
+   mremap_init_new_pages(pi, um, old_len);
+   return true;
+}
+
+/*
+ * Move [vaddr, vaddr + old_len) to a new place in the mmap heap, big enough
+ * for new_len bytes. No data is copied: the page table entries are just moved
+ * to their new location.
+ */
+static long
+mremap_move(struct process *pi,
+            struct user_mapping *um,
+            ulong vaddr,
+            size_t old_len,
+            size_t new_len)
+{
+   struct user_mapping *new_um;
+   int rc;
+
+   new_um = mmap_user_vrange(pi, 0, new_len, NULL, true, 0, um->prot);
+
+   if (!new_um)
+      return -ENOMEM;
+
+   new_um->advice = um->advice;
+
+   /* The page table entries are moved one by one: split any big page */
+   if (split_big_user_pages(pi->pdir, (void *)vaddr, old_len >> PAGE_SHIFT) ||
+       split_big_user_pages(pi->pdir, new_um->vaddrp, old_len >> PAGE_SHIFT))
    {
+      munmap_int(pi, new_um->vaddrp, new_len);
+      return -ENOMEM;
+   }
+
+   /*
+    * Both the ranges are fully mapped: after the swap, the old one contains
+    * the fresh pages of the new one, and they'll be freed by munmap_int().
+    */
+   swap_pages_mappings(pi->pdir,
+                       (void *)vaddr,
+                       new_um->vaddrp,
+                       old_len >> PAGE_SHIFT);
+
+   if ((rc = munmap_int(pi, (void *)vaddr, old_len))) {
+
+      /* Out of memory while splitting the old mapping: revert everything */
+      swap_pages_mappings(pi->pdir,
+                          (void *)vaddr,
+                          new_um->vaddrp,
+                          old_len >> PAGE_SHIFT);
+
+      munmap_int(pi, new_um->vaddrp, new_len);
+      return rc;
+   }
+
+   mremap_init_new_pages(pi, new_um, old_len);
+   return (long)new_um->vaddr;
+}
+
+static long
+mremap_int(struct process *pi,
+           ulong vaddr,
+           size_t old_len,
+           size_t new_len,
+           int flags)
+{
+   struct user_mapping *um;
+
+   ASSERT(!is_preemption_enabled());
+
+   um = process_get_user_mapping((void *)vaddr);
+
+   if (!um || vaddr + old_len > um->vaddr + um->len)
+      return -EFAULT;
+
+   if (new_len == old_len)
+      return (long)vaddr;
+
+   if (new_len < old_len) {
+
+      int rc = munmap_int(pi, (void *)(vaddr + new_len), old_len - new_len);
+      return rc ? rc : (long)vaddr;
+   }
+
+   /* Only private anonymous mappings can grow */
+   if (um->h || um->shm)
       return -EINVAL;
+
+   if (vaddr + old_len == um->vaddr + um->len) {
+      if (mremap_grow_in_place(pi, um, new_len - old_len))
+         return (long)vaddr;
    }
 
+   if (!(flags & MREMAP_MAYMOVE))
+      return -ENOMEM;
+
+   return mremap_move(pi, um, vaddr, old_len, new_len);
+}
+
+long
+sys_mremap(void *old_vaddr, size_t old_len,
+           size_t new_len, int flags, void *new_vaddr)
+{
+   struct process *pi = get_curr_proc();
+   const ulong vaddr = (ulong)old_vaddr;
+   long rc;
+
+   if (flags & ~MREMAP_MAYMOVE)
+      return -EINVAL; /* MREMAP_FIXED and MREMAP_DONTUNMAP are not supported */
+
+   if (!IS_PAGE_ALIGNED(vaddr) || !old_len || !new_len)
+      return -EINVAL;
+
+   if (old_len > USER_MMAP_MAX_SZ || new_len > USER_MMAP_MAX_SZ)
+      return -ENOMEM;
+
+   if (!pi->mi)
+      return -EFAULT;
+
+   old_len = pow2_round_up_at(old_len, PAGE_SIZE);
+   new_len = pow2_round_up_at(new_len, PAGE_SIZE);
+
    disable_preemption();
    {
-      rc = munmap_int(pi, vaddrp, len);
+      if (new_len < old_len)
+         process_update_maxrss(pi);
+
+      rc = mremap_int(pi, vaddr, old_len, new_len, flags);
+   }
+   enable_preemption();
+   return rc;
+}
+
+static int reclaim_lazyfree_visit_cb(void *obj, void *arg)
+{
+   struct task *ti = obj;
+   struct process *pi = ti->pi;
+   size_t *count = arg;
+   struct user_mapping *um;
+
+   if (is_kernel_thread(ti) || !is_main_thread(ti))
+      return 0;
+
+   if (ti->state == TASK_STATE_ZOMBIE || !pi->mi)
+      return 0;
+
+   list_for_each_ro(um, &pi->mi->mappings, pi_node) {
+
+      if (um->h || um->shm)
+         continue;
+
+      *count += reclaim_lazyfree_pages(pi->pdir,
+                                       um->vaddrp,
+                                       um->len >> PAGE_SHIFT);
+   }
+
+   return 0;
+}
+
+size_t reclaim_lazyfree_memory(void)
+{
+   size_t count = 0;
+
+   if (!lazyfree_pages)
+      return 0;
+
+   disable_preemption();
+   {
+      iterate_over_tasks(&reclaim_lazyfree_visit_cb, &count);
+      lazyfree_pages = 0;
+   }
+   enable_preemption();
+   return count;
+}
+
+/*
+ * Can the pages of `um` be dropped and re-created later by the page fault
+ * handler? That's not the case for file-systems without a handle_fault func.
+ */
+static bool can_drop_mapping_pages(struct user_mapping *um)
+{
+   struct fs_handle_base *hb = um->h;
+   return !hb || hb->fops->handle_fault != NULL;
+}
+
+static void
+madvise_dontneed(struct process *pi, struct user_mapping *um,
+                 ulong vaddr, ulong vend)
+{
+   const size_t len = vend - vaddr;
+   int rc;
+
+   if (um->shm) {
+
+      shmem_unmap(pi->pdir, (void *)vaddr, len);
+
+   } else if (um->h) {
+
+      /* The data stays in the file: the pages will be just mapped again */
+      rc = vfs_munmap(um, (void *)vaddr, len);
+      ASSERT(rc == 0);
+      (void) rc; /* prevent the "unused variable" Werror in release */
+
+   } else {
+
+      reset_anon_pages_range(pi->pdir, vaddr, vend);
+
+      if ((um->prot & PROT_RW) != PROT_RW)
+         set_pages_prot(pi->pdir, (void *)vaddr, len >> PAGE_SHIFT, um->prot);
+   }
+}
+
+static void
+madvise_willneed(struct process *pi, struct user_mapping *um,
+                 ulong vaddr, ulong vend)
+{
+   struct user_mapping tmp;
+
+   if (!um->h && !um->shm) {
+
+      /* Bring back the swapped-out pages, if any. Just a hint, as well */
+      swap_in_pages(pi->pdir, (void *)vaddr, (vend - vaddr) >> PAGE_SHIFT);
+      return;
+   }
+
+   if (!um->h || !can_drop_mapping_pages(um))
+      return; /* Shared memory is never swapped out: nothing to do */
+
+   /*
+    * Map all the resident pages of the file in the range, using a temporary
+    * copy of `um`, restricted to [vaddr, vend), never registered in the inode.
+    * This is just a hint: it's fine to ignore any out-of-memory error.
+    */
+   tmp = *um;
+   tmp.off = um->off + (vaddr - um->vaddr);
+   tmp.vaddr = vaddr;
+   tmp.len = vend - vaddr;
+   vfs_mmap(&tmp, pi->pdir, VFS_MM_DONT_REGISTER | VFS_MM_POPULATE);
+}
+
+static int
+madvise_mapping(struct process *pi, struct user_mapping *um,
+                ulong vaddr, ulong vend, int advice)
+{
+   const bool anon = !um->h && !um->shm;
+
+   if (anon && (advice == MADV_DONTNEED || advice == MADV_FREE)) {
+
+      /* These advices work on single pages: split the big pages first */
+      if (split_big_user_pages(pi->pdir,
+                               (void *)vaddr,
+                               (vend - vaddr) >> PAGE_SHIFT))
+      {
+         return -ENOMEM;
+      }
+   }
+
+   switch (advice) {
+
+      case MADV_DONTNEED:
+         madvise_dontneed(pi, um, vaddr, vend);
+         break;
+
+      case MADV_FREE:
+         lazyfree_pages += mark_pages_lazyfree(pi->pdir,
+                                               (void *)vaddr,
+                                               (vend - vaddr) >> PAGE_SHIFT);
+         break;
+
+      case MADV_WILLNEED:
+         madvise_willneed(pi, um, vaddr, vend);
+         break;
+
+      case MADV_NORMAL:
+      case MADV_RANDOM:
+      case MADV_SEQUENTIAL:
+
+         if (um->advice == advice)
+            break;
+
+         if (!(um = isolate_user_mapping(pi, um, vaddr, vend)))
+            return -ENOMEM;
+
+         um->advice = advice;
+         break;
+
+      default:
+         /* Other hints are accepted, but they're just no-ops */
+         break;
+   }
+
+   return 0;
+}
+
+/*
+ * Pages in the brk heap and in the user stack, populated on-demand: dropping
+ * them is all we can do, for both MADV_DONTNEED and MADV_FREE.
+ */
+static void
+madvise_lazy_page(struct process *pi, ulong vaddr, int advice)
+{
+   if (advice == MADV_DONTNEED || advice == MADV_FREE)
+      unmap_page_permissive(pi->pdir, (void *)vaddr, true);
+}
+
+static int
+madvise_int(struct process *pi, ulong vaddr, ulong vend, int advice)
+{
+   struct user_mapping *um;
+   ulong va, end;
+   int rc;
+
+   ASSERT(!is_preemption_enabled());
+
+   /* First, check the whole range, in order to fail without side-effects */
+   for (va = vaddr; va < vend; va = end) {
+
+      if (!(um = process_get_user_mapping((void *)va))) {
+
+         if (!is_lazy_user_vaddr(pi, (void *)va))
+            return -ENOMEM;
+
+         end = va + PAGE_SIZE;
+         continue;
+      }
+
+      end = um->vaddr + um->len;
+
+      if (advice == MADV_DONTNEED && !can_drop_mapping_pages(um))
+         return -EINVAL;
+
+      if (advice == MADV_FREE && (um->h || um->shm))
+         return -EINVAL; /* Valid only for private anonymous memory */
+   }
+
+   for (va = vaddr; va < vend; va = end) {
+
+      if (!(um = process_get_user_mapping((void *)va))) {
+         madvise_lazy_page(pi, va, advice);
+         end = va + PAGE_SIZE;
+         continue;
+      }
+
+      end = MIN(um->vaddr + um->len, vend);
+
+      if ((rc = madvise_mapping(pi, um, va, end, advice)))
+         return rc;
+   }
+
+   return 0;
+}
+
+int sys_madvise(void *addrp, size_t len, int advice)
+{
+   struct process *pi = get_curr_proc();
+   const ulong vaddr = (ulong)addrp;
+   ulong vend;
+   int rc;
+
+   if (!IS_PAGE_ALIGNED(vaddr))
+      return -EINVAL;
+
+   if (!len)
+      return 0;
+
+   vend = vaddr + pow2_round_up_at(len, PAGE_SIZE);
+
+   if (vend < vaddr || !pi->mi)
+      return -ENOMEM;
+
+   disable_preemption();
+   {
+      if (advice == MADV_DONTNEED || advice == MADV_FREE)
+         process_update_maxrss(pi);
+
+      rc = madvise_int(pi, vaddr, vend, advice);
    }
    enable_preemption();
    return rc;
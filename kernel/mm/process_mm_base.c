@@ -3,6 +3,7 @@
 #include <tilck/kernel/process_mm.h>
 #include <tilck/kernel/process.h>
 #include <tilck/kernel/paging_hw.h>
+#include <tilck/kernel/shmem.h>
 
 struct user_mapping *
 process_add_user_mapping(fs_handle h,
@@ -16,8 +17,8 @@ process_add_user_mapping(fs_handle h,
 
    ASSERT((len & OFFSET_IN_PAGE_MASK) == 0);
    ASSERT(!is_preemption_enabled());
-   ASSERT(!process_get_user_mapping(vaddr));
    ASSERT(pi->mi);
+   ASSERT(user_vas_is_range_free(pi->mi, (ulong)vaddr, len));
 
    if (!(um = kzalloc_obj(struct user_mapping)))
       return NULL;
@@ -33,48 +34,41 @@ process_add_user_mapping(fs_handle h,
    um->prot = prot;
 
    list_add_tail(&pi->mi->mappings, &um->pi_node);
+   user_vas_insert(pi->mi, um);
    return um;
 }
 
 void process_remove_user_mapping(struct user_mapping *um)
 {
+   struct process *pi = get_curr_proc();
+
    ASSERT(!is_preemption_enabled());
+   ASSERT(pi->mi);
 
+   user_vas_remove(pi->mi, um);
    list_remove(&um->pi_node);
    list_remove(&um->inode_node);
+
+   if (um->shm)
+      shmem_release(um->shm);
+
    kfree_obj(um, struct user_mapping);
 }
 
 struct user_mapping *process_get_user_mapping(void *vaddrp)
 {
-   const ulong vaddr = (ulong)vaddrp;
    struct process *pi = get_curr_proc();
-   struct user_mapping *pos;
 
    ASSERT(!is_preemption_enabled());
 
-   if (pi->mi) {
-
-      /*
-       * Given that pi->mi->mappings contains at the moment only the memory
-       * mappings done with mmap(), some small processes that don't use dynamic
-       * memory allocation will not even have this field (pi->mi == NULL).
-       *
-       * For the rest, the list is supposed to be *short*, so a linear scan
-       * is acceptable for the moment. If in the future we start to put
-       * there also the mappings for program's text and data and expect to have
-       * more than a few elements, it will be necessary to use a BST to perform
-       * the lookup here below.
-       */
-
-      list_for_each_ro(pos, &pi->mi->mappings, pi_node) {
-
-         if (IN_RANGE(vaddr, pos->vaddr, pos->vaddr + pos->len))
-            return pos;
-      }
-   }
+   /*
+    * Small processes that don't use dynamic memory allocation will not even
+    * have this field (pi->mi == NULL).
+    */
+   if (!pi->mi)
+      return NULL;
 
-   return NULL;
+   return user_vas_find(pi->mi, (ulong)vaddrp);
 }
 
 void remove_all_user_zero_mem_mappings(struct process *pi)
@@ -118,21 +112,12 @@ void remove_all_mappings_of_handle(struct process *pi, fs_handle h)
 
 void full_remove_user_mapping(struct process *pi, struct user_mapping *um)
 {
-   struct mappings_info *mi = pi->mi;
-   size_t actual_len = um->len;
-
-   ASSERT(mi);
-   ASSERT(mi->mmap_heap);
+   ASSERT(pi->mi);
 
    if (um->h)
-      vfs_munmap(um, um->vaddrp, actual_len);
-
-   per_heap_kfree(mi->mmap_heap,
-                  um->vaddrp,
-                  &actual_len,
-                  KFREE_FL_ALLOW_SPLIT |
-                  KFREE_FL_MULTI_STEP  |
-                  KFREE_FL_NO_ACTUAL_FREE);
+      vfs_munmap(um, um->vaddrp, um->len);
+   else if (um->shm)
+      shmem_unmap(pi->pdir, um->vaddrp, um->len);
 
    process_remove_user_mapping(um);
 }
@@ -159,12 +144,7 @@ duplicate_mappings_info(struct process *new_pi, struct mappings_info *mi)
    if (!(new_mi = kalloc_obj(struct mappings_info)))
       goto oom_case;
 
-   list_init(&new_mi->mappings);
-
-   if (!(new_mi->mmap_heap = kmalloc_heap_dup(mi->mmap_heap)))
-      goto oom_case;
-
-   new_mi->mmap_heap_size = mi->mmap_heap_size;
+   user_vas_init(new_mi);
 
    list_for_each_ro(um, &mi->mappings, pi_node) {
 
@@ -177,6 +157,10 @@ duplicate_mappings_info(struct process *new_pi, struct mappings_info *mi)
       /* Re-assign the process pointer */
       um2->pi = new_pi;
 
+      /* Both the mappings keep the shared-page object alive */
+      if (um2->shm)
+         shmem_retain(um2->shm);
+
       /* Re-init the new nodes */
       list_node_init(&um2->pi_node);
       list_node_init(&um2->inode_node);
@@ -184,6 +168,9 @@ duplicate_mappings_info(struct process *new_pi, struct mappings_info *mi)
       /* Add the pi_node to new process's mappings list */
       list_add_tail(&new_mi->mappings, &um2->pi_node);
 
+      /* Insert it in the new trees, re-computing its gap in the meanwhile */
+      user_vas_insert(new_mi, um2);
+
       /*
        * If the inode_node belongs to a list (mappings per inode)
        * add the new mapping's inode_node to the same list.
@@ -198,13 +185,13 @@ oom_case:
 
    if (new_mi) {
 
-      if (new_mi->mmap_heap) {
-         kmalloc_destroy_heap(new_mi->mmap_heap);
-         kfree2(new_mi->mmap_heap, kmalloc_get_heap_struct_size());
-      }
-
       list_for_each(um, um2, &new_mi->mappings, pi_node) {
+
          list_remove(&um->pi_node);
+
+         if (um->shm)
+            shmem_release(um->shm);
+
          kfree_obj(um, struct user_mapping);
       }
 
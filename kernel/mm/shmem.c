@@ -0,0 +1,390 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+#include <tilck/common/utils.h>
+
+#include <tilck/kernel/shmem.h>
+#include <tilck/kernel/process.h>
+#include <tilck/kernel/process_mm.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/errno.h>
+
+#include <sys/mman.h>      // system header
+
+static ALWAYS_INLINE size_t size_to_pages(size_t size)
+{
+   return pow2_round_up_at(size, PAGE_SIZE) >> PAGE_SHIFT;
+}
+
+/*
+ * Make room for at least `nr` pages in the `pages` array. The swap of the
+ * array happens with preemption disabled, because shmem_handle_fault() walks
+ * it without holding the mutex.
+ */
+static int shmem_reserve_slots(struct shmem *s, size_t nr)
+{
+   void **old_pages = s->pages;
+   const size_t old_nr = s->nr_slots;
+   void **new_pages;
+
+   if (nr <= old_nr)
+      return 0;
+
+   if (!(new_pages = kzalloc_array_obj(void *, nr)))
+      return -ENOMEM;
+
+   disable_preemption();
+   {
+      if (old_nr)
+         memcpy(new_pages, old_pages, old_nr * sizeof(void *));
+
+      s->pages = new_pages;
+      s->nr_slots = nr;
+   }
+   enable_preemption();
+
+   if (old_pages)
+      kfree_array_obj(old_pages, void *, old_nr);
+
+   return 0;
+}
+
+/*
+ * Get the page at index `idx`, allocating it when `alloc` is true.
+ * Preemption must be disabled: the check and the store must be atomic.
+ */
+static void *shmem_get_page(struct shmem *s, size_t idx, bool alloc)
+{
+   void *page;
+
+   ASSERT(!is_preemption_enabled());
+   ASSERT(idx < s->nr_slots);
+
+   if ((page = s->pages[idx]) || !alloc)
+      return page;
+
+   if (!(page = kzmalloc(PAGE_SIZE)))
+      return NULL;
+
+   ASSERT(IS_PAGE_ALIGNED(page));
+   retain_pageframe(KERNEL_VA_TO_PA(page));
+   s->pages[idx] = page;
+   s->nr_pages++;
+   return page;
+}
+
+static void shmem_drop_pages_from(struct shmem *s, size_t first)
+{
+   ASSERT(!is_preemption_enabled());
+
+   for (size_t i = first; i < s->nr_slots; i++) {
+
+      if (!s->pages[i])
+         continue;
+
+      release_pageframe(KERNEL_VA_TO_PA(s->pages[i]));
+      s->pages[i] = NULL;
+      s->nr_pages--;
+   }
+}
+
+struct shmem *shmem_create(size_t size)
+{
+   struct shmem *s;
+
+   if (!(s = kzalloc_obj(struct shmem)))
+      return NULL;
+
+   kmutex_init(&s->lock, 0);
+
+   if (shmem_reserve_slots(s, size_to_pages(size))) {
+      kmutex_destroy(&s->lock);
+      kfree_obj(s, struct shmem);
+      return NULL;
+   }
+
+   s->size = size;
+   retain_obj(s);       /* the caller owns the first reference */
+   return s;
+}
+
+void shmem_release(struct shmem *s)
+{
+   if (release_obj(s) > 0)
+      return;
+
+   disable_preemption();
+   {
+      shmem_drop_pages_from(s, 0);
+   }
+   enable_preemption();
+
+   ASSERT(s->nr_pages == 0);
+
+   if (s->pages)
+      kfree_array_obj(s->pages, void *, s->nr_slots);
+
+   kmutex_destroy(&s->lock);
+   kfree_obj(s, struct shmem);
+}
+
+static int shmem_truncate_nolock(struct shmem *s, size_t size)
+{
+   const size_t nr = size_to_pages(size);
+   const size_t tail = size & OFFSET_IN_PAGE_MASK;
+   int rc;
+
+   if (size > SHMEM_MAX_SIZE)
+      return -EFBIG;
+
+   if (size >= s->size) {
+
+      if ((rc = shmem_reserve_slots(s, nr)))
+         return rc;
+
+      s->size = size;
+      return 0;
+   }
+
+   disable_preemption();
+   {
+      shmem_drop_pages_from(s, nr);
+
+      /* Zero the tail of the last page, so that a later grow reads zeros */
+      if (tail && s->pages[nr - 1])
+         bzero(s->pages[nr - 1] + tail, PAGE_SIZE - tail);
+
+      s->size = size;
+   }
+   enable_preemption();
+   return 0;
+}
+
+int shmem_truncate(struct shmem *s, size_t size)
+{
+   int rc;
+
+   kmutex_lock(&s->lock);
+   {
+      rc = shmem_truncate_nolock(s, size);
+   }
+   kmutex_unlock(&s->lock);
+   return rc;
+}
+
+ssize_t shmem_read(struct shmem *s, char *buf, size_t len, size_t off)
+{
+   size_t tot = 0;
+   void *page;
+
+   kmutex_lock(&s->lock);
+
+   if (off >= s->size)
+      goto out;
+
+   len = MIN(len, s->size - off);
+
+   while (tot < len) {
+
+      const size_t page_off = off & OFFSET_IN_PAGE_MASK;
+      const size_t to_read = MIN(len - tot, PAGE_SIZE - page_off);
+
+      disable_preemption();
+      {
+         page = shmem_get_page(s, off >> PAGE_SHIFT, false);
+      }
+      enable_preemption();
+
+      if (page)
+         memcpy(buf + tot, page + page_off, to_read);
+      else
+         bzero(buf + tot, to_read);
+
+      tot += to_read;
+      off += to_read;
+   }
+
+out:
+   kmutex_unlock(&s->lock);
+   return (ssize_t)tot;
+}
+
+ssize_t shmem_write(struct shmem *s, const char *buf, size_t len, size_t off)
+{
+   size_t tot = 0;
+   void *page;
+   int rc;
+
+   if (off + len < off || off + len > SHMEM_MAX_SIZE)
+      return -EFBIG;
+
+   kmutex_lock(&s->lock);
+
+   if (off + len > s->size) {
+
+      const size_t nr = size_to_pages(off + len);
+
+      /* Grow the slots array geometrically, in order to make appends cheap */
+      if ((rc = shmem_reserve_slots(s, MAX(nr, s->nr_slots * 2)))) {
+         kmutex_unlock(&s->lock);
+         return rc;
+      }
+   }
+
+   while (tot < len) {
+
+      const size_t page_off = off & OFFSET_IN_PAGE_MASK;
+      const size_t to_write = MIN(len - tot, PAGE_SIZE - page_off);
+
+      disable_preemption();
+      {
+         page = shmem_get_page(s, off >> PAGE_SHIFT, true);
+      }
+      enable_preemption();
+
+      if (!page)
+         break;
+
+      memcpy(page + page_off, buf + tot, to_write);
+      tot += to_write;
+      off += to_write;
+      s->size = MAX(s->size, off);
+   }
+
+   kmutex_unlock(&s->lock);
+
+   if (!tot && len)
+      return -ENOSPC;
+
+   return (ssize_t)tot;
+}
+
+int shmem_populate(struct shmem *s)
+{
+   const size_t nr = size_to_pages(s->size);
+   int rc = 0;
+
+   kmutex_lock(&s->lock);
+
+   for (size_t i = 0; i < nr && !rc; i++) {
+
+      disable_preemption();
+      {
+         if (!shmem_get_page(s, i, true))
+            rc = -ENOMEM;
+      }
+      enable_preemption();
+   }
+
+   kmutex_unlock(&s->lock);
+   return rc;
+}
+
+int shmem_map(struct shmem *s, pdir_t *pdir, struct user_mapping *um)
+{
+   ulong va = um->vaddr;
+   size_t off = um->off;
+   size_t off_end;
+   u32 pg_flags;
+   void *page;
+   int rc = 0;
+
+   ASSERT(IS_PAGE_ALIGNED(um->off));
+   ASSERT(IS_PAGE_ALIGNED(um->len));
+
+   pg_flags = PAGING_FL_US | PAGING_FL_SHARED;
+
+   if (um->prot & PROT_WRITE)
+      pg_flags |= PAGING_FL_RW;
+
+   kmutex_lock(&s->lock);
+   off_end = MIN(um->off + um->len, size_to_pages(s->size) << PAGE_SHIFT);
+
+   for (; off < off_end; off += PAGE_SIZE, va += PAGE_SIZE) {
+
+      disable_preemption();
+      {
+         page = shmem_get_page(s, off >> PAGE_SHIFT, true);
+      }
+      enable_preemption();
+
+      if (!page) {
+         rc = -ENOMEM;
+         break;
+      }
+
+      if ((rc = map_page(pdir, (void *)va, KERNEL_VA_TO_PA(page), pg_flags)))
+         break;
+   }
+
+   if (rc)
+      shmem_unmap(pdir, um->vaddrp, va - um->vaddr);
+
+   kmutex_unlock(&s->lock);
+   return rc;
+}
+
+void shmem_unmap(pdir_t *pdir, void *vaddr, size_t len)
+{
+   ASSERT(IS_PAGE_ALIGNED(len));
+
+   /*
+    * The object holds its own reference on each page: do_free=true here just
+    * means that pages already dropped by the object get freed by their last
+    * unmap.
+    */
+   unmap_pages_permissive(pdir, vaddr, len >> PAGE_SHIFT, true);
+}
+
+static bool
+shmem_handle_fault_int(struct user_mapping *um, ulong vaddr, bool p, bool rw)
+{
+   struct shmem *s = um->shm;
+   const size_t abs_off = um->off + (vaddr - um->vaddr);
+   u32 pg_flags = PAGING_FL_US | PAGING_FL_SHARED;
+   void *page;
+
+   if (p) {
+
+      /*
+       * The page is present, just is read-only and the user code tried to
+       * write: there's nothing we can do.
+       */
+
+      ASSERT(rw);
+      return false;
+   }
+
+   if (abs_off >= s->size)
+      return false; /* Read/write past the end of the object: SIGBUS */
+
+   if (!(page = shmem_get_page(s, abs_off >> PAGE_SHIFT, true)))
+      return false;
+
+   if (um->prot & PROT_WRITE)
+      pg_flags |= PAGING_FL_RW;
+
+   if (map_page(um->pi->pdir,
+                (void *)(vaddr & PAGE_MASK),
+                KERNEL_VA_TO_PA(page),
+                pg_flags))
+   {
+      return false;
+   }
+
+   invalidate_page(vaddr);
+   return true;
+}
+
+bool shmem_handle_fault(struct user_mapping *um, void *vaddr, bool p, bool rw)
+{
+   bool ret;
+
+   disable_preemption();
+   {
+      ret = shmem_handle_fault_int(um, (ulong)vaddr, p, rw);
+   }
+   enable_preemption();
+   return ret;
+}
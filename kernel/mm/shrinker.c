@@ -0,0 +1,162 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/config_kernel.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+
+#include <tilck/kernel/shrinker.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/highmem.h>
+#include <tilck/kernel/interrupts.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/worker_thread.h>
+
+struct list shrinkers_list = STATIC_LIST_INIT(shrinkers_list);
+struct reclaim_info reclaim_info;
+
+static struct worker_thread *reclaim_wth;
+static bool reclaim_running;
+
+/*
+ * Set while a shrinker not sleeping is running (always with preemption
+ * disabled): a kmalloc() failing inside it must not recurse in the shrinkers.
+ */
+static bool shrinking;
+
+size_t get_free_memory(void)
+{
+   size_t free = kmalloc_get_tot_heap_free();
+   free += highmem_free_pages << PAGE_SHIFT;
+   reclaim_info.free_kb = free / KB;
+   return free;
+}
+
+void register_shrinker(struct shrinker *s)
+{
+   disable_preemption();
+   {
+      ASSERT(!list_is_node_in_list(&s->node));
+      list_add_tail(&shrinkers_list, &s->node);
+   }
+   enable_preemption();
+}
+
+static size_t run_shrinker(struct shrinker *s, size_t bytes)
+{
+   size_t freed;
+
+   if (s->may_sleep) {
+
+      freed = s->scan(bytes);
+
+   } else {
+
+      disable_preemption();
+      {
+         shrinking = true;
+         freed = s->scan(bytes);
+         shrinking = false;
+      }
+      enable_preemption();
+   }
+
+   s->reclaimed_bytes += freed;
+   s->calls++;
+   return freed;
+}
+
+size_t shrink_memory(size_t bytes)
+{
+   struct shrinker *s;
+   size_t freed = 0;
+
+   if (in_irq() || shrinking)
+      return 0;
+
+   disable_preemption();
+   {
+      reclaim_info.direct_reclaims++;
+
+      list_for_each_ro(s, &shrinkers_list, node) {
+
+         if (s->may_sleep)
+            continue;
+
+         if ((freed += run_shrinker(s, bytes - freed)) >= bytes)
+            break;
+      }
+   }
+   enable_preemption();
+   return freed;
+}
+
+static void reclaim_job(void *unused)
+{
+   const size_t high = reclaim_info.wmark_high_kb * KB;
+   struct shrinker *s;
+   size_t free, freed;
+
+   reclaim_info.bg_reclaims++;
+
+   do {
+
+      freed = 0;
+
+      /* The list never shrinks: it's safe to walk it while sleeping */
+      list_for_each_ro(s, &shrinkers_list, node) {
+
+         if ((free = get_free_memory()) >= high)
+            break;
+
+         freed += run_shrinker(s, high - free);
+      }
+
+      kernel_yield();
+
+   } while (freed && get_free_memory() < high);
+
+   reclaim_running = false;
+}
+
+void check_memory_watermarks(void)
+{
+   if (!reclaim_wth || reclaim_running)
+      return;
+
+   if (get_free_memory() >= reclaim_info.wmark_low_kb * KB)
+      return;
+
+   disable_preemption();
+   {
+      /* The job might have been already enqueued by an IRQ handler */
+      if (!reclaim_running) {
+         reclaim_running = true;
+         if (!wth_enqueue_on(reclaim_wth, &reclaim_job, NULL))
+            reclaim_running = false;
+      }
+   }
+   enable_preemption();
+}
+
+void init_shrinkers(void)
+{
+   const size_t tot_kb =
+      kmalloc_get_max_tot_heap_free() / KB +
+      highmem_total_pages * (PAGE_SIZE / KB);
+
+   /* Defaults: start at 1/64 of the memory free, stop at 1/32 */
+   reclaim_info.wmark_low_kb = tot_kb / 64;
+   reclaim_info.wmark_high_kb = tot_kb / 32;
+
+   disable_preemption();
+   {
+      reclaim_wth = wth_create_thread("reclaim",
+                                      WTH_PRIO_LOWEST,
+                                      WTH_RECLAIM_QUEUE_SIZE);
+   }
+   enable_preemption();
+
+   if (!reclaim_wth)
+      panic("Unable to create the reclaim worker thread");
+}
@@ -0,0 +1,148 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/config_mm.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+
+#include <tilck/kernel/process.h>
+#include <tilck/kernel/process_mm.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/swap.h>
+#include <tilck/kernel/shrinker.h>
+
+/* Pages swapped out at once on out-of-memory: 1 MB */
+#define SWAP_OUT_BATCH                                   256
+
+const struct swap_backend *swap_backend;
+
+/*
+ * The scan resumes from the process after the one where the previous one
+ * stopped, like a clock's hand: this way, no process gets all the pressure.
+ */
+static int swap_hand_pid;
+
+struct swap_out_ctx {
+   size_t target;
+   size_t count;
+   int min_pid;
+   int max_pid;
+};
+
+void register_swap_backend(const struct swap_backend *be)
+{
+   ASSERT(!swap_backend);
+   swap_backend = be;
+   printk("swap: using the %s backend\n", be->name);
+}
+
+static int swap_out_visit_cb(void *obj, void *arg)
+{
+   struct task *ti = obj;
+   struct process *pi = ti->pi;
+   struct swap_out_ctx *ctx = arg;
+   struct user_mapping *um;
+
+   if (is_kernel_thread(ti) || !is_main_thread(ti))
+      return 0;
+
+   if (ti->state == TASK_STATE_ZOMBIE || !pi->mi)
+      return 0;
+
+   if (pi->pid < ctx->min_pid || pi->pid > ctx->max_pid)
+      return 0;
+
+   list_for_each_ro(um, &pi->mi->mappings, pi_node) {
+
+      if (um->h || um->shm)
+         continue;
+
+      ctx->count += swap_out_pages(pi->pdir,
+                                   um->vaddrp,
+                                   um->len >> PAGE_SHIFT,
+                                   ctx->target - ctx->count);
+
+      if (ctx->count == ctx->target) {
+         swap_hand_pid = pi->pid;
+         return 1; /* stop the iteration */
+      }
+   }
+
+   return 0;
+}
+
+static size_t swap_out_memory(size_t target)
+{
+   struct swap_out_ctx ctx = { .target = target };
+
+   /*
+    * The first round might just clear the accessed bits of all the pages,
+    * making them candidates for the second one.
+    */
+   for (int round = 0; round < 2 && ctx.count < target; round++) {
+
+      if (!swap_backend->can_store())
+         break;
+
+      ctx.min_pid = swap_hand_pid + 1;
+      ctx.max_pid = MAX_PID;
+
+      if (!iterate_over_tasks(&swap_out_visit_cb, &ctx)) {
+         ctx.min_pid = 0;
+         ctx.max_pid = swap_hand_pid;
+         iterate_over_tasks(&swap_out_visit_cb, &ctx);
+      }
+   }
+
+   return ctx.count;
+}
+
+size_t reclaim_user_memory(void)
+{
+   size_t count;
+
+   if ((count = reclaim_lazyfree_memory()))
+      return count;
+
+   if (!swap_backend)
+      return 0;
+
+   disable_preemption();
+   {
+      count = swap_out_memory(SWAP_OUT_BATCH);
+   }
+   enable_preemption();
+   return count;
+}
+
+static size_t lazyfree_shrink(size_t bytes)
+{
+   return reclaim_lazyfree_memory() << PAGE_SHIFT;
+}
+
+static size_t swap_shrink(size_t bytes)
+{
+   const size_t pages = (bytes + PAGE_SIZE - 1) >> PAGE_SHIFT;
+
+   if (!swap_backend)
+      return 0;
+
+   return swap_out_memory(MIN(pages, (size_t)SWAP_OUT_BATCH)) << PAGE_SHIFT;
+}
+
+static struct shrinker lazyfree_shrinker = {
+   .name = "lazyfree",
+   .scan = &lazyfree_shrink,
+};
+
+/* Counts the pages swapped out: with zram, a compressed copy stays in memory */
+static struct shrinker swap_shrinker = {
+   .name = "swap",
+   .scan = &swap_shrink,
+};
+
+void init_swap(void)
+{
+   register_shrinker(&lazyfree_shrinker);
+   register_shrinker(&swap_shrinker);
+}
@@ -0,0 +1,231 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/config_mm.h>
+
+#include <tilck/common/basic_defs.h>
+
+#include <tilck/kernel/process_mm.h>
+#include <tilck/kernel/bintree.h>
+
+#define LEFT_UM(um)     ((struct user_mapping *)(um)->tree_node.left_obj)
+#define RIGHT_UM(um)    ((struct user_mapping *)(um)->tree_node.right_obj)
+#define LEFT_GAP(g)     ((struct mmap_gap *)(g)->node.left_obj)
+#define RIGHT_GAP(g)    ((struct mmap_gap *)(g)->node.right_obj)
+
+/*
+ * NOTE: we cannot use the bintree_*_ptr() funcs with the user vaddrs, because
+ * they compare the values by subtracting them as signed integers.
+ */
+static long um_cmp(const void *a, const void *b)
+{
+   const ulong va1 = ((const struct user_mapping *)a)->vaddr;
+   const ulong va2 = ((const struct user_mapping *)b)->vaddr;
+   return va1 < va2 ? -1 : (va1 > va2);
+}
+
+static long um_vaddr_cmp(const void *obj, const void *value)
+{
+   const ulong va1 = ((const struct user_mapping *)obj)->vaddr;
+   const ulong va2 = (ulong)value;
+   return va1 < va2 ? -1 : (va1 > va2);
+}
+
+static long gap_cmp(const void *a, const void *b)
+{
+   const struct mmap_gap *g1 = a;
+   const struct mmap_gap *g2 = b;
+
+   if (g1->size != g2->size)
+      return g1->size < g2->size ? -1 : 1;
+
+   return g1->start < g2->start ? -1 : (g1->start > g2->start);
+}
+
+static inline ulong gap_end(struct mmap_gap *g)
+{
+   return g->start + g->size;
+}
+
+static void
+set_gap(struct mappings_info *mi, struct mmap_gap *g, ulong start, size_t sz)
+{
+   void *removed;
+
+   if (g->size) {
+      removed = bintree_remove(&mi->gaps_tree, g, gap_cmp,
+                               struct mmap_gap, node);
+      ASSERT(removed == g);
+      (void) removed; /* prevent the "unused variable" Werror in release */
+   }
+
+   g->start = start;
+   g->size = sz;
+
+   if (sz) {
+      bintree_node_init(&g->node);
+      bintree_insert(&mi->gaps_tree, g, gap_cmp, struct mmap_gap, node);
+   }
+}
+
+/* The last mapping starting at or before `vaddr`, if any */
+static struct user_mapping *
+find_floor_mapping(struct mappings_info *mi, ulong vaddr)
+{
+   struct user_mapping *um = mi->tree;
+   struct user_mapping *res = NULL;
+
+   while (um) {
+
+      if (um->vaddr <= vaddr) {
+         res = um;
+         um = RIGHT_UM(um);
+      } else {
+         um = LEFT_UM(um);
+      }
+   }
+
+   return res;
+}
+
+/* The gap containing `vaddr`, assuming that `vaddr` is not mapped */
+static struct mmap_gap *
+find_gap_owning(struct mappings_info *mi, ulong vaddr)
+{
+   struct user_mapping *prev = find_floor_mapping(mi, vaddr);
+   return prev ? &prev->gap : &mi->head_gap;
+}
+
+void user_vas_init(struct mappings_info *mi)
+{
+   list_init(&mi->mappings);
+   mi->tree = NULL;
+   mi->gaps_tree = NULL;
+   mi->head_gap = (struct mmap_gap) { 0 };
+   set_gap(mi, &mi->head_gap, USER_MMAP_BEGIN, USER_MMAP_MAX_SZ);
+}
+
+void user_vas_insert(struct mappings_info *mi, struct user_mapping *um)
+{
+   struct mmap_gap *g = find_gap_owning(mi, um->vaddr);
+   const ulong vend = um->vaddr + um->len;
+   const ulong gend = gap_end(g);
+   bool success;
+
+   ASSERT(g->start <= um->vaddr && vend <= gend);
+
+   /* The gap gets split in two: before and after the new mapping */
+   set_gap(mi, g, g->start, um->vaddr - g->start);
+
+   um->gap = (struct mmap_gap) { 0 };
+   set_gap(mi, &um->gap, vend, gend - vend);
+
+   bintree_node_init(&um->tree_node);
+   success = bintree_insert(&mi->tree, um, um_cmp,
+                            struct user_mapping, tree_node);
+
+   ASSERT(success);
+   (void) success; /* prevent the "unused variable" Werror in release */
+}
+
+void user_vas_remove(struct mappings_info *mi, struct user_mapping *um)
+{
+   const ulong gend = gap_end(&um->gap);
+   struct mmap_gap *g;
+   void *removed;
+
+   removed = bintree_remove(&mi->tree, TO_PTR(um->vaddr), um_vaddr_cmp,
+                            struct user_mapping, tree_node);
+
+   ASSERT(removed == um);
+   (void) removed; /* prevent the "unused variable" Werror in release */
+
+   /* Merge the gap before the mapping, its range and the gap after it */
+   g = find_gap_owning(mi, um->vaddr);
+   set_gap(mi, &um->gap, 0, 0);
+   set_gap(mi, g, g->start, gend - g->start);
+}
+
+void user_vas_resize(struct mappings_info *mi,
+                     struct user_mapping *um,
+                     ulong vaddr,
+                     size_t len)
+{
+   user_vas_remove(mi, um);
+   um->vaddr = vaddr;
+   um->len = len;
+   user_vas_insert(mi, um);
+}
+
+struct user_mapping *user_vas_find(struct mappings_info *mi, ulong vaddr)
+{
+   struct user_mapping *um = find_floor_mapping(mi, vaddr);
+
+   if (um && vaddr < um->vaddr + um->len)
+      return um;
+
+   return NULL;
+}
+
+struct user_mapping *user_vas_find_next(struct mappings_info *mi, ulong vaddr)
+{
+   struct user_mapping *um = mi->tree;
+   struct user_mapping *res = NULL;
+
+   while (um) {
+
+      if (um->vaddr + um->len > vaddr) {
+         res = um;
+         um = LEFT_UM(um);
+      } else {
+         um = RIGHT_UM(um);
+      }
+   }
+
+   return res;
+}
+
+ulong user_vas_get_free_range(struct mappings_info *mi, size_t len)
+{
+   struct mmap_gap *g = mi->gaps_tree;
+   struct mmap_gap *res = NULL;
+
+   ASSERT(len > 0);
+
+   /* Best fit: the smallest gap big enough, at the lowest address */
+   while (g) {
+
+      if (g->size >= len) {
+         res = g;
+         g = LEFT_GAP(g);
+      } else {
+         g = RIGHT_GAP(g);
+      }
+   }
+
+   return res ? res->start : 0;
+}
+
+bool user_vas_is_range_free(struct mappings_info *mi, ulong vaddr, size_t len)
+{
+   struct mmap_gap *g;
+
+   if (vaddr < USER_MMAP_BEGIN || vaddr + len < vaddr)
+      return false;
+
+   if (vaddr + len > USER_MMAP_END)
+      return false;
+
+   if (user_vas_find(mi, vaddr))
+      return false;
+
+   g = find_gap_owning(mi, vaddr);
+   return vaddr + len <= gap_end(g);
+}
+
+size_t user_vas_largest_gap(struct mappings_info *mi)
+{
+   struct mmap_gap *g = bintree_get_last_obj(mi->gaps_tree,
+                                             struct mmap_gap,
+                                             node);
+   return g ? g->size : 0;
+}
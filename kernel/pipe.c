@@ -2,22 +2,64 @@
 
 #include <tilck/common/basic_defs.h>
 #include <tilck/common/atomics.h>
+#include <tilck/common/string_util.h>
 
 #include <tilck/kernel/kmalloc.h>
 #include <tilck/kernel/fs/vfs.h>
 #include <tilck/kernel/errno.h>
 #include <tilck/kernel/pipe.h>
 #include <tilck/kernel/fs/kernelfs.h>
-#include <tilck/kernel/ringbuf.h>
 #include <tilck/kernel/sync.h>
 #include <tilck/kernel/sched.h>
+#include <tilck/kernel/process.h>
+#include <tilck/kernel/paging.h>
+#include <tilck/kernel/user.h>
+
+#include <fcntl.h>      // system header
+
+#ifndef SPLICE_F_NONBLOCK
+   #define SPLICE_F_NONBLOCK     2
+   #define SPLICE_F_GIFT         8
+#endif
+
+/*
+ * A page-sized chunk of pipe data: `len` bytes starting at `page + off`.
+ * Gifted pages come from vmsplice(SPLICE_F_GIFT): they're user pageframes
+ * on which we hold a reference, instead of pages allocated by the pipe itself.
+ */
+struct pipe_buf {
+
+   char *page;
+   u16 off;
+   u16 len;
+   bool gifted;
+};
+
+/*
+ * A task blocked in pipe_read() on an empty pipe or in pipe_write() on a full
+ * one. The task on the other side can copy directly from/to `buf`, skipping
+ * the pipe's buffers, and then wake up the waiter through its own `cond`.
+ */
+struct pipe_waiter {
+
+   char *buf;
+   size_t size;
+   size_t done;               /* bytes transferred by the other side */
+   struct kcond cond;
+};
 
 struct pipe {
 
    KOBJ_BASE_FIELDS
 
-   char *buf;
-   struct ringbuf rb;
+   struct pipe_buf *bufs;     /* ring of `nr_bufs` slots (power of 2) */
+   u32 nr_bufs;
+   u32 head;                  /* index of the first slot with data */
+   u32 used;                  /* number of slots with data */
+   char *spare_page;          /* one free page kept around, for writers */
+   struct pipe_waiter *reader;   /* reader waiting for a direct handoff */
+   struct pipe_waiter *writer;   /* writer waiting for a direct handoff */
+
    struct kmutex mutex;
    struct kcond not_full_cond;
    struct kcond not_empty_cond;
@@ -27,6 +69,267 @@ struct pipe {
    ATOMIC(int) write_handles;
 };
 
+static ALWAYS_INLINE bool pipe_is_empty(struct pipe *p)
+{
+   return p->used == 0;
+}
+
+static ALWAYS_INLINE struct pipe_buf *pipe_last_buf(struct pipe *p)
+{
+   ASSERT(p->used > 0);
+   return &p->bufs[(p->head + p->used - 1) & (p->nr_bufs - 1)];
+}
+
+static ALWAYS_INLINE bool pipe_buf_has_room(struct pipe_buf *b)
+{
+   return !b->gifted && b->off + b->len < PAGE_SIZE;
+}
+
+static bool pipe_is_full(struct pipe *p)
+{
+   if (p->used < p->nr_bufs)
+      return false;
+
+   return !pipe_buf_has_room(pipe_last_buf(p));
+}
+
+static void pipe_release_buf(struct pipe *p, struct pipe_buf *b)
+{
+   if (b->gifted) {
+
+      release_pageframe(KERNEL_VA_TO_PA(b->page));
+
+   } else if (!p->spare_page) {
+
+      p->spare_page = b->page;
+
+   } else {
+
+      kfree2(b->page, PAGE_SIZE);
+   }
+
+   bzero(b, sizeof(*b));
+}
+
+/*
+ * Return a slot where at least one byte can be appended, allocating a new
+ * page if necessary. Returns NULL if the pipe is full and sets `*oom` when
+ * a page was needed, but it could not be allocated.
+ */
+static struct pipe_buf *pipe_get_tail_buf(struct pipe *p, bool *oom)
+{
+   struct pipe_buf *b;
+   char *page;
+
+   if (p->used > 0) {
+
+      b = pipe_last_buf(p);
+
+      if (pipe_buf_has_room(b))
+         return b;
+   }
+
+   if (p->used == p->nr_bufs)
+      return NULL;
+
+   if (p->spare_page) {
+
+      page = p->spare_page;
+      p->spare_page = NULL;
+
+   } else if (!(page = kmalloc(PAGE_SIZE))) {
+
+      *oom = true;
+      return NULL;
+   }
+
+   p->used++;
+   b = pipe_last_buf(p);
+   *b = (struct pipe_buf) { .page = page, .off = 0, .len = 0, .gifted = 0 };
+   return b;
+}
+
+static size_t pipe_copy_out(struct pipe *p, char *buf, size_t size)
+{
+   struct pipe_buf *b;
+   size_t tot = 0, n;
+
+   while (tot < size && !pipe_is_empty(p)) {
+
+      b = &p->bufs[p->head];
+      n = MIN(size - tot, (size_t)b->len);
+
+      memcpy(buf + tot, b->page + b->off, n);
+      b->off += n;
+      b->len -= n;
+      tot += n;
+
+      if (!b->len) {
+         pipe_release_buf(p, b);
+         p->head = (p->head + 1) & (p->nr_bufs - 1);
+         p->used--;
+      }
+   }
+
+   return tot;
+}
+
+/*
+ * Copy up to `size` bytes into the pipe. When `user` is true, `buf` is an
+ * user pointer. Returns the number of bytes copied, or a negative errno
+ * value if nothing could be copied because of an error.
+ */
+static ssize_t
+pipe_copy_in(struct pipe *p, const char *buf, size_t size, bool user)
+{
+   struct pipe_buf *b;
+   bool oom = false;
+   size_t tot = 0, n;
+
+   while (tot < size) {
+
+      if (!(b = pipe_get_tail_buf(p, &oom)))
+         break;
+
+      n = MIN(size - tot, PAGE_SIZE - b->off - b->len);
+
+      if (user) {
+
+         if (copy_from_user(b->page + b->off + b->len, buf + tot, n)) {
+
+            if (!b->len) {
+               /* We've just allocated this slot: drop it */
+               pipe_release_buf(p, b);
+               p->used--;
+            }
+
+            return tot ? (ssize_t)tot : -EFAULT;
+         }
+
+      } else {
+
+         memcpy(b->page + b->off + b->len, buf + tot, n);
+      }
+
+      b->len += n;
+      tot += n;
+   }
+
+   if (!tot && oom)
+      return -ENOMEM;
+
+   return (ssize_t)tot;
+}
+
+/*
+ * Handoff from a writer blocked on a full pipe: when the pipe is empty, its
+ * data is copied directly into the reader's buffer and then, whatever is left,
+ * is moved into the pipe, so that the writer doesn't have to do anything else
+ * than returning after waking up. Returns the number of bytes copied in `buf`.
+ */
+static size_t pipe_take_from_writer(struct pipe *p, char *buf, size_t size)
+{
+   struct pipe_waiter *w = p->writer;
+   size_t n = 0;
+   ssize_t rc;
+
+   if (pipe_is_empty(p)) {
+      n = MIN(size, w->size - w->done);
+      memcpy(buf, w->buf + w->done, n);
+      w->done += n;
+   }
+
+   if (w->done < w->size) {
+
+      rc = pipe_copy_in(p, w->buf + w->done, w->size - w->done, false);
+
+      if (rc > 0)
+         w->done += (size_t)rc;
+   }
+
+   if (w->done) {
+      p->writer = NULL;
+      kcond_signal_one(&w->cond);
+   }
+
+   return n;
+}
+
+/*
+ * Handoff to a reader blocked on an empty pipe: copy the data directly into
+ * its buffer, skipping the pipe's buffers. What doesn't fit in the reader's
+ * buffer goes into the pipe, as usual.
+ */
+static ssize_t
+pipe_give_to_reader(struct pipe *p, const char *buf, size_t size)
+{
+   struct pipe_waiter *w = p->reader;
+   const size_t n = MIN(size, w->size);
+   ssize_t rc;
+
+   ASSERT(pipe_is_empty(p));
+
+   memcpy(w->buf, buf, n);
+   w->done = n;
+   p->reader = NULL;
+   kcond_signal_one(&w->cond);
+
+   if (n == size)
+      return (ssize_t)n;
+
+   rc = pipe_copy_in(p, buf + n, size - n, false);
+   return (ssize_t)n + MAX(rc, 0);
+}
+
+static void pipe_wake_reader(struct pipe *p)
+{
+   if (p->reader)
+      kcond_signal_one(&p->reader->cond);
+   else
+      kcond_signal_one(&p->not_empty_cond);
+}
+
+static void pipe_wake_writer(struct pipe *p)
+{
+   if (p->writer)
+      kcond_signal_one(&p->writer->cond);
+   else
+      kcond_signal_one(&p->not_full_cond);
+}
+
+/*
+ * Wait on the pipe as a reader or as a writer. The first task blocking on each
+ * side registers itself, along with its buffer, to allow the other side to do
+ * a direct handoff. All the others just wait on the regular condition.
+ * Returns the number of bytes transferred by the other side, if any.
+ */
+static size_t
+pipe_wait(struct pipe *p,
+          struct pipe_waiter **slot,
+          struct kcond *cond,
+          char *buf,
+          size_t size)
+{
+   struct pipe_waiter w;
+
+   if (*slot) {
+      kcond_wait(cond, &p->mutex, KCOND_WAIT_FOREVER);
+      return 0;
+   }
+
+   w = (struct pipe_waiter) { .buf = buf, .size = size, .done = 0 };
+   kcond_init(&w.cond);
+   *slot = &w;
+
+   kcond_wait(&w.cond, &p->mutex, KCOND_WAIT_FOREVER);
+
+   if (*slot == &w)
+      *slot = NULL;   /* We woke up for another reason: unregister */
+
+   kcond_destory(&w.cond);
+   return w.done;
+}
+
 static ssize_t pipe_read(fs_handle h, char *buf, size_t size, offt *pos)
 {
    struct kfs_handle *kh = h;
@@ -42,7 +345,10 @@ static ssize_t pipe_read(fs_handle h, char *buf, size_t size, offt *pos)
 
    while (true) {
 
-      rc = (ssize_t)ringbuf_read_bytes(&p->rb, (u8 *)buf, size);
+      rc = (ssize_t)pipe_copy_out(p, buf, size);
+
+      if (p->writer)
+         rc += (ssize_t)pipe_take_from_writer(p, buf + rc, size - (size_t)rc);
 
       if (rc)
          break; /* Everything is alright, we read something */
@@ -57,8 +363,11 @@ static ssize_t pipe_read(fs_handle h, char *buf, size_t size, offt *pos)
          break;
       }
 
-      /* Wait for writers to fill up the buffer */
-      kcond_wait(&p->not_empty_cond, &p->mutex, KCOND_WAIT_FOREVER);
+      /* Wait for writers to fill up the buffer (or our buffer, directly) */
+      rc = (ssize_t)pipe_wait(p, &p->reader, &p->not_empty_cond, buf, size);
+
+      if (rc)
+         break; /* A writer copied the data directly in our buffer */
 
       /* After wake up */
       if (pending_signals()) {
@@ -79,9 +388,9 @@ static ssize_t pipe_read(fs_handle h, char *buf, size_t size, offt *pos)
     * The situation is perfectly symmetric for the readers as well, that's why
     * here below we wake up another reader if the buffer is not empty.
     */
-   kcond_signal_one(&p->not_full_cond);
+   pipe_wake_writer(p);
 
-   if (!ringbuf_is_empty(&p->rb)) {
+   if (!pipe_is_empty(p)) {
       /* The buffer is not empty: wake up one more reader, if any */
       kcond_signal_one(&p->not_empty_cond);
    }
@@ -114,18 +423,24 @@ static ssize_t pipe_write(fs_handle h, char *buf, size_t size, offt *pos)
          break;
       }
 
-      rc = (ssize_t)ringbuf_write_bytes(&p->rb, (u8 *)buf, size);
+      if (p->reader && pipe_is_empty(p))
+         rc = pipe_give_to_reader(p, buf, size);
+      else
+         rc = pipe_copy_in(p, buf, size, false);
 
       if (rc)
-         break; /* Everything is alright, we wrote something */
+         break; /* We wrote something or we hit an error */
 
       if (kh->fl_flags & O_NONBLOCK) {
          rc = -EAGAIN;
          break;
       }
 
-      /* Wait for readers to empty the buffer */
-      kcond_wait(&p->not_full_cond, &p->mutex, KCOND_WAIT_FOREVER);
+      /* Wait for readers to empty the buffer (or to take our data directly) */
+      rc = (ssize_t)pipe_wait(p, &p->writer, &p->not_full_cond, buf, size);
+
+      if (rc)
+         break; /* A reader took the data directly from our buffer */
 
       /* After wake up */
       if (pending_signals()) {
@@ -138,9 +453,9 @@ static ssize_t pipe_write(fs_handle h, char *buf, size_t size, offt *pos)
     * Wake up one blocked reader, instead of all of them.
     * See the comments in pipe_read() above.
     */
-   kcond_signal_one(&p->not_empty_cond);
+   pipe_wake_reader(p);
 
-   if (!ringbuf_is_full(&p->rb)) {
+   if (!pipe_is_full(p)) {
       /* The buffer is not full: wake up one more writer, if any */
       kcond_signal_one(&p->not_full_cond);
    }
@@ -158,7 +473,7 @@ static int pipe_read_ready(fs_handle h)
 
    kmutex_lock(&p->mutex);
    {
-      ret = !ringbuf_is_empty(&p->rb) ||
+      ret = !pipe_is_empty(p) ||
             atomic_load_explicit(&p->write_handles, mo_relaxed) == 0;
    }
    kmutex_unlock(&p->mutex);
@@ -180,7 +495,7 @@ static int pipe_write_ready(fs_handle h)
 
    kmutex_lock(&p->mutex);
    {
-      ret = !ringbuf_is_full(&p->rb) ||
+      ret = !pipe_is_full(p) ||
             atomic_load_explicit(&p->read_handles, mo_relaxed) == 0;
    }
    kmutex_unlock(&p->mutex);
@@ -243,8 +558,17 @@ void destroy_pipe(struct pipe *p)
    kcond_destory(&p->not_empty_cond);
    kcond_destory(&p->not_full_cond);
    kmutex_destroy(&p->mutex);
-   ringbuf_destory(&p->rb);
-   kfree2(p->buf, PIPE_BUF_SIZE);
+
+   while (!pipe_is_empty(p)) {
+      pipe_release_buf(p, &p->bufs[p->head]);
+      p->head = (p->head + 1) & (p->nr_bufs - 1);
+      p->used--;
+   }
+
+   if (p->spare_page)
+      kfree2(p->spare_page, PAGE_SIZE);
+
+   kfree_array_obj(p->bufs, struct pipe_buf, p->nr_bufs);
    kfree_obj(p, struct pipe);
 }
 
@@ -263,6 +587,17 @@ static void pipe_on_handle_close(fs_handle h)
    ASSERT(old > 0);
 
    if (old == 1) {
+
+      kmutex_lock(&p->mutex);
+      {
+         if (p->reader)
+            kcond_signal_one(&p->reader->cond);
+
+         if (p->writer)
+            kcond_signal_one(&p->writer->cond);
+      }
+      kmutex_unlock(&p->mutex);
+
       kcond_signal_all(&p->not_full_cond);
       kcond_signal_all(&p->not_empty_cond);
       kcond_signal_all(&p->err_cond);
@@ -288,7 +623,9 @@ struct pipe *create_pipe(void)
    if (!(p = (void *)kzalloc_obj(struct pipe)))
       return NULL;
 
-   if (!(p->buf = kmalloc(PIPE_BUF_SIZE))) {
+   p->nr_bufs = PIPE_BUF_SIZE / PAGE_SIZE;
+
+   if (!(p->bufs = kzalloc_array_obj(struct pipe_buf, p->nr_bufs))) {
       kfree_obj(p, struct pipe);
       return NULL;
    }
@@ -296,7 +633,6 @@ struct pipe *create_pipe(void)
    p->on_handle_close = &pipe_on_handle_close;
    p->on_handle_dup = &pipe_on_handle_dup;
    p->destory_obj = (void *)&destroy_pipe;
-   ringbuf_init(&p->rb, PIPE_BUF_SIZE, 1, p->buf);
    kmutex_init(&p->mutex, 0);
    kcond_init(&p->not_full_cond);
    kcond_init(&p->not_empty_cond);
@@ -327,3 +663,185 @@ fs_handle pipe_create_write_handle(struct pipe *p)
 
    return res;
 }
+
+bool is_pipe_handle(fs_handle h)
+{
+   struct kfs_handle *kh = h;
+
+   return kh->fops == &static_ops_pipe_read_end ||
+          kh->fops == &static_ops_pipe_write_end;
+}
+
+int pipe_get_size(fs_handle h)
+{
+   struct kfs_handle *kh = h;
+   struct pipe *p = (void *)kh->kobj;
+
+   ASSERT(is_pipe_handle(h));
+   return (int)(p->nr_bufs * PAGE_SIZE);
+}
+
+int pipe_set_size(fs_handle h, size_t size)
+{
+   struct kfs_handle *kh = h;
+   struct pipe *p = (void *)kh->kobj;
+   struct pipe_buf *new_bufs;
+   u32 nr = 1;
+
+   ASSERT(is_pipe_handle(h));
+
+   if (size > PIPE_MAX_SIZE)
+      return -EPERM;
+
+   size = MAX(size, (size_t)PIPE_MIN_SIZE);
+
+   while (nr * PAGE_SIZE < size)
+      nr <<= 1;
+
+   if (!(new_bufs = kzalloc_array_obj(struct pipe_buf, nr)))
+      return -ENOMEM;
+
+   kmutex_lock(&p->mutex);
+
+   if (p->used > nr) {
+      /* Linux as well refuses to shrink a pipe below its current content */
+      kmutex_unlock(&p->mutex);
+      kfree_array_obj(new_bufs, struct pipe_buf, nr);
+      return -EBUSY;
+   }
+
+   for (u32 i = 0; i < p->used; i++)
+      new_bufs[i] = p->bufs[(p->head + i) & (p->nr_bufs - 1)];
+
+   kfree_array_obj(p->bufs, struct pipe_buf, p->nr_bufs);
+   p->bufs = new_bufs;
+   p->nr_bufs = nr;
+   p->head = 0;
+
+   /* The pipe might have room now: wake up the writers */
+   if (p->writer)
+      kcond_signal_one(&p->writer->cond);
+
+   kcond_signal_all(&p->not_full_cond);
+   kmutex_unlock(&p->mutex);
+   return (int)(nr * PAGE_SIZE);
+}
+
+/*
+ * Try to append the user page at `vaddr` to the pipe without copying it.
+ * Returns true on success.
+ */
+static bool pipe_gift_page(struct pipe *p, void *vaddr)
+{
+   struct process *pi = get_curr_proc();
+   struct pipe_buf *b;
+   ulong paddr;
+   int rc;
+
+   if (p->used == p->nr_bufs)
+      return false;
+
+   disable_preemption();
+   {
+      rc = retain_user_page_cow(pi->pdir, vaddr, &paddr);
+   }
+   enable_preemption();
+
+   if (rc)
+      return false;
+
+   p->used++;
+   b = pipe_last_buf(p);
+
+   *b = (struct pipe_buf) {
+      .page = KERNEL_PA_TO_VA(paddr),
+      .off = 0,
+      .len = PAGE_SIZE,
+      .gifted = true,
+   };
+
+   return true;
+}
+
+ssize_t
+pipe_vmsplice(fs_handle h, const struct iovec *iov, u32 iovcnt, u32 flags)
+{
+   struct kfs_handle *kh = h;
+   struct pipe *p = (void *)kh->kobj;
+   const bool nonblock = (flags & SPLICE_F_NONBLOCK) ||
+                         (kh->fl_flags & O_NONBLOCK);
+   bool sig_pending = false;
+   ssize_t rc = 0, tot = 0;
+
+   ASSERT(kh->fops == &static_ops_pipe_write_end);
+   kmutex_lock(&p->mutex);
+
+   for (u32 i = 0; i < iovcnt; i++) {
+
+      char *ptr = iov[i].iov_base;
+      size_t len = iov[i].iov_len;
+
+      while (len > 0) {
+
+         if (atomic_load_explicit(&p->read_handles, mo_relaxed) == 0) {
+
+            /* Broken pipe */
+            send_signal(get_curr_pid(), SIGPIPE, true);
+            rc = -EPIPE;
+            goto out;
+         }
+
+         if ((flags & SPLICE_F_GIFT) &&
+             IS_PAGE_ALIGNED(ptr) &&
+             len >= PAGE_SIZE &&
+             pipe_gift_page(p, ptr))
+         {
+            ptr += PAGE_SIZE;
+            len -= PAGE_SIZE;
+            tot += PAGE_SIZE;
+            pipe_wake_reader(p);
+            continue;
+         }
+
+         rc = pipe_copy_in(p, ptr, len, true);
+
+         if (rc < 0)
+            goto out;
+
+         if (rc > 0) {
+            ptr += rc;
+            len -= (size_t)rc;
+            tot += rc;
+            pipe_wake_reader(p);
+            continue;
+         }
+
+         /* The pipe is full */
+         if (tot > 0)
+            goto out;
+
+         if (nonblock) {
+            rc = -EAGAIN;
+            goto out;
+         }
+
+         kcond_wait(&p->not_full_cond, &p->mutex, KCOND_WAIT_FOREVER);
+
+         if (pending_signals()) {
+            sig_pending = true;
+            goto out;
+         }
+      }
+   }
+
+out:
+   if (!pipe_is_full(p))
+      kcond_signal_one(&p->not_full_cond);
+
+   kmutex_unlock(&p->mutex);
+
+   if (tot > 0)
+      return tot;
+
+   return !sig_pending ? rc : -EINTR;
+}
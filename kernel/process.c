@@ -135,9 +135,6 @@ void process_free_mappings_info(struct process *pi)
    struct mappings_info *mi = pi->mi;
 
    if (mi && !pi->vforked) {
-      ASSERT(mi->mmap_heap);
-      kmalloc_destroy_heap(mi->mmap_heap);
-      kfree2(mi->mmap_heap, kmalloc_get_heap_struct_size());
       kfree_obj(mi, struct mappings_info);
       pi->mi = NULL;
    }
@@ -248,7 +245,7 @@ allocate_new_process(struct task *parent, int pid, pdir_t *new_pdir)
       pi->vforked = true;
    }
 
-   pi->inherited_mmap_heap = !!pi->mi;
+   pi->inherited_mi = !!pi->mi;
    ti->pi = pi;
    ti->tid = pid;
    ti->is_main_thread = true;
@@ -264,8 +261,11 @@ allocate_new_process(struct task *parent, int pid, pdir_t *new_pdir)
     */
    drop_all_pending_signals(ti);
 
-   /* Reset sched ticks in the new process */
+   /* Reset sched ticks and resource usage counters in the new process */
    bzero(&ti->ticks, sizeof(ti->ticks));
+   bzero(&ti->rusage, sizeof(ti->rusage));
+   pi->children_ru = NULL;
+   pi->maxrss = 0;
 
    /* Copy parent's `cwd` while retaining the `fs` and the inode obj */
    process_set_cwd2_nolock_raw(pi, &parent_pi->cwd);
@@ -353,6 +353,7 @@ static void free_process_int(struct process *pi)
    if (release_obj(pi) == 0) {
 
       arch_specific_free_proc(pi);
+      kfree_obj(pi->children_ru, struct children_rusage);
       kfree2(get_process_task(pi), TOT_PROC_AND_TASK_SIZE);
 
       if (MOD_debugpanel)
@@ -0,0 +1,148 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/process.h>
+#include <tilck/kernel/paging.h>
+#include <tilck/kernel/errno.h>
+#include <tilck/kernel/user.h>
+#include <tilck/kernel/datetime.h>
+#include <tilck/kernel/syscalls.h>
+
+/* getrusage()'s `who` values, as in Linux */
+#define RUSAGE_SELF                                   0
+#define RUSAGE_CHILDREN                             (-1)
+#define RUSAGE_THREAD                                 1
+
+void process_update_maxrss(struct process *pi)
+{
+   ASSERT(!is_preemption_enabled());
+
+   if (pi == kernel_process_pi)
+      return;
+
+   pi->maxrss = MAX(pi->maxrss, get_user_rss_pages(pi->pdir));
+}
+
+static void
+rusage_add(struct task_rusage *dst, const struct task_rusage *src)
+{
+   dst->minflt += src->minflt;
+   dst->majflt += src->majflt;
+   dst->cow_copies += src->cow_copies;
+   dst->nvcsw += src->nvcsw;
+   dst->nivcsw += src->nivcsw;
+   dst->syscalls += src->syscalls;
+   dst->rchar += src->rchar;
+   dst->wchar += src->wchar;
+}
+
+/*
+ * Called by wait4() just before reaping the zombie `child`. As in Linux, what
+ * gets accounted includes the children waited by `child` itself.
+ */
+void process_account_waited_child(struct process *pi, struct task *child)
+{
+   struct children_rusage *c = pi->children_ru;
+   struct children_rusage *cc = child->pi->children_ru;
+
+   ASSERT(!is_preemption_enabled());
+   ASSERT(child->state == TASK_STATE_ZOMBIE);
+
+   /* Having a child, `pi` must have called fork() or be init */
+   ASSERT(c != NULL);
+
+   rusage_add(&c->ru, &child->rusage);
+   c->ticks += child->ticks.total;
+   c->kernel_ticks += child->ticks.total_kernel;
+   c->maxrss = MAX(c->maxrss, child->pi->maxrss);
+
+   if (cc) {
+      rusage_add(&c->ru, &cc->ru);
+      c->ticks += cc->ticks;
+      c->kernel_ticks += cc->kernel_ticks;
+      c->maxrss = MAX(c->maxrss, cc->maxrss);
+   }
+}
+
+static void
+ticks_to_timeval(u64 ticks, struct k_timeval *tv)
+{
+   struct k_timespec64 tp;
+
+   ticks_to_timespec(ticks, &tp);
+   tv->tv_sec = (long) tp.tv_sec;
+   tv->tv_usec = tp.tv_nsec / 1000;
+}
+
+/*
+ * Fill `ru` with the resource usage of `ti` (self), of its waited children
+ * (children) or with the sum of both, like wait4() does. Preemption must be
+ * disabled.
+ */
+void task_get_rusage(struct task *ti,
+                     bool self,
+                     bool children,
+                     struct k_rusage *ru)
+{
+   struct process *pi = ti->pi;
+   struct children_rusage *c = pi->children_ru;
+   struct task_rusage tot = {0};
+   u64 ticks = 0, kernel_ticks = 0;
+   ulong maxrss = 0;
+
+   ASSERT(!is_preemption_enabled());
+
+   if (self) {
+
+      /* The pdir of a zombie is gone, but its maxrss has been updated */
+      if (ti->state != TASK_STATE_ZOMBIE)
+         process_update_maxrss(pi);
+
+      rusage_add(&tot, &ti->rusage);
+      ticks += ti->ticks.total;
+      kernel_ticks += ti->ticks.total_kernel;
+      maxrss = pi->maxrss;
+   }
+
+   if (children && c) {
+      rusage_add(&tot, &c->ru);
+      ticks += c->ticks;
+      kernel_ticks += c->kernel_ticks;
+      maxrss = MAX(maxrss, c->maxrss);
+   }
+
+   bzero(ru, sizeof(*ru));
+   ticks_to_timeval(ticks - kernel_ticks, &ru->ru_utime);
+   ticks_to_timeval(kernel_ticks, &ru->ru_stime);
+
+   ru->ru_maxrss = (long)(maxrss * (PAGE_SIZE / KB));   /* in KB */
+   ru->ru_minflt = (long)tot.minflt;
+   ru->ru_majflt = (long)tot.majflt;
+   ru->ru_nvcsw = (long)tot.nvcsw;
+   ru->ru_nivcsw = (long)tot.nivcsw;
+}
+
+int sys_getrusage(int who, struct k_rusage *user_usage)
+{
+   struct k_rusage ru;
+
+   /* There are no threads in Tilck: RUSAGE_THREAD is just like RUSAGE_SELF */
+   if (who != RUSAGE_SELF && who != RUSAGE_CHILDREN && who != RUSAGE_THREAD)
+      return -EINVAL;
+
+   disable_preemption();
+   {
+      task_get_rusage(get_curr_task(),
+                      who != RUSAGE_CHILDREN,
+                      who == RUSAGE_CHILDREN,
+                      &ru);
+   }
+   enable_preemption();
+
+   if (copy_to_user(user_usage, &ru, sizeof(ru)))
+      return -EFAULT;
+
+   return 0;
+}
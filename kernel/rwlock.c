@@ -2,6 +2,8 @@
 
 #include <tilck/kernel/rwlock.h>
 #include <tilck/kernel/sched.h>
+#include <tilck/kernel/hal.h>
+#include <tilck/kernel/lockstat.h>
 
 void rwlock_rp_init(struct rwlock_rp *r)
 {
@@ -57,9 +59,66 @@ void rwlock_rp_exunlock(struct rwlock_rp *r)
 
 /* ---------------------------------------------- */
 
+#if KERNEL_LOCKSTAT
+
+static ALWAYS_INLINE u64
+rwlock_wp_lockstat_start(void)
+{
+   return RDTSC();
+}
+
+static void
+rwlock_wp_lockstat_acquired(struct rwlock_wp *rw,
+                            enum lockstat_type type,
+                            ulong site,
+                            u64 start,
+                            bool contended)
+{
+   const u64 now = lockstat_acquired(rw, site, type, start, contended);
+
+   if (type == lockstat_rwlock_ex) {
+      rw->ls_site = site;
+      rw->ls_acquired = now;
+   }
+}
+
+static void
+rwlock_wp_lockstat_exreleased(struct rwlock_wp *rw)
+{
+   lockstat_released(rw, rw->ls_site, rw->ls_acquired);
+   rw->ls_site = 0;
+}
+
+#else
+
+static ALWAYS_INLINE u64
+rwlock_wp_lockstat_start(void)
+{
+   return 0;
+}
+
+static ALWAYS_INLINE void
+rwlock_wp_lockstat_acquired(struct rwlock_wp *rw,
+                            enum lockstat_type type,
+                            ulong site,
+                            u64 start,
+                            bool contended)
+{
+   /* do nothing */
+}
+
+static ALWAYS_INLINE void
+rwlock_wp_lockstat_exreleased(struct rwlock_wp *rw)
+{
+   /* do nothing */
+}
+
+#endif
+
 void rwlock_wp_init(struct rwlock_wp *rw, bool recursive)
 {
-   kmutex_init(&rw->m, 0);
+   /* The rwlock itself is accounted in lockstat, not its internal mutex */
+   kmutex_init(&rw->m, KMUTEX_FL_NO_LOCKSTAT);
    kcond_init(&rw->c);
    rw->ex_owner = NULL;
    rw->r = 0;
@@ -78,10 +137,14 @@ void rwlock_wp_destroy(struct rwlock_wp *rw)
 
 void rwlock_wp_shlock(struct rwlock_wp *rw)
 {
+   const u64 start = rwlock_wp_lockstat_start();
+   bool contended = false;
+
    kmutex_lock(&rw->m);
    {
       /* Wait until there's at least one writer waiting (they have priority) */
       while (rw->w) {
+         contended = true;
          kcond_wait(&rw->c, &rw->m, KCOND_WAIT_FOREVER);
       }
 
@@ -91,6 +154,12 @@ void rwlock_wp_shlock(struct rwlock_wp *rw)
        * lock.
        */
       rw->r++;
+
+      rwlock_wp_lockstat_acquired(rw,
+                                  lockstat_rwlock_sh,
+                                  (ulong)__builtin_return_address(0),
+                                  start,
+                                  contended);
    }
    kmutex_unlock(&rw->m);
 }
@@ -109,8 +178,11 @@ void rwlock_wp_shunlock(struct rwlock_wp *rw)
    kmutex_unlock(&rw->m);
 }
 
-static void rwlock_wp_exlock_int(struct rwlock_wp *rw)
+static void
+rwlock_wp_exlock_int(struct rwlock_wp *rw, ulong site, u64 start)
 {
+   bool contended = false;
+
    if (rw->rec) {
       if (rw->ex_owner == get_curr_task()) {
          ASSERT(rw->w);
@@ -123,6 +195,7 @@ static void rwlock_wp_exlock_int(struct rwlock_wp *rw)
 
    /* Wait our turn until other writers are waiting to write */
    while (rw->w) {
+      contended = true;
       kcond_wait(&rw->c, &rw->m, KCOND_WAIT_FOREVER);
    }
 
@@ -134,6 +207,7 @@ static void rwlock_wp_exlock_int(struct rwlock_wp *rw)
 
    /* Wait until there are any readers currently holding the rwlock */
    while (rw->r > 0) {
+      contended = true;
       kcond_wait(&rw->c, &rw->m, KCOND_WAIT_FOREVER);
    }
 
@@ -145,6 +219,7 @@ static void rwlock_wp_exlock_int(struct rwlock_wp *rw)
 
    ASSERT(rw->ex_owner == NULL);
    rw->ex_owner = get_curr_task();
+   rwlock_wp_lockstat_acquired(rw, lockstat_rwlock_ex, site, start, contended);
 
    if (rw->rec) {
       /* recursive locking count */
@@ -155,9 +230,11 @@ static void rwlock_wp_exlock_int(struct rwlock_wp *rw)
 
 void rwlock_wp_exlock(struct rwlock_wp *rw)
 {
+   const u64 start = rwlock_wp_lockstat_start();
+
    kmutex_lock(&rw->m);
    {
-      rwlock_wp_exlock_int(rw);
+      rwlock_wp_exlock_int(rw, (ulong)__builtin_return_address(0), start);
    }
    kmutex_unlock(&rw->m);
 }
@@ -177,6 +254,7 @@ static void rwlock_wp_exunlock_int(struct rwlock_wp *rw)
          return;
    }
 
+   rwlock_wp_lockstat_exreleased(rw);
    rw->ex_owner = NULL;
 
    /* The `w` flag must be set */
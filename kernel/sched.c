@@ -10,6 +10,7 @@
 #include <tilck/kernel/worker_thread.h>
 #include <tilck/kernel/timer.h>
 #include <tilck/kernel/errno.h>
+#include <tilck/kernel/tracepoint.h>
 
 /* Shared global variables */
 struct task *__current;
@@ -40,8 +41,14 @@ const char *const task_state_str[5] = {
 
 void enable_preemption(void)
 {
-   int oldval =
-      atomic_fetch_sub_explicit(&__disable_preempt, 1, mo_relaxed);
+   int oldval;
+
+#if KERNEL_IRQSOFF_TRACER
+   if (get_preempt_disable_count() == 1)
+      irqsoff_trace_preempt_on((ulong)__builtin_return_address(0));
+#endif
+
+   oldval = atomic_fetch_sub_explicit(&__disable_preempt, 1, mo_relaxed);
 
    ASSERT(oldval > 0);
 
@@ -535,6 +542,10 @@ void task_change_state(struct task *ti, enum task_state new_state)
 
    disable_interrupts(&var);
    {
+      if (ti->state == TASK_STATE_SLEEPING)
+         if (new_state == TASK_STATE_RUNNABLE)
+            tracepoint(tp_sched_wakeup, ti->tid, 0, 0);
+
       task_remove_from_state_list(ti);
       atomic_store_explicit(&ti->state, new_state, mo_relaxed);
       task_add_to_state_list(ti);
@@ -749,10 +760,15 @@ void do_schedule(void)
       ASSERT(!selected->stopped);
 
       /* If we preempted the process, it is still `running` */
-      if (curr_state == TASK_STATE_RUNNING)
+      if (curr_state == TASK_STATE_RUNNING) {
          task_change_state(curr, TASK_STATE_RUNNABLE);
+         curr->rusage.nivcsw++;
+      } else {
+         curr->rusage.nvcsw++;
+      }
 
       /* A task switch is required */
+      tracepoint(tp_sched_switch, curr->tid, selected->tid, curr_state);
       switch_to_task(selected);
 
    } else {
@@ -24,12 +24,6 @@
 #define LINUX_REBOOT_CMD_HALT       0xcdef0123
 #define LINUX_REBOOT_CMD_POWER_OFF  0x4321fedc
 
-int sys_madvise(void *addr, size_t len, int advice)
-{
-   // TODO (future): consider implementing at least part of sys_madvice().
-   return 0;
-}
-
 int
 do_nanosleep(const struct k_timespec64 *req, struct k_timespec64 *rem)
 {
@@ -127,19 +121,20 @@ NORETURN int sys_exit_group(int status)
 ulong sys_times(struct tms *user_buf)
 {
    struct task *curr = get_curr_task();
+   struct children_rusage *c;
    struct tms buf;
 
    // TODO (threads): when threads are supported, update sys_times()
-   // TODO: consider supporting tms_cutime and tms_cstime in sys_times()
 
    disable_preemption();
    {
+      c = curr->pi->children_ru;
 
       buf = (struct tms) {
          .tms_utime = (clock_t) curr->ticks.total,
          .tms_stime = (clock_t) curr->ticks.total_kernel,
-         .tms_cutime = 0,
-         .tms_cstime = 0,
+         .tms_cutime = c ? (clock_t) c->ticks : 0,
+         .tms_cstime = c ? (clock_t) c->kernel_ticks : 0,
       };
 
    }
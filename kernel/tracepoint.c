@@ -0,0 +1,95 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+
+#include <tilck/kernel/hal.h>
+#include <tilck/kernel/tracepoint.h>
+
+static const char *const tracepoint_names[TP_COUNT] = {
+
+   [tp_sched_switch]    = "sched_switch",
+   [tp_sched_wakeup]    = "sched_wakeup",
+   [tp_irq_entry]       = "irq_entry",
+   [tp_irq_exit]        = "irq_exit",
+   [tp_page_fault]      = "page_fault",
+   [tp_cow_copy]        = "cow_copy",
+   [tp_kmalloc_fail]    = "kmalloc_fail",
+   [tp_wth_job_start]   = "wth_job_start",
+   [tp_wth_job_end]     = "wth_job_end",
+};
+
+static tracepoint_handler tp_handler;
+bool __tracepoints_on[TP_COUNT];
+
+void
+tracepoint_fire(enum tracepoint_id id, ulong a0, ulong a1, ulong a2)
+{
+   tracepoint_handler h = tp_handler;
+
+   if (h)
+      h(id, a0, a1, a2);
+}
+
+tracepoint_handler
+tracepoint_set_handler(tracepoint_handler h)
+{
+   tracepoint_handler old = tp_handler;
+   tp_handler = h;
+   return old;
+}
+
+const char *
+tracepoint_get_name(enum tracepoint_id id)
+{
+   ASSERT(id < TP_COUNT);
+   return tracepoint_names[id];
+}
+
+#ifndef UNIT_TEST_ENVIRONMENT
+
+static void
+tracepoint_patch_sites(enum tracepoint_id id, bool enabled)
+{
+   /* Defined in the linker script */
+   extern const struct tracepoint_site __tracepoints_start[];
+   extern const struct tracepoint_site __tracepoints_end[];
+
+   for (const struct tracepoint_site *s = __tracepoints_start;
+        s < __tracepoints_end;
+        s++)
+   {
+      if (s->id == id)
+         arch_patch_tracepoint_site(s, enabled);
+   }
+}
+
+#else
+
+static void
+tracepoint_patch_sites(enum tracepoint_id id, bool enabled)
+{
+   /* Nothing to patch: the unit tests check __tracepoints_on[] instead */
+}
+
+#endif
+
+void
+tracepoint_set_enabled(enum tracepoint_id id, bool enabled)
+{
+   ulong var;
+   ASSERT(id < TP_COUNT);
+
+   /*
+    * Patch all the sites with the interrupts disabled: this way an IRQ handler
+    * cannot observe a partially-patched instruction.
+    */
+   disable_interrupts(&var);
+   {
+      if (__tracepoints_on[id] != enabled) {
+         tracepoint_patch_sites(id, enabled);
+         __tracepoints_on[id] = enabled;
+      }
+   }
+   enable_interrupts(&var);
+}
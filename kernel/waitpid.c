@@ -263,25 +263,17 @@ int sys_wait4(int tid, int *user_wstatus, int options, void *user_rusage)
 
    if (user_rusage) {
 
-      struct k_rusage ru = {0};
-      struct k_timespec64 tp;
-      u64 user_ticks = chtask->ticks.total - chtask->ticks.total_kernel;
-
-      ticks_to_timespec(user_ticks, &tp);
-
-      ru.ru_utime.tv_sec = (long) tp.tv_sec;
-      ru.ru_utime.tv_usec = tp.tv_nsec / 1000;
-
-      ticks_to_timespec(chtask->ticks.total_kernel, &tp);
-      ru.ru_stime.tv_sec = (long) tp.tv_sec;
-      ru.ru_stime.tv_usec = tp.tv_nsec / 1000;
+      struct k_rusage ru;
+      task_get_rusage(chtask, true, true, &ru);
 
       if (copy_to_user(user_rusage, &ru, sizeof(ru)) < 0)
          chtask_tid = -EFAULT;
    }
 
-   if (chtask->state == TASK_STATE_ZOMBIE)
+   if (chtask->state == TASK_STATE_ZOMBIE) {
+      process_account_waited_child(curr->pi, chtask);
       remove_task(chtask);
+   }
 
    enable_preemption();
    return chtask_tid;
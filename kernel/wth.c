@@ -13,6 +13,7 @@
 #include <tilck/kernel/interrupts.h>
 #include <tilck/kernel/debug_utils.h>
 #include <tilck/kernel/sort.h>
+#include <tilck/kernel/tracepoint.h>
 
 #include "wth_int.h"
 
@@ -139,13 +140,15 @@ wth_find_worker(int lowest_prio)
 bool wth_process_single_job(struct worker_thread *t)
 {
    bool success;
-   struct wjob job_to_run;
+   struct wjob job;
 
-   success = safe_ringbuf_read_elem(&t->rb, &job_to_run);
+   success = safe_ringbuf_read_elem(&t->rb, &job);
 
    if (success) {
       /* Run the job with preemption enabled */
-      job_to_run.func(job_to_run.arg);
+      tracepoint(tp_wth_job_start, t->priority, job.func, job.arg);
+      job.func(job.arg);
+      tracepoint(tp_wth_job_end, t->priority, job.func, job.arg);
    }
 
    return success;
@@ -128,19 +128,36 @@ void dp_register_screen(struct dp_screen *screen)
    list_add_after(pred, &screen->node);
 }
 
+/*
+ * Move to the next header position, wrapping the headers on the (otherwise
+ * empty) row below them, when they don't fit in the panel's width.
+ */
+static void
+dp_header_advance(int *col, int len)
+{
+   if (*col + len > DP_W - 2) {
+      dp_move_cursor(dp_start_row + 2, dp_start_col + 2);
+      *col = 2;
+   }
+
+   *col += len;
+}
+
 static void redraw_screen(void)
 {
    struct dp_screen *pos;
    char buf[64];
-   int rc;
+   int rc, col = 2;
 
    dp_clear();
    dp_move_cursor(dp_start_row + 1, dp_start_col + 2);
 
    list_for_each_ro(pos, &dp_screens_list, node) {
-      dp_write_header(pos->index+1, pos->label, pos == dp_ctx);
+      dp_header_advance(&col, (int)strlen(pos->label) + 4); /* "N[label] " */
+      dp_write_header((pos->index + 1) % 10, pos->label, pos == dp_ctx);
    }
 
+   dp_header_advance(&col, 8);
    dp_write_raw("q[Quit]" RESET_ATTRS " ");
    dp_ctx->draw_func();
 
@@ -170,6 +187,9 @@ dp_main_handle_keypress(struct key_event ke)
       struct dp_screen *pos;
       rc = ke.print_char - '0';
 
+      if (!rc)
+         rc = 10;    /* '0' is the 10th screen, as on the keyboard */
+
       list_for_each_ro(pos, &dp_screens_list, node) {
 
          if (pos->index == rc - 1 && pos != dp_ctx) {
@@ -4,13 +4,18 @@
 
 #include <tilck/common/basic_defs.h>
 #include <tilck/common/string_util.h>
+#include <tilck/common/printk.h>
 #include <tilck/kernel/debug_utils.h>
 #include <tilck/kernel/irq.h>
 #include <tilck/kernel/timer.h>
 #include <tilck/kernel/kb.h>
 #include <tilck/kernel/sched.h>
+#include <tilck/kernel/irqsoff.h>
+#include <tilck/kernel/datetime.h>
+#include <tilck/kernel/elf_utils.h>
 
 #include "termutil.h"
+#include "dp_int.h"
 
 static int row;
 
@@ -72,6 +77,77 @@ static void debug_dump_masked_irqs(void)
    dp_writeln("");
 }
 
+#if KERNEL_IRQSOFF_TRACER
+
+static void debug_dump_irqsoff_max(void)
+{
+   const ulong cycles_per_us = get_tsc_cycles_per_us();
+   struct irqsoff_max m;
+   char buf[64];
+
+   dp_writeln("");
+   dp_writeln("Longest windows with IRQs or preemption disabled [%s%s"
+              RESET_ATTRS "]",
+              irqsoff_info.enabled ? E_COLOR_BR_GREEN : E_COLOR_BR_RED,
+              irqsoff_info.enabled ? "enabled" : "disabled");
+
+   for (int k = 0; k < IRQSOFF_KINDS; k++) {
+
+      irqsoff_get_max(k, &m);
+
+      dp_writeln("   %-10s %6" PRIu64 " us (%lu windows)",
+                 irqsoff_get_kind_name(k),
+                 cycles_per_us ? m.max_cycles / cycles_per_us : 0,
+                 m.windows);
+
+      if (!m.windows)
+         continue;
+
+      format_sym_at_addr(buf, sizeof(buf), m.start_site);
+      dp_writeln("      from: %s", buf);
+      format_sym_at_addr(buf, sizeof(buf), m.end_site);
+      dp_writeln("      to:   %s", buf);
+   }
+
+   dp_writeln(
+      E_COLOR_BR_WHITE "e" RESET_ATTRS ": enable/disable, "
+      E_COLOR_BR_WHITE "r" RESET_ATTRS ": reset"
+   );
+}
+
+static enum kb_handler_action
+dp_irqs_keypress(struct key_event ke)
+{
+   switch (ke.print_char) {
+
+      case 'e':
+         irqsoff_info.enabled = !irqsoff_info.enabled;
+         break;
+
+      case 'r':
+         irqsoff_reset();
+         break;
+
+      default:
+         return kb_handler_nak;
+   }
+
+   ui_need_update = true;
+   return kb_handler_ok_and_continue;
+}
+
+#else
+
+static void debug_dump_irqsoff_max(void) { }
+
+static enum kb_handler_action
+dp_irqs_keypress(struct key_event ke)
+{
+   return kb_handler_nak;
+}
+
+#endif // #if KERNEL_IRQSOFF_TRACER
+
 static void dp_show_irq_stats(void)
 {
    row = dp_screen_start_row;
@@ -81,6 +157,7 @@ static void dp_show_irq_stats(void)
    debug_dump_spur_irq_count();
    debug_dump_unhandled_irq_count();
    debug_dump_masked_irqs();
+   debug_dump_irqsoff_max();
 }
 
 static struct dp_screen dp_irqs_screen =
@@ -88,7 +165,7 @@ static struct dp_screen dp_irqs_screen =
    .index = 4,
    .label = "IRQs",
    .draw_func = dp_show_irq_stats,
-   .on_keypress_func = NULL,
+   .on_keypress_func = dp_irqs_keypress,
 };
 
 __attribute__((constructor))
@@ -0,0 +1,233 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/config_kmalloc.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+
+#include <tilck/kernel/kb.h>
+#include <tilck/kernel/sort.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/kmalloc_debug.h>
+#include <tilck/kernel/elf_utils.h>
+
+#include "termutil.h"
+#include "dp_int.h"
+
+#define DP_KMSITES_TOP_N                           32
+
+#if KMALLOC_SITE_PROF
+
+static int row;
+static char order_by = 'l';
+static ulong sites_count;
+static ulong sites_max;
+static struct kmalloc_site *sites;
+
+static long dp_kmsites_delta(const struct kmalloc_site *s)
+{
+   return (long)(s->live_bytes - s->snap_bytes);
+}
+
+static long dp_kmsites_cmpf_live(const void *a, const void *b)
+{
+   const struct kmalloc_site *x = a;
+   const struct kmalloc_site *y = b;
+
+   if (x->live_bytes != y->live_bytes)
+      return x->live_bytes < y->live_bytes ? 1 : -1;
+
+   return 0;
+}
+
+static long dp_kmsites_cmpf_peak(const void *a, const void *b)
+{
+   const struct kmalloc_site *x = a;
+   const struct kmalloc_site *y = b;
+
+   if (x->peak_bytes != y->peak_bytes)
+      return x->peak_bytes < y->peak_bytes ? 1 : -1;
+
+   return 0;
+}
+
+static long dp_kmsites_cmpf_count(const void *a, const void *b)
+{
+   const struct kmalloc_site *x = a;
+   const struct kmalloc_site *y = b;
+
+   if (x->live_count != y->live_count)
+      return x->live_count < y->live_count ? 1 : -1;
+
+   return 0;
+}
+
+static long dp_kmsites_cmpf_delta(const void *a, const void *b)
+{
+   const long x = dp_kmsites_delta(a);
+   const long y = dp_kmsites_delta(b);
+   return x < y ? 1 : (x > y ? -1 : 0);
+}
+
+static void dp_kmsites_enter(void)
+{
+   sites_max = kmalloc_site_prof_info.max_sites;
+
+   if (sites_max && !sites)
+      sites = kmalloc(sites_max * sizeof(*sites));
+}
+
+static void dp_kmsites_exit(void)
+{
+   if (sites) {
+      kfree2(sites, sites_max * sizeof(*sites));
+      sites = NULL;
+   }
+}
+
+static void
+dp_kmsites_sort(void)
+{
+   cmpfun_ptr cmpf;
+
+   switch (order_by) {
+      case 'p':   cmpf = dp_kmsites_cmpf_peak;    break;
+      case 'c':   cmpf = dp_kmsites_cmpf_count;   break;
+      case 'd':   cmpf = dp_kmsites_cmpf_delta;   break;
+      default:    cmpf = dp_kmsites_cmpf_live;    break;
+   }
+
+   insertion_sort_generic(sites, sizeof(sites[0]), (u32)sites_count, cmpf);
+}
+
+static enum kb_handler_action
+dp_kmsites_keypress(struct key_event ke)
+{
+   struct kmalloc_site_prof_info *info = &kmalloc_site_prof_info;
+   const char c = ke.print_char;
+
+   switch (c) {
+
+      case 'l':
+      case 'p':
+      case 'c':
+      case 'd':
+         order_by = c;
+         break;
+
+      case 's':
+         debug_kmalloc_sites_snapshot();
+         break;
+
+      case 'b':
+         info->backtrace = !info->backtrace;
+         break;
+
+      default:
+         return kb_handler_nak;
+   }
+
+   ui_need_update = true;
+   return kb_handler_ok_and_continue;
+}
+
+static void
+dp_kmsites_show_site(struct kmalloc_site *s)
+{
+   char site[64];
+   int n;
+
+   /* The innermost frame, followed by its caller, if any */
+   n = format_sym_at_addr(site, sizeof(site), (ulong)s->frames[0]);
+
+   if (s->frames[1]) {
+      n += snprintk(site + n, sizeof(site) - (size_t)n, "<-");
+      format_sym_at_addr(site + n, sizeof(site) - (size_t)n,
+                         (ulong)s->frames[1]);
+   }
+
+   dp_writeln(" %7lu %6lu %7lu %7ld  %-38.38s",
+              s->live_bytes / KB, s->live_count,
+              s->peak_bytes / KB, dp_kmsites_delta(s) / (long)KB,
+              site);
+}
+
+static void
+dp_show_kmsites(void)
+{
+   const struct kmalloc_site_prof_info *info = &kmalloc_site_prof_info;
+   row = dp_screen_start_row;
+
+   if (!sites) {
+      dp_writeln("Out of memory or site profiler not initialized");
+      return;
+   }
+
+   sites_count = debug_kmalloc_get_sites(sites, sites_max);
+   dp_kmsites_sort();
+
+   dp_writeln("kmalloc sites: %lu/%lu, live blocks: %lu/%lu, dropped: %lu",
+              info->sites, info->max_sites,
+              info->blocks, info->max_blocks, info->dropped);
+
+   dp_writeln("Snapshots: %lu, backtrace: %s",
+              info->snapshots, info->backtrace ? "ON" : "OFF");
+
+   dp_writeln(
+      "Order by: "
+      E_COLOR_BR_WHITE "l" RESET_ATTRS "ive, "
+      E_COLOR_BR_WHITE "p" RESET_ATTRS "eak, "
+      E_COLOR_BR_WHITE "c" RESET_ATTRS "ount, "
+      E_COLOR_BR_WHITE "d" RESET_ATTRS "elta; "
+      E_COLOR_BR_WHITE "s" RESET_ATTRS ": snapshot, "
+      E_COLOR_BR_WHITE "b" RESET_ATTRS ": toggle backtrace"
+   );
+   dp_writeln("Sizes in KB. Delta: live memory change since the snapshot.");
+   dp_writeln("");
+
+   dp_writeln(E_COLOR_BR_WHITE
+              " %7s %6s %7s %7s  %-38s"
+              RESET_ATTRS,
+              "Live", "Count", "Peak", "Delta", "Site");
+
+   for (ulong i = 0; i < MIN(sites_count, (ulong)DP_KMSITES_TOP_N); i++)
+      dp_kmsites_show_site(&sites[i]);
+}
+
+#else
+
+static int row;
+
+static void dp_kmsites_enter(void) { }
+static void dp_kmsites_exit(void) { }
+
+static enum kb_handler_action
+dp_kmsites_keypress(struct key_event ke)
+{
+   return kb_handler_nak;
+}
+
+static void
+dp_show_kmsites(void)
+{
+   row = dp_screen_start_row;
+   dp_writeln("Not available: recompile with KMALLOC_SITE_PROF=1");
+}
+
+#endif // #if KMALLOC_SITE_PROF
+
+static struct dp_screen dp_kmsites_screen =
+{
+   .index = 9,
+   .label = "KmSites",
+   .draw_func = dp_show_kmsites,
+   .on_dp_enter = dp_kmsites_enter,
+   .on_dp_exit = dp_kmsites_exit,
+   .on_keypress_func = dp_kmsites_keypress,
+};
+
+__attribute__((constructor))
+static void dp_kmsites_init(void)
+{
+   dp_register_screen(&dp_kmsites_screen);
+}
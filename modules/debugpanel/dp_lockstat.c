@@ -0,0 +1,183 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/config_debug.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+
+#include <tilck/kernel/kb.h>
+#include <tilck/kernel/sort.h>
+#include <tilck/kernel/elf_utils.h>
+#include <tilck/kernel/datetime.h>
+#include <tilck/kernel/lockstat.h>
+
+#include "termutil.h"
+#include "dp_int.h"
+
+#define DP_LOCKSTAT_TOP_N                          32
+
+#if KERNEL_LOCKSTAT
+
+static int row;
+static char order_by = 'w';
+static u32 entries_count;
+static struct lockstat_entry entries[LOCKSTAT_MAX_ENTRIES];
+
+static long dp_lockstat_cmpf_wait(const void *a, const void *b)
+{
+   const struct lockstat_entry *x = a;
+   const struct lockstat_entry *y = b;
+   return x->tot_wait < y->tot_wait ? 1 : (x->tot_wait > y->tot_wait ? -1 : 0);
+}
+
+static long dp_lockstat_cmpf_contended(const void *a, const void *b)
+{
+   const struct lockstat_entry *x = a;
+   const struct lockstat_entry *y = b;
+   return (long)y->contended - (long)x->contended;
+}
+
+static long dp_lockstat_cmpf_hold(const void *a, const void *b)
+{
+   const struct lockstat_entry *x = a;
+   const struct lockstat_entry *y = b;
+   return x->max_hold < y->max_hold ? 1 : (x->max_hold > y->max_hold ? -1 : 0);
+}
+
+static const char *
+dp_lockstat_type_str(enum lockstat_type type)
+{
+   switch (type) {
+      case lockstat_kmutex:      return "m";
+      case lockstat_rwlock_sh:   return "rs";
+      case lockstat_rwlock_ex:   return "rx";
+      default:                   return "?";
+   }
+}
+
+static u64
+dp_lockstat_us(u64 cycles, ulong cycles_per_us)
+{
+   return cycles_per_us ? cycles / cycles_per_us : 0;
+}
+
+static void
+dp_lockstat_show_entry(struct lockstat_entry *e, ulong cycles_per_us)
+{
+   char lock[32], site[48];
+
+   format_sym_at_addr(lock, sizeof(lock), (ulong)e->lock);
+   format_sym_at_addr(site, sizeof(site), e->site);
+
+   dp_writeln(" %-16.16s %-20.20s %-2s %6u %5u %6" PRIu64
+              " %6" PRIu64 " %6" PRIu64,
+              lock, site, dp_lockstat_type_str(e->type),
+              e->acquisitions, e->contended,
+              dp_lockstat_us(e->tot_wait, cycles_per_us),
+              dp_lockstat_us(e->max_wait, cycles_per_us),
+              dp_lockstat_us(e->max_hold, cycles_per_us));
+}
+
+static void
+dp_lockstat_sort(void)
+{
+   cmpfun_ptr cmpf;
+
+   switch (order_by) {
+      case 'c':   cmpf = dp_lockstat_cmpf_contended;   break;
+      case 'h':   cmpf = dp_lockstat_cmpf_hold;        break;
+      default:    cmpf = dp_lockstat_cmpf_wait;        break;
+   }
+
+   insertion_sort_generic(entries, sizeof(entries[0]), entries_count, cmpf);
+}
+
+static enum kb_handler_action
+dp_lockstat_keypress(struct key_event ke)
+{
+   const char c = ke.print_char;
+
+   switch (c) {
+
+      case 'w':
+      case 'c':
+      case 'h':
+         order_by = c;
+         break;
+
+      case 'r':
+         lockstat_reset();
+         break;
+
+      default:
+         return kb_handler_nak;
+   }
+
+   ui_need_update = true;
+   return kb_handler_ok_and_continue;
+}
+
+static void
+dp_show_lockstat(void)
+{
+   const ulong cycles_per_us = get_tsc_cycles_per_us();
+   row = dp_screen_start_row;
+
+   entries_count = lockstat_get_entries(entries, ARRAY_SIZE(entries));
+   dp_lockstat_sort();
+
+   dp_writeln("Lock contention (TSC: %lu cycles/us), locks: %u, dropped: %lu",
+              cycles_per_us, entries_count, lockstat_get_dropped());
+
+   dp_writeln(
+      "Order by: "
+      E_COLOR_BR_WHITE "w" RESET_ATTRS "ait time, "
+      E_COLOR_BR_WHITE "c" RESET_ATTRS "ontended, "
+      "max " E_COLOR_BR_WHITE "h" RESET_ATTRS "old; "
+      E_COLOR_BR_WHITE "r" RESET_ATTRS ": reset"
+   );
+   dp_writeln("Types: m: kmutex, rs/rx: rwlock shared/exclusive. Times in us.");
+   dp_writeln("");
+
+   dp_writeln(E_COLOR_BR_WHITE
+              " %-16s %-20s %-2s %6s %5s %6s %6s %6s"
+              RESET_ATTRS,
+              "Lock", "Call site", "T", "Acq", "Cont",
+              "Wait", "MaxW", "MaxH");
+
+   for (u32 i = 0; i < MIN(entries_count, (u32)DP_LOCKSTAT_TOP_N); i++)
+      dp_lockstat_show_entry(&entries[i], cycles_per_us);
+}
+
+#else
+
+static int row;
+
+static enum kb_handler_action
+dp_lockstat_keypress(struct key_event ke)
+{
+   return kb_handler_nak;
+}
+
+static void
+dp_show_lockstat(void)
+{
+   row = dp_screen_start_row;
+   dp_writeln("Not available: recompile with KERNEL_LOCKSTAT=1");
+}
+
+#endif // #if KERNEL_LOCKSTAT
+
+static struct dp_screen dp_lockstat_screen =
+{
+   .index = 8,
+   .label = "Locks",
+   .draw_func = dp_show_lockstat,
+   .on_keypress_func = dp_lockstat_keypress,
+};
+
+__attribute__((constructor))
+static void dp_lockstat_init(void)
+{
+   dp_register_screen(&dp_lockstat_screen);
+}
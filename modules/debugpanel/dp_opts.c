@@ -15,6 +15,7 @@
 #include <tilck_gen_headers/mod_acpi.h>
 #include <tilck_gen_headers/mod_pci.h>
 #include <tilck_gen_headers/mod_sb16.h>
+#include <tilck_gen_headers/mod_zram.h>
 
 #include <tilck/common/basic_defs.h>
 #include <tilck/common/string_util.h>
@@ -66,6 +67,7 @@ static void dp_show_opts(void)
    DUMP_BOOL_OPT(MOD_tracing);
    DUMP_BOOL_OPT(MOD_sysfs);
    DUMP_BOOL_OPT(MOD_sb16);
+   DUMP_BOOL_OPT(MOD_zram);
 
    DUMP_LABEL("Modules config");
    DUMP_INT_OPT(FBCON_BIGFONT_THR);
@@ -87,6 +89,8 @@ static void dp_show_opts(void)
    DUMP_BOOL_OPT(BOOT_INTERACTIVE);
    DUMP_BOOL_OPT(KERNEL_64BIT_OFFT);
    DUMP_BOOL_OPT(KRN_CLOCK_DRIFT_COMP);
+   DUMP_BOOL_OPT(MMAP_BIG_PAGES);
+   DUMP_BOOL_OPT(KERNEL_HIGHMEM);
 
    DUMP_LABEL("Disabled by default");
    DUMP_BOOL_OPT(KRN_NO_SYS_WARN);
@@ -101,7 +105,10 @@ static void dp_show_opts(void)
    DUMP_BOOL_OPT(FORK_NO_COW);
    DUMP_BOOL_OPT(MMAP_NO_COW);
    DUMP_BOOL_OPT(PANIC_SHOW_REGS);
+   DUMP_BOOL_OPT(KERNEL_LOCKSTAT);
+   DUMP_BOOL_OPT(KERNEL_IRQSOFF_TRACER);
    DUMP_BOOL_OPT(KMALLOC_HEAVY_STATS);
+   DUMP_BOOL_OPT(KMALLOC_SITE_PROF);
    DUMP_BOOL_OPT(KMALLOC_FREE_MEM_POISONING);
    DUMP_BOOL_OPT(KMALLOC_SUPPORT_DEBUG_LOG);
    DUMP_BOOL_OPT(KMALLOC_SUPPORT_LEAK_DETECTOR);
@@ -0,0 +1,97 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/mod_prof.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+
+#include <tilck/kernel/kb.h>
+#include <tilck/mods/prof.h>
+
+#include "termutil.h"
+#include "dp_int.h"
+
+#if MOD_prof
+
+static const char *dp_prof_err;
+
+static enum kb_handler_action dp_prof_keypress(struct key_event ke)
+{
+   switch (ke.print_char) {
+
+      case 's':
+         dp_prof_err = NULL;
+
+         if (prof_info.running)
+            prof_stop();
+         else if (prof_start() < 0)
+            dp_prof_err = "Out of memory";
+
+         break;
+
+      case 'r':
+         prof_reset();
+         break;
+
+      case '+':
+         prof_set_hz(prof_info.hz * 2);
+         break;
+
+      case '-':
+         prof_set_hz(prof_info.hz / 2);
+         break;
+
+      default:
+         return kb_handler_nak;
+   }
+
+   ui_need_update = true;
+   return kb_handler_ok_and_continue;
+}
+
+static void dp_show_prof(void)
+{
+   int row = dp_screen_start_row;
+
+   dp_writeln("Statistical profiler (RTC periodic interrupt)");
+   dp_writeln("");
+
+   dp_writeln("   Status:   %s%s" RESET_ATTRS,
+              prof_info.running ? E_COLOR_BR_GREEN : E_COLOR_BR_RED,
+              prof_info.running ? "running" : "stopped");
+
+   dp_writeln("   Rate:     %lu Hz", prof_info.hz);
+   dp_writeln("   Samples:  %lu / %lu", prof_info.samples, prof_info.max_samples);
+   dp_writeln("   Dropped:  %lu", prof_info.dropped);
+
+   if (dp_prof_err)
+      dp_writeln("   Error:    " E_COLOR_BR_RED "%s" RESET_ATTRS, dp_prof_err);
+
+   dp_writeln("");
+   dp_writeln(
+      E_COLOR_BR_WHITE "s" RESET_ATTRS ": start/stop, "
+      E_COLOR_BR_WHITE "r" RESET_ATTRS ": reset, "
+      E_COLOR_BR_WHITE "+" RESET_ATTRS "/"
+      E_COLOR_BR_WHITE "-" RESET_ATTRS ": double/halve the rate"
+   );
+
+   dp_writeln("");
+   dp_writeln("The samples are in /dev/prof, in the folded stacks format:");
+   dp_writeln("copy the file on the host and run flamegraph.pl on it.");
+}
+
+static struct dp_screen dp_prof_screen =
+{
+   .index = 6,
+   .label = "Prof",
+   .draw_func = dp_show_prof,
+   .on_keypress_func = dp_prof_keypress,
+};
+
+__attribute__((constructor))
+static void dp_prof_init(void)
+{
+   dp_register_screen(&dp_prof_screen);
+}
+
+#endif // #if MOD_prof
@@ -0,0 +1,188 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/mod_sysstat.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+
+#include <tilck/kernel/kb.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/process.h>
+#include <tilck/kernel/sort.h>
+#include <tilck/kernel/syscalls.h>
+#include <tilck/mods/sysstat.h>
+
+#include "termutil.h"
+#include "dp_int.h"
+
+#if MOD_sysstat
+
+struct dp_sysstat_row {
+   u32 sn;
+   u64 tot_cycles;
+};
+
+static int row;
+static struct dp_sysstat_row sorted_syscalls[MAX_SYSCALLS];
+
+static long
+dp_sysstat_cmp(const void *a, const void *b)
+{
+   const u64 ta = ((const struct dp_sysstat_row *)a)->tot_cycles;
+   const u64 tb = ((const struct dp_sysstat_row *)b)->tot_cycles;
+
+   /* Descending order by the total time */
+   return ta < tb ? 1 : (ta > tb ? -1 : 0);
+}
+
+static int
+dp_sysstat_next_pid_cb(void *obj, void *arg)
+{
+   struct task *ti = obj;
+   long *next = arg;
+   const long pid = ti->pi->pid;
+
+   if (is_kernel_thread(ti) || ti->tid != pid)
+      return 0; /* not the main thread of a user process */
+
+   if (pid > sysstat_info.pid && (!*next || pid < *next))
+      *next = pid;
+
+   return 0;
+}
+
+/* Filter the next user process, by PID, or no process after the last one */
+static void
+dp_sysstat_filter_next_process(void)
+{
+   long next = 0;
+
+   disable_preemption();
+   {
+      iterate_over_tasks(dp_sysstat_next_pid_cb, &next);
+   }
+   enable_preemption();
+
+   sysstat_info.pid = next;
+   sysstat_reset();
+}
+
+static enum kb_handler_action
+dp_sysstat_keypress(struct key_event ke)
+{
+   switch (ke.print_char) {
+
+      case 'e':
+         sysstat_info.enabled = !sysstat_info.enabled;
+         break;
+
+      case 'r':
+         sysstat_reset();
+         break;
+
+      case 'p':
+         dp_sysstat_filter_next_process();
+         break;
+
+      default:
+         return kb_handler_nak;
+   }
+
+   ui_need_update = true;
+   return kb_handler_ok_and_continue;
+}
+
+static void
+dp_sysstat_fmt_us(char *buf, size_t buf_sz, u64 cycles)
+{
+   const u64 ns = sysstat_cycles_to_ns(cycles);
+
+   snprintk(buf, buf_sz, "%" PRIu64 ".%u",
+            ns / 1000, (u32)((ns % 1000) / 100));
+}
+
+static void
+dp_sysstat_show_entry(u32 sn)
+{
+   struct sysstat_entry e;
+   char name[32], avg[16], p50[16], p99[16], max[16];
+
+   if (!sysstat_get_entry(sn, &e))
+      return; /* reset in the meanwhile */
+
+   dp_sysstat_fmt_us(avg, sizeof(avg), e.tot_cycles / e.calls);
+   dp_sysstat_fmt_us(p50, sizeof(p50), sysstat_get_percentile(&e, 50));
+   dp_sysstat_fmt_us(p99, sizeof(p99), sysstat_get_percentile(&e, 99));
+   dp_sysstat_fmt_us(max, sizeof(max), e.max_cycles);
+
+   dp_writeln(" %-16s %7lu %6lu %9s %9s %9s %9s",
+              sysstat_get_syscall_name(sn, name, sizeof(name)),
+              e.calls, e.errors, avg, p50, p99, max);
+}
+
+static void
+dp_show_sysstat(void)
+{
+   struct sysstat_entry e;
+   u32 cnt = 0;
+   row = dp_screen_start_row;
+
+   dp_writeln("Per-syscall latency (TSC: %lu cycles/us)",
+              get_tsc_cycles_per_us());
+   dp_writeln("");
+
+   dp_writeln("   Status:   %s%s" RESET_ATTRS,
+              sysstat_info.enabled ? E_COLOR_BR_GREEN : E_COLOR_BR_RED,
+              sysstat_info.enabled ? "enabled" : "disabled");
+
+   if (sysstat_info.pid > 0)
+      dp_writeln("   Process:  %ld", sysstat_info.pid);
+   else
+      dp_writeln("   Process:  all");
+
+   dp_writeln("");
+   dp_writeln(
+      E_COLOR_BR_WHITE "e" RESET_ATTRS ": enable/disable, "
+      E_COLOR_BR_WHITE "r" RESET_ATTRS ": reset, "
+      E_COLOR_BR_WHITE "p" RESET_ATTRS ": filter the next process"
+   );
+   dp_writeln("");
+
+   for (u32 sn = 0; sn < MAX_SYSCALLS; sn++) {
+      if (sysstat_get_entry(sn, &e)) {
+         sorted_syscalls[cnt].sn = sn;
+         sorted_syscalls[cnt].tot_cycles = e.tot_cycles;
+         cnt++;
+      }
+   }
+
+   insertion_sort_generic(sorted_syscalls,
+                          sizeof(sorted_syscalls[0]),
+                          cnt,
+                          dp_sysstat_cmp);
+
+   dp_writeln(E_COLOR_BR_WHITE
+              " %-16s %7s %6s %9s %9s %9s %9s"
+              RESET_ATTRS,
+              "Syscall", "Calls", "Errors",
+              "Avg [us]", "p50 [us]", "p99 [us]", "Max [us]");
+
+   for (u32 i = 0; i < cnt; i++)
+      dp_sysstat_show_entry(sorted_syscalls[i].sn);
+}
+
+static struct dp_screen dp_sysstat_screen =
+{
+   .index = 7,
+   .label = "Sys",
+   .draw_func = dp_show_sysstat,
+   .on_keypress_func = dp_sysstat_keypress,
+};
+
+__attribute__((constructor))
+static void dp_sysstat_init(void)
+{
+   dp_register_screen(&dp_sysstat_screen);
+}
+
+#endif // #if MOD_sysstat
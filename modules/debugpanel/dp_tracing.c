@@ -9,6 +9,8 @@
 #include <tilck/kernel/sched.h>
 #include <tilck/kernel/kmalloc.h>
 #include <tilck/kernel/errno.h>
+#include <tilck/kernel/elf_utils.h>
+#include <tilck/kernel/tracepoint.h>
 #include <tilck/kernel/fs/vfs.h>
 
 #include <tilck/mods/tracing.h>
@@ -20,6 +22,9 @@
 
 static char *line_buf;
 
+/* `line_buf` is used for editing the filter expression too */
+STATIC_ASSERT(TRACE_FILTER_STR_LEN <= TRACED_SYSCALLS_STR_LEN);
+
 /* Shared data with dp_tracing_sys.c */
 char *rend_bufs[6];
 int used_rend_bufs;
@@ -62,6 +67,13 @@ tracing_ui_show_help(void)
       RESET_ATTRS
    );
 
+   dp_write_raw(
+      E_COLOR_YELLOW "  "
+      E_COLOR_YELLOW "f" RESET_ATTRS "     : Edit the filter expr "
+      E_COLOR_RED "[2]" RESET_ATTRS "\r\n"
+      RESET_ATTRS
+   );
+
    dp_write_raw(
       E_COLOR_YELLOW "  "
       E_COLOR_YELLOW "k" RESET_ATTRS "     : Set trace_printk() level\r\n"
@@ -74,6 +86,12 @@ tracing_ui_show_help(void)
       RESET_ATTRS
    );
 
+   dp_write_raw(
+      E_COLOR_YELLOW "  "
+      E_COLOR_YELLOW "n" RESET_ATTRS "     : Toggle kernel tracepoints\r\n"
+      RESET_ATTRS
+   );
+
    dp_write_raw(
       E_COLOR_YELLOW "  "
       E_COLOR_YELLOW "p" RESET_ATTRS "     : Dump user tasks list\r\n"
@@ -120,6 +138,60 @@ tracing_ui_show_help(void)
       E_COLOR_BR_WHITE "Example: " RESET_ATTRS
       "read*,write*,!readlink* \r\n"
    );
+
+   dp_write_raw("\r\n" E_COLOR_RED "[2]" RESET_ATTRS " ");
+   dp_write_raw("Only the syscall events matching the filter get traced. "
+                "Fields: pid, tid,\r\n");
+
+   dp_write_raw("sys, arg0..arg5, ret, dur (usec), exit and path. "
+                "Operators: == != < <= > >= &\r\n");
+
+   dp_write_raw("^= (path prefix), !, &&, || and parentheses. "
+                "Empty: no filter.\r\n");
+
+   dp_write_raw(
+      E_COLOR_BR_WHITE "Example: " RESET_ATTRS
+      "ret < 0 && (sys == open || path ^= \"/tmp\") \r\n"
+   );
+}
+
+static int
+get_enabled_tracepoints_count(void)
+{
+   int cnt = 0;
+
+   for (int i = 0; i < TP_COUNT; i++)
+      cnt += tracepoint_is_enabled(i);
+
+   return cnt;
+}
+
+/*
+ * Show how many syscall events the filter discarded and the avg. cycles spent
+ * on each passed and rejected event: the difference is the overhead saved.
+ */
+static void
+dp_show_filter_stats(void)
+{
+   struct trace_filter_stats s;
+   ulong tot;
+
+   trace_filter_get_stats(&s);
+
+   if (!(tot = s.passed + s.rejected))
+      return;
+
+   dp_write_raw(
+      TERM_VLINE " Events passed: " E_COLOR_BR_BLUE "%lu" RESET_ATTRS
+      ", rejected: " E_COLOR_BR_BLUE "%lu" RESET_ATTRS " (%lu%%) "
+      TERM_VLINE " Cycles/event: passed %" PRIu64 ", rejected %" PRIu64
+      "\r\n",
+      s.passed,
+      s.rejected,
+      s.rejected * 100 / tot,
+      s.passed ? s.pass_cycles / s.passed : 0,
+      s.rejected ? s.reject_cycles / s.rejected : 0
+   );
 }
 
 static void
@@ -138,7 +210,8 @@ tracing_ui_msg(void)
       TERM_VLINE " #Sys traced: " E_COLOR_BR_BLUE "%d" RESET_ATTRS " "
       TERM_VLINE " #Tasks traced: " E_COLOR_BR_BLUE "%d" RESET_ATTRS " "
       TERM_VLINE "\r\n"
-      TERM_VLINE " Printk lvl: " E_COLOR_BR_BLUE "%d" RESET_ATTRS
+      TERM_VLINE " Printk lvl: " E_COLOR_BR_BLUE "%d" RESET_ATTRS " "
+      TERM_VLINE " #Tracepoints on: " E_COLOR_BR_BLUE "%d" RESET_ATTRS
       "\r\n",
 
       tracing_is_force_exp_block_enabled()
@@ -151,7 +224,8 @@ tracing_ui_msg(void)
 
       get_traced_syscalls_count(),
       get_traced_tasks_count(),
-      tracing_get_printk_lvl()
+      tracing_get_printk_lvl(),
+      get_enabled_tracepoints_count()
    );
 
    get_traced_syscalls_str(line_buf, TRACED_SYSCALLS_STR_LEN);
@@ -163,9 +237,80 @@ tracing_ui_msg(void)
    );
 
    dp_write_raw("\r\n");
+   get_trace_filter_str(line_buf, TRACE_FILTER_STR_LEN);
+
+   if (line_buf[0]) {
+      dp_write_raw(
+         TERM_VLINE
+         " Filter: " E_COLOR_YELLOW "%s" RESET_ATTRS "\r\n",
+         line_buf
+      );
+   }
+
+   dp_show_filter_stats();
    dp_write_raw(E_COLOR_YELLOW "> " RESET_ATTRS);
 }
 
+static void
+dp_dump_tracepoint_event(struct tracepoint_event_data *tp)
+{
+   const ulong *a = tp->args;
+   const char *sym;
+   long off;
+
+   dp_write_raw(
+      E_COLOR_BR_CYAN "%s" RESET_ATTRS ": ",
+      tracepoint_get_name(tp->id)
+   );
+
+   switch (tp->id) {
+
+      case tp_sched_switch:
+         dp_write_raw("prev: %d (%s), next: %d\r\n",
+                      (int)a[0],
+                      a[2] < ARRAY_SIZE(task_state_str)
+                        ? task_state_str[a[2]]
+                        : "?",
+                      (int)a[1]);
+         break;
+
+      case tp_sched_wakeup:
+         dp_write_raw("tid: %d\r\n", (int)a[0]);
+         break;
+
+      case tp_irq_entry:
+      case tp_irq_exit:
+         dp_write_raw("irq: %d\r\n", (int)a[0]);
+         break;
+
+      case tp_page_fault:
+         dp_write_raw("vaddr: %p, err: %#lx, eip: %p\r\n",
+                      TO_PTR(a[0]), a[1], TO_PTR(a[2]));
+         break;
+
+      case tp_cow_copy:
+         dp_write_raw("vaddr: %p, paddr: %p -> %p\r\n",
+                      TO_PTR(a[0]), TO_PTR(a[1]), TO_PTR(a[2]));
+         break;
+
+      case tp_kmalloc_fail:
+         dp_write_raw("size: %lu, flags: %#lx\r\n", a[0], a[1]);
+         break;
+
+      case tp_wth_job_start:
+      case tp_wth_job_end:
+         sym = find_sym_at_addr(a[1], &off, NULL);
+         dp_write_raw("wth prio: %d, func: %s (%p), arg: %p\r\n",
+                      (int)a[0], sym ? sym : "???", TO_PTR(a[1]),
+                      TO_PTR(a[2]));
+         break;
+
+      default:
+         dp_write_raw("%p %p %p\r\n",
+                      TO_PTR(a[0]), TO_PTR(a[1]), TO_PTR(a[2]));
+   }
+}
+
 static void
 dp_dump_tracing_event(struct trace_event *e)
 {
@@ -206,6 +351,10 @@ dp_dump_tracing_event(struct trace_event *e)
          );
          break;
 
+      case te_tracepoint:
+         dp_dump_tracepoint_event(&e->tp_ev);
+         break;
+
       default:
          dp_write_raw(
             E_COLOR_BR_RED "<unknown event %d>\r\n" RESET_ATTRS,
@@ -262,6 +411,24 @@ dp_edit_trace_syscall_str(void)
       dp_write_raw(E_COLOR_RED "Invalid input\r\n" RESET_ATTRS);
 }
 
+static void
+dp_edit_trace_filter(void)
+{
+   int rc;
+
+   get_trace_filter_str(line_buf, TRACE_FILTER_STR_LEN);
+   dp_move_left(2);
+   dp_write_raw(E_COLOR_YELLOW "filter> " RESET_ATTRS);
+   dp_set_input_blocking(true);
+   dp_read_line(line_buf, TRACE_FILTER_STR_LEN);
+   dp_set_input_blocking(false);
+
+   if ((rc = set_trace_filter(line_buf)) < 0) {
+      dp_write_raw("\r\n");
+      dp_write_raw(E_COLOR_RED "Invalid filter (%d)\r\n" RESET_ATTRS, rc);
+   }
+}
+
 static void
 dp_edit_trace_printk_level(void)
 {
@@ -284,6 +451,42 @@ dp_edit_trace_printk_level(void)
    tracing_set_printk_lvl((int) val);
 }
 
+static void
+dp_edit_tracepoints(void)
+{
+   dp_write_raw("\r\n\r\n");
+   dp_write_raw(E_COLOR_YELLOW "Kernel tracepoints" RESET_ATTRS "\r\n");
+
+   for (int i = 0; i < TP_COUNT; i++) {
+      dp_write_raw("  %d) %-16s %s\r\n",
+                   i,
+                   tracepoint_get_name(i),
+                   tracepoint_is_enabled(i)
+                     ? E_COLOR_GREEN "ON" RESET_ATTRS
+                     : E_COLOR_RED "OFF" RESET_ATTRS);
+   }
+
+   line_buf[0] = 0;
+   dp_write_raw(E_COLOR_YELLOW "Toggle [0, %d]: " RESET_ATTRS, TP_COUNT - 1);
+   dp_set_input_blocking(true);
+   dp_read_line(line_buf, TRACED_SYSCALLS_STR_LEN);
+   dp_set_input_blocking(false);
+
+   if (!line_buf[0])
+      return;
+
+   int err = 0;
+   long val = tilck_strtol(line_buf, NULL, 10, &err);
+
+   if (err || val < 0 || val >= TP_COUNT) {
+      dp_write_raw("\r\n");
+      dp_write_raw(E_COLOR_RED "Invalid input\r\n" RESET_ATTRS);
+      return;
+   }
+
+   tracepoint_set_enabled((int)val, !tracepoint_is_enabled((int)val));
+}
+
 struct traced_list_cb_ctx {
 
    char *buf;
@@ -468,6 +671,7 @@ dp_tracing_screen(void)
 {
    char c;
    int rc;
+   ulong dropped;
    bool should_continue;
 
    dp_set_cursor_enabled(true);
@@ -489,6 +693,15 @@ dp_tracing_screen(void)
       if (c == 'q')
          break; /* clean exit */
 
+      if (c == DP_KEY_ENTER && tracing_get_stream_port_name()) {
+
+         dp_write_raw("\r\n");
+         dp_write_raw("The trace events are streamed to %s\r\n\r\n",
+                      tracing_get_stream_port_name());
+         tracing_ui_msg();
+         continue;
+      }
+
       if (c == DP_KEY_ENTER) {
 
          dp_write_raw("\r\n");
@@ -496,11 +709,13 @@ dp_tracing_screen(void)
             E_COLOR_GREEN "-- Tracing active --" RESET_ATTRS "\r\n\r\n"
          );
 
+         dropped = tracing_get_dropped_events_count();
          tracing_set_enabled(true);
          {
             should_continue = dp_tracing_screen_main_loop();
          }
          tracing_set_enabled(false);
+         dropped = tracing_get_dropped_events_count() - dropped;
 
          if (!should_continue)
             break;
@@ -509,6 +724,9 @@ dp_tracing_screen(void)
             E_COLOR_RED "-- Tracing stopped --" RESET_ATTRS "\r\n"
          );
 
+         if (dropped)
+            dp_write_raw("Dropped events (buffer full): %lu\r\n", dropped);
+
          if ((rc = dp_tracing_dump_remaining_events()) < 0)
             break; /* unexpected I/O error */
 
@@ -553,10 +771,19 @@ dp_tracing_screen(void)
             dp_edit_trace_syscall_str();
             break;
 
+         case 'f':
+            dp_edit_trace_filter();
+            break;
+
          case 'k':
             dp_edit_trace_printk_level();
             break;
 
+         case 'n':
+            dp_write_raw("%c", c);
+            dp_edit_tracepoints();
+            break;
+
          case 't':
             dp_edit_traced_list();
             break;
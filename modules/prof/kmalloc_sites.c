@@ -0,0 +1,316 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/mod_sysfs.h>
+#include <tilck_gen_headers/config_kmalloc.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/kmalloc_debug.h>
+#include <tilck/kernel/sync.h>
+#include <tilck/kernel/errno.h>
+#include <tilck/kernel/sort.h>
+#include <tilck/kernel/elf_utils.h>
+#include <tilck/kernel/fs/devfs.h>
+#include <tilck/kernel/fs/vfs.h>
+
+#include <tilck/mods/prof.h>
+#include <tilck/mods/sysfs.h>
+#include <tilck/mods/sysfs_utils.h>
+
+/*
+ * kmalloc_sites: dump of kmalloc's allocation-site profiler (see
+ * KMALLOC_SITE_PROF). The files contain one line per site:
+ *
+ *    /dev/kmalloc_sites:        all the sites, by live bytes
+ *    /dev/kmalloc_sites_diff:   the sites whose live bytes changed since the
+ *                               last snapshot, by the change
+ *
+ * A snapshot is taken by writing 1 to /syst/kmalloc_sites/snapshot or from the
+ * "KmSites" screen of the debug panel. As for /dev/prof, the content is
+ * generated on open().
+ */
+
+#if KMALLOC_SITE_PROF
+
+#define KMSITES_LINE_MAX                  256
+#define KMSITES_MINOR_ALL                   0
+#define KMSITES_MINOR_DIFF                  1
+
+struct kmsites_handle_extra {
+
+   char *buf;
+   size_t size;
+};
+
+STATIC_ASSERT(sizeof(struct kmsites_handle_extra) <= DEVFS_EXTRA_SIZE);
+
+static struct kmutex kmsites_mutex = STATIC_KMUTEX_INIT(kmsites_mutex, 0);
+static char kmsites_line[KMSITES_LINE_MAX];  /* protected by kmsites_mutex */
+
+static long kmsites_cmp_live(const void *a, const void *b)
+{
+   const struct kmalloc_site *s1 = a;
+   const struct kmalloc_site *s2 = b;
+
+   if (s1->live_bytes != s2->live_bytes)
+      return s1->live_bytes < s2->live_bytes ? 1 : -1;
+
+   return 0;
+}
+
+static long kmsites_cmp_diff(const void *a, const void *b)
+{
+   const struct kmalloc_site *s1 = a;
+   const struct kmalloc_site *s2 = b;
+   const long d1 = (long)(s1->live_bytes - s1->snap_bytes);
+   const long d2 = (long)(s2->live_bytes - s2->snap_bytes);
+
+   if (d1 != d2)
+      return d1 < d2 ? 1 : -1;
+
+   return 0;
+}
+
+/* Format the line of `s` in `kmsites_line` and return its length */
+static size_t kmsites_format_line(struct kmalloc_site *s)
+{
+   char *const end = kmsites_line + sizeof(kmsites_line) - 1;
+   char *p = kmsites_line;
+
+   p += snprintk(p, (size_t)(end - p),
+                 "%lu %lu %lu %lu %lu %ld %ld ",
+                 s->live_bytes,
+                 s->live_count,
+                 s->peak_bytes,
+                 s->allocs,
+                 s->frees,
+                 (long)(s->live_bytes - s->snap_bytes),
+                 (long)(s->live_count - s->snap_count));
+
+   for (int i = 0; i < KMALLOC_SITE_FRAMES && s->frames[i]; i++) {
+
+      if (i)
+         p += snprintk(p, (size_t)(end - p), "<-");
+
+      p += format_sym_at_addr(p, (size_t)(end - p), (ulong)s->frames[i]);
+   }
+
+   *p++ = '\n';
+   return (size_t)(p - kmsites_line);
+}
+
+/*
+ * Write the lines of the `n` sites in `buf`, if not NULL, and return their
+ * length. Requires `kmsites_mutex`.
+ */
+static size_t
+kmsites_dump(struct kmalloc_site *sites, ulong n, bool diff, char *buf)
+{
+   size_t len = 0, line_len;
+
+   for (ulong i = 0; i < n; i++) {
+
+      if (diff && sites[i].live_bytes == sites[i].snap_bytes)
+         continue;
+
+      line_len = kmsites_format_line(&sites[i]);
+
+      if (buf)
+         memcpy(buf + len, kmsites_line, line_len);
+
+      len += line_len;
+   }
+
+   return len;
+}
+
+static int kmsites_create_extra(int minor, void *extra)
+{
+   const ulong max_sites = kmalloc_site_prof_info.max_sites;
+   const bool diff = minor == KMSITES_MINOR_DIFF;
+   struct kmsites_handle_extra *e = extra;
+   struct kmalloc_site *sites;
+   ulong n;
+   int rc = 0;
+
+   if (!max_sites)
+      return 0; /* not initialized: empty file */
+
+   if (!(sites = vmalloc(max_sites * sizeof(*sites))))
+      return -ENOMEM;
+
+   n = debug_kmalloc_get_sites(sites, max_sites);
+   insertion_sort_generic(sites,
+                          sizeof(*sites),
+                          (u32)n,
+                          diff ? kmsites_cmp_diff : kmsites_cmp_live);
+
+   kmutex_lock(&kmsites_mutex);
+
+   if ((e->size = kmsites_dump(sites, n, diff, NULL))) {
+
+      if ((e->buf = vmalloc(e->size)))
+         kmsites_dump(sites, n, diff, e->buf);
+      else
+         rc = -ENOMEM;
+   }
+
+   kmutex_unlock(&kmsites_mutex);
+   vfree2(sites, max_sites * sizeof(*sites));
+   return rc;
+}
+
+static int kmsites_on_dup_extra(int minor, void *extra)
+{
+   struct kmsites_handle_extra *e = extra;
+   char *new_buf;
+
+   if (!e->size)
+      return 0;
+
+   if (!(new_buf = vmalloc(e->size)))
+      return -ENOMEM;
+
+   memcpy(new_buf, e->buf, e->size);
+   e->buf = new_buf;
+   return 0;
+}
+
+static void kmsites_destroy_extra(int minor, void *extra)
+{
+   struct kmsites_handle_extra *e = extra;
+
+   if (e->size)
+      vfree2(e->buf, e->size);
+}
+
+static ssize_t kmsites_read(fs_handle h, char *buf, size_t size, offt *pos)
+{
+   struct devfs_handle *dh = h;
+   struct kmsites_handle_extra *e = (void *)&dh->extra;
+   size_t len;
+
+   if (*pos >= (offt)e->size)
+      return 0;
+
+   len = MIN(size, e->size - (size_t)*pos);
+   memcpy(buf, e->buf + *pos, len);
+   *pos += (offt)len;
+   return (ssize_t)len;
+}
+
+static int
+create_kmsites_device(int minor,
+                      enum vfs_entry_type *type,
+                      struct devfs_file_info *nfo)
+{
+   static const struct file_ops static_ops_kmsites = {
+      .read = kmsites_read,
+   };
+
+   *type = VFS_CHAR_DEV;
+   nfo->fops = &static_ops_kmsites;
+   nfo->create_extra = &kmsites_create_extra;
+   nfo->on_dup_extra = &kmsites_on_dup_extra;
+   nfo->destroy_extra = &kmsites_destroy_extra;
+   return 0;
+}
+
+#if MOD_sysfs
+
+DEF_STATIC_SYSOBJ_PROP(backtrace, &sysobj_ptype_rw_bool);
+DEF_STATIC_SYSOBJ_PROP(snapshot, &sysobj_ptype_rw_bool);
+DEF_STATIC_SYSOBJ_PROP(sites, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(max_sites, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(blocks, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(max_blocks, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(dropped, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(snapshots, &sysobj_ptype_ro_ulong);
+
+/* Written by sysfs, applied by the post_store hook */
+static bool sysfs_snapshot;
+
+static offt
+kmsites_obj_pre_load(struct sysobj *obj, struct sysobj_prop *prop, void *data)
+{
+   sysfs_snapshot = false;
+   return 0;
+}
+
+static void
+kmsites_obj_post_store(struct sysobj *obj,
+                       struct sysobj_prop *prop,
+                       void *data)
+{
+   if (prop == &prop_snapshot && sysfs_snapshot)
+      debug_kmalloc_sites_snapshot();
+}
+
+static struct sysobj_hooks kmsites_obj_hooks = {
+   .pre_load = &kmsites_obj_pre_load,
+   .post_store = &kmsites_obj_post_store,
+};
+
+static void kmsites_create_sysfs_obj(void)
+{
+   struct kmalloc_site_prof_info *info = &kmalloc_site_prof_info;
+   struct sysobj *obj;
+
+   obj = sysfs_create_custom_obj(
+      "kmalloc_sites",
+      &kmsites_obj_hooks,
+      &prop_backtrace, &info->backtrace,
+      &prop_snapshot, &sysfs_snapshot,
+      &prop_sites, &info->sites,
+      &prop_max_sites, &info->max_sites,
+      &prop_blocks, &info->blocks,
+      &prop_max_blocks, &info->max_blocks,
+      &prop_dropped, &info->dropped,
+      &prop_snapshots, &info->snapshots,
+      NULL
+   );
+
+   if (!obj ||
+       sysfs_register_obj(NULL, &sysfs_root_obj, "kmalloc_sites", obj))
+   {
+      panic("Unable to create the sysfs kmalloc_sites obj");
+   }
+}
+
+#else
+
+static void kmsites_create_sysfs_obj(void) { }
+
+#endif
+
+void init_kmalloc_sites(void)
+{
+   struct driver_info *di;
+   int rc;
+
+   if (!(di = kzalloc_obj(struct driver_info)))
+      panic("kmalloc_sites: out of memory");
+
+   di->name = "kmalloc_sites";
+   di->create_dev_file = create_kmsites_device;
+
+   if ((rc = register_driver(di, -1)) < 0)
+      panic("kmalloc_sites: failed to register the driver (%d)", rc);
+
+   if (create_dev_file("kmalloc_sites", (u16)rc, KMSITES_MINOR_ALL, NULL) ||
+       create_dev_file("kmalloc_sites_diff", (u16)rc, KMSITES_MINOR_DIFF, NULL))
+   {
+      panic("kmalloc_sites: unable to create the device files");
+   }
+
+   kmsites_create_sysfs_obj();
+}
+
+#else
+
+void init_kmalloc_sites(void) { }
+
+#endif // #if KMALLOC_SITE_PROF
@@ -0,0 +1,501 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/mod_sysfs.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/atomics.h>
+#include <tilck/common/printk.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/modules.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/process.h>
+#include <tilck/kernel/sync.h>
+#include <tilck/kernel/errno.h>
+#include <tilck/kernel/irq.h>
+#include <tilck/kernel/hal.h>
+#include <tilck/kernel/bintree.h>
+#include <tilck/kernel/elf_utils.h>
+#include <tilck/kernel/debug_utils.h>
+#include <tilck/kernel/fs/devfs.h>
+#include <tilck/kernel/fs/vfs.h>
+
+#include <tilck/mods/prof.h>
+#include <tilck/mods/sysfs.h>
+#include <tilck/mods/sysfs_utils.h>
+
+/*
+ * prof: statistical profiler. The RTC's periodic interrupt, independent from
+ * the scheduler's timer, samples the interrupted instruction and its call
+ * stack, walked through the frame pointers on both the kernel and the user
+ * stack of the current task. The samples are stored in a buffer allocated on
+ * the first start and kept until reset: when it's full, the new ones are just
+ * counted as dropped.
+ *
+ * /dev/prof exposes the samples in the "folded stacks" format used by
+ * flamegraph.pl: one line per distinct stack, the frames from the outermost
+ * one, separated by ';', followed by the number of samples. The kernel frames
+ * are symbolized and annotated with "_[k]", the user ones are addresses. The
+ * content is generated on open(): re-open the file to get the new samples.
+ *
+ * Control: the "Prof" screen in the debug panel, or /syst/prof.
+ */
+
+#define PROF_MAX_SAMPLES                 8192
+#define PROF_MAX_FRAMES                    24
+#define PROF_COMM_LEN                      16
+#define PROF_LINE_MAX                    2048
+
+struct prof_sample {
+
+   struct bintree_node node;     /* used only by prof_dump() */
+   u32 count;                    /* used only by prof_dump() */
+
+   u8 frames_count;
+   u8 kframes;                   /* how many `frames` are kernel addrs */
+   char comm[PROF_COMM_LEN];
+   ulong frames[PROF_MAX_FRAMES];   /* the innermost first */
+};
+
+struct prof_handle_extra {
+
+   char *buf;
+   size_t size;
+};
+
+STATIC_ASSERT(sizeof(struct prof_handle_extra) <= DEVFS_EXTRA_SIZE);
+
+struct prof_info prof_info = {
+   .hz = PROF_DEF_HZ,
+   .max_samples = PROF_MAX_SAMPLES,
+};
+
+static struct prof_sample *prof_buf;
+static struct kmutex prof_mutex = STATIC_KMUTEX_INIT(prof_mutex, 0);
+static char prof_line[PROF_LINE_MAX];        /* protected by prof_mutex */
+
+static void prof_get_comm(struct task *ti, char *buf)
+{
+   const char *name = ti->kthread_name;
+   const char *p;
+   size_t i;
+
+   if (!name && !is_kernel_thread(ti) && ti->pi->debug_cmdline) {
+
+      /* The basename of argv[0] */
+      for (p = name = ti->pi->debug_cmdline; *p && *p != ' '; p++)
+         if (*p == '/')
+            name = p + 1;
+
+      for (i = 0; i < PROF_COMM_LEN - 1 && name + i < p; i++)
+         buf[i] = name[i];
+
+      buf[i] = 0;
+      return;
+   }
+
+   if (name)
+      snprintk(buf, PROF_COMM_LEN, "%s", name);
+   else
+      snprintk(buf, PROF_COMM_LEN, "pid_%d", ti->pi->pid);
+}
+
+static void prof_take_sample(regs_t *r)
+{
+   struct prof_sample *s;
+   size_t count, kframes;
+
+   if (prof_info.samples == prof_info.max_samples) {
+      prof_info.dropped++;
+      return;
+   }
+
+   s = &prof_buf[prof_info.samples];
+   count = stackwalk_irq(r, s->frames, PROF_MAX_FRAMES, &kframes);
+   s->frames_count = (u8)count;
+   s->kframes = (u8)kframes;
+   prof_get_comm(get_curr_task(), s->comm);
+
+   /* prof_dump() reads only the samples below `samples` */
+   atomic_signal_fence(mo_release);
+   prof_info.samples++;
+}
+
+static enum irq_action prof_irq_handler(void *ctx)
+{
+   regs_t *r = get_irq_regs();
+   hw_rtc_periodic_irq_ack();
+
+   if (prof_info.running && r)
+      prof_take_sample(r);
+
+   return IRQ_HANDLED;
+}
+
+DEFINE_IRQ_HANDLER_NODE(prof_irq, prof_irq_handler, NULL);
+
+int prof_start(void)
+{
+   int rc = 0;
+
+   kmutex_lock(&prof_mutex);
+
+   if (prof_info.running)
+      goto out;
+
+   if (!prof_buf) {
+
+      prof_buf = vmalloc(PROF_MAX_SAMPLES * sizeof(struct prof_sample));
+
+      if (!prof_buf) {
+         rc = -ENOMEM;
+         goto out;
+      }
+   }
+
+   prof_info.running = true;
+   irq_install_handler(X86_PC_RTC_IRQ, &prof_irq);
+   prof_info.hz = hw_rtc_periodic_irq_setup((u32)prof_info.hz);
+
+out:
+   kmutex_unlock(&prof_mutex);
+   return rc;
+}
+
+void prof_stop(void)
+{
+   kmutex_lock(&prof_mutex);
+
+   if (prof_info.running) {
+      hw_rtc_periodic_irq_setup(0);
+      irq_uninstall_handler(X86_PC_RTC_IRQ, &prof_irq);
+      prof_info.running = false;
+   }
+
+   kmutex_unlock(&prof_mutex);
+}
+
+void prof_reset(void)
+{
+   ulong var;
+
+   kmutex_lock(&prof_mutex);
+   {
+      /* The IRQ handler might be running: disable the interrupts */
+      disable_interrupts(&var);
+      {
+         prof_info.samples = 0;
+         prof_info.dropped = 0;
+      }
+      enable_interrupts(&var);
+   }
+   kmutex_unlock(&prof_mutex);
+}
+
+void prof_set_hz(ulong hz)
+{
+   kmutex_lock(&prof_mutex);
+   {
+      prof_info.hz = CLAMP(hz, 2ul, (ulong)PROF_MAX_HZ);
+
+      if (prof_info.running)
+         prof_info.hz = hw_rtc_periodic_irq_setup((u32)prof_info.hz);
+   }
+   kmutex_unlock(&prof_mutex);
+}
+
+static long prof_sample_cmp(const void *a, const void *b)
+{
+   const struct prof_sample *s1 = a;
+   const struct prof_sample *s2 = b;
+   long rc;
+
+   if ((rc = strcmp(s1->comm, s2->comm)))
+      return rc;
+
+   if (s1->frames_count != s2->frames_count)
+      return (long)s1->frames_count - (long)s2->frames_count;
+
+   if (s1->kframes != s2->kframes)
+      return (long)s1->kframes - (long)s2->kframes;
+
+   return memcmp(s1->frames, s2->frames, s1->frames_count * sizeof(ulong));
+}
+
+static size_t
+prof_format_frame(char *buf, size_t size, struct prof_sample *s, int i)
+{
+   const ulong va = s->frames[i];
+   const char *sym = NULL;
+   u32 sym_size;
+   long off;
+
+   if (i >= s->kframes)
+      return (size_t)snprintk(buf, size, ";%p", TO_PTR(va));
+
+   /* All the frames but the innermost one are return addresses */
+   if (KERNEL_SYMBOLS)
+      sym = find_sym_at_addr(i ? va - 1 : va, &off, &sym_size);
+
+   if (sym)
+      return (size_t)snprintk(buf, size, ";%s_[k]", sym);
+
+   return (size_t)snprintk(buf, size, ";%p_[k]", TO_PTR(va));
+}
+
+/* Format in `prof_line` the folded stack of `s` and return its length */
+static size_t prof_format_line(struct prof_sample *s)
+{
+   char *const end = prof_line + sizeof(prof_line);
+   char *const frames_end = end - 16;     /* room for the count */
+   char *p = prof_line;
+   int i;
+
+   p += snprintk(p, (size_t)(frames_end - p), "%s", s->comm);
+
+   /* The user frames are the outermost ones, then the kernel ones */
+   for (i = s->frames_count - 1; i >= s->kframes; i--)
+      p += prof_format_frame(p, (size_t)(frames_end - p), s, i);
+
+   for (i = s->kframes - 1; i >= 0; i--)
+      p += prof_format_frame(p, (size_t)(frames_end - p), s, i);
+
+   p += snprintk(p, (size_t)(end - p), " %u\n", s->count);
+   return (size_t)(p - prof_line);
+}
+
+/*
+ * Group the identical samples among the first `n` ones in a binary tree and
+ * return its root: the `count` of each node is the number of its duplicates.
+ */
+static struct prof_sample *prof_group_samples(ulong n)
+{
+   struct prof_sample *root = NULL, *s, *dup;
+
+   for (ulong j = 0; j < n; j++) {
+
+      s = &prof_buf[j];
+      bintree_node_init(&s->node);
+      s->count = 1;
+
+      if (!bintree_insert(&root, s, prof_sample_cmp,
+                          struct prof_sample, node))
+      {
+         dup = bintree_find(root, s, prof_sample_cmp,
+                            struct prof_sample, node);
+         dup->count++;
+      }
+   }
+
+   return root;
+}
+
+/*
+ * Write the folded stacks of the grouped samples in `buf`, if not NULL, and
+ * return their length. Requires `prof_mutex`.
+ */
+static size_t prof_dump(struct prof_sample *root, char *buf)
+{
+   struct bintree_walk_ctx ctx;
+   struct prof_sample *s;
+   size_t len = 0, line_len;
+
+   bintree_in_order_visit_start(&ctx, root, struct prof_sample, node, false);
+
+   while ((s = bintree_in_order_visit_next(&ctx))) {
+
+      line_len = prof_format_line(s);
+
+      if (buf)
+         memcpy(buf + len, prof_line, line_len);
+
+      len += line_len;
+   }
+
+   return len;
+}
+
+static int prof_create_extra(int minor, void *extra)
+{
+   struct prof_handle_extra *e = extra;
+   struct prof_sample *root;
+   int rc = 0;
+
+   kmutex_lock(&prof_mutex);
+
+   /* New samples might come in the meanwhile: they'll be in the next dump */
+   root = prof_group_samples(prof_buf ? prof_info.samples : 0);
+
+   if ((e->size = prof_dump(root, NULL))) {
+
+      if ((e->buf = vmalloc(e->size)))
+         prof_dump(root, e->buf);
+      else
+         rc = -ENOMEM;
+   }
+
+   kmutex_unlock(&prof_mutex);
+   return rc;
+}
+
+static int prof_on_dup_extra(int minor, void *extra)
+{
+   struct prof_handle_extra *e = extra;
+   char *new_buf;
+
+   if (!e->size)
+      return 0;
+
+   if (!(new_buf = vmalloc(e->size)))
+      return -ENOMEM;
+
+   memcpy(new_buf, e->buf, e->size);
+   e->buf = new_buf;
+   return 0;
+}
+
+static void prof_destroy_extra(int minor, void *extra)
+{
+   struct prof_handle_extra *e = extra;
+
+   if (e->size)
+      vfree2(e->buf, e->size);
+}
+
+static ssize_t prof_read(fs_handle h, char *buf, size_t size, offt *pos)
+{
+   struct devfs_handle *dh = h;
+   struct prof_handle_extra *e = (void *)&dh->extra;
+   size_t len;
+
+   if (*pos >= (offt)e->size)
+      return 0;
+
+   len = MIN(size, e->size - (size_t)*pos);
+   memcpy(buf, e->buf + *pos, len);
+   *pos += (offt)len;
+   return (ssize_t)len;
+}
+
+static int
+create_prof_device(int minor,
+                   enum vfs_entry_type *type,
+                   struct devfs_file_info *nfo)
+{
+   static const struct file_ops static_ops_prof = {
+      .read = prof_read,
+   };
+
+   *type = VFS_CHAR_DEV;
+   nfo->fops = &static_ops_prof;
+   nfo->create_extra = &prof_create_extra;
+   nfo->on_dup_extra = &prof_on_dup_extra;
+   nfo->destroy_extra = &prof_destroy_extra;
+   return 0;
+}
+
+#if MOD_sysfs
+
+DEF_STATIC_SYSOBJ_PROP(running, &sysobj_ptype_rw_bool);
+DEF_STATIC_SYSOBJ_PROP(reset, &sysobj_ptype_rw_bool);
+DEF_STATIC_SYSOBJ_PROP(hz, &sysobj_ptype_rw_ulong);
+DEF_STATIC_SYSOBJ_PROP(samples, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(dropped, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(max_samples, &sysobj_ptype_ro_ulong);
+
+/* Written by sysfs, applied by the post_store hook */
+static bool sysfs_running;
+static bool sysfs_reset;
+static ulong sysfs_hz;
+
+static offt
+prof_obj_pre_load(struct sysobj *obj, struct sysobj_prop *prop, void *data)
+{
+   sysfs_running = prof_info.running;
+   sysfs_reset = false;
+   sysfs_hz = prof_info.hz;
+   return 0;
+}
+
+static void
+prof_obj_post_store(struct sysobj *obj, struct sysobj_prop *prop, void *data)
+{
+   if (prop == &prop_hz) {
+
+      prof_set_hz(sysfs_hz);
+
+   } else if (prop == &prop_reset) {
+
+      if (sysfs_reset)
+         prof_reset();
+
+   } else if (prop == &prop_running) {
+
+      if (sysfs_running)
+         prof_start();
+      else
+         prof_stop();
+   }
+}
+
+static struct sysobj_hooks prof_obj_hooks = {
+   .pre_load = &prof_obj_pre_load,
+   .post_store = &prof_obj_post_store,
+};
+
+static void prof_create_sysfs_obj(void)
+{
+   struct sysobj *obj;
+
+   obj = sysfs_create_custom_obj(
+      "prof",
+      &prof_obj_hooks,
+      &prop_running, &sysfs_running,
+      &prop_reset, &sysfs_reset,
+      &prop_hz, &sysfs_hz,
+      &prop_samples, &prof_info.samples,
+      &prop_dropped, &prof_info.dropped,
+      &prop_max_samples, &prof_info.max_samples,
+      NULL
+   );
+
+   if (!obj || sysfs_register_obj(NULL, &sysfs_root_obj, "prof", obj))
+      panic("Unable to create the sysfs prof obj");
+}
+
+#else
+
+static void prof_create_sysfs_obj(void) { }
+
+#endif
+
+static void init_prof(void)
+{
+   struct driver_info *di;
+   int rc;
+
+   if (!(di = kzalloc_obj(struct driver_info)))
+      panic("prof: out of memory");
+
+   di->name = "prof";
+   di->create_dev_file = create_prof_device;
+
+   if ((rc = register_driver(di, -1)) < 0)
+      panic("prof: failed to register the driver (%d)", rc);
+
+   if ((rc = create_dev_file("prof", (u16)rc, 0 /* minor */, NULL)))
+      panic("prof: unable to create /dev/prof (error: %d)", rc);
+
+   prof_create_sysfs_obj();
+   init_kmalloc_sites();
+}
+
+static struct module prof_module = {
+
+   .name = "prof",
+   .priority = MOD_prof_prio,
+   .init = &init_prof,
+};
+
+REGISTER_MODULE(&prof_module);
@@ -16,6 +16,7 @@
 #include <tilck_gen_headers/mod_acpi.h>
 #include <tilck_gen_headers/mod_pci.h>
 #include <tilck_gen_headers/mod_sb16.h>
+#include <tilck_gen_headers/mod_zram.h>
 
 #include <tilck/common/build_info.h>
 
@@ -46,6 +47,8 @@ DEF_STATIC_CONF_RO(BOOL,  big_io_buf,              KERNEL_BIG_IO_BUF);
 DEF_STATIC_CONF_RO(BOOL,  gcov,                    KERNEL_GCOV);
 DEF_STATIC_CONF_RO(BOOL,  fork_no_cow,             FORK_NO_COW);
 DEF_STATIC_CONF_RO(BOOL,  mmap_no_cow,             MMAP_NO_COW);
+DEF_STATIC_CONF_RO(BOOL,  mmap_big_pages,          MMAP_BIG_PAGES);
+DEF_STATIC_CONF_RO(BOOL,  highmem,                 KERNEL_HIGHMEM);
 DEF_STATIC_CONF_RO(BOOL,  ubsan,                   KERNEL_UBSAN);
 DEF_STATIC_CONF_RO(BOOL,  kernel_64bit_offt,       KERNEL_64BIT_OFFT);
 DEF_STATIC_CONF_RO(BOOL,  clock_drift_comp,        KRN_CLOCK_DRIFT_COMP);
@@ -69,6 +72,7 @@ DEF_STATIC_CONF_RO(BOOL,  console,                 MOD_console);
 DEF_STATIC_CONF_RO(BOOL,  fb,                      MOD_fb);
 DEF_STATIC_CONF_RO(BOOL,  serial,                  MOD_serial);
 DEF_STATIC_CONF_RO(BOOL,  sb16,                    MOD_sb16);
+DEF_STATIC_CONF_RO(BOOL,  zram,                    MOD_zram);
 DEF_STATIC_CONF_RO(BOOL,  debugpanel,              MOD_debugpanel);
 
 void sysfs_create_config_obj(void)
@@ -110,6 +114,8 @@ void sysfs_create_config_obj(void)
       SYSOBJ_CONF_PROP_PAIR(gcov),
       SYSOBJ_CONF_PROP_PAIR(fork_no_cow),
       SYSOBJ_CONF_PROP_PAIR(mmap_no_cow),
+      SYSOBJ_CONF_PROP_PAIR(mmap_big_pages),
+      SYSOBJ_CONF_PROP_PAIR(highmem),
       SYSOBJ_CONF_PROP_PAIR(ubsan),
       SYSOBJ_CONF_PROP_PAIR(kernel_64bit_offt),
       SYSOBJ_CONF_PROP_PAIR(clock_drift_comp),
@@ -153,6 +159,7 @@ void sysfs_create_config_obj(void)
       SYSOBJ_CONF_PROP_PAIR(fb),
       SYSOBJ_CONF_PROP_PAIR(serial),
       SYSOBJ_CONF_PROP_PAIR(sb16),
+      SYSOBJ_CONF_PROP_PAIR(zram),
       SYSOBJ_CONF_PROP_PAIR(debugpanel),
       NULL
    );
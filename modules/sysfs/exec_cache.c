@@ -0,0 +1,59 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/printk.h>
+
+#include <tilck/kernel/exec_cache.h>
+
+#include <tilck/mods/sysfs.h>
+#include <tilck/mods/sysfs_utils.h>
+
+DEF_STATIC_SYSOBJ_PROP(enabled, &sysobj_ptype_rw_bool);
+DEF_STATIC_SYSOBJ_PROP(entries, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(pages, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(hits, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(misses, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(invalidations, &sysobj_ptype_ro_ulong);
+
+static void
+exec_cache_obj_post_store(struct sysobj *obj,
+                          struct sysobj_prop *prop,
+                          void *data)
+{
+   /* Disabling the cache frees its memory as well */
+   if (!exec_cache_info.enabled)
+      exec_cache_flush();
+}
+
+static struct sysobj_hooks exec_cache_obj_hooks = {
+   .post_store = &exec_cache_obj_post_store,
+};
+
+void sysfs_create_exec_cache_obj(void)
+{
+   struct exec_cache_info *ei = &exec_cache_info;
+   struct sysobj *obj;
+
+   obj = sysfs_create_custom_obj(
+      "exec_cache",
+      &exec_cache_obj_hooks,
+      &prop_enabled, &ei->enabled,
+      &prop_entries, &ei->entries,
+      &prop_pages, &ei->pages,
+      &prop_hits, &ei->hits,
+      &prop_misses, &ei->misses,
+      &prop_invalidations, &ei->invalidations,
+      NULL
+   );
+
+   if (!obj)
+      goto fail;
+
+   if (sysfs_register_obj(NULL, &sysfs_root_obj, "exec_cache", obj))
+      goto fail;
+
+   /* Success */
+   return;
+
+fail:
+   panic("Unable to create the sysfs exec_cache obj");
+}
@@ -0,0 +1,124 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/config_debug.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+
+#include <tilck/kernel/irqsoff.h>
+#include <tilck/kernel/datetime.h>
+#include <tilck/kernel/elf_utils.h>
+
+#include <tilck/mods/sysfs.h>
+#include <tilck/mods/sysfs_utils.h>
+
+#if KERNEL_IRQSOFF_TRACER
+
+#define IRQSOFF_LINE_MAX                                 192
+
+DEF_STATIC_SYSOBJ_PROP(enabled, &sysobj_ptype_rw_bool);
+DEF_STATIC_SYSOBJ_PROP(reset, &sysobj_ptype_rw_bool);
+
+/* Written by sysfs, applied by the post_store hook */
+static bool sysfs_reset;
+
+static offt
+irqsoff_report_get_buf_sz(struct sysobj *obj, void *data)
+{
+   return IRQSOFF_LINE_MAX * (1 + IRQSOFF_KINDS);
+}
+
+static offt
+irqsoff_report_load(struct sysobj *obj, void *data, void *b, offt sz, offt off)
+{
+   const ulong cycles_per_us = get_tsc_cycles_per_us();
+   char *buf = b, start[64], end[64];
+   struct irqsoff_max m;
+   offt written;
+
+   written = snprintk(buf, IRQSOFF_LINE_MAX,
+                      "# kind max_us max_cycles windows start_site end_site\n");
+
+   for (int k = 0; k < IRQSOFF_KINDS; k++) {
+
+      irqsoff_get_max(k, &m);
+
+      if (m.windows) {
+         format_sym_at_addr(start, sizeof(start), m.start_site);
+         format_sym_at_addr(end, sizeof(end), m.end_site);
+      }
+
+      written += snprintk(
+         buf + written, IRQSOFF_LINE_MAX,
+         "%s %" PRIu64 " %" PRIu64 " %lu %s %s\n",
+         irqsoff_get_kind_name(k),
+         cycles_per_us ? m.max_cycles / cycles_per_us : 0,
+         m.max_cycles,
+         m.windows,
+         m.windows ? start : "-",
+         m.windows ? end : "-"
+      );
+   }
+
+   return written;
+}
+
+static const struct sysobj_prop_type irqsoff_ptype_report = {
+   .get_buf_sz = &irqsoff_report_get_buf_sz,
+   .load = &irqsoff_report_load,
+};
+
+DEF_STATIC_SYSOBJ_PROP(report, &irqsoff_ptype_report);
+
+static offt
+irqsoff_obj_pre_load(struct sysobj *obj, struct sysobj_prop *prop, void *data)
+{
+   sysfs_reset = false;
+   return 0;
+}
+
+static void
+irqsoff_obj_post_store(struct sysobj *obj,
+                       struct sysobj_prop *prop,
+                       void *data)
+{
+   if (prop == &prop_reset && sysfs_reset)
+      irqsoff_reset();
+}
+
+static struct sysobj_hooks irqsoff_obj_hooks = {
+   .pre_load = &irqsoff_obj_pre_load,
+   .post_store = &irqsoff_obj_post_store,
+};
+
+void sysfs_create_irqsoff_obj(void)
+{
+   struct sysobj *obj;
+
+   obj = sysfs_create_custom_obj(
+      "irqsoff",
+      &irqsoff_obj_hooks,
+      &prop_enabled, &irqsoff_info.enabled,
+      &prop_reset, &sysfs_reset,
+      &prop_report, NULL,
+      NULL
+   );
+
+   if (!obj)
+      goto fail;
+
+   if (sysfs_register_obj(NULL, &sysfs_root_obj, "irqsoff", obj))
+      goto fail;
+
+   /* Success */
+   return;
+
+fail:
+   panic("Unable to create the sysfs irqsoff obj");
+}
+
+#else
+
+void sysfs_create_irqsoff_obj(void) { }
+
+#endif // #if KERNEL_IRQSOFF_TRACER
@@ -0,0 +1,56 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/printk.h>
+
+#include <tilck/kernel/fs/vfs.h>
+#include <tilck/kernel/fs/ramfs.h>
+
+#include <tilck/mods/sysfs.h>
+#include <tilck/mods/sysfs_utils.h>
+
+/* ramfs: compression of the cold blocks of the root ramfs (/, /tmp) */
+DEF_STATIC_SYSOBJ_PROP(compr_age_ms, &sysobj_ptype_rw_ulong);
+DEF_STATIC_SYSOBJ_PROP(compr_pages, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(bytes_saved, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(compressions, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(decompressions, &sysobj_ptype_ro_ulong);
+
+static void
+ramfs_obj_post_store(struct sysobj *obj, struct sysobj_prop *prop, void *data)
+{
+   if (ramfs_compr_update(mp_get_root()))
+      printk("sysfs: unable to start the ramfs compression\n");
+}
+
+static struct sysobj_hooks ramfs_obj_hooks = {
+   .post_store = &ramfs_obj_post_store,
+};
+
+void sysfs_create_ramfs_obj(void)
+{
+   struct ramfs_compr_info *ci = ramfs_get_compr_info(mp_get_root());
+   struct sysobj *ramfs;
+
+   ramfs = sysfs_create_custom_obj(
+      "ramfs",
+      &ramfs_obj_hooks,
+      &prop_compr_age_ms, &ci->age_ms,
+      &prop_compr_pages, &ci->compr_pages,
+      &prop_bytes_saved, &ci->bytes_saved,
+      &prop_compressions, &ci->compressions,
+      &prop_decompressions, &ci->decompressions,
+      NULL
+   );
+
+   if (!ramfs)
+      goto fail;
+
+   if (sysfs_register_obj(NULL, &sysfs_root_obj, "ramfs", ramfs))
+      goto fail;
+
+   /* Success */
+   return;
+
+fail:
+   panic("Unable to create the sysfs ramfs obj");
+}
@@ -0,0 +1,106 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/printk.h>
+
+#include <tilck/kernel/shrinker.h>
+#include <tilck/kernel/errno.h>
+
+#include <tilck/mods/sysfs.h>
+#include <tilck/mods/sysfs_utils.h>
+
+/* reclaim: watermarks of the background reclaim and stats of the shrinkers */
+DEF_STATIC_SYSOBJ_PROP(wmark_low_kb, &sysobj_ptype_rw_ulong);
+DEF_STATIC_SYSOBJ_PROP(wmark_high_kb, &sysobj_ptype_rw_ulong);
+DEF_STATIC_SYSOBJ_PROP(free_kb, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(direct_reclaims, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(bg_reclaims, &sysobj_ptype_ro_ulong);
+
+/* reclaim/<shrinker name> */
+DEF_STATIC_SYSOBJ_PROP(reclaimed_bytes, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(calls, &sysobj_ptype_ro_ulong);
+
+static offt
+reclaim_obj_pre_load(struct sysobj *obj, struct sysobj_prop *prop, void *data)
+{
+   if (prop == &prop_free_kb)
+      get_free_memory(); /* updates reclaim_info.free_kb */
+
+   return 0;
+}
+
+static void
+reclaim_obj_post_store(struct sysobj *obj, struct sysobj_prop *prop, void *data)
+{
+   struct reclaim_info *ri = &reclaim_info;
+
+   /* The background reclaim stops at the high watermark */
+   if (ri->wmark_high_kb < ri->wmark_low_kb)
+      ri->wmark_high_kb = ri->wmark_low_kb;
+}
+
+static struct sysobj_hooks reclaim_obj_hooks = {
+   .pre_load = &reclaim_obj_pre_load,
+   .post_store = &reclaim_obj_post_store,
+};
+
+static int
+sysfs_create_shrinker_obj(struct sysobj *parent, struct shrinker *s)
+{
+   struct sysobj *obj;
+   int rc;
+
+   obj = sysfs_create_custom_obj(
+      "shrinker",
+      NULL,       /* hooks */
+      &prop_reclaimed_bytes, &s->reclaimed_bytes,
+      &prop_calls, &s->calls,
+      NULL
+   );
+
+   if (!obj)
+      return -ENOMEM;
+
+   if ((rc = sysfs_register_obj(NULL, parent, s->name, obj)))
+      sysfs_destroy_unregistered_obj(obj);
+
+   return rc;
+}
+
+/*
+ * NOTE: only the shrinkers registered before the sysfs module's init appear
+ * here: the ones of the core kernel, not the ones of the other modules.
+ */
+void sysfs_create_reclaim_obj(void)
+{
+   struct reclaim_info *ri = &reclaim_info;
+   struct sysobj *reclaim;
+   struct shrinker *s;
+
+   reclaim = sysfs_create_custom_obj(
+      "reclaim",
+      &reclaim_obj_hooks,
+      &prop_wmark_low_kb, &ri->wmark_low_kb,
+      &prop_wmark_high_kb, &ri->wmark_high_kb,
+      &prop_free_kb, &ri->free_kb,
+      &prop_direct_reclaims, &ri->direct_reclaims,
+      &prop_bg_reclaims, &ri->bg_reclaims,
+      NULL
+   );
+
+   if (!reclaim)
+      goto fail;
+
+   if (sysfs_register_obj(NULL, &sysfs_root_obj, "reclaim", reclaim))
+      goto fail;
+
+   list_for_each_ro(s, &shrinkers_list, node) {
+      if (sysfs_create_shrinker_obj(reclaim, s))
+         goto fail;
+   }
+
+   /* Success */
+   return;
+
+fail:
+   panic("Unable to create the sysfs reclaim obj");
+}
@@ -0,0 +1,186 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+
+#include <tilck/kernel/process.h>
+#include <tilck/kernel/sched.h>
+
+#include <tilck/mods/sysfs.h>
+#include <tilck/mods/sysfs_utils.h>
+
+/*
+ * rusage: procfs-like per-process resource usage counters.
+ *
+ *    procs: one line per user process (including the zombie ones)
+ *    self:  the counters of the reading process, one per line
+ */
+
+#define RUSAGE_LINE_MAX                                     192
+#define RUSAGE_CMD_MAX                                       32
+#define RUSAGE_EXTRA_PROCS                                    8
+
+struct rusage_procs_ctx {
+
+   char *buf;
+   offt buf_sz;
+   offt written;
+   int count;
+};
+
+static int
+rusage_count_procs_cb(void *obj, void *arg)
+{
+   struct task *ti = obj;
+   struct rusage_procs_ctx *ctx = arg;
+
+   if (!is_kernel_thread(ti))
+      ctx->count++;
+
+   return 0;
+}
+
+static offt
+rusage_procs_get_buf_sz(struct sysobj *obj, void *data)
+{
+   struct rusage_procs_ctx ctx = {0};
+
+   disable_preemption();
+   {
+      iterate_over_tasks(&rusage_count_procs_cb, &ctx);
+   }
+   enable_preemption();
+
+   /* Leave some room for the processes created until load() is called */
+   return (1 + ctx.count + RUSAGE_EXTRA_PROCS) * RUSAGE_LINE_MAX;
+}
+
+static int
+rusage_dump_proc_cb(void *obj, void *arg)
+{
+   struct task *ti = obj;
+   struct process *pi = ti->pi;
+   struct rusage_procs_ctx *ctx = arg;
+   const struct task_rusage *ru = &ti->rusage;
+   const char *cmd = pi->debug_cmdline ? pi->debug_cmdline : "-";
+
+   if (is_kernel_thread(ti))
+      return 0;
+
+   if (ctx->buf_sz - ctx->written < RUSAGE_LINE_MAX)
+      return -1; /* no more space: stop the iteration */
+
+   if (ti->state != TASK_STATE_ZOMBIE)
+      process_update_maxrss(pi);
+
+   ctx->written += snprintk(
+      ctx->buf + ctx->written, RUSAGE_LINE_MAX,
+      "%d %lu %lu %lu %lu %lu %lu %" PRIu64 " %" PRIu64 " %lu %.*s\n",
+      pi->pid,
+      ru->minflt,
+      ru->majflt,
+      ru->cow_copies,
+      ru->nvcsw,
+      ru->nivcsw,
+      ru->syscalls,
+      ru->rchar,
+      ru->wchar,
+      pi->maxrss * (PAGE_SIZE / KB),
+      RUSAGE_CMD_MAX, cmd
+   );
+
+   return 0;
+}
+
+static offt
+rusage_procs_load(struct sysobj *obj, void *data, void *buf, offt sz, offt off)
+{
+   struct rusage_procs_ctx ctx = {
+      .buf = buf,
+      .buf_sz = sz,
+   };
+
+   ctx.written = snprintk(buf, (size_t)sz,
+                          "# pid minflt majflt cow nvcsw nivcsw syscalls "
+                          "rchar wchar maxrss_kb cmd\n");
+
+   disable_preemption();
+   {
+      iterate_over_tasks(&rusage_dump_proc_cb, &ctx);
+   }
+   enable_preemption();
+   return ctx.written;
+}
+
+static offt
+rusage_self_load(struct sysobj *obj, void *data, void *buf, offt sz, offt off)
+{
+   struct task *curr = get_curr_task();
+   struct task_rusage ru;
+   ulong maxrss;
+
+   disable_preemption();
+   {
+      process_update_maxrss(curr->pi);
+      ru = curr->rusage;
+      maxrss = curr->pi->maxrss;
+   }
+   enable_preemption();
+
+   return snprintk(buf, (size_t)sz,
+                   "minflt %lu\n"
+                   "majflt %lu\n"
+                   "cow %lu\n"
+                   "nvcsw %lu\n"
+                   "nivcsw %lu\n"
+                   "syscalls %lu\n"
+                   "rchar %" PRIu64 "\n"
+                   "wchar %" PRIu64 "\n"
+                   "maxrss_kb %lu\n",
+                   ru.minflt,
+                   ru.majflt,
+                   ru.cow_copies,
+                   ru.nvcsw,
+                   ru.nivcsw,
+                   ru.syscalls,
+                   ru.rchar,
+                   ru.wchar,
+                   maxrss * (PAGE_SIZE / KB));
+}
+
+static const struct sysobj_prop_type rusage_ptype_procs = {
+   .get_buf_sz = &rusage_procs_get_buf_sz,
+   .load = &rusage_procs_load,
+};
+
+static const struct sysobj_prop_type rusage_ptype_self = {
+   .load = &rusage_self_load,
+};
+
+DEF_STATIC_SYSOBJ_PROP(procs, &rusage_ptype_procs);
+DEF_STATIC_SYSOBJ_PROP(self, &rusage_ptype_self);
+
+void sysfs_create_rusage_obj(void)
+{
+   struct sysobj *obj;
+
+   obj = sysfs_create_custom_obj(
+      "rusage",
+      NULL,       /* hooks */
+      &prop_procs, NULL,
+      &prop_self, NULL,
+      NULL
+   );
+
+   if (!obj)
+      goto fail;
+
+   if (sysfs_register_obj(NULL, &sysfs_root_obj, "rusage", obj))
+      goto fail;
+
+   /* Success */
+   return;
+
+fail:
+   panic("Unable to create the sysfs rusage obj");
+}
@@ -25,6 +25,12 @@
 #include "lock_and_retain.c.h"
 
 void sysfs_create_config_obj(void);
+void sysfs_create_vm_obj(void);
+void sysfs_create_ramfs_obj(void);
+void sysfs_create_reclaim_obj(void);
+void sysfs_create_exec_cache_obj(void);
+void sysfs_create_irqsoff_obj(void);
+void sysfs_create_rusage_obj(void);
 static struct mnt_fs *sysfs;
 
 static int
@@ -756,6 +762,12 @@ init_sysfs(void)
       panic("Unable to create default objects");
 
    sysfs_create_config_obj();
+   sysfs_create_vm_obj();
+   sysfs_create_ramfs_obj();
+   sysfs_create_reclaim_obj();
+   sysfs_create_exec_cache_obj();
+   sysfs_create_irqsoff_obj();
+   sysfs_create_rusage_obj();
 }
 
 static struct module sysfs_module = {
@@ -142,7 +142,7 @@ sys_bool_store(struct sysobj *obj, void *data, void *buf, offt buf_sz)
 {
    char *s = buf;
 
-   if (s[0] == '0' || s[1] == '1') {
+   if (s[0] == '0' || s[0] == '1') {
       if (!s[1] || s[1] == '\n' || s[1] == '\r') {
          *(bool *)data = s[0] - '0';
       }
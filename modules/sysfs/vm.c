@@ -0,0 +1,40 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/config_mm.h>
+
+#include <tilck/kernel/process_mm.h>
+#include <tilck/kernel/highmem.h>
+
+#include <tilck/mods/sysfs.h>
+#include <tilck/mods/sysfs_utils.h>
+
+/* vm: runtime-tunable memory management params */
+DEF_STATIC_SYSOBJ_PROP(fault_around_pages, &sysobj_ptype_rw_ulong);
+DEF_STATIC_SYSOBJ_PROP(highmem_total_pages, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(highmem_free_pages, &sysobj_ptype_ro_ulong);
+
+void sysfs_create_vm_obj(void)
+{
+   struct sysobj *vm;
+
+   vm = sysfs_create_custom_obj(
+      "vm",
+      NULL,       /* hooks */
+      &prop_fault_around_pages, &fault_around_pages,
+      &prop_highmem_total_pages, &highmem_total_pages,
+      &prop_highmem_free_pages, &highmem_free_pages,
+      NULL
+   );
+
+   if (!vm)
+      goto fail;
+
+   if (sysfs_register_obj(NULL, &sysfs_root_obj, "vm", vm))
+      goto fail;
+
+   /* Success */
+   return;
+
+fail:
+   panic("Unable to create the sysfs vm obj");
+}
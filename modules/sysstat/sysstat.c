@@ -0,0 +1,335 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/mod_sysfs.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/modules.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/process.h>
+#include <tilck/kernel/datetime.h>
+#include <tilck/kernel/syscalls.h>
+#include <tilck/kernel/elf_utils.h>
+#include <tilck/kernel/debug_utils.h>
+
+#include <tilck/mods/sysstat.h>
+#include <tilck/mods/sysfs.h>
+#include <tilck/mods/sysfs_utils.h>
+
+/*
+ * sysstat: always-on per-syscall counters and log2 latency histograms. The
+ * syscall dispatch code reads the TSC before and after each syscall (see
+ * sysstat_syscall_begin() and sysstat_syscall_end()) and the difference is
+ * accounted here, in the entry of the syscall. The latency is the wall-clock
+ * one: it includes the time the task spent sleeping or preempted.
+ *
+ * The histograms are enough to get the percentiles, with a 2x granularity,
+ * without storing the single samples. The cycles are converted to nanoseconds
+ * using the TSC frequency measured by get_tsc_cycles_per_us().
+ *
+ * Control: the "Sys" screen in the debug panel, or /syst/sysstat.
+ */
+
+#define SYSSTAT_MAX_ERRNO                4095
+
+struct sysstat_info sysstat_info;
+
+static struct sysstat_entry *sysstat_entries;
+
+static u32
+sysstat_get_bucket(u64 cycles)
+{
+   u32 b;
+
+   if (cycles < 2)
+      return 0;
+
+   b = 63 - (u32)__builtin_clzll(cycles);
+   return MIN(b, SYSSTAT_BUCKETS - 1u);
+}
+
+void
+sysstat_account_int(u32 sn, long retval, u64 cycles)
+{
+   struct sysstat_entry *e;
+
+   if (sn >= MAX_SYSCALLS || !sysstat_entries)
+      return;
+
+   if (sysstat_info.pid > 0 && get_curr_proc()->pid != sysstat_info.pid)
+      return; /* filtered out */
+
+   e = &sysstat_entries[sn];
+
+   disable_preemption();
+   {
+      e->calls++;
+      e->tot_cycles += cycles;
+      e->max_cycles = MAX(e->max_cycles, cycles);
+      e->hist[sysstat_get_bucket(cycles)]++;
+
+      if (retval < 0 && retval >= -SYSSTAT_MAX_ERRNO)
+         e->errors++;
+   }
+   enable_preemption();
+}
+
+bool
+sysstat_get_entry(u32 sn, struct sysstat_entry *e)
+{
+   if (sn >= MAX_SYSCALLS || !sysstat_entries)
+      return false;
+
+   disable_preemption();
+   {
+      memcpy(e, &sysstat_entries[sn], sizeof(*e));
+   }
+   enable_preemption();
+   return e->calls > 0;
+}
+
+u64
+sysstat_get_percentile(const struct sysstat_entry *e, u32 pct)
+{
+   u64 tot = 0, target, cum = 0;
+
+   for (u32 i = 0; i < SYSSTAT_BUCKETS; i++)
+      tot += e->hist[i];
+
+   if (!tot)
+      return 0;
+
+   target = (tot * pct + 99) / 100;
+
+   for (u32 i = 0; i < SYSSTAT_BUCKETS - 1; i++) {
+
+      cum += e->hist[i];
+
+      if (cum >= target)
+         return MIN(1ull << (i + 1), e->max_cycles);
+   }
+
+   return e->max_cycles;
+}
+
+const char *
+sysstat_get_syscall_name(u32 sn, char *buf, size_t buf_sz)
+{
+   const char *name;
+   long off;
+
+   name = find_sym_at_addr((ulong)get_syscall_func_ptr(sn), &off, NULL);
+
+   if (name && !off && !strncmp(name, "sys_", 4))
+      return name + 4;
+
+   snprintk(buf, buf_sz, "syscall_%u", sn);
+   return buf;
+}
+
+void
+sysstat_reset(void)
+{
+   if (!sysstat_entries)
+      return;
+
+   disable_preemption();
+   {
+      bzero(sysstat_entries, MAX_SYSCALLS * sizeof(*sysstat_entries));
+   }
+   enable_preemption();
+}
+
+#if MOD_sysfs
+
+#define SYSSTAT_LINE_MAX                  128
+#define SYSSTAT_HIST_LINE_MAX             (32 + SYSSTAT_BUCKETS * 16)
+
+DEF_STATIC_SYSOBJ_PROP(enabled, &sysobj_ptype_rw_bool);
+DEF_STATIC_SYSOBJ_PROP(pid, &sysobj_ptype_rw_long);
+DEF_STATIC_SYSOBJ_PROP(reset, &sysobj_ptype_rw_bool);
+DEF_STATIC_SYSOBJ_PROP(cycles_per_us, &sysobj_ptype_ro_ulong);
+
+/* Written by sysfs, applied by the post_store hook */
+static bool sysfs_reset;
+static ulong sysfs_cycles_per_us;
+
+static u32
+sysstat_get_used_entries_count(void)
+{
+   u32 cnt = 0;
+
+   for (u32 sn = 0; sn < MAX_SYSCALLS; sn++)
+      if (sysstat_entries[sn].calls)
+         cnt++;
+
+   return cnt;
+}
+
+static offt
+sysstat_table_get_buf_sz(struct sysobj *obj, void *data)
+{
+   return SYSSTAT_LINE_MAX * (1 + sysstat_get_used_entries_count());
+}
+
+static offt
+sysstat_table_load(struct sysobj *obj, void *data, void *b, offt sz, offt off)
+{
+   struct sysstat_entry e;
+   char *buf = b, name_buf[32];
+   offt written;
+
+   written = snprintk(buf, (size_t)sz,
+                      "# syscall calls errors avg_ns p50_ns p99_ns max_ns\n");
+
+   for (u32 sn = 0; sn < MAX_SYSCALLS; sn++) {
+
+      if (!sysstat_get_entry(sn, &e))
+         continue;
+
+      if (written + SYSSTAT_LINE_MAX > sz)
+         break; /* the number of entries changed since get_buf_sz() */
+
+      written += snprintk(
+         buf + written, SYSSTAT_LINE_MAX,
+         "%s %lu %lu %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 "\n",
+         sysstat_get_syscall_name(sn, name_buf, sizeof(name_buf)),
+         e.calls,
+         e.errors,
+         sysstat_cycles_to_ns(e.tot_cycles / e.calls),
+         sysstat_cycles_to_ns(sysstat_get_percentile(&e, 50)),
+         sysstat_cycles_to_ns(sysstat_get_percentile(&e, 99)),
+         sysstat_cycles_to_ns(e.max_cycles)
+      );
+   }
+
+   return written;
+}
+
+static offt
+sysstat_hist_get_buf_sz(struct sysobj *obj, void *data)
+{
+   return SYSSTAT_HIST_LINE_MAX * (1 + sysstat_get_used_entries_count());
+}
+
+static offt
+sysstat_hist_load(struct sysobj *obj, void *data, void *b, offt sz, offt off)
+{
+   struct sysstat_entry e;
+   char *buf = b, name_buf[32];
+   offt written;
+
+   written = snprintk(buf, (size_t)sz,
+                      "# syscall log2(cycles):count ...\n");
+
+   for (u32 sn = 0; sn < MAX_SYSCALLS; sn++) {
+
+      if (!sysstat_get_entry(sn, &e))
+         continue;
+
+      if (written + SYSSTAT_HIST_LINE_MAX > sz)
+         break; /* the number of entries changed since get_buf_sz() */
+
+      written += snprintk(buf + written, SYSSTAT_LINE_MAX, "%s",
+                          sysstat_get_syscall_name(sn, name_buf,
+                                                   sizeof(name_buf)));
+
+      for (u32 i = 0; i < SYSSTAT_BUCKETS; i++) {
+         if (e.hist[i])
+            written += snprintk(buf + written, 16, " %u:%u", i, e.hist[i]);
+      }
+
+      written += snprintk(buf + written, 2, "\n");
+   }
+
+   return written;
+}
+
+static const struct sysobj_prop_type sysstat_ptype_table = {
+   .get_buf_sz = &sysstat_table_get_buf_sz,
+   .load = &sysstat_table_load,
+};
+
+static const struct sysobj_prop_type sysstat_ptype_hist = {
+   .get_buf_sz = &sysstat_hist_get_buf_sz,
+   .load = &sysstat_hist_load,
+};
+
+DEF_STATIC_SYSOBJ_PROP(table, &sysstat_ptype_table);
+DEF_STATIC_SYSOBJ_PROP(hist, &sysstat_ptype_hist);
+
+static offt
+sysstat_obj_pre_load(struct sysobj *obj, struct sysobj_prop *prop, void *data)
+{
+   sysfs_reset = false;
+   sysfs_cycles_per_us = get_tsc_cycles_per_us();
+   return 0;
+}
+
+static void
+sysstat_obj_post_store(struct sysobj *obj,
+                       struct sysobj_prop *prop,
+                       void *data)
+{
+   if (prop == &prop_reset && sysfs_reset)
+      sysstat_reset();
+
+   /* A new filter: don't mix the stats of different processes */
+   if (prop == &prop_pid)
+      sysstat_reset();
+}
+
+static struct sysobj_hooks sysstat_obj_hooks = {
+   .pre_load = &sysstat_obj_pre_load,
+   .post_store = &sysstat_obj_post_store,
+};
+
+static void sysstat_create_sysfs_obj(void)
+{
+   struct sysobj *obj;
+
+   obj = sysfs_create_custom_obj(
+      "sysstat",
+      &sysstat_obj_hooks,
+      &prop_enabled, &sysstat_info.enabled,
+      &prop_pid, &sysstat_info.pid,
+      &prop_reset, &sysfs_reset,
+      &prop_cycles_per_us, &sysfs_cycles_per_us,
+      &prop_table, NULL,
+      &prop_hist, NULL,
+      NULL
+   );
+
+   if (!obj || sysfs_register_obj(NULL, &sysfs_root_obj, "sysstat", obj))
+      panic("Unable to create the sysfs sysstat obj");
+}
+
+#else
+
+static void sysstat_create_sysfs_obj(void) { }
+
+#endif
+
+static void init_sysstat(void)
+{
+   if (!(sysstat_entries = kzalloc_array_obj(struct sysstat_entry,
+                                             MAX_SYSCALLS)))
+   {
+      panic("sysstat: out of memory");
+   }
+
+   sysstat_info.enabled = true;
+   sysstat_create_sysfs_obj();
+}
+
+static struct module sysstat_module = {
+
+   .name = "sysstat",
+   .priority = MOD_sysstat_prio,
+   .init = &init_sysstat,
+};
+
+REGISTER_MODULE(&sysstat_module);
@@ -0,0 +1,716 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/mod_sysfs.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+#include <tilck/common/printk.h>
+
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/process.h>
+#include <tilck/kernel/errno.h>
+
+#include <tilck/mods/tracing.h>
+#include <tilck/mods/sysfs.h>
+#include <tilck/mods/sysfs_utils.h>
+
+/*
+ * Trace filter: a boolean expression evaluated on each syscall event before
+ * enqueueing it. The events for which it's false are discarded. Syntax:
+ *
+ *    expr     := and { "||" and }
+ *    and      := unary { "&&" unary }
+ *    unary    := "!" unary | "(" expr ")" | pred
+ *    pred     := field op value
+ *    op       := "==" | "!=" | "<" | "<=" | ">" | ">=" | "&" | "^="
+ *
+ * The integer fields are: pid, tid, sys (the syscall number), arg0 ... arg5,
+ * ret, dur (the syscall's duration in microseconds) and exit (1 for the EXIT
+ * events, 0 for the ENTER ones). The comparisons are signed, while `&` is true
+ * when any of the bits of the value is set. The values are decimal or hex
+ * (0x...) numbers; for `sys`, they can be also syscall names (e.g. open). On
+ * the ENTER events, `ret` and `dur` are 0.
+ *
+ * The only string field is `path`: the first path parameter of the syscall, if
+ * any, as saved in the event (truncated to 63 chars). Its values are quoted
+ * strings and its operators ==, != and ^= (starts with). Example:
+ *
+ *    ret < 0 && (sys == open || path ^= "/tmp")
+ *
+ * The expression is compiled into the instructions of an accumulator machine:
+ * each predicate sets the accumulator, `!` negates it and the && / || operators
+ * become conditional jumps to the end of their sub-expression (short-circuit).
+ * The filter runs before saving the params of the event (the most expensive
+ * part of the tracing, because of the copies from the user space), unless it
+ * uses `path`. The other events (printk, signals, tracepoints) are not
+ * filtered.
+ */
+
+#define TF_MAX_INSNS                                  32
+#define TF_STR_POOL_SIZE                              64
+#define TF_MAX_DEPTH                                  16
+
+enum tf_op {
+
+   tf_op_eq,         /* acc = field == val */
+   tf_op_ne,         /* acc = field != val */
+   tf_op_lt,         /* acc = field < val */
+   tf_op_le,         /* acc = field <= val */
+   tf_op_gt,         /* acc = field > val */
+   tf_op_ge,         /* acc = field >= val */
+   tf_op_and,        /* acc = (field & val) != 0 */
+   tf_op_str_eq,     /* acc = path == strs + val */
+   tf_op_str_pfx,    /* acc = path starts with strs + val */
+   tf_op_not,        /* acc = !acc */
+   tf_op_jf,         /* if (!acc) goto val */
+   tf_op_jt,         /* if (acc) goto val */
+};
+
+enum tf_field {
+
+   tf_pid,
+   tf_tid,
+   tf_sys,
+   tf_ret,
+   tf_dur,
+   tf_exit,
+   tf_arg0,
+   tf_arg1,
+   tf_arg2,
+   tf_arg3,
+   tf_arg4,
+   tf_arg5,
+   tf_path,
+};
+
+struct tf_insn {
+
+   u8 op;            /* enum tf_op */
+   u8 field;         /* enum tf_field */
+   long val;         /* immediate, offset in `strs` or jump target */
+};
+
+struct tf_prog {
+
+   u8 len;
+   u8 strs_used;
+   bool uses_path;
+   struct tf_insn code[TF_MAX_INSNS];
+   char strs[TF_STR_POOL_SIZE];
+};
+
+struct tf_parser {
+
+   const char *p;
+   struct tf_prog *prog;
+   int depth;
+};
+
+static const char *const tf_field_names[] = {
+
+   [tf_pid]    = "pid",
+   [tf_tid]    = "tid",
+   [tf_sys]    = "sys",
+   [tf_ret]    = "ret",
+   [tf_dur]    = "dur",
+   [tf_exit]   = "exit",
+   [tf_arg0]   = "arg0",
+   [tf_arg1]   = "arg1",
+   [tf_arg2]   = "arg2",
+   [tf_arg3]   = "arg3",
+   [tf_arg4]   = "arg4",
+   [tf_arg5]   = "arg5",
+   [tf_path]   = "path",
+};
+
+/* NOTE: the longer operators must come before their prefixes */
+static const struct {
+   const char *str;
+   enum tf_op op;
+} tf_ops[] = {
+
+   { "==", tf_op_eq },
+   { "!=", tf_op_ne },
+   { "<=", tf_op_le },
+   { ">=", tf_op_ge },
+   { "^=", tf_op_str_pfx },
+   { "<", tf_op_lt },
+   { ">", tf_op_gt },
+   { "&", tf_op_and },
+};
+
+/* The active filter: updated and evaluated with preemption disabled */
+static struct tf_prog tf_active;
+static char tf_active_str[TRACE_FILTER_STR_LEN];
+static struct trace_filter_stats tf_stats;
+
+static int
+tf_emit(struct tf_prog *prog, enum tf_op op, enum tf_field field, long val)
+{
+   if (prog->len == TF_MAX_INSNS)
+      return -E2BIG;
+
+   prog->code[prog->len++] = (struct tf_insn) {
+      .op = (u8)op,
+      .field = (u8)field,
+      .val = val,
+   };
+
+   return 0;
+}
+
+static void
+tf_skip_spaces(struct tf_parser *ps)
+{
+   while (*ps->p == ' ' || *ps->p == '\t')
+      ps->p++;
+}
+
+static bool
+tf_accept(struct tf_parser *ps, const char *tok)
+{
+   const size_t len = strlen(tok);
+
+   tf_skip_spaces(ps);
+
+   if (strncmp(ps->p, tok, len))
+      return false;
+
+   ps->p += len;
+   return true;
+}
+
+static bool
+tf_is_ident_char(char c)
+{
+   return isalpha(c) || isdigit(c) || c == '_';
+}
+
+/* Read an identifier in `buf`, returning its length (0 if none) */
+static size_t
+tf_read_ident(struct tf_parser *ps, char *buf, size_t buf_sz)
+{
+   size_t len = 0;
+
+   tf_skip_spaces(ps);
+
+   for (; tf_is_ident_char(*ps->p); ps->p++) {
+
+      if (len == buf_sz - 1)
+         return 0; /* too long: not a valid identifier for us */
+
+      buf[len++] = *ps->p;
+   }
+
+   buf[len] = 0;
+   return len;
+}
+
+static int
+tf_get_syscall_by_name(const char *name)
+{
+   const char *sn;
+
+   for (u32 i = 0; i < MAX_SYSCALLS; i++) {
+
+      if ((sn = tracing_get_syscall_name(i)) && !strcmp(sn + 4, name))
+         return (int)i;
+   }
+
+   return -1;
+}
+
+static int
+tf_parse_int(struct tf_parser *ps, enum tf_field field, long *val)
+{
+   char name[32];
+   int err = 0;
+
+   tf_skip_spaces(ps);
+
+   if (field == tf_sys && isalpha(*ps->p)) {
+
+      if (!tf_read_ident(ps, name, sizeof(name)))
+         return -EINVAL;
+
+      if ((*val = tf_get_syscall_by_name(name)) < 0)
+         return -EINVAL;
+
+      return 0;
+   }
+
+   if (ps->p[0] == '0' && ps->p[1] == 'x')
+      *val = (long)tilck_strtoul(ps->p + 2, &ps->p, 16, &err);
+   else
+      *val = tilck_strtol(ps->p, &ps->p, 10, &err);
+
+   if (err || tf_is_ident_char(*ps->p))
+      return -EINVAL;
+
+   return 0;
+}
+
+static int
+tf_parse_str(struct tf_parser *ps, long *val)
+{
+   struct tf_prog *prog = ps->prog;
+   const char *end;
+   size_t len;
+
+   if (!tf_accept(ps, "\""))
+      return -EINVAL;
+
+   for (end = ps->p; *end && *end != '"'; end++) { }
+
+   if (!*end)
+      return -EINVAL; /* unterminated string */
+
+   len = (size_t)(end - ps->p);
+
+   if (prog->strs_used + len + 1 > sizeof(prog->strs))
+      return -E2BIG;
+
+   *val = prog->strs_used;
+   memcpy(prog->strs + prog->strs_used, ps->p, len);
+   prog->strs[prog->strs_used + len] = 0;
+   prog->strs_used += (u8)(len + 1);
+   ps->p = end + 1;
+   return 0;
+}
+
+static int
+tf_parse_pred(struct tf_parser *ps)
+{
+   enum tf_field field;
+   enum tf_op op;
+   char name[8];
+   long val;
+   u32 i;
+   int rc;
+
+   if (!tf_read_ident(ps, name, sizeof(name)))
+      return -EINVAL;
+
+   for (i = 0; i < ARRAY_SIZE(tf_field_names); i++)
+      if (!strcmp(name, tf_field_names[i]))
+         break;
+
+   if (i == ARRAY_SIZE(tf_field_names))
+      return -EINVAL; /* unknown field */
+
+   field = (enum tf_field)i;
+
+   for (i = 0; i < ARRAY_SIZE(tf_ops); i++)
+      if (tf_accept(ps, tf_ops[i].str))
+         break;
+
+   if (i == ARRAY_SIZE(tf_ops))
+      return -EINVAL; /* missing operator */
+
+   op = tf_ops[i].op;
+
+   if (field != tf_path) {
+
+      if (op == tf_op_str_pfx)
+         return -EINVAL;
+
+      if ((rc = tf_parse_int(ps, field, &val)))
+         return rc;
+
+      return tf_emit(ps->prog, op, field, val);
+   }
+
+   if (op != tf_op_eq && op != tf_op_ne && op != tf_op_str_pfx)
+      return -EINVAL;
+
+   if ((rc = tf_parse_str(ps, &val)))
+      return rc;
+
+   ps->prog->uses_path = true;
+
+   if (op == tf_op_str_pfx)
+      return tf_emit(ps->prog, tf_op_str_pfx, field, val);
+
+   if ((rc = tf_emit(ps->prog, tf_op_str_eq, field, val)))
+      return rc;
+
+   return op == tf_op_ne ? tf_emit(ps->prog, tf_op_not, field, 0) : 0;
+}
+
+static int
+tf_parse_or(struct tf_parser *ps);
+
+static int
+tf_parse_unary(struct tf_parser *ps)
+{
+   int rc;
+
+   if (++ps->depth > TF_MAX_DEPTH)
+      return -E2BIG;
+
+   if (tf_accept(ps, "!")) {
+
+      if (!(rc = tf_parse_unary(ps)))
+         rc = tf_emit(ps->prog, tf_op_not, 0, 0);
+
+   } else if (tf_accept(ps, "(")) {
+
+      if (!(rc = tf_parse_or(ps)))
+         rc = tf_accept(ps, ")") ? 0 : -EINVAL;
+
+   } else {
+
+      rc = tf_parse_pred(ps);
+   }
+
+   ps->depth--;
+   return rc;
+}
+
+/*
+ * Parse a sequence of sub-expressions joined by the operator `tok`, each one
+ * parsed by `parse_sub`. After each sub-expression but the last one, emit a
+ * jump to the end of the sequence, taken when its result is enough (false for
+ * &&, true for ||): the chained jumps of a nested sequence end up there too.
+ */
+static int
+tf_parse_seq(struct tf_parser *ps,
+             const char *tok,
+             enum tf_op jmp_op,
+             int (*parse_sub)(struct tf_parser *))
+{
+   struct tf_prog *prog = ps->prog;
+   u8 jmp;
+   int rc;
+
+   if ((rc = parse_sub(ps)))
+      return rc;
+
+   while (tf_accept(ps, tok)) {
+
+      jmp = prog->len;
+
+      if ((rc = tf_emit(prog, jmp_op, 0, 0)))
+         return rc;
+
+      if ((rc = parse_sub(ps)))
+         return rc;
+
+      prog->code[jmp].val = prog->len;
+   }
+
+   return 0;
+}
+
+static int
+tf_parse_and(struct tf_parser *ps)
+{
+   return tf_parse_seq(ps, "&&", tf_op_jf, &tf_parse_unary);
+}
+
+static int
+tf_parse_or(struct tf_parser *ps)
+{
+   return tf_parse_seq(ps, "||", tf_op_jt, &tf_parse_and);
+}
+
+static int
+tf_compile(const char *str, struct tf_prog *prog)
+{
+   struct tf_parser ps = { .p = str, .prog = prog };
+   int rc;
+
+   bzero(prog, sizeof(*prog));
+   tf_skip_spaces(&ps);
+
+   if (!*ps.p)
+      return 0; /* empty expression: no filter */
+
+   if ((rc = tf_parse_or(&ps)))
+      return rc;
+
+   tf_skip_spaces(&ps);
+   return *ps.p ? -EINVAL : 0;
+}
+
+static const char *
+tf_get_path(struct trace_event *e, const struct syscall_info *si)
+{
+   char *buf = NULL;
+   size_t bs = 0;
+
+   if (!si)
+      return "";
+
+   for (int i = 0; i < si->n_params; i++) {
+
+      if (si->params[i].type != &ptype_path)
+         continue;
+
+      return tracing_get_slot(e, si, i, &buf, &bs) ? buf : "";
+   }
+
+   return "";
+}
+
+static long
+tf_load(struct trace_event *e, long dur, enum tf_field field)
+{
+   switch (field) {
+
+      case tf_pid:
+         return get_curr_proc()->pid;
+
+      case tf_tid:
+         return e->tid;
+
+      case tf_sys:
+         return (long)e->sys_ev.sys;
+
+      case tf_ret:
+         return e->sys_ev.retval;
+
+      case tf_dur:
+         return dur;
+
+      case tf_exit:
+         return e->type == te_sys_exit;
+
+      default:
+         ASSERT(field >= tf_arg0 && field <= tf_arg5);
+         return (long)e->sys_ev.args[field - tf_arg0];
+   }
+}
+
+static bool
+tf_run(const struct tf_prog *prog,
+       struct trace_event *e,
+       const struct syscall_info *si,
+       long dur)
+{
+   const char *path = prog->uses_path ? tf_get_path(e, si) : NULL;
+   const struct tf_insn *in;
+   bool acc = true;
+   long v = 0;
+
+   for (u32 pc = 0; pc < prog->len; pc++) {
+
+      in = &prog->code[pc];
+
+      if (in->op <= tf_op_and)
+         v = tf_load(e, dur, in->field);
+
+      switch (in->op) {
+
+         case tf_op_eq:    acc = v == in->val;          break;
+         case tf_op_ne:    acc = v != in->val;          break;
+         case tf_op_lt:    acc = v < in->val;           break;
+         case tf_op_le:    acc = v <= in->val;          break;
+         case tf_op_gt:    acc = v > in->val;           break;
+         case tf_op_ge:    acc = v >= in->val;          break;
+         case tf_op_and:   acc = (v & in->val) != 0;    break;
+         case tf_op_not:   acc = !acc;                  break;
+
+         case tf_op_str_eq:
+            acc = !strcmp(path, prog->strs + in->val);
+            break;
+
+         case tf_op_str_pfx:
+            v = (long)strlen(prog->strs + in->val);
+            acc = !strncmp(path, prog->strs + in->val, (size_t)v);
+            break;
+
+         case tf_op_jf:
+         case tf_op_jt:
+            if (acc == (in->op == tf_op_jt))
+               pc = (u32)in->val - 1;
+            break;
+
+         default:
+            NOT_REACHED();
+      }
+   }
+
+   return acc;
+}
+
+bool
+trace_filter_match(struct trace_event *e,
+                   const struct syscall_info *si,
+                   long dur)
+{
+   bool ret;
+
+   ASSERT(e->type == te_sys_enter || e->type == te_sys_exit);
+
+   disable_preemption();
+   {
+      ret = tf_run(&tf_active, e, si, dur);
+   }
+   enable_preemption();
+   return ret;
+}
+
+bool
+trace_filter_needs_params(void)
+{
+   return tf_active.uses_path;
+}
+
+void
+trace_filter_account(bool passed, u64 cycles)
+{
+   disable_preemption();
+   {
+      if (passed) {
+         tf_stats.passed++;
+         tf_stats.pass_cycles += cycles;
+      } else {
+         tf_stats.rejected++;
+         tf_stats.reject_cycles += cycles;
+      }
+   }
+   enable_preemption();
+}
+
+void
+trace_filter_get_stats(struct trace_filter_stats *s)
+{
+   disable_preemption();
+   {
+      *s = tf_stats;
+   }
+   enable_preemption();
+}
+
+void
+trace_filter_reset_stats(void)
+{
+   disable_preemption();
+   {
+      bzero(&tf_stats, sizeof(tf_stats));
+   }
+   enable_preemption();
+}
+
+void
+get_trace_filter_str(char *buf, size_t len)
+{
+   disable_preemption();
+   {
+      memcpy(buf, tf_active_str, MIN(len, TRACE_FILTER_STR_LEN));
+   }
+   enable_preemption();
+}
+
+int
+set_trace_filter(const char *str)
+{
+   const size_t len = strlen(str);
+   struct tf_prog prog;
+   int rc;
+
+   if (len >= TRACE_FILTER_STR_LEN)
+      return -ENAMETOOLONG;
+
+   if ((rc = tf_compile(str, &prog)))
+      return rc;
+
+   disable_preemption();
+   {
+      tf_active = prog;
+      memcpy(tf_active_str, str, len + 1);
+      bzero(&tf_stats, sizeof(tf_stats));
+   }
+   enable_preemption();
+   return 0;
+}
+
+#if MOD_sysfs
+
+DEF_STATIC_CONF_RW_STRING(expr, "", TRACE_FILTER_STR_LEN);
+DEF_STATIC_SYSOBJ_PROP(reset, &sysobj_ptype_rw_bool);
+DEF_STATIC_SYSOBJ_PROP(passed, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(rejected, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(pass_cycles, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(reject_cycles, &sysobj_ptype_ro_ulong);
+
+/* Written by sysfs, applied by the post_store hook */
+static bool sysfs_reset;
+
+/* Snapshot of the stats, taken by the pre_load hook (avg. cycles per event) */
+static ulong sysfs_passed;
+static ulong sysfs_rejected;
+static ulong sysfs_pass_cycles;
+static ulong sysfs_reject_cycles;
+
+static offt
+tf_obj_pre_load(struct sysobj *obj, struct sysobj_prop *prop, void *data)
+{
+   struct trace_filter_stats s;
+
+   trace_filter_get_stats(&s);
+   get_trace_filter_str(expr_buf, sizeof(expr_buf));
+
+   sysfs_reset = false;
+   sysfs_passed = s.passed;
+   sysfs_rejected = s.rejected;
+   sysfs_pass_cycles = s.passed ? (ulong)(s.pass_cycles / s.passed) : 0;
+   sysfs_reject_cycles =
+      s.rejected ? (ulong)(s.reject_cycles / s.rejected) : 0;
+
+   return 0;
+}
+
+static void
+tf_obj_post_store(struct sysobj *obj, struct sysobj_prop *prop, void *data)
+{
+   int rc;
+
+   if (prop == &prop_reset && sysfs_reset)
+      trace_filter_reset_stats();
+
+   if (prop == &prop_expr) {
+
+      /* On failure, keep the previous filter and show it back in `expr` */
+      if ((rc = set_trace_filter(expr_buf))) {
+         printk("tracing: invalid filter expression (%d)\n", rc);
+         get_trace_filter_str(expr_buf, sizeof(expr_buf));
+      }
+   }
+}
+
+static struct sysobj_hooks tf_obj_hooks = {
+   .pre_load = &tf_obj_pre_load,
+   .post_store = &tf_obj_post_store,
+};
+
+void
+init_trace_filter(void)
+{
+   struct sysobj *obj;
+
+   obj = sysfs_create_custom_obj(
+      "trace_filter",
+      &tf_obj_hooks,
+      &prop_expr, &conf_expr,
+      &prop_reset, &sysfs_reset,
+      &prop_passed, &sysfs_passed,
+      &prop_rejected, &sysfs_rejected,
+      &prop_pass_cycles, &sysfs_pass_cycles,
+      &prop_reject_cycles, &sysfs_reject_cycles,
+      NULL
+   );
+
+   if (!obj ||
+       sysfs_register_obj(NULL, &sysfs_root_obj, "trace_filter", obj))
+   {
+      panic("Unable to create the sysfs trace_filter obj");
+   }
+}
+
+#else
+
+void init_trace_filter(void) { }
+
+#endif
@@ -0,0 +1,391 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/mod_serial.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+#include <tilck/common/printk.h>
+
+#include <tilck/kernel/hal.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/timer.h>
+#include <tilck/kernel/datetime.h>
+#include <tilck/kernel/cmdline.h>
+#include <tilck/kernel/tracepoint.h>
+
+#include <tilck/mods/tracing.h>
+#include <tilck/mods/serial.h>
+
+/*
+ * Binary trace stream: with the `-trace_stream <port>` kernel option, a kernel
+ * thread drains the trace buffer and writes the events, unformatted, to a COM
+ * port or to QEMU's debugcon port (0xE9). The stream is a sequence of records:
+ *
+ *    struct ts_rec_hdr    (magic, type, payload length)
+ *    payload
+ *
+ * It starts with the metadata (a ts_rec_header record, then one record for
+ * each syscall, errno name, signal name and tracepoint name) and continues with
+ * the events.
+ * Everything is little-endian. See scripts/dev/decode_trace_stream, which
+ * re-creates the output of the debug panel and the per-syscall latencies.
+ */
+
+#define TS_VERSION                                 2
+#define TS_REC_MAGIC                          0x5254   /* "TR" */
+#define TS_DEBUGCON_PORT                        0xE9
+
+enum ts_rec_type {
+
+   ts_rec_header     = 1,
+   ts_rec_syscall    = 2,
+   ts_rec_errno      = 3,
+   ts_rec_signal     = 4,
+   ts_rec_event      = 5,
+   ts_rec_dropped    = 6,
+   ts_rec_tracepoint = 7,
+};
+
+struct ts_rec_hdr {
+
+   u16 magic;
+   u8 type;
+   u8 unused;
+   u32 len;
+};
+
+/* Payload of ts_rec_header: the layout of struct trace_event */
+struct ts_header {
+
+   char magic[8];          /* "TILCKTRC" */
+   u32 version;
+   u32 ptr_size;
+   u32 event_size;
+   u32 ts_scale;           /* sys_time units per second */
+   u32 force_exp_block;
+
+   u32 off_type;
+   u32 off_tid;
+   u32 off_sys_time;
+   u32 off_sys;
+   u32 off_retval;
+   u32 off_args;
+   u32 off_p_level;
+   u32 off_p_buf;
+   u32 p_buf_size;
+   u32 off_signum;
+   u32 off_tp_id;
+   u32 off_tp_args;
+};
+
+/*
+ * Payload of ts_rec_syscall: the fixed part below followed by the syscall's
+ * name (NUL-terminated) and, for each param, a struct ts_param followed by the
+ * param's name (NUL-terminated).
+ */
+struct ts_syscall {
+
+   u32 sys_n;
+   u8 has_info;
+   u8 exp_block;
+   u8 n_params;
+   u8 ret_type;            /* see ts_ptypes[] */
+};
+
+struct ts_param {
+
+   u8 type;                /* see ts_ptypes[] */
+   u8 kind;                /* enum sys_param_kind */
+   s8 helper_idx;
+   u8 flags;
+   u16 slot_off;           /* offset in struct trace_event, 0 if no slot */
+   u16 slot_size;
+};
+
+#define TS_PARAM_REAL_SZ_IN_RET                     (1 << 0)
+#define TS_PARAM_INVISIBLE                          (1 << 1)
+
+/* The ptype ids in the stream are: position + 1, or 0 for unknown types */
+static const struct sys_param_type *const ts_ptypes[] = {
+
+   &ptype_int,
+   &ptype_voidp,
+   &ptype_oct,
+   &ptype_errno_or_val,
+   &ptype_errno_or_ptr,
+   &ptype_buffer,
+   &ptype_big_buf,
+   &ptype_path,
+   &ptype_open_flags,
+   &ptype_iov_in,
+   &ptype_iov_out,
+   &ptype_int32_pair,
+   &ptype_doff64,
+   &ptype_whence,
+   &ptype_u64_ptr,
+   &ptype_signum,
+};
+
+static u16 ts_port;
+static const char *ts_port_name;
+static char ts_buf[512];
+static struct trace_event ts_dummy_event;
+
+static void
+ts_write(const void *data, size_t len)
+{
+   const u8 *p = data;
+
+   for (size_t i = 0; i < len; i++) {
+
+#if MOD_serial
+      if (ts_port != TS_DEBUGCON_PORT) {
+         serial_write(ts_port, (char)p[i]);
+         continue;
+      }
+#endif
+
+      outb(ts_port, p[i]);
+   }
+}
+
+static void
+ts_write_rec(enum ts_rec_type type, const void *data, size_t len)
+{
+   const struct ts_rec_hdr h = {
+      .magic = TS_REC_MAGIC,
+      .type = (u8)type,
+      .len = (u32)len,
+   };
+
+   ts_write(&h, sizeof(h));
+   ts_write(data, len);
+}
+
+static size_t
+ts_buf_append(size_t pos, const void *data, size_t len)
+{
+   ASSERT(pos + len <= sizeof(ts_buf));
+   memcpy(ts_buf + pos, data, len);
+   return pos + len;
+}
+
+static size_t
+ts_buf_append_str(size_t pos, const char *s)
+{
+   return ts_buf_append(pos, s, strlen(s) + 1);
+}
+
+static u8
+ts_get_ptype_id(const struct sys_param_type *t)
+{
+   for (u32 i = 0; i < ARRAY_SIZE(ts_ptypes); i++)
+      if (ts_ptypes[i] == t)
+         return (u8)(i + 1);
+
+   return 0;
+}
+
+static void
+ts_write_header(void)
+{
+   const struct trace_event *e = NULL;
+   struct ts_header h = {
+
+      .magic = "TILCKTRC",
+      .version = TS_VERSION,
+      .ptr_size = sizeof(void *),
+      .event_size = sizeof(struct trace_event),
+      .ts_scale = TS_SCALE,
+      .force_exp_block = tracing_is_force_exp_block_enabled(),
+
+      .off_type = OFFSET_OF(struct trace_event, type),
+      .off_tid = OFFSET_OF(struct trace_event, tid),
+      .off_sys_time = OFFSET_OF(struct trace_event, sys_time),
+      .off_sys = OFFSET_OF(struct trace_event, sys_ev.sys),
+      .off_retval = OFFSET_OF(struct trace_event, sys_ev.retval),
+      .off_args = OFFSET_OF(struct trace_event, sys_ev.args),
+      .off_p_level = OFFSET_OF(struct trace_event, p_ev.level),
+      .off_p_buf = OFFSET_OF(struct trace_event, p_ev.buf),
+      .p_buf_size = sizeof(e->p_ev.buf),
+      .off_signum = OFFSET_OF(struct trace_event, sig_ev.signum),
+      .off_tp_id = OFFSET_OF(struct trace_event, tp_ev.id),
+      .off_tp_args = OFFSET_OF(struct trace_event, tp_ev.args),
+   };
+
+   ts_write_rec(ts_rec_header, &h, sizeof(h));
+}
+
+static void
+ts_write_syscall(u32 n, const char *name)
+{
+   const struct syscall_info *si = tracing_get_syscall_info(n);
+   struct trace_event *e = &ts_dummy_event;
+   struct ts_syscall s = { .sys_n = n };
+   struct ts_param p;
+   size_t pos, size;
+   char *slot;
+
+   if (si) {
+      s.has_info = true;
+      s.exp_block = si->exp_block;
+      s.n_params = (u8)si->n_params;
+      s.ret_type = ts_get_ptype_id(si->ret_type);
+   }
+
+   pos = ts_buf_append(0, &s, sizeof(s));
+   pos = ts_buf_append_str(pos, name);
+
+   e->type = te_sys_exit;
+   e->sys_ev.sys = n;
+
+   for (int i = 0; i < s.n_params; i++) {
+
+      const struct sys_param_info *pi = &si->params[i];
+
+      p = (struct ts_param) {
+         .type = ts_get_ptype_id(pi->type),
+         .kind = (u8)pi->kind,
+         .helper_idx = -1,
+      };
+
+      if (pi->helper_param_name)
+         p.helper_idx = (s8)tracing_get_param_idx(si, pi->helper_param_name);
+
+      if (pi->real_sz_in_ret)
+         p.flags |= TS_PARAM_REAL_SZ_IN_RET;
+
+      if (pi->invisible)
+         p.flags |= TS_PARAM_INVISIBLE;
+
+      if (tracing_get_slot(e, si, i, &slot, &size)) {
+         p.slot_off = (u16)(slot - (char *)e);
+         p.slot_size = (u16)size;
+      }
+
+      pos = ts_buf_append(pos, &p, sizeof(p));
+      pos = ts_buf_append_str(pos, pi->name);
+   }
+
+   ts_write_rec(ts_rec_syscall, ts_buf, pos);
+}
+
+static void
+ts_write_name(enum ts_rec_type type, u32 n, const char *name)
+{
+   size_t pos;
+
+   pos = ts_buf_append(0, &n, sizeof(n));
+   pos = ts_buf_append_str(pos, name);
+   ts_write_rec(type, ts_buf, pos);
+}
+
+static void
+ts_write_metadata(void)
+{
+   const char *name;
+
+   ts_write_header();
+
+   for (u32 n = 0; n < MAX_SYSCALLS; n++) {
+      if ((name = tracing_get_syscall_name(n)))
+         ts_write_syscall(n, name + 4 /* skip "sys_" */);
+   }
+
+   for (int i = 1; i < 512; i++) {
+      if ((name = get_errno_name(i)))
+         ts_write_name(ts_rec_errno, (u32)i, name);
+   }
+
+   for (int i = 1; i < _NSIG; i++) {
+      if (*(name = get_signal_name(i)))
+         ts_write_name(ts_rec_signal, (u32)i, name);
+   }
+
+   for (int i = 0; i < TP_COUNT; i++)
+      ts_write_name(ts_rec_tracepoint, (u32)i, tracepoint_get_name(i));
+}
+
+static void
+ts_write_event(struct trace_event *e)
+{
+   const u8 *p = (const u8 *)e;
+   size_t len = sizeof(*e);
+
+   /* The decoder pads the events with zeros: skip the unused trailing part */
+   while (len > 0 && !p[len - 1])
+      len--;
+
+   ts_write_rec(ts_rec_event, e, len);
+}
+
+static void
+trace_stream_thread(void *unused)
+{
+   struct trace_event e;
+   ulong dropped = 0, d;
+
+   ts_write_metadata();
+
+   while (true) {
+
+      if (read_trace_event(&e, TIMER_HZ))
+         ts_write_event(&e);
+
+      if ((d = tracing_get_dropped_events_count()) != dropped) {
+         dropped = d;
+         ts_write_rec(ts_rec_dropped, &dropped, sizeof(dropped));
+      }
+   }
+}
+
+static u16
+ts_parse_port(const char *s)
+{
+   static const struct { const char *name; u16 port; } ports[] = {
+      { "debugcon", TS_DEBUGCON_PORT },
+#if MOD_serial
+      { "com1", COM1 },
+      { "com2", COM2 },
+      { "com3", COM3 },
+      { "com4", COM4 },
+#endif
+   };
+
+   for (u32 i = 0; i < ARRAY_SIZE(ports); i++)
+      if (!strcmp(s, ports[i].name))
+         return ports[i].port;
+
+   return 0;
+}
+
+const char *
+tracing_get_stream_port_name(void)
+{
+   return ts_port_name;
+}
+
+void
+init_trace_stream(void)
+{
+   if (!kopt_trace_stream)
+      return;
+
+   if (!(ts_port = ts_parse_port(kopt_trace_stream))) {
+      printk("tracing: unknown trace stream port '%s'\n", kopt_trace_stream);
+      return;
+   }
+
+   /* Headless mode: trace everything, with ENTER and EXIT events */
+   tracing_set_all_tasks_traced(true);
+   tracing_set_force_exp_block(true);
+
+   if (kthread_create(trace_stream_thread, 0, NULL) < 0) {
+      printk("tracing: WARNING: unable to create the trace stream thread\n");
+      return;
+   }
+
+   ts_port_name = kopt_trace_stream;
+   tracing_set_enabled(true);
+   printk("tracing: streaming the trace events to %s\n", ts_port_name);
+}
@@ -4,19 +4,25 @@
 #include <tilck/common/printk.h>
 
 #include <tilck/kernel/modules.h>
+#include <tilck/kernel/hal.h>
 #include <tilck/kernel/sched.h>
 #include <tilck/kernel/kmalloc.h>
 #include <tilck/kernel/sync.h>
-#include <tilck/kernel/ringbuf.h>
+#include <tilck/kernel/interrupts.h>
 #include <tilck/kernel/datetime.h>
 #include <tilck/kernel/elf_utils.h>
 #include <tilck/kernel/bintree.h>
 #include <tilck/kernel/syscalls.h>
 #include <tilck/kernel/debug_utils.h>
+#include <tilck/kernel/tracepoint.h>
 
 #include <tilck/mods/tracing.h>
 
 #define TRACE_BUF_SIZE                       (128 * KB)
+#define TRACE_BUF_ELEMS                      (TRACE_BUF_SIZE / 256)
+#define TRACE_BUF_MASK                       (TRACE_BUF_ELEMS - 1)
+
+STATIC_ASSERT((TRACE_BUF_ELEMS & TRACE_BUF_MASK) == 0);
 
 struct symbol_node {
 
@@ -27,10 +33,25 @@ struct symbol_node {
    const char *name;
 };
 
-static struct kmutex tracing_lock;
+/*
+ * The trace buffer is a lock-free multi-producer, single-consumer ring. The
+ * producers reserve a slot by incrementing `tracing_head` with a CAS (so that
+ * an IRQ handler can enqueue events while a task is in the middle of it), copy
+ * the event and commit it by setting the slot's seq number to `pos + 1`. The
+ * reader consumes the slots in order, as long as they're committed. Preemption
+ * is disabled between the reservation and the commit, so that a reserved slot
+ * cannot remain uncommitted for long. When the ring is full, the events are
+ * dropped and counted in `tracing_dropped`: the producers never block.
+ */
+static struct trace_event *tracing_buf;
+static ATOMIC(u32) *tracing_buf_seq;
+static ATOMIC(u32) tracing_head;
+static ATOMIC(u32) tracing_tail;
+static ATOMIC(ulong) tracing_dropped;
+static ATOMIC(bool) tracing_reader_waiting;
+
+static struct kmutex tracing_lock;        /* serializes the readers only */
 static struct kcond tracing_cond;
-static struct ringbuf tracing_rb;
-static void *tracing_buf;
 
 static u32 syms_count;
 static struct symbol_node *syms_buf;
@@ -46,6 +67,7 @@ static int traced_syscalls_count;
 bool *traced_syscalls;
 bool __force_exp_block;
 bool __tracing_on;
+bool __tracing_all_tasks;
 bool __tracing_dump_big_bufs;
 int __tracing_printk_lvl = 10;
 
@@ -233,14 +255,93 @@ trace_syscall_exit_save_params(const struct syscall_info *si,
 }
 
 static void
-enqueue_trace_event(struct trace_event *e)
+enqueue_trace_event_int(struct trace_event *e, bool wake_reader)
 {
-   kmutex_lock(&tracing_lock);
-   {
-      ringbuf_write_elem(&tracing_rb, e);
+   u32 pos, tail;
+
+   disable_preemption();
+
+   pos = atomic_load_explicit(&tracing_head, mo_relaxed);
+
+   do {
+
+      tail = atomic_load_explicit(&tracing_tail, mo_acquire);
+
+      if (pos - tail >= TRACE_BUF_ELEMS) {
+         atomic_fetch_add_explicit(&tracing_dropped, 1, mo_relaxed);
+         goto out;
+      }
+
+   } while (!atomic_cas_weak(&tracing_head,
+                             &pos,
+                             pos + 1,
+                             mo_relaxed,
+                             mo_relaxed));
+
+   memcpy(&tracing_buf[pos & TRACE_BUF_MASK], e, sizeof(*e));
+
+   atomic_store_explicit(&tracing_buf_seq[pos & TRACE_BUF_MASK],
+                         pos + 1,
+                         mo_release);
+
+   /* kcond_signal_one() cannot be used in IRQ context */
+   if (wake_reader && atomic_load(&tracing_reader_waiting) && !in_irq())
       kcond_signal_one(&tracing_cond);
+
+out:
+   enable_preemption();
+}
+
+static ALWAYS_INLINE void
+enqueue_trace_event(struct trace_event *e)
+{
+   enqueue_trace_event_int(e, true);
+}
+
+/*
+ * The syscall ENTER time is saved in the task as a 32-bit counter of
+ * microseconds: struct task is tight and the durations are computed with a
+ * wrap-around subtraction, correct up to ~71 minutes.
+ */
+static ALWAYS_INLINE u32
+tracing_time_to_us(u64 sys_time)
+{
+   return (u32)(sys_time / (TS_SCALE / MILLION));
+}
+
+/*
+ * Filter, save the params and enqueue the syscall event `e`. Unless the filter
+ * needs the params, it runs before saving them: that's what makes the rejected
+ * events cheap. The cycles spent since `start` are accounted in the filter's
+ * stats, for both the passed and the rejected events.
+ */
+static void
+trace_syscall_event(const struct syscall_info *si,
+                    struct trace_event *e,
+                    long dur,
+                    u64 start)
+{
+   const bool late_filter = trace_filter_needs_params();
+   bool pass = true;
+
+   if (!late_filter)
+      pass = trace_filter_match(e, si, dur);
+
+   if (pass) {
+
+      if (e->type == te_sys_enter)
+         trace_syscall_enter_save_params(si, e);
+      else
+         trace_syscall_exit_save_params(si, e);
+
+      if (late_filter)
+         pass = trace_filter_match(e, si, dur);
+
+      if (pass)
+         enqueue_trace_event(e);
    }
-   kmutex_unlock(&tracing_lock);
+
+   trace_filter_account(pass, RDTSC() - start);
 }
 
 void
@@ -252,11 +353,18 @@ trace_syscall_enter_int(u32 sys,
                         ulong a5,
                         ulong a6)
 {
+   const u64 start = RDTSC();
    const struct syscall_info *si = tracing_get_syscall_info(sys);
+   struct task *curr = get_curr_task();
+   u64 sys_time;
 
-   if (!get_curr_task()->traced)
+   if (!tracing_is_task_traced(curr))
       return; /* the current task is not traced */
 
+   /* Needed for the duration of the syscall, in the EXIT event */
+   sys_time = get_sys_time();
+   curr->traced_sys_enter_us = tracing_time_to_us(sys_time);
+
    if (si && !exp_block(si))
       return; /* don't trace the enter event */
 
@@ -264,15 +372,14 @@ trace_syscall_enter_int(u32 sys,
 
       .type = te_sys_enter,
       .tid = get_curr_tid(),
-      .sys_time = get_sys_time(),
+      .sys_time = sys_time,
       .sys_ev = {
          .sys = sys,
          .args = {a1,a2,a3,a4,a5,a6}
       }
    };
 
-   trace_syscall_enter_save_params(si, &e);
-   enqueue_trace_event(&e);
+   trace_syscall_event(si, &e, 0, start);
 }
 
 void
@@ -285,9 +392,13 @@ trace_syscall_exit_int(u32 sys,
                        ulong a5,
                        ulong a6)
 {
+   const u64 start = RDTSC();
    const struct syscall_info *si = tracing_get_syscall_info(sys);
+   struct task *curr = get_curr_task();
+   const u32 enter_us = curr->traced_sys_enter_us;
+   long dur = 0;
 
-   if (!get_curr_task()->traced)
+   if (!tracing_is_task_traced(curr))
       return; /* the current task is not traced */
 
    struct trace_event e = {
@@ -301,8 +412,12 @@ trace_syscall_exit_int(u32 sys,
       }
    };
 
-   trace_syscall_exit_save_params(si, &e);
-   enqueue_trace_event(&e);
+   if (enter_us) {
+      dur = (long)(tracing_time_to_us(e.sys_time) - enter_us);
+      curr->traced_sys_enter_us = 0;
+   }
+
+   trace_syscall_event(si, &e, dur, start);
 }
 
 void
@@ -343,7 +458,7 @@ trace_signal_delivered_int(int target_tid, int signum)
    if (!ti)
       return;
 
-   if (!ti->traced)
+   if (!tracing_is_task_traced(ti))
       return; /* the task is not traced */
 
    struct trace_event e = {
@@ -361,7 +476,7 @@ trace_signal_delivered_int(int target_tid, int signum)
 void
 trace_task_killed_int(int signum)
 {
-   if (!get_curr_task()->traced)
+   if (!tracing_is_task_traced(get_curr_task()))
       return; /* the current task is not traced */
 
    struct trace_event e = {
@@ -376,12 +491,53 @@ trace_task_killed_int(int signum)
    enqueue_trace_event(&e);
 }
 
+/*
+ * Handler of the kernel's static tracepoints (see tracepoint.h). Unlike the
+ * other events, these are not filtered per task. Also, the reader is never
+ * woken up from here: the tracepoints fire in the scheduler itself (even when
+ * a task wakes up) and with the interrupts disabled. The reader will get the
+ * events at the next regular event or, at most, at its timeout.
+ */
+static void
+trace_tracepoint_int(enum tracepoint_id id, ulong a0, ulong a1, ulong a2)
+{
+   if (!tracing_is_enabled())
+      return;
+
+   struct trace_event e = {
+      .type = te_tracepoint,
+      .tid = get_curr_tid(),
+      .sys_time = get_sys_time(),
+      .tp_ev = {
+         .id = id,
+         .args = {a0, a1, a2},
+      }
+   };
+
+   enqueue_trace_event_int(&e, false);
+}
+
+/* Must be called holding `tracing_lock` */
+static bool
+dequeue_trace_event(struct trace_event *e)
+{
+   const u32 pos = atomic_load_explicit(&tracing_tail, mo_relaxed);
+   const u32 idx = pos & TRACE_BUF_MASK;
+
+   if (atomic_load_explicit(&tracing_buf_seq[idx], mo_acquire) != pos + 1)
+      return false; /* the ring is empty or the event is not committed yet */
+
+   memcpy(e, &tracing_buf[idx], sizeof(*e));
+   atomic_store_explicit(&tracing_tail, pos + 1, mo_release);
+   return true;
+}
+
 bool read_trace_event_noblock(struct trace_event *e)
 {
    bool ret;
    kmutex_lock(&tracing_lock);
    {
-      ret = ringbuf_read_elem(&tracing_rb, e);
+      ret = dequeue_trace_event(e);
    }
    kmutex_unlock(&tracing_lock);
    return ret;
@@ -391,12 +547,27 @@ bool read_trace_event(struct trace_event *e, u32 timeout_ticks)
 {
    bool ret;
    kmutex_lock(&tracing_lock);
-   {
-      if (ringbuf_is_empty(&tracing_rb))
-         kcond_wait(&tracing_cond, &tracing_lock, timeout_ticks);
 
-      ret = ringbuf_read_elem(&tracing_rb, e);
+   if ((ret = dequeue_trace_event(e)))
+      goto out;
+
+   /*
+    * Set the flag before checking the ring again: a producer committing an
+    * event after that will signal the condition. Because the signal might
+    * still come before we're actually waiting on it, the flag remains set
+    * until we wake up: in the worst case, we'll wake up at the next event
+    * or at the timeout.
+    */
+   atomic_store(&tracing_reader_waiting, true);
+
+   if (!(ret = dequeue_trace_event(e))) {
+      kcond_wait(&tracing_cond, &tracing_lock, timeout_ticks);
+      ret = dequeue_trace_event(e);
    }
+
+   atomic_store(&tracing_reader_waiting, false);
+
+out:
    kmutex_unlock(&tracing_lock);
    return ret;
 }
@@ -763,13 +934,15 @@ set_traced_syscalls(const char *s)
 int
 tracing_get_in_buffer_events_count(void)
 {
-   int rc;
-   kmutex_lock(&tracing_lock);
-   {
-      rc = (int)ringbuf_get_elems(&tracing_rb); // integer narrowing
-   }
-   kmutex_unlock(&tracing_lock);
-   return rc;
+   const u32 tail = atomic_load_explicit(&tracing_tail, mo_relaxed);
+   const u32 head = atomic_load_explicit(&tracing_head, mo_relaxed);
+   return (int)(head - tail);
+}
+
+ulong
+tracing_get_dropped_events_count(void)
+{
+   return atomic_load_explicit(&tracing_dropped, mo_relaxed);
 }
 
 static void
@@ -781,9 +954,12 @@ tracing_init_oom_panic(const char *buf_name)
 void
 init_tracing(void)
 {
-   if (!(tracing_buf = kzmalloc(TRACE_BUF_SIZE)))
+   if (!(tracing_buf = kzalloc_array_obj(struct trace_event, TRACE_BUF_ELEMS)))
       tracing_init_oom_panic("tracing_buf");
 
+   if (!(tracing_buf_seq = kzmalloc(TRACE_BUF_ELEMS * sizeof(ATOMIC(u32)))))
+      tracing_init_oom_panic("tracing_buf_seq");
+
    if (!(syms_buf = kalloc_array_obj(struct symbol_node, MAX_SYSCALLS)))
       tracing_init_oom_panic("syms_buf");
 
@@ -802,11 +978,6 @@ init_tracing(void)
    if (!(traced_syscalls_str = kmalloc(TRACED_SYSCALLS_STR_LEN)))
       tracing_init_oom_panic("traced_syscalls_str");
 
-   ringbuf_init(&tracing_rb,
-                TRACE_BUF_SIZE / sizeof(struct trace_event),
-                sizeof(struct trace_event),
-                tracing_buf);
-
    kmutex_init(&tracing_lock, 0);
    kcond_init(&tracing_cond);
 
@@ -816,6 +987,9 @@ init_tracing(void)
    tracing_allocate_slots_for_params();
 
    set_traced_syscalls("*");
+   init_trace_filter();
+   tracepoint_set_handler(&trace_tracepoint_int);
+   init_trace_stream();
 }
 
 static struct module dp_module = {
@@ -0,0 +1,430 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/mod_sysfs.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+#include <tilck/common/string_util.h>
+#include <tilck/common/utils.h>
+
+#include <tilck/kernel/modules.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/highmem.h>
+#include <tilck/kernel/system_mmap.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/errno.h>
+#include <tilck/kernel/swap.h>
+#include <tilck/kernel/lz4.h>
+#include <tilck/kernel/hal.h>
+
+#include <tilck/mods/sysfs.h>
+#include <tilck/mods/sysfs_utils.h>
+
+/*
+ * zram: swap backend compressing the pages with LZ4 and keeping them in a pool
+ * of pageframes. Each pool page holds objects of a single size class (a
+ * multiple of ZRAM_CLASS_SIZE): this way, the objects are packed well enough
+ * and the free ones are tracked with just a bitmap. The pages that don't
+ * compress to at most half of their size are rejected.
+ *
+ * Swapping out a page never allocates memory: when a new pool page is needed,
+ * the pageframe of the page being swapped out becomes the pool page. The pool
+ * pages are freed as soon as they get empty.
+ *
+ * Disabled by default: enable it by writing 1 in /syst/zram/enabled.
+ */
+
+#define ZRAM_CLASS_SHIFT                                      6
+#define ZRAM_CLASS_SIZE                   (1 << ZRAM_CLASS_SHIFT)
+#define ZRAM_MAX_OBJ_SIZE                        (PAGE_SIZE / 2)
+#define ZRAM_CLASSES          (ZRAM_MAX_OBJ_SIZE / ZRAM_CLASS_SIZE)
+
+/* A slot is: (pool page index << ZRAM_OBJ_SHIFT) | object index */
+#define ZRAM_OBJ_SHIFT                                        6
+#define ZRAM_OBJ_MASK                  ((1u << ZRAM_OBJ_SHIFT) - 1)
+#define ZRAM_MAX_POOL_PAGES ((1u << (SWAP_SLOT_BITS-ZRAM_OBJ_SHIFT)) - 1)
+#define NO_ZPAGE                                              0
+
+STATIC_ASSERT(PAGE_SIZE / ZRAM_CLASS_SIZE <= (1 << ZRAM_OBJ_SHIFT));
+STATIC_ASSERT(ZRAM_MAX_POOL_PAGES <= 0xffff);
+
+struct zobj_hdr {
+   u16 len;                  /* compressed size */
+   u16 ref_count;            /* > 1 when shared after fork() */
+};
+
+struct zpage {
+
+   u64 used;                 /* used objects, all 1s when full */
+   ulong paddr;              /* might be in highmem: use kmap() */
+   u16 class_idx;
+   u16 used_count;
+   u16 prev;                 /* the list of non-full pages of the class */
+   u16 next;                 /* (or the list of the free descriptors) */
+};
+
+static struct zpage *zpages;                  /* index 0 is not used */
+static u16 non_full_head[ZRAM_CLASSES];
+static u16 free_zpages;
+
+static u8 compr_buf[ZRAM_MAX_OBJ_SIZE];
+static u16 lz4_wrkmem[LZ4_WRKMEM_SIZE / 2];
+static u64 swapin_tot_cycles;
+
+/* Tunables and stats, in /syst/zram */
+static bool zram_enabled;
+static ulong zram_pool_max_pages;
+static ulong zram_pool_pages;
+static ulong zram_stored_pages;
+static ulong zram_stored_bytes;               /* compressed data */
+static ulong zram_compr_ratio;                /* percentage */
+static ulong zram_rejected_pages;             /* not compressible enough */
+static ulong zram_swap_outs;
+static ulong zram_swap_ins;
+static ulong zram_swapin_avg_cycles;
+static ulong zram_swapin_max_cycles;
+
+static ALWAYS_INLINE u32 class_obj_size(u32 class_idx)
+{
+   return (class_idx + 1) << ZRAM_CLASS_SHIFT;
+}
+
+static ALWAYS_INLINE struct zobj_hdr *
+get_zobj(struct zpage *zp, void *pool_page, u32 obj)
+{
+   return pool_page + obj * class_obj_size(zp->class_idx);
+}
+
+static void non_full_list_add(u16 idx)
+{
+   struct zpage *zp = &zpages[idx];
+   u16 *head = &non_full_head[zp->class_idx];
+
+   zp->prev = NO_ZPAGE;
+   zp->next = *head;
+
+   if (*head != NO_ZPAGE)
+      zpages[*head].prev = idx;
+
+   *head = idx;
+}
+
+static void non_full_list_remove(u16 idx)
+{
+   struct zpage *zp = &zpages[idx];
+
+   if (zp->prev != NO_ZPAGE)
+      zpages[zp->prev].next = zp->next;
+   else
+      non_full_head[zp->class_idx] = zp->next;
+
+   if (zp->next != NO_ZPAGE)
+      zpages[zp->next].prev = zp->prev;
+}
+
+static void update_compr_ratio(void)
+{
+   zram_compr_ratio = zram_stored_bytes
+      ? (ulong)((u64)zram_stored_pages * PAGE_SIZE * 100 / zram_stored_bytes)
+      : 0;
+}
+
+/* Turn the pageframe at `paddr` into a new, empty, pool page */
+static u16 new_zpage(u32 class_idx, ulong paddr)
+{
+   const u32 capacity = PAGE_SIZE / class_obj_size(class_idx);
+   struct zpage *zp;
+   u16 idx;
+
+   if ((idx = free_zpages) == NO_ZPAGE)
+      return NO_ZPAGE; /* The pool reached its max size */
+
+   zp = &zpages[idx];
+   free_zpages = zp->next;
+
+   *zp = (struct zpage) {
+      .used = capacity < 64 ? ~((1ull << capacity) - 1) : 0,
+      .paddr = paddr,
+      .class_idx = (u16)class_idx,
+   };
+
+   non_full_list_add(idx);
+   zram_pool_pages++;
+   return idx;
+}
+
+static void free_zobj(u16 idx, u32 obj, u32 len)
+{
+   struct zpage *zp = &zpages[idx];
+
+   if (zp->used == ~0ull)
+      non_full_list_add(idx);
+
+   zp->used &= ~(1ull << obj);
+   zp->used_count--;
+
+   zram_stored_pages--;
+   zram_stored_bytes -= len;
+   update_compr_ratio();
+
+   if (!zp->used_count) {
+
+      non_full_list_remove(idx);
+      pageframe_free(zp->paddr);
+
+      zp->paddr = 0;
+      zp->next = free_zpages;
+      free_zpages = idx;
+      zram_pool_pages--;
+   }
+}
+
+static struct zpage *get_zpage_of_slot(u32 slot, u32 *obj)
+{
+   const u32 idx = slot >> ZRAM_OBJ_SHIFT;
+   struct zpage *zp = &zpages[idx];
+
+   *obj = slot & ZRAM_OBJ_MASK;
+
+   ASSERT(idx != NO_ZPAGE && idx <= zram_pool_max_pages);
+   ASSERT(zp->used & (1ull << *obj));
+   return zp;
+}
+
+static bool zram_can_store(void)
+{
+   if (!zram_enabled)
+      return false;
+
+   if (free_zpages != NO_ZPAGE)
+      return true;
+
+   for (u32 i = 0; i < ZRAM_CLASSES; i++) {
+      if (non_full_head[i] != NO_ZPAGE)
+         return true;
+   }
+
+   return false;
+}
+
+static u32 zram_store(ulong paddr, bool *keep_frame)
+{
+   struct zobj_hdr *hdr;
+   struct zpage *zp;
+   u32 class_idx, obj, slot = 0;
+   void *va, *pool_page;
+   size_t len;
+   u16 idx;
+
+   if (!zram_enabled)
+      return 0;
+
+   disable_preemption();
+
+   va = kmap(paddr);
+   len = lz4_compress(va, PAGE_SIZE,
+                      compr_buf, sizeof(compr_buf) - sizeof(*hdr),
+                      lz4_wrkmem);
+   kunmap(va);
+
+   if (!len) {
+      zram_rejected_pages++;
+      goto out;
+   }
+
+   class_idx = (u32)(len + sizeof(*hdr) - 1) >> ZRAM_CLASS_SHIFT;
+
+   if ((idx = non_full_head[class_idx]) == NO_ZPAGE) {
+
+      if ((idx = new_zpage(class_idx, paddr)) == NO_ZPAGE)
+         goto out;
+
+      /* Its content is in compr_buf now: the pageframe is ours */
+      *keep_frame = true;
+   }
+
+   zp = &zpages[idx];
+   obj = get_first_zero_bit_index64(zp->used);
+   zp->used |= (1ull << obj);
+   zp->used_count++;
+
+   if (zp->used == ~0ull)
+      non_full_list_remove(idx);
+
+   pool_page = kmap(zp->paddr);
+   hdr = get_zobj(zp, pool_page, obj);
+   hdr->len = (u16)len;
+   hdr->ref_count = 1;
+   memcpy(hdr + 1, compr_buf, len);
+   kunmap(pool_page);
+
+   zram_stored_pages++;
+   zram_stored_bytes += len;
+   zram_swap_outs++;
+   update_compr_ratio();
+
+   slot = ((u32)idx << ZRAM_OBJ_SHIFT) | obj;
+
+out:
+   enable_preemption();
+   return slot;
+}
+
+static int zram_load(u32 slot, ulong paddr)
+{
+   const u64 start = RDTSC();
+   struct zobj_hdr *hdr;
+   struct zpage *zp;
+   void *pool_page, *dest;
+   u64 cycles;
+   long rc;
+   u32 obj;
+
+   disable_preemption();
+   {
+      zp = get_zpage_of_slot(slot, &obj);
+      pool_page = kmap(zp->paddr);
+      dest = kmap(paddr);
+
+      hdr = get_zobj(zp, pool_page, obj);
+      rc = lz4_decompress(hdr + 1, hdr->len, dest, PAGE_SIZE);
+
+      kunmap(dest);
+      kunmap(pool_page);
+
+      if (rc == PAGE_SIZE) {
+
+         cycles = RDTSC() - start;
+         swapin_tot_cycles += cycles;
+         zram_swap_ins++;
+
+         zram_swapin_avg_cycles = (ulong)(swapin_tot_cycles / zram_swap_ins);
+         zram_swapin_max_cycles = MAX(zram_swapin_max_cycles, (ulong)cycles);
+      }
+   }
+   enable_preemption();
+   return rc == PAGE_SIZE ? 0 : -EIO;
+}
+
+static void zram_dup(u32 slot)
+{
+   struct zpage *zp;
+   void *pool_page;
+   u32 obj;
+
+   disable_preemption();
+   {
+      zp = get_zpage_of_slot(slot, &obj);
+      pool_page = kmap(zp->paddr);
+      get_zobj(zp, pool_page, obj)->ref_count++;
+      kunmap(pool_page);
+   }
+   enable_preemption();
+}
+
+static void zram_release(u32 slot)
+{
+   struct zobj_hdr *hdr;
+   struct zpage *zp;
+   void *pool_page;
+   u32 obj, len;
+   bool last;
+
+   disable_preemption();
+   {
+      zp = get_zpage_of_slot(slot, &obj);
+      pool_page = kmap(zp->paddr);
+      hdr = get_zobj(zp, pool_page, obj);
+      last = !--hdr->ref_count;
+      len = hdr->len;
+      kunmap(pool_page);
+
+      if (last)
+         free_zobj((u16)(slot >> ZRAM_OBJ_SHIFT), obj, len);
+   }
+   enable_preemption();
+}
+
+static const struct swap_backend zram_backend = {
+
+   .name = "zram",
+   .can_store = &zram_can_store,
+   .store = &zram_store,
+   .load = &zram_load,
+   .dup = &zram_dup,
+   .release = &zram_release,
+};
+
+#if MOD_sysfs
+
+DEF_STATIC_SYSOBJ_PROP(enabled, &sysobj_ptype_rw_bool);
+DEF_STATIC_SYSOBJ_PROP(pool_max_pages, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(pool_pages, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(stored_pages, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(stored_bytes, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(compr_ratio, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(rejected_pages, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(swap_outs, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(swap_ins, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(swapin_avg_cycles, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(swapin_max_cycles, &sysobj_ptype_ro_ulong);
+
+static void zram_create_sysfs_obj(void)
+{
+   struct sysobj *obj;
+
+   obj = sysfs_create_custom_obj(
+      "zram",
+      NULL,       /* hooks */
+      &prop_enabled, &zram_enabled,
+      &prop_pool_max_pages, &zram_pool_max_pages,
+      &prop_pool_pages, &zram_pool_pages,
+      &prop_stored_pages, &zram_stored_pages,
+      &prop_stored_bytes, &zram_stored_bytes,
+      &prop_compr_ratio, &zram_compr_ratio,
+      &prop_rejected_pages, &zram_rejected_pages,
+      &prop_swap_outs, &zram_swap_outs,
+      &prop_swap_ins, &zram_swap_ins,
+      &prop_swapin_avg_cycles, &zram_swapin_avg_cycles,
+      &prop_swapin_max_cycles, &zram_swapin_max_cycles,
+      NULL
+   );
+
+   if (!obj || sysfs_register_obj(NULL, &sysfs_root_obj, "zram", obj))
+      panic("Unable to create the sysfs zram obj");
+}
+
+#else
+
+static void zram_create_sysfs_obj(void) { }
+
+#endif
+
+static void init_zram(void)
+{
+   const ulong ram_pages = (ulong)(get_phys_mem_size() >> PAGE_SHIFT);
+   const u32 count = MIN(ram_pages / 4, ZRAM_MAX_POOL_PAGES);
+
+   if (!(zpages = kzalloc_array_obj(struct zpage, count + 1))) {
+      printk("zram: unable to allocate the pool descriptors\n");
+      return;
+   }
+
+   for (u32 i = count; i > 0; i--) {
+      zpages[i].next = free_zpages;
+      free_zpages = (u16)i;
+   }
+
+   zram_pool_max_pages = count;
+   register_swap_backend(&zram_backend);
+   zram_create_sysfs_obj();
+}
+
+static struct module zram_module = {
+
+   .name = "zram",
+   .priority = MOD_zram_prio,
+   .init = &init_zram,
+};
+
+REGISTER_MODULE(&zram_module);
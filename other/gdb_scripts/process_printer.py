@@ -45,7 +45,7 @@ class printer_struct_process:
          ("children           ", children_arr),
          ("did_call_execve    ", proc['did_call_execve']),
          ("vforked            ", proc['vforked']),
-         ("inherited_mmap_heap", proc['inherited_mmap_heap']),
+         ("inherited_mi       ", proc['inherited_mi']),
          ("str_cwd            ", "\"{}\"".format(cwd)),
          ("handles            ", handles_arr),
          ("mi                 ", mi),
@@ -0,0 +1,87 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/config_debug.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/hal.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/timer.h>
+#include <tilck/kernel/datetime.h>
+#include <tilck/kernel/elf_utils.h>
+#include <tilck/kernel/irqsoff.h>
+#include <tilck/kernel/self_tests.h>
+
+#if KERNEL_IRQSOFF_TRACER
+
+#define SE_IRQSOFF_WINDOW_US                     2000
+
+static void
+se_irqsoff_check(enum irqsoff_kind kind, const char *func)
+{
+   const ulong cycles_per_us = get_tsc_cycles_per_us();
+   struct irqsoff_max m;
+   const char *start, *end;
+
+   irqsoff_get_max(kind, &m);
+   start = find_sym_at_addr(m.start_site, NULL, NULL);
+   end = find_sym_at_addr(m.end_site, NULL, NULL);
+
+   printk("%s: max: %" PRIu64 " us, from: %s, to: %s\n",
+          irqsoff_get_kind_name(kind),
+          cycles_per_us ? m.max_cycles / cycles_per_us : 0,
+          start ? start : "?",
+          end ? end : "?");
+
+   VERIFY(m.windows > 0);
+   /* delay_us() is not that precise: just check the order of magnitude */
+   VERIFY(m.max_cycles >= (u64)SE_IRQSOFF_WINDOW_US / 2 * cycles_per_us);
+
+   if (KERNEL_SYMBOLS) {
+      VERIFY(start && !strcmp(start, func));
+      VERIFY(end && !strcmp(end, func));
+   }
+}
+
+static NO_INLINE void
+se_irqsoff_long_irqs_off(void)
+{
+   disable_interrupts_forced();
+   {
+      delay_us(SE_IRQSOFF_WINDOW_US);
+   }
+   enable_interrupts_forced();
+}
+
+static NO_INLINE void
+se_irqsoff_long_preempt_off(void)
+{
+   disable_preemption();
+   {
+      delay_us(SE_IRQSOFF_WINDOW_US);
+   }
+   enable_preemption_nosched();
+}
+
+void selftest_irqsoff_short(void)
+{
+   const bool was_enabled = irqsoff_info.enabled;
+
+   irqsoff_info.enabled = true;
+   irqsoff_reset();
+
+   se_irqsoff_long_irqs_off();
+   se_irqsoff_check(irqsoff_irqs, "se_irqsoff_long_irqs_off");
+
+   se_irqsoff_long_preempt_off();
+   se_irqsoff_check(irqsoff_preempt, "se_irqsoff_long_preempt_off");
+
+   irqsoff_info.enabled = was_enabled;
+   se_regular_end();
+}
+
+DECLARE_AND_REGISTER_SELF_TEST(irqsoff, se_short, &selftest_irqsoff_short)
+
+#endif // #if KERNEL_IRQSOFF_TRACER
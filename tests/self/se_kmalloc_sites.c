@@ -0,0 +1,93 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/config_debug.h>
+#include <tilck_gen_headers/config_kmalloc.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/kmalloc_debug.h>
+#include <tilck/kernel/elf_utils.h>
+#include <tilck/kernel/self_tests.h>
+
+#if KMALLOC_SITE_PROF && KERNEL_SYMBOLS
+
+#define SE_KMSITES_ALLOCS                          16
+#define SE_KMSITES_SIZE                           256
+
+static void *se_kmsites_ptrs[SE_KMSITES_ALLOCS];
+
+static NO_INLINE void se_kmsites_alloc(void)
+{
+   for (int i = 0; i < SE_KMSITES_ALLOCS; i++) {
+      se_kmsites_ptrs[i] = kmalloc(SE_KMSITES_SIZE);
+      VERIFY(se_kmsites_ptrs[i] != NULL);
+   }
+}
+
+static void se_kmsites_get(struct kmalloc_site *buf, struct kmalloc_site *res)
+{
+   const ulong max = kmalloc_site_prof_info.max_sites;
+   const ulong n = debug_kmalloc_get_sites(buf, max);
+   const char *name;
+
+   bzero(res, sizeof(*res));
+
+   for (ulong i = 0; i < n; i++) {
+
+      if (buf[i].frames[1])
+         continue; /* not a single-frame site */
+
+      name = find_sym_at_addr((ulong)buf[i].frames[0], NULL, NULL);
+
+      if (name && !strcmp(name, "se_kmsites_alloc")) {
+         *res = buf[i];
+         return;
+      }
+   }
+}
+
+void selftest_kmalloc_sites_short(void)
+{
+   const ulong bufsz =
+      kmalloc_site_prof_info.max_sites * sizeof(struct kmalloc_site);
+   const ulong tot = SE_KMSITES_ALLOCS * SE_KMSITES_SIZE;
+   const bool was_backtrace = kmalloc_site_prof_info.backtrace;
+   struct kmalloc_site *buf;
+   struct kmalloc_site s;
+
+   VERIFY(bufsz > 0);
+   VERIFY((buf = vmalloc(bufsz)) != NULL);
+
+   /* Single-frame sites: the same as in the previous runs */
+   kmalloc_site_prof_info.backtrace = false;
+   debug_kmalloc_sites_snapshot();
+   se_kmsites_alloc();
+
+   se_kmsites_get(buf, &s);
+   printk("site: live: %lu bytes, %lu blocks, delta: %ld bytes\n",
+          s.live_bytes, s.live_count, (long)(s.live_bytes - s.snap_bytes));
+
+   VERIFY(s.live_count == SE_KMSITES_ALLOCS);
+   VERIFY(s.live_bytes >= tot);
+   VERIFY(s.live_bytes - s.snap_bytes >= tot);
+   VERIFY(s.peak_bytes >= s.live_bytes);
+
+   for (int i = 0; i < SE_KMSITES_ALLOCS; i++)
+      kfree2(se_kmsites_ptrs[i], SE_KMSITES_SIZE);
+
+   se_kmsites_get(buf, &s);
+   VERIFY(s.live_count == 0);
+   VERIFY(s.live_bytes == 0);
+
+   kmalloc_site_prof_info.backtrace = was_backtrace;
+   vfree2(buf, bufsz);
+   se_regular_end();
+}
+
+DECLARE_AND_REGISTER_SELF_TEST(kmalloc_sites, se_short,
+                               &selftest_kmalloc_sites_short)
+
+#endif // #if KMALLOC_SITE_PROF && KERNEL_SYMBOLS
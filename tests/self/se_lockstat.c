@@ -0,0 +1,122 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/config_debug.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/sync.h>
+#include <tilck/kernel/rwlock.h>
+#include <tilck/kernel/timer.h>
+#include <tilck/kernel/lockstat.h>
+#include <tilck/kernel/self_tests.h>
+
+#if KERNEL_LOCKSTAT
+
+static struct kmutex se_ls_mutex;
+static struct rwlock_wp se_ls_rwlock;
+static struct lockstat_entry se_ls_entries[LOCKSTAT_MAX_ENTRIES];
+
+static void se_ls_mutex_thread(void *unused)
+{
+   kmutex_lock(&se_ls_mutex);
+   kmutex_unlock(&se_ls_mutex);
+}
+
+static void se_ls_rwlock_thread(void *unused)
+{
+   rwlock_wp_shlock(&se_ls_rwlock);
+   rwlock_wp_shunlock(&se_ls_rwlock);
+}
+
+/* Makes a kthread wait on a lock held by the current task for a few ticks */
+static void se_ls_contend(void (*lock)(void), void (*unlock)(void),
+                          void (*thread)(void *))
+{
+   int tid;
+
+   lock();
+   {
+      tid = kthread_create(thread, 0, NULL);
+      VERIFY(tid > 0);
+      kernel_sleep(TIMER_HZ / 10);
+   }
+   unlock();
+   kthread_join(tid, true);
+}
+
+static void se_ls_mutex_lock(void) { kmutex_lock(&se_ls_mutex); }
+static void se_ls_mutex_unlock(void) { kmutex_unlock(&se_ls_mutex); }
+static void se_ls_rw_exlock(void) { rwlock_wp_exlock(&se_ls_rwlock); }
+static void se_ls_rw_exunlock(void) { rwlock_wp_exunlock(&se_ls_rwlock); }
+
+static void
+se_ls_get_totals(const void *lock, enum lockstat_type type,
+                 u32 *acq, u32 *contended, u64 *max_hold)
+{
+   u32 cnt = lockstat_get_entries(se_ls_entries, LOCKSTAT_MAX_ENTRIES);
+
+   *acq = *contended = 0;
+   *max_hold = 0;
+
+   for (u32 i = 0; i < cnt; i++) {
+
+      struct lockstat_entry *e = &se_ls_entries[i];
+
+      if (e->lock == lock && e->type == type) {
+         *acq += e->acquisitions;
+         *contended += e->contended;
+         *max_hold = MAX(*max_hold, e->max_hold);
+      }
+   }
+}
+
+void selftest_lockstat_short(void)
+{
+   u32 acq, contended;
+   u64 max_hold;
+
+   kmutex_init(&se_ls_mutex, 0);
+   rwlock_wp_init(&se_ls_rwlock, false);
+   lockstat_reset();
+
+   se_ls_contend(&se_ls_mutex_lock, &se_ls_mutex_unlock, &se_ls_mutex_thread);
+   se_ls_get_totals(&se_ls_mutex, lockstat_kmutex,
+                    &acq, &contended, &max_hold);
+
+   printk("lockstat: kmutex acq: %u, contended: %u, max hold: %" PRIu64 "\n",
+          acq, contended, max_hold);
+
+   VERIFY(acq == 2);
+   VERIFY(contended == 1);
+   VERIFY(max_hold > 0);
+
+   se_ls_contend(&se_ls_rw_exlock, &se_ls_rw_exunlock, &se_ls_rwlock_thread);
+   se_ls_get_totals(&se_ls_rwlock, lockstat_rwlock_sh,
+                    &acq, &contended, &max_hold);
+
+   VERIFY(acq == 1);
+   VERIFY(contended == 1);
+
+   se_ls_get_totals(&se_ls_rwlock, lockstat_rwlock_ex,
+                    &acq, &contended, &max_hold);
+
+   VERIFY(acq == 1);
+   VERIFY(contended == 0);
+   VERIFY(max_hold > 0);
+
+   /* The internal mutex of the rwlock must not be accounted */
+   se_ls_get_totals(&se_ls_rwlock.m, lockstat_kmutex,
+                    &acq, &contended, &max_hold);
+
+   VERIFY(acq == 0);
+
+   rwlock_wp_destroy(&se_ls_rwlock);
+   kmutex_destroy(&se_ls_mutex);
+   se_regular_end();
+}
+
+DECLARE_AND_REGISTER_SELF_TEST(lockstat, se_short, &selftest_lockstat_short)
+
+#endif // #if KERNEL_LOCKSTAT
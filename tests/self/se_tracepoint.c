@@ -0,0 +1,59 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/tracepoint.h>
+#include <tilck/kernel/self_tests.h>
+
+#define SE_TP_HUGE_ALLOC                  (1024 * MB)
+
+static int se_tp_count;
+static ulong se_tp_size;
+
+static void
+se_tp_handler(enum tracepoint_id id, ulong a0, ulong a1, ulong a2)
+{
+   if (id == tp_kmalloc_fail) {
+      se_tp_count++;
+      se_tp_size = a0;
+   }
+}
+
+static void
+se_tp_failing_kmalloc(void)
+{
+   void *ptr = kmalloc(SE_TP_HUGE_ALLOC);
+   VERIFY(ptr == NULL);
+}
+
+void selftest_tracepoint_short(void)
+{
+   const bool was_enabled = tracepoint_is_enabled(tp_kmalloc_fail);
+   tracepoint_handler old;
+
+   old = tracepoint_set_handler(&se_tp_handler);
+   tracepoint_set_enabled(tp_kmalloc_fail, false);
+
+   /* Disabled: the site is a NOP */
+   se_tp_failing_kmalloc();
+   VERIFY(se_tp_count == 0);
+
+   /* Enabled: the site jumps to the handler */
+   tracepoint_set_enabled(tp_kmalloc_fail, true);
+   se_tp_failing_kmalloc();
+   VERIFY(se_tp_count == 1);
+   VERIFY(se_tp_size == SE_TP_HUGE_ALLOC);
+
+   /* Disabled again: the NOP is restored */
+   tracepoint_set_enabled(tp_kmalloc_fail, false);
+   se_tp_failing_kmalloc();
+   VERIFY(se_tp_count == 1);
+
+   tracepoint_set_enabled(tp_kmalloc_fail, was_enabled);
+   tracepoint_set_handler(old);
+   se_regular_end();
+}
+
+DECLARE_AND_REGISTER_SELF_TEST(tracepoint, se_short, &selftest_tracepoint_short)
@@ -0,0 +1,293 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/mod_tracing.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+#include <tilck/common/syscalls.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/hal.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/sync.h>
+#include <tilck/kernel/ringbuf.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/datetime.h>
+#include <tilck/kernel/self_tests.h>
+
+#include <tilck/mods/tracing.h>
+
+#if MOD_tracing
+
+#define SE_TRACING_BATCH                  128
+#define SE_TRACING_ITERS                  100
+#define SE_TRACING_MAX_EVENTS             (64 * 1024)
+
+/*
+ * The old implementation of the trace buffer, used as a baseline: a ringbuf
+ * protected by a kmutex, with a kcond signalled for every event.
+ */
+static struct kmutex locked_rb_lock;
+static struct kcond locked_rb_cond;
+static struct ringbuf locked_rb;
+
+static void
+locked_trace_syscall_exit(u32 sys, long retval)
+{
+   struct trace_event e = {
+      .type = te_sys_exit,
+      .tid = get_curr_tid(),
+      .sys_time = get_sys_time(),
+      .sys_ev = {
+         .sys = sys,
+         .retval = retval,
+      }
+   };
+
+   kmutex_lock(&locked_rb_lock);
+   {
+      ringbuf_write_elem(&locked_rb, &e);
+      kcond_signal_one(&locked_rb_cond);
+   }
+   kmutex_unlock(&locked_rb_lock);
+}
+
+static void
+se_tracing_drain(void)
+{
+   struct trace_event e;
+   while (read_trace_event_noblock(&e)) { }
+}
+
+/* Returns the avg. cycles per syscall exit event */
+static u64
+se_tracing_syscall_loop(bool locked)
+{
+   u64 start, tot = 0;
+
+   for (int i = 0; i < SE_TRACING_ITERS; i++) {
+
+      start = RDTSC();
+
+      for (int j = 0; j < SE_TRACING_BATCH; j++) {
+
+         if (locked)
+            locked_trace_syscall_exit(SYS_getuid, j);
+         else
+            trace_syscall_exit_int(SYS_getuid, j, 0, 0, 0, 0, 0, 0);
+      }
+
+      tot += RDTSC() - start;
+
+      /* Drain the buffers outside of the measurement */
+      se_tracing_drain();
+      ringbuf_reset(&locked_rb);
+   }
+
+   return tot / (SE_TRACING_ITERS * SE_TRACING_BATCH);
+}
+
+static void
+se_tracing_check_dropped(void)
+{
+   const ulong dropped = tracing_get_dropped_events_count();
+   struct trace_event e;
+   int n, cnt;
+
+   se_tracing_drain();
+
+   for (n = 0; tracing_get_dropped_events_count() == dropped; n++) {
+      VERIFY(n < SE_TRACING_MAX_EVENTS);
+      trace_syscall_exit_int(SYS_getuid, n, 0, 0, 0, 0, 0, 0);
+   }
+
+   /* The last event has been dropped: all the others must be in order */
+   cnt = tracing_get_in_buffer_events_count();
+   printk("Trace buffer full after %d events\n", cnt);
+   VERIFY(cnt == n - 1);
+
+   for (int i = 0; i < cnt; i++) {
+      VERIFY(read_trace_event_noblock(&e));
+      VERIFY(e.type == te_sys_exit);
+      VERIFY(e.sys_ev.retval == i);
+   }
+
+   VERIFY(!read_trace_event_noblock(&e));
+}
+
+void selftest_tracing_perf_short(void)
+{
+   struct task *curr = get_curr_task();
+   const bool traced = curr->traced;
+   void *buf;
+   u64 c_untraced, c_locked, c_lockfree;
+
+   buf = kalloc_array_obj(struct trace_event, SE_TRACING_BATCH);
+   VERIFY(buf != NULL);
+
+   kmutex_init(&locked_rb_lock, 0);
+   kcond_init(&locked_rb_cond);
+   ringbuf_init(&locked_rb,
+                SE_TRACING_BATCH,
+                sizeof(struct trace_event),
+                buf);
+
+   curr->traced = false;
+   c_untraced = se_tracing_syscall_loop(false);
+
+   curr->traced = true;
+   se_tracing_drain();
+   c_locked = se_tracing_syscall_loop(true);
+   c_lockfree = se_tracing_syscall_loop(false);
+   se_tracing_check_dropped();
+   curr->traced = traced;
+
+   printk("Cycles per syscall exit event:\n");
+   printk("    not traced:          %" PRIu64 "\n", c_untraced);
+   printk("    kmutex + ringbuf:    %" PRIu64 "\n", c_locked);
+   printk("    lock-free ring:      %" PRIu64 "\n", c_lockfree);
+
+   ringbuf_destory(&locked_rb);
+   kcond_destory(&locked_rb_cond);
+   kmutex_destroy(&locked_rb_lock);
+   kfree_array_obj(buf, struct trace_event, SE_TRACING_BATCH);
+   se_regular_end();
+}
+
+DECLARE_AND_REGISTER_SELF_TEST(tracing_perf,
+                               se_short,
+                               &selftest_tracing_perf_short)
+
+static bool
+se_tracing_filter_match(const char *expr, struct trace_event *e, long dur)
+{
+   const struct syscall_info *si = tracing_get_syscall_info(e->sys_ev.sys);
+
+   VERIFY(set_trace_filter(expr) == 0);
+   return trace_filter_match(e, si, dur);
+}
+
+static void
+se_tracing_filter_check_exprs(void)
+{
+   const struct syscall_info *si = tracing_get_syscall_info(SYS_open);
+   char expr[TRACE_FILTER_STR_LEN];
+   char *buf = NULL;
+   size_t bs = 0;
+
+   struct trace_event e = {
+      .type = te_sys_exit,
+      .tid = get_curr_tid(),
+      .sys_ev = {
+         .sys = SYS_open,
+         .retval = -2,
+         .args = {0, 0x41, 0644},
+      }
+   };
+
+   static const char *const invalid_exprs[] = {
+      "ret <",
+      "foo == 1",
+      "(ret < 0",
+      "ret < 0 &&",
+      "ret < 0 ret",
+      "ret ^= 1",
+      "path < \"/tmp\"",
+      "path == \"/tmp",
+      "sys == no_such_syscall",
+   };
+
+   for (u32 i = 0; i < ARRAY_SIZE(invalid_exprs); i++)
+      VERIFY(set_trace_filter(invalid_exprs[i]) < 0);
+
+   VERIFY(si != NULL);
+   VERIFY(tracing_get_slot(&e, si, 0, &buf, &bs));
+   strcpy(buf, "/tmp/se_file");
+
+   VERIFY(se_tracing_filter_match("", &e, 0));
+   VERIFY(se_tracing_filter_match("ret < 0", &e, 0));
+   VERIFY(!se_tracing_filter_match("ret >= 0", &e, 0));
+   VERIFY(se_tracing_filter_match("sys == open && ret == -2", &e, 0));
+   VERIFY(se_tracing_filter_match("arg1 & 0x40 && arg2 == 420", &e, 0));
+   VERIFY(!se_tracing_filter_match("arg1 & 0x2 || exit == 0", &e, 0));
+   VERIFY(se_tracing_filter_match("!(ret < 0 && exit == 0)", &e, 0));
+   VERIFY(se_tracing_filter_match("ret > 0 || ret < -1 && exit == 1", &e, 0));
+   VERIFY(!se_tracing_filter_match("(ret > 0 || ret < -1) && !(exit == 1)",
+                                    &e, 0));
+   VERIFY(!se_tracing_filter_match("dur > 1000", &e, 999));
+   VERIFY(se_tracing_filter_match("dur > 1000", &e, 2000));
+   VERIFY(se_tracing_filter_match("path ^= \"/tmp/\"", &e, 0));
+   VERIFY(!se_tracing_filter_match("path == \"/tmp\"", &e, 0));
+   VERIFY(se_tracing_filter_match("path != \"/tmp\"", &e, 0));
+   VERIFY(!se_tracing_filter_match("path ^= \"/usr\" && ret < 0", &e, 0));
+
+   snprintk(expr, sizeof(expr), "tid == %d && pid == %d",
+            get_curr_tid(), get_curr_pid());
+   VERIFY(se_tracing_filter_match(expr, &e, 0));
+
+   snprintk(expr, sizeof(expr), "tid != %d", get_curr_tid());
+   VERIFY(!se_tracing_filter_match(expr, &e, 0));
+}
+
+/*
+ * Returns the avg. cycles per syscall exit event, using the filter `expr`,
+ * which is expected to pass or to reject all the events.
+ */
+static u64
+se_tracing_filter_loop(const char *expr, bool reject)
+{
+   const ulong tot = SE_TRACING_ITERS * SE_TRACING_BATCH;
+   struct trace_filter_stats s;
+
+   VERIFY(set_trace_filter(expr) == 0);
+   se_tracing_drain();
+
+   for (int i = 0; i < SE_TRACING_ITERS; i++) {
+
+      for (int j = 0; j < SE_TRACING_BATCH; j++)
+         trace_syscall_exit_int(SYS_getuid, j, 0, 0, 0, 0, 0, 0);
+
+      se_tracing_drain();
+   }
+
+   trace_filter_get_stats(&s);
+
+   if (reject) {
+      VERIFY(s.rejected >= tot);
+      return s.reject_cycles / s.rejected;
+   }
+
+   VERIFY(s.passed >= tot);
+   return s.pass_cycles / s.passed;
+}
+
+void selftest_tracing_filter_short(void)
+{
+   struct task *curr = get_curr_task();
+   const bool traced = curr->traced;
+   char saved_expr[TRACE_FILTER_STR_LEN];
+   u64 c_nofilter, c_passed, c_rejected;
+
+   get_trace_filter_str(saved_expr, sizeof(saved_expr));
+   se_tracing_filter_check_exprs();
+
+   curr->traced = true;
+   c_nofilter = se_tracing_filter_loop("", false);
+   c_passed = se_tracing_filter_loop("ret >= 0 && sys != open", false);
+   c_rejected = se_tracing_filter_loop("ret < 0 || sys == open", true);
+   curr->traced = traced;
+
+   printk("Cycles per syscall exit event:\n");
+   printk("    no filter:           %" PRIu64 "\n", c_nofilter);
+   printk("    filter, passed:      %" PRIu64 "\n", c_passed);
+   printk("    filter, rejected:    %" PRIu64 "\n", c_rejected);
+
+   VERIFY(set_trace_filter(saved_expr) == 0);
+   se_regular_end();
+}
+
+DECLARE_AND_REGISTER_SELF_TEST(tracing_filter,
+                               se_short,
+                               &selftest_tracing_filter_short)
+
+#endif // #if MOD_tracing
@@ -17,12 +17,22 @@ DECL_CMD(bad_read);
 DECL_CMD(bad_write);
 DECL_CMD(fork_perf);
 DECL_CMD(vfork_perf);
+DECL_CMD(exec_perf);
 DECL_CMD(syscall_perf);
+DECL_CMD(prof);
+DECL_CMD(sysstat);
+DECL_CMD(rusage);
 DECL_CMD(fpu);
 DECL_CMD(fpu_loop);
 DECL_CMD(brk);
+DECL_CMD(lazy_mem);
 DECL_CMD(mmap);
 DECL_CMD(mmap2);
+DECL_CMD(mmap_fixed);
+DECL_CMD(mremap);
+DECL_CMD(mremap_perf);
+DECL_CMD(mprotect);
+DECL_CMD(madvise);
 DECL_CMD(kcow);
 DECL_CMD(wpid1);
 DECL_CMD(wpid2);
@@ -60,13 +70,24 @@ DECL_CMD(fmmap4);
 DECL_CMD(fmmap5);
 DECL_CMD(fmmap6);
 DECL_CMD(fmmap7);
+DECL_CMD(fs_compr);
 DECL_CMD(fs_perf1);
 DECL_CMD(fs_perf2);
+DECL_CMD(fmmap_perf);
 DECL_CMD(pipe1);
 DECL_CMD(pipe2);
 DECL_CMD(pipe3);
 DECL_CMD(pipe4);
 DECL_CMD(pipe5);
+DECL_CMD(pipe6);
+DECL_CMD(pipe_perf);
+DECL_CMD(pipe_lat);
+DECL_CMD(shm1);
+DECL_CMD(shm2);
+DECL_CMD(shm3);
+DECL_CMD(io_uring1);
+DECL_CMD(io_uring2);
+DECL_CMD(io_uring_perf);
 DECL_CMD(pollerr);
 DECL_CMD(pollhup);
 DECL_CMD(execve0);
@@ -88,6 +109,12 @@ DECL_CMD(sig11);
 DECL_CMD(sig12);
 DECL_CMD(sig13);
 DECL_CMD(fork_oom);
+DECL_CMD(madvise_rss);
+DECL_CMD(big_pages);
+DECL_CMD(big_pages_perf);
+DECL_CMD(highmem);
+DECL_CMD(zram);
+DECL_CMD(reclaim);
 DECL_CMD(sigsegv3);
 DECL_CMD(sigsegv4);
 DECL_CMD(sigsegv5);
@@ -107,12 +134,22 @@ static struct test_cmd_entry _cmds_table[] =
    CMD_ENTRY(bad_write,    TT_SHORT,  true),
    CMD_ENTRY(fork_perf,    TT_LONG,   true),
    CMD_ENTRY(vfork_perf,   TT_LONG,   true),
+   CMD_ENTRY(exec_perf,    TT_MED,    true),
    CMD_ENTRY(syscall_perf, TT_MED,    true),
+   CMD_ENTRY(prof,         TT_SHORT,  true),
+   CMD_ENTRY(sysstat,      TT_SHORT,  true),
+   CMD_ENTRY(rusage,       TT_SHORT,  true),
    CMD_ENTRY(fpu,          TT_SHORT,  true),
    CMD_ENTRY(fpu_loop,     TT_LONG,  false),
    CMD_ENTRY(brk,          TT_SHORT,  true),
+   CMD_ENTRY(lazy_mem,     TT_SHORT,  true),
    CMD_ENTRY(mmap,         TT_MED,    true),
    CMD_ENTRY(mmap2,        TT_SHORT,  true),
+   CMD_ENTRY(mmap_fixed,   TT_SHORT,  true),
+   CMD_ENTRY(mremap,       TT_SHORT,  true),
+   CMD_ENTRY(mremap_perf,  TT_MED,    true),
+   CMD_ENTRY(mprotect,     TT_SHORT,  true),
+   CMD_ENTRY(madvise,      TT_SHORT,  true),
    CMD_ENTRY(kcow,         TT_SHORT,  true),
    CMD_ENTRY(wpid1,        TT_SHORT,  true),
    CMD_ENTRY(wpid2,        TT_SHORT,  true),
@@ -138,6 +175,7 @@ static struct test_cmd_entry _cmds_table[] =
    CMD_ENTRY(fs7,          TT_SHORT,  true),
    CMD_ENTRY(fs_perf1,     TT_SHORT,  true),
    CMD_ENTRY(fs_perf2,     TT_SHORT,  true),
+   CMD_ENTRY(fmmap_perf,   TT_MED,    true),
    CMD_ENTRY(fmmap1,       TT_SHORT,  true),
    CMD_ENTRY(fmmap2,       TT_SHORT,  true),
    CMD_ENTRY(fmmap3,       TT_SHORT,  true),
@@ -145,11 +183,21 @@ static struct test_cmd_entry _cmds_table[] =
    CMD_ENTRY(fmmap5,       TT_SHORT,  true),
    CMD_ENTRY(fmmap6,       TT_SHORT,  true),
    CMD_ENTRY(fmmap7,       TT_SHORT,  true),
+   CMD_ENTRY(fs_compr,     TT_MED,    true),
    CMD_ENTRY(pipe1,        TT_SHORT,  true),
    CMD_ENTRY(pipe2,        TT_SHORT,  true),
    CMD_ENTRY(pipe3,        TT_SHORT,  true),
    CMD_ENTRY(pipe4,        TT_SHORT,  true),
    CMD_ENTRY(pipe5,        TT_SHORT,  true),
+   CMD_ENTRY(pipe6,        TT_SHORT,  true),
+   CMD_ENTRY(pipe_perf,    TT_MED,    true),
+   CMD_ENTRY(pipe_lat,     TT_MED,    true),
+   CMD_ENTRY(shm1,         TT_SHORT,  true),
+   CMD_ENTRY(shm2,         TT_SHORT,  true),
+   CMD_ENTRY(shm3,         TT_SHORT,  true),
+   CMD_ENTRY(io_uring1,    TT_SHORT,  true),
+   CMD_ENTRY(io_uring2,    TT_SHORT,  true),
+   CMD_ENTRY(io_uring_perf, TT_MED,   true),
    CMD_ENTRY(pollerr,      TT_SHORT,  true),
    CMD_ENTRY(pollhup,      TT_SHORT,  true),
    CMD_ENTRY(poll1,        TT_SHORT,  true),
@@ -178,6 +226,12 @@ static struct test_cmd_entry _cmds_table[] =
    CMD_ENTRY(sig12,        TT_SHORT,  true),
    CMD_ENTRY(sig13,        TT_SHORT,  true),
    CMD_ENTRY(fork_oom,     TT_MED,    true),
+   CMD_ENTRY(madvise_rss,  TT_LONG,   true),
+   CMD_ENTRY(big_pages,    TT_SHORT,  true),
+   CMD_ENTRY(big_pages_perf, TT_LONG,  true),
+   CMD_ENTRY(highmem,      TT_LONG,   true),
+   CMD_ENTRY(zram,         TT_LONG,   true),
+   CMD_ENTRY(reclaim,      TT_SHORT,  true),
    CMD_ENTRY(sigsegv3,     TT_SHORT,  true),
    CMD_ENTRY(sigsegv4,     TT_SHORT,  true),
    CMD_ENTRY(sigsegv5,     TT_SHORT,  true),
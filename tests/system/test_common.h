@@ -9,6 +9,9 @@ void remove_test_file_expecting_success(const char *path, int n);
 bool running_on_tilck(void);
 void not_on_tilck_message(void);
 
+long read_syst_prop(const char *obj, const char *name);
+bool write_syst_prop(const char *obj, const char *name, const char *val);
+
 int test_sig(void (*child_func)(void *),
              void *arg,
              int ex_sig,
@@ -16,6 +16,7 @@
 
 #include "devshell.h"
 #include "sysenter.h"
+#include "test_common.h"
 
 static int sysenter_fork(void)
 {
@@ -121,6 +122,83 @@ static int do_fork_perf(int (*fork_func)(void))
    return 0;
 }
 
+#define EXEC_PERF_BIN     "/initrd/bin/busybox"
+
+/* Average cycles of vfork() + execve("true") + waitpid(), or 0 on failure */
+static ull_t do_exec_perf(int iters)
+{
+   int rc, wstatus, child_pid;
+   ull_t start;
+
+   start = RDTSC();
+
+   for (int i = 0; i < iters; i++) {
+
+      child_pid = vfork();
+
+      if (child_pid < 0) {
+         perror("vfork() failed");
+         return 0;
+      }
+
+      if (!child_pid) {
+         execl(EXEC_PERF_BIN, "true", NULL);
+         _exit(127);
+      }
+
+      rc = waitpid(child_pid, &wstatus, 0);
+
+      if (rc != child_pid) {
+         perror("waitpid() failed");
+         return 0;
+      }
+
+      if (!WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0) {
+         printf("The child failed with status: %d\n", wstatus);
+         return 0;
+      }
+   }
+
+   return (RDTSC() - start) / iters;
+}
+
+int cmd_exec_perf(int argc, char **argv)
+{
+   const int iters = 1000;
+   ull_t no_cache, cached;
+   long hits;
+
+   if (access(EXEC_PERF_BIN, X_OK)) {
+      printf("[SKIP] because " EXEC_PERF_BIN " is not available\n");
+      return 0;
+   }
+
+   /* Not on Tilck (or no sysfs): just measure */
+   if (!write_syst_prop("exec_cache", "enabled", "0")) {
+      cached = do_exec_perf(iters);
+      DEVSHELL_CMD_ASSERT(cached != 0);
+      printf("duration: %llu\n", cached);
+      return 0;
+   }
+
+   no_cache = do_exec_perf(iters);
+   DEVSHELL_CMD_ASSERT(write_syst_prop("exec_cache", "enabled", "1"));
+   hits = read_syst_prop("exec_cache", "hits");
+   cached = do_exec_perf(iters);
+
+   DEVSHELL_CMD_ASSERT(no_cache != 0);
+   DEVSHELL_CMD_ASSERT(cached != 0);
+
+   printf("duration (no cache): %llu\n", no_cache);
+   printf("duration (cached):   %llu\n", cached);
+   printf("cached images:       %ld\n",
+          read_syst_prop("exec_cache", "entries"));
+
+   /* The first exec fills the cache, all the others hit it */
+   DEVSHELL_CMD_ASSERT(read_syst_prop("exec_cache", "hits") >= hits + iters-1);
+   return 0;
+}
+
 int cmd_fork_se(int argc, char **argv)
 {
    return fork_test(&sysenter_fork);
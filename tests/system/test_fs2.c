@@ -575,3 +575,87 @@ int cmd_fmmap7(int argc, char **argv)
    unlink(test_file);
    return rc;
 }
+
+static void fill_compr_test_page(char *buf, size_t pg, int n)
+{
+   memset(buf, 'a' + n % 26, pg);
+   memcpy(buf, &n, sizeof(n));
+}
+
+/*
+ * Compression of the cold ramfs blocks: write a compressible file, let the
+ * blocks get cold and check that they've been compressed, except the one
+ * mapped in memory. Then, read the whole file back.
+ */
+int cmd_fs_compr(int argc, char **argv)
+{
+   const char *path = "/tmp/compr_test";
+   const size_t pg = getpagesize();
+   const int pages = 64;
+   long compr, decompr_before, decompr_after;
+   char *buf, *exp, *map;
+   int fd, rc;
+
+   if (!running_on_tilck() || read_syst_prop("ramfs", "compr_age_ms") < 0) {
+      not_on_tilck_message();
+      return 0;
+   }
+
+   buf = malloc(pg);
+   exp = malloc(pg);
+   DEVSHELL_CMD_ASSERT(buf && exp);
+
+   fd = open(path, O_CREAT | O_RDWR | O_TRUNC, 0644);
+   DEVSHELL_CMD_ASSERT(fd >= 0);
+
+   for (int i = 0; i < pages; i++) {
+      fill_compr_test_page(buf, pg, i);
+      rc = write(fd, buf, pg);
+      DEVSHELL_CMD_ASSERT(rc == (int)pg);
+   }
+
+   /* The first page is mapped: it must never be compressed */
+   map = mmap(NULL, pg, PROT_READ, MAP_SHARED, fd, 0);
+   DEVSHELL_CMD_ASSERT(map != MAP_FAILED);
+   DEVSHELL_CMD_ASSERT(map[sizeof(int)] == 'a');
+
+   DEVSHELL_CMD_ASSERT(write_syst_prop("ramfs", "compr_age_ms", "100"));
+   sleep(3);
+
+   compr = read_syst_prop("ramfs", "compr_pages");
+   decompr_before = read_syst_prop("ramfs", "decompressions");
+
+   printf(PFX "Compressed pages: %ld, bytes saved: %ld\n",
+          compr, read_syst_prop("ramfs", "bytes_saved"));
+
+   DEVSHELL_CMD_ASSERT(compr >= pages - 1);
+   DEVSHELL_CMD_ASSERT(write_syst_prop("ramfs", "compr_age_ms", "0"));
+
+   rc = lseek(fd, 0, SEEK_SET);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   for (int i = 0; i < pages; i++) {
+      fill_compr_test_page(exp, pg, i);
+      rc = read(fd, buf, pg);
+      DEVSHELL_CMD_ASSERT(rc == (int)pg);
+      DEVSHELL_CMD_ASSERT(!memcmp(buf, exp, pg));
+   }
+
+   decompr_after = read_syst_prop("ramfs", "decompressions");
+   printf(PFX "Decompressions: %ld\n", decompr_after - decompr_before);
+   DEVSHELL_CMD_ASSERT(decompr_after - decompr_before >= pages - 1);
+
+   fill_compr_test_page(exp, pg, 0);
+   DEVSHELL_CMD_ASSERT(!memcmp(map, exp, pg));
+
+   rc = munmap(map, pg);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   close(fd);
+   rc = unlink(path);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   free(exp);
+   free(buf);
+   return 0;
+}
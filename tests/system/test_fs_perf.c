@@ -109,3 +109,110 @@ int cmd_fs_perf2(int argc, char **argv)
    DEVSHELL_CMD_ASSERT(rc == 0);
    return 0;
 }
+
+static const char *fault_around_path = "/syst/vm/fault_around_pages";
+
+/* Returns the previous value or -1 if the tunable is not available */
+static long set_fault_around_pages(long val)
+{
+   char buf[32];
+   long old;
+   int fd, rc;
+
+   if ((fd = open(fault_around_path, O_RDWR)) < 0)
+      return -1;
+
+   rc = read(fd, buf, sizeof(buf) - 1);
+   DEVSHELL_CMD_ASSERT(rc > 0);
+   buf[rc] = 0;
+   old = atol(buf);
+
+   sprintf(buf, "%ld", val);
+   rc = write(fd, buf, strlen(buf));
+   DEVSHELL_CMD_ASSERT(rc == (int)strlen(buf));
+
+   close(fd);
+   return old;
+}
+
+static u64 fmmap_scan(int fd, size_t size, int extra_flags)
+{
+   volatile unsigned sum = 0;
+   u64 start, end;
+   char *p;
+   int rc;
+
+   start = RDTSC();
+
+   p = mmap(NULL, size, PROT_READ, MAP_SHARED | extra_flags, fd, 0);
+   DEVSHELL_CMD_ASSERT(p != MAP_FAILED);
+
+   for (size_t i = 0; i < size; i += 64)
+      sum += *(unsigned *)(p + i);
+
+   end = RDTSC();
+
+   rc = munmap(p, size);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   return end - start;
+}
+
+/*
+ * Sequential scan of a mmapped ramfs file, with and without fault-around and
+ * with MAP_POPULATE. The file size in MB can be passed as first argument: the
+ * default is small enough to fit in the test VM, but on a machine with enough
+ * RAM, try with 256 MB.
+ */
+int cmd_fmmap_perf(int argc, char **argv)
+{
+   const size_t size = (argc > 0 ? (size_t)atoi(argv[0]) : 32) * MB;
+   const char *path = "/tmp/fmmap_perf";
+   const size_t pages = size / 4096;
+   long orig_fa, fa_values[] = { 1, 4, 16, 64 };
+   char *buf;
+   u64 cycles;
+   int fd, rc;
+
+   DEVSHELL_CMD_ASSERT(size > 0);
+   buf = malloc(MB);
+   DEVSHELL_CMD_ASSERT(buf != NULL);
+   memset(buf, 'x', MB);
+
+   fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+   DEVSHELL_CMD_ASSERT(fd > 0);
+
+   for (size_t i = 0; i < size / MB; i++) {
+      rc = write(fd, buf, MB);
+      DEVSHELL_CMD_ASSERT(rc == MB);
+   }
+
+   free(buf);
+   printf("Scanning a %zu MB mmapped file\n", size / MB);
+
+   orig_fa = set_fault_around_pages(1);
+
+   if (orig_fa >= 0) {
+
+      for (int i = 0; i < ARRAY_SIZE(fa_values); i++) {
+         set_fault_around_pages(fa_values[i]);
+         cycles = fmmap_scan(fd, size, 0);
+         printf("fault-around %2ld pages: %6llu cycles/page\n",
+                fa_values[i], cycles / pages);
+      }
+
+      set_fault_around_pages(orig_fa);
+
+   } else {
+
+      cycles = fmmap_scan(fd, size, 0);
+      printf("default:                 %6llu cycles/page\n", cycles / pages);
+   }
+
+   cycles = fmmap_scan(fd, size, MAP_POPULATE);
+   printf("MAP_POPULATE:            %6llu cycles/page\n", cycles / pages);
+
+   close(fd);
+   rc = unlink(path);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   return 0;
+}
@@ -0,0 +1,386 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+
+#include "devshell.h"
+#include "test_common.h"
+
+#ifndef SYS_io_uring_setup
+   #define SYS_io_uring_setup          425
+   #define SYS_io_uring_enter          426
+#endif
+
+/* The subset of the Linux io_uring ABI used here */
+#define UR_OFF_SQ_RING                 0x00000000
+#define UR_OFF_SQES                    0x10000000
+#define UR_ENTER_GETEVENTS             (1u << 0)
+#define UR_IOSQE_ASYNC                 (1u << 4)
+
+#define UR_OP_NOP                      0
+#define UR_OP_READV                    1
+#define UR_OP_FSYNC                    3
+#define UR_OP_POLL_ADD                 6
+#define UR_OP_TIMEOUT                  11
+#define UR_OP_OPENAT                   18
+#define UR_OP_CLOSE                    19
+#define UR_OP_READ                     22
+#define UR_OP_WRITE                    23
+
+struct ur_params {
+   uint32_t sq_entries, cq_entries, flags, sq_thread_cpu, sq_thread_idle;
+   uint32_t features, wq_fd, resv[3];
+   uint32_t sq_head, sq_tail, sq_mask, sq_nr, sq_flags, sq_dropped, sq_array;
+   uint32_t sq_resv1;
+   uint64_t sq_resv2;
+   uint32_t cq_head, cq_tail, cq_mask, cq_nr, cq_overflow, cq_cqes, cq_flags;
+   uint32_t cq_resv1;
+   uint64_t cq_resv2;
+};
+
+struct ur_sqe {
+   uint8_t opcode, flags;
+   uint16_t ioprio;
+   int32_t fd;
+   uint64_t off, addr;
+   uint32_t len, op_flags;
+   uint64_t user_data;
+   uint64_t pad[3];
+};
+
+struct ur_cqe {
+   uint64_t user_data;
+   int32_t res;
+   uint32_t flags;
+};
+
+struct ur_timespec {
+   int64_t tv_sec;
+   int64_t tv_nsec;
+};
+
+struct uring {
+   int fd;
+   unsigned sq_entries;
+   unsigned cq_entries;
+   volatile unsigned *sq_tail;
+   unsigned *sq_array;
+   volatile unsigned *cq_head;
+   volatile unsigned *cq_tail;
+   struct ur_sqe *sqes;
+   struct ur_cqe *cqes;
+   char *ring;
+   size_t ring_size;
+   size_t sqes_size;
+};
+
+static void uring_init(struct uring *u, unsigned entries)
+{
+   struct ur_params p;
+
+   memset(&p, 0, sizeof(p));
+   u->fd = (int)syscall(SYS_io_uring_setup, entries, &p);
+   DEVSHELL_CMD_ASSERT(u->fd >= 0);
+   DEVSHELL_CMD_ASSERT(fcntl(u->fd, F_GETFD) & FD_CLOEXEC);
+
+   u->sq_entries = p.sq_entries;
+   u->cq_entries = p.cq_entries;
+   u->ring_size = p.cq_cqes + p.cq_entries * sizeof(struct ur_cqe);
+   u->sqes_size = p.sq_entries * sizeof(struct ur_sqe);
+
+   if (p.sq_array + p.sq_entries * sizeof(unsigned) > u->ring_size)
+      u->ring_size = p.sq_array + p.sq_entries * sizeof(unsigned);
+
+   u->ring = mmap(NULL, u->ring_size, PROT_READ | PROT_WRITE,
+                  MAP_SHARED, u->fd, UR_OFF_SQ_RING);
+   DEVSHELL_CMD_ASSERT(u->ring != MAP_FAILED);
+
+   u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE,
+                  MAP_SHARED, u->fd, UR_OFF_SQES);
+   DEVSHELL_CMD_ASSERT(u->sqes != MAP_FAILED);
+
+   u->sq_tail = (void *)(u->ring + p.sq_tail);
+   u->sq_array = (void *)(u->ring + p.sq_array);
+   u->cq_head = (void *)(u->ring + p.cq_head);
+   u->cq_tail = (void *)(u->ring + p.cq_tail);
+   u->cqes = (void *)(u->ring + p.cq_cqes);
+}
+
+static void uring_destroy(struct uring *u)
+{
+   munmap(u->sqes, u->sqes_size);
+   munmap(u->ring, u->ring_size);
+   close(u->fd);
+}
+
+/* Queue a new SQE. The caller has to make sure that the SQ ring has room */
+static struct ur_sqe *
+uring_sqe(struct uring *u, uint8_t op, int fd, uint64_t user_data)
+{
+   const unsigned tail = *u->sq_tail;
+   const unsigned idx = tail & (u->sq_entries - 1);
+   struct ur_sqe *sqe = &u->sqes[idx];
+
+   memset(sqe, 0, sizeof(*sqe));
+   sqe->opcode = op;
+   sqe->fd = fd;
+   sqe->off = (uint64_t)-1;
+   sqe->user_data = user_data;
+   u->sq_array[idx] = idx;
+
+   __atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+   return sqe;
+}
+
+static int uring_enter(struct uring *u, unsigned submit, unsigned wait)
+{
+   return (int)syscall(SYS_io_uring_enter, u->fd, submit, wait,
+                       wait ? UR_ENTER_GETEVENTS : 0, NULL, 0);
+}
+
+/* Pop the next CQE, if any */
+static bool uring_cqe(struct uring *u, struct ur_cqe *out)
+{
+   const unsigned head = *u->cq_head;
+
+   if (head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE))
+      return false;
+
+   *out = u->cqes[head & (u->cq_entries - 1)];
+   __atomic_store_n(u->cq_head, head + 1, __ATOMIC_RELEASE);
+   return true;
+}
+
+/* Submit everything queued, wait for `n` completions and collect them */
+static void uring_run(struct uring *u, unsigned n, int res[])
+{
+   struct ur_cqe cqe;
+   int rc;
+
+   rc = uring_enter(u, n, n);
+   DEVSHELL_CMD_ASSERT(rc == (int)n);
+
+   for (unsigned i = 0; i < n; i++) {
+      DEVSHELL_CMD_ASSERT(uring_cqe(u, &cqe));
+      DEVSHELL_CMD_ASSERT(cqe.user_data < n);
+      res[cqe.user_data] = cqe.res;
+   }
+
+   DEVSHELL_CMD_ASSERT(!uring_cqe(u, &cqe));
+}
+
+/* File I/O: openat, write, fsync, async read, readv and close */
+int cmd_io_uring1(int argc, char **argv)
+{
+   const char *path = "/tmp/io_uring1_test";
+   const char *msg = "hello, io_uring!";
+   char buf[32], b1[5], b2[4];
+   struct iovec iov[2] = {
+      { .iov_base = b1, .iov_len = sizeof(b1) },
+      { .iov_base = b2, .iov_len = sizeof(b2) },
+   };
+   struct ur_sqe *sqe;
+   struct uring u;
+   int res[8];
+   int fd;
+
+   uring_init(&u, 6);
+   DEVSHELL_CMD_ASSERT(u.sq_entries == 8);
+   DEVSHELL_CMD_ASSERT(u.cq_entries == 16);
+
+   sqe = uring_sqe(&u, UR_OP_OPENAT, AT_FDCWD, 0);
+   sqe->addr = (uintptr_t)path;
+   sqe->op_flags = O_CREAT | O_RDWR | O_TRUNC;
+   sqe->len = 0644;
+   uring_run(&u, 1, res);
+   DEVSHELL_CMD_ASSERT(res[0] >= 0);
+   fd = res[0];
+
+   sqe = uring_sqe(&u, UR_OP_WRITE, fd, 0);
+   sqe->addr = (uintptr_t)msg;
+   sqe->len = (uint32_t)strlen(msg);
+   sqe->off = 0;
+
+   uring_sqe(&u, UR_OP_FSYNC, fd, 1);
+   uring_sqe(&u, UR_OP_NOP, -1, 2);
+   uring_sqe(&u, 200 /* invalid opcode */, -1, 3);
+   uring_run(&u, 4, res);
+
+   DEVSHELL_CMD_ASSERT(res[0] == (int)strlen(msg));
+   DEVSHELL_CMD_ASSERT(res[1] == 0);
+   DEVSHELL_CMD_ASSERT(res[2] == 0);
+   DEVSHELL_CMD_ASSERT(res[3] == -EINVAL);
+
+   memset(buf, 0, sizeof(buf));
+   sqe = uring_sqe(&u, UR_OP_READ, fd, 0);
+   sqe->flags = UR_IOSQE_ASYNC;
+   sqe->addr = (uintptr_t)buf;
+   sqe->len = sizeof(buf);
+   sqe->off = 0;
+
+   sqe = uring_sqe(&u, UR_OP_READV, fd, 1);
+   sqe->addr = (uintptr_t)iov;
+   sqe->len = 2;
+   sqe->off = 7;
+
+   /* Async reads and writes bigger than 64 KB are rejected */
+   sqe = uring_sqe(&u, UR_OP_READ, fd, 2);
+   sqe->flags = UR_IOSQE_ASYNC;
+   sqe->addr = (uintptr_t)buf;
+   sqe->len = 64 * 1024 + 1;
+   sqe->off = 0;
+   uring_run(&u, 3, res);
+
+   DEVSHELL_CMD_ASSERT(res[0] == (int)strlen(msg));
+   DEVSHELL_CMD_ASSERT(!strcmp(buf, msg));
+   DEVSHELL_CMD_ASSERT(res[1] == 9);
+   DEVSHELL_CMD_ASSERT(!memcmp(b1, "io_ur", 5) && !memcmp(b2, "ing!", 4));
+   DEVSHELL_CMD_ASSERT(res[2] == -EINVAL);
+
+   uring_sqe(&u, UR_OP_CLOSE, fd, 0);
+   uring_sqe(&u, UR_OP_CLOSE, fd, 1);
+   uring_run(&u, 2, res);
+   DEVSHELL_CMD_ASSERT(res[0] == 0);
+   DEVSHELL_CMD_ASSERT(res[1] == -EBADF);
+
+   uring_destroy(&u);
+   DEVSHELL_CMD_ASSERT(unlink(path) == 0);
+   return 0;
+}
+
+/* Pipes, poll and timeouts: requests waiting for readiness */
+int cmd_io_uring2(int argc, char **argv)
+{
+   struct ur_timespec ts = { .tv_sec = 0, .tv_nsec = 20 * 1000 * 1000 };
+   struct ur_sqe *sqe;
+   struct uring u;
+   char c1 = 0, c2 = 0;
+   int pfd[2], res[8];
+   int rc, wstatus;
+   pid_t child;
+
+   uring_init(&u, 8);
+   rc = pipe(pfd);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   /* The read waits for the write submitted after it, in the same batch */
+   sqe = uring_sqe(&u, UR_OP_READ, pfd[0], 0);
+   sqe->addr = (uintptr_t)&c1;
+   sqe->len = 1;
+
+   sqe = uring_sqe(&u, UR_OP_WRITE, pfd[1], 1);
+   sqe->addr = (uintptr_t)"x";
+   sqe->len = 1;
+
+   sqe = uring_sqe(&u, UR_OP_POLL_ADD, pfd[1], 2);
+   sqe->op_flags = POLLOUT;
+
+   sqe = uring_sqe(&u, UR_OP_TIMEOUT, -1, 3);
+   sqe->addr = (uintptr_t)&ts;
+   sqe->len = 1;
+   sqe->off = 0;       /* a pure timeout: don't wait for other completions */
+
+   uring_run(&u, 4, res);
+   DEVSHELL_CMD_ASSERT(res[0] == 1 && c1 == 'x');
+   DEVSHELL_CMD_ASSERT(res[1] == 1);
+   DEVSHELL_CMD_ASSERT(res[2] & POLLOUT);
+   DEVSHELL_CMD_ASSERT(res[3] == -ETIME);
+
+   /* Sleep in io_uring_enter() until another process writes in the pipe */
+   child = fork();
+   DEVSHELL_CMD_ASSERT(child >= 0);
+
+   if (!child) {
+      usleep(50 * 1000);
+      exit(write(pfd[1], "y", 1) == 1 ? 0 : 1);
+   }
+
+   sqe = uring_sqe(&u, UR_OP_POLL_ADD, pfd[0], 0);
+   sqe->op_flags = POLLIN;
+
+   sqe = uring_sqe(&u, UR_OP_READ, pfd[0], 1);
+   sqe->addr = (uintptr_t)&c2;
+   sqe->len = 1;
+   uring_run(&u, 2, res);
+
+   DEVSHELL_CMD_ASSERT(res[0] & POLLIN);
+   DEVSHELL_CMD_ASSERT(res[1] == 1 && c2 == 'y');
+
+   waitpid(child, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+
+   close(pfd[0]);
+   close(pfd[1]);
+   uring_destroy(&u);
+   return 0;
+}
+
+/*
+ * Batching: 10k small reads with one syscall each, compared to the same reads
+ * submitted through a single io_uring_enter() call.
+ */
+int cmd_io_uring_perf(int argc, char **argv)
+{
+   const char *path = "/tmp/io_uring_perf_test";
+   const unsigned n = 10000, rsize = 16;
+   ull_t start, sys_cycles, ring_cycles;
+   char buf[4096], rbuf[16];
+   struct ur_cqe cqe;
+   struct ur_sqe *sqe;
+   struct uring u;
+   int fd, rc;
+
+   memset(buf, 'a', sizeof(buf));
+   fd = open(path, O_CREAT | O_RDWR | O_TRUNC, 0644);
+   DEVSHELL_CMD_ASSERT(fd >= 0);
+   rc = write(fd, buf, sizeof(buf));
+   DEVSHELL_CMD_ASSERT(rc == sizeof(buf));
+
+   start = RDTSC();
+
+   for (unsigned i = 0; i < n; i++) {
+      rc = pread(fd, rbuf, rsize, (off_t)((i * rsize) % sizeof(buf)));
+      DEVSHELL_CMD_ASSERT(rc == (int)rsize);
+   }
+
+   sys_cycles = RDTSC() - start;
+   uring_init(&u, n);
+
+   for (unsigned i = 0; i < n; i++) {
+      sqe = uring_sqe(&u, UR_OP_READ, fd, i);
+      sqe->addr = (uintptr_t)rbuf;
+      sqe->len = rsize;
+      sqe->off = (i * rsize) % sizeof(buf);
+   }
+
+   start = RDTSC();
+   rc = uring_enter(&u, n, n);
+   ring_cycles = RDTSC() - start;
+   DEVSHELL_CMD_ASSERT(rc == (int)n);
+
+   for (unsigned i = 0; i < n; i++) {
+      DEVSHELL_CMD_ASSERT(uring_cqe(&u, &cqe));
+      DEVSHELL_CMD_ASSERT(cqe.res == (int)rsize);
+   }
+
+   printf("%u reads of %u bytes:\n", n, rsize);
+   printf("    pread():      %6llu cycles/read\n", sys_cycles / n);
+   printf("    io_uring:     %6llu cycles/read\n", ring_cycles / n);
+
+   uring_destroy(&u);
+   close(fd);
+   DEVSHELL_CMD_ASSERT(unlink(path) == 0);
+   return 0;
+}
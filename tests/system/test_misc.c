@@ -14,6 +14,7 @@
 #include <sys/syscall.h>
 #include <sys/mman.h>
 #include <sys/time.h>
+#include <sys/resource.h>
 
 #include "devshell.h"
 #include "sysenter.h"
@@ -28,6 +29,44 @@ void not_on_tilck_message(void)
    fprintf(stderr, "[SKIP]: Test designed to run exclusively on Tilck\n");
 }
 
+/* Returns the value of a /syst ulong property or -1 if it's not available */
+long read_syst_prop(const char *obj, const char *name)
+{
+   char path[64], buf[32];
+   int fd, rc;
+
+   sprintf(path, "/syst/%s/%s", obj, name);
+
+   if ((fd = open(path, O_RDONLY)) < 0)
+      return -1;
+
+   rc = read(fd, buf, sizeof(buf) - 1);
+   close(fd);
+
+   if (rc <= 0)
+      return -1;
+
+   buf[rc] = 0;
+   return atol(buf);
+}
+
+bool write_syst_prop(const char *obj, const char *name, const char *val)
+{
+   const ssize_t len = (ssize_t)strlen(val);
+   char path[64];
+   ssize_t rc;
+   int fd;
+
+   sprintf(path, "/syst/%s/%s", obj, name);
+
+   if ((fd = open(path, O_WRONLY)) < 0)
+      return false;
+
+   rc = write(fd, val, (size_t)len);
+   close(fd);
+   return rc == len;
+}
+
 
 int cmd_loop(int argc, char **argv)
 {
@@ -147,6 +186,208 @@ int cmd_syscall_perf(int argc, char **argv)
    return 0;
 }
 
+/*
+ * Sample a busy loop with the statistical profiler and check that /dev/prof
+ * accounts all the samples, in the folded stacks format.
+ */
+int cmd_prof(int argc, char **argv)
+{
+   char *buf, *line, *cnt, *save = NULL;
+   size_t size = 0, cap = 64 * 1024;
+   long samples, tot = 0;
+   ssize_t rc;
+   int fd;
+
+   if (access("/dev/prof", R_OK)) {
+      printf(PFX "[SKIP] because /dev/prof is not available\n");
+      return 0;
+   }
+
+   DEVSHELL_CMD_ASSERT(write_syst_prop("prof", "running", "0"));
+   DEVSHELL_CMD_ASSERT(write_syst_prop("prof", "reset", "1"));
+   DEVSHELL_CMD_ASSERT(write_syst_prop("prof", "hz", "1024"));
+   DEVSHELL_CMD_ASSERT(write_syst_prop("prof", "running", "1"));
+
+   for (int i = 0; i < 50 * 1000 * 1000; i++)
+      asmVolatile("nop");
+
+   DEVSHELL_CMD_ASSERT(write_syst_prop("prof", "running", "0"));
+   samples = read_syst_prop("prof", "samples");
+   printf("Samples: %ld, dropped: %ld\n",
+          samples, read_syst_prop("prof", "dropped"));
+
+   DEVSHELL_CMD_ASSERT(samples > 0);
+   DEVSHELL_CMD_ASSERT(buf = malloc(cap));
+   DEVSHELL_CMD_ASSERT((fd = open("/dev/prof", O_RDONLY)) >= 0);
+
+   while ((rc = read(fd, buf + size, cap - size - 1)) > 0) {
+
+      size += (size_t)rc;
+
+      if (size == cap - 1)
+         DEVSHELL_CMD_ASSERT(buf = realloc(buf, cap *= 2));
+   }
+
+   close(fd);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   buf[size] = 0;
+
+   /* Each line: frame;frame;...;frame <count> */
+   line = strtok_r(buf, "\n", &save);
+
+   for (; line; line = strtok_r(NULL, "\n", &save)) {
+
+      cnt = strrchr(line, ' ');
+      DEVSHELL_CMD_ASSERT(cnt != NULL);
+      DEVSHELL_CMD_ASSERT(atol(cnt + 1) > 0);
+      tot += atol(cnt + 1);
+   }
+
+   printf("First stack: %.70s\n", buf);
+   free(buf);
+   DEVSHELL_CMD_ASSERT(tot == samples);
+   DEVSHELL_CMD_ASSERT(write_syst_prop("prof", "reset", "1"));
+   return 0;
+}
+
+/*
+ * Filter the syscall statistics on this process, call getppid() a known number
+ * of times and check that /syst/sysstat/table accounts exactly those calls.
+ */
+int cmd_sysstat(int argc, char **argv)
+{
+   const int iters = 1000;
+   char *buf, *line, *save = NULL, name[32], pid_str[16];
+   long calls = -1, errors = -1;
+   ssize_t rc;
+   int fd;
+
+   if (access("/syst/sysstat/table", R_OK)) {
+      printf(PFX "[SKIP] because /syst/sysstat is not available\n");
+      return 0;
+   }
+
+   sprintf(pid_str, "%d", getpid());
+   DEVSHELL_CMD_ASSERT(write_syst_prop("sysstat", "enabled", "1"));
+   DEVSHELL_CMD_ASSERT(write_syst_prop("sysstat", "pid", pid_str));
+   DEVSHELL_CMD_ASSERT(write_syst_prop("sysstat", "reset", "1"));
+
+   for (int i = 0; i < iters; i++)
+      syscall(SYS_getppid);
+
+   DEVSHELL_CMD_ASSERT(buf = calloc(1, 64 * 1024));
+   DEVSHELL_CMD_ASSERT((fd = open("/syst/sysstat/table", O_RDONLY)) >= 0);
+   rc = read(fd, buf, 64 * 1024 - 1);
+   close(fd);
+   DEVSHELL_CMD_ASSERT(rc > 0);
+
+   /* Each line: syscall calls errors avg_ns p50_ns p99_ns max_ns */
+   line = strtok_r(buf, "\n", &save);
+
+   for (; line; line = strtok_r(NULL, "\n", &save)) {
+
+      if (line[0] == '#')
+         continue;
+
+      if (sscanf(line, "%31s %ld %ld", name, &calls, &errors) != 3)
+         continue;
+
+      if (!strcmp(name, "getppid")) {
+         printf("%s\n", line);
+         break;
+      }
+
+      calls = errors = -1;
+   }
+
+   free(buf);
+   DEVSHELL_CMD_ASSERT(write_syst_prop("sysstat", "pid", "0"));
+   DEVSHELL_CMD_ASSERT(calls == iters);
+   DEVSHELL_CMD_ASSERT(errors == 0);
+   return 0;
+}
+
+/*
+ * Touch some fresh anonymous memory and check that the page faults show up in
+ * getrusage(). Then, do the same in a child and check the rusage reported by
+ * wait4() and by getrusage(RUSAGE_CHILDREN).
+ */
+int cmd_rusage(int argc, char **argv)
+{
+   const size_t pages = 64;
+   const size_t len = pages * getpagesize();
+   struct rusage r0, r1, cru, ch;
+   char *p;
+   int pid, wstatus;
+
+   DEVSHELL_CMD_ASSERT(getrusage(RUSAGE_SELF, &r0) == 0);
+
+   p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+   DEVSHELL_CMD_ASSERT(p != MAP_FAILED);
+
+   for (size_t i = 0; i < pages; i++)
+      p[i * getpagesize()] = 1;
+
+   DEVSHELL_CMD_ASSERT(getrusage(RUSAGE_SELF, &r1) == 0);
+   DEVSHELL_CMD_ASSERT(munmap(p, len) == 0);
+
+   printf("self: minflt: %ld -> %ld, maxrss: %ld KB\n",
+          r0.ru_minflt, r1.ru_minflt, r1.ru_maxrss);
+
+   DEVSHELL_CMD_ASSERT(r1.ru_minflt > r0.ru_minflt);
+   DEVSHELL_CMD_ASSERT(r1.ru_maxrss > 0);
+
+   DEVSHELL_CMD_ASSERT((pid = fork()) >= 0);
+
+   if (!pid) {
+
+      p = malloc(len);
+
+      for (size_t i = 0; i < len; i += 512)
+         p[i] = 1;
+
+      free(p);
+      exit(0);
+   }
+
+   DEVSHELL_CMD_ASSERT(wait4(pid, &wstatus, 0, &cru) == pid);
+   DEVSHELL_CMD_ASSERT(getrusage(RUSAGE_CHILDREN, &ch) == 0);
+
+   printf("child: minflt: %ld, maxrss: %ld KB, nvcsw: %ld, nivcsw: %ld\n",
+          cru.ru_minflt, cru.ru_maxrss, cru.ru_nvcsw, cru.ru_nivcsw);
+
+   DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+   DEVSHELL_CMD_ASSERT(cru.ru_minflt > 0);
+   DEVSHELL_CMD_ASSERT(cru.ru_maxrss > 0);
+   DEVSHELL_CMD_ASSERT(ch.ru_minflt >= cru.ru_minflt);
+   DEVSHELL_CMD_ASSERT(ch.ru_maxrss >= cru.ru_maxrss);
+
+   if (!access("/syst/rusage/self", R_OK)) {
+
+      char buf[256], *s;
+      long syscalls = -1;
+      ssize_t rc;
+      int fd;
+
+      DEVSHELL_CMD_ASSERT((fd = open("/syst/rusage/self", O_RDONLY)) >= 0);
+      rc = read(fd, buf, sizeof(buf) - 1);
+      close(fd);
+
+      DEVSHELL_CMD_ASSERT(rc > 0);
+      buf[rc] = 0;
+
+      if ((s = strstr(buf, "syscalls ")))
+         syscalls = atol(s + 9);
+
+      printf("self: syscalls: %ld\n", syscalls);
+      DEVSHELL_CMD_ASSERT(syscalls > 0);
+   }
+
+   return 0;
+}
+
 int cmd_fpu(int argc, char **argv)
 {
    long double e = 1.0;
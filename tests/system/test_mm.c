@@ -14,6 +14,7 @@
 #include <sys/stat.h>
 #include <sys/syscall.h>
 #include <sys/mman.h>
+#include <signal.h>
 
 #include "devshell.h"
 #include "sysenter.h"
@@ -52,6 +53,89 @@ int cmd_brk(int argc, char **argv)
    return 0;
 }
 
+static int stack_overflow_rec(int depth)
+{
+   volatile char buf[1024];
+
+   if (depth == 1000 * 1000)
+      return 0; /* 1 GB of stack: never reached */
+
+   buf[0] = (char)depth;
+   return stack_overflow_rec(depth + 1) + buf[0];
+}
+
+static void stack_overflow_child(void *unused)
+{
+   printf("unexpected: %d\n", stack_overflow_rec(0));
+}
+
+static void stack_growth_child(void *unused)
+{
+   /* Well below the initially mapped stack pages, but within the limit */
+   volatile char buf[USER_STACK_PAGES * 4096 / 2];
+
+   for (size_t i = 0; i < sizeof(buf); i += 4096)
+      buf[i] = 'x';
+
+   exit(buf[0] == 'x' ? 0 : 1);
+}
+
+/* brk() memory and the user stack get populated on the first access */
+int cmd_lazy_mem(int argc, char **argv)
+{
+   const size_t size = 64 * MB;
+   int fds[2], wstatus, rc;
+   char *orig_brk, *b;
+   pid_t child;
+
+   orig_brk = (void *)syscall(SYS_brk, 0);
+   b = (void *)syscall(SYS_brk, orig_brk + size);
+   DEVSHELL_CMD_ASSERT(b == orig_brk + size);
+
+   /* Reading the never-touched pages must return zeros */
+   for (size_t i = 0; i < size; i += 1 * MB)
+      DEVSHELL_CMD_ASSERT(orig_brk[i] == 0);
+
+   memset(orig_brk, 'a', 64 * KB);
+
+   /* The kernel writing on a never-touched page (fault-resumable path) */
+   rc = pipe(fds);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   rc = write(fds[1], "hello", 5);
+   DEVSHELL_CMD_ASSERT(rc == 5);
+   rc = read(fds[0], orig_brk + size - 4096, 5);
+   DEVSHELL_CMD_ASSERT(rc == 5);
+   DEVSHELL_CMD_ASSERT(!memcmp(orig_brk + size - 4096, "hello", 5));
+   close(fds[0]);
+   close(fds[1]);
+
+   /* Shrink and grow again: the pages must be zeroed again */
+   b = (void *)syscall(SYS_brk, orig_brk);
+   DEVSHELL_CMD_ASSERT(b == orig_brk);
+   b = (void *)syscall(SYS_brk, orig_brk + size);
+   DEVSHELL_CMD_ASSERT(b == orig_brk + size);
+   DEVSHELL_CMD_ASSERT(orig_brk[0] == 0);
+   DEVSHELL_CMD_ASSERT(orig_brk[size - 4096] == 0);
+
+   b = (void *)syscall(SYS_brk, orig_brk);
+   DEVSHELL_CMD_ASSERT(b == orig_brk);
+
+   /* The stack grows on-demand */
+   child = fork();
+   DEVSHELL_CMD_ASSERT(child >= 0);
+
+   if (!child)
+      stack_growth_child(NULL);
+
+   waitpid(child, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+
+   /* ... but not indefinitely */
+   rc = test_sig(stack_overflow_child, NULL, SIGSEGV, 0, 0);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   return 0;
+}
+
 int cmd_mmap(int argc, char **argv)
 {
    const int iters_count = 10;
@@ -125,6 +209,453 @@ int cmd_mmap(int argc, char **argv)
    return 0;
 }
 
+#ifndef MREMAP_MAYMOVE
+   #define MREMAP_MAYMOVE  1
+   #define MREMAP_FIXED    2
+#endif
+
+static void *sys_mremap(void *old, size_t old_len, size_t new_len, int flags)
+{
+   return (void *)syscall(SYS_mremap, old, old_len, new_len, flags, NULL);
+}
+
+static void *mmap_anon(size_t size, int prot)
+{
+   void *res = mmap(NULL, size, prot, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+   return res != MAP_FAILED ? res : NULL;
+}
+
+static bool check_pattern(const char *buf, size_t len, char c)
+{
+   for (size_t i = 0; i < len; i++) {
+      if (buf[i] != c)
+         return false;
+   }
+
+   return true;
+}
+
+int cmd_mremap(int argc, char **argv)
+{
+   char *a, *b, *r;
+   int wstatus, rc;
+   pid_t child;
+
+   a = mmap_anon(64 * KB, PROT_READ | PROT_WRITE);
+   b = mmap_anon(64 * KB, PROT_READ | PROT_WRITE);
+   DEVSHELL_CMD_ASSERT(a && b);
+
+   memset(a, 'a', 64 * KB);
+   memset(b, 'b', 64 * KB);
+
+   /* Without MREMAP_MAYMOVE, growing can only happen in place */
+   r = sys_mremap(a, 64 * KB, 128 * KB, 0);
+   DEVSHELL_CMD_ASSERT(r == a || (r == MAP_FAILED && errno == ENOMEM));
+
+   if (r == a) {
+      DEVSHELL_CMD_ASSERT(check_pattern(a + 64 * KB, 64 * KB, 0));
+      r = sys_mremap(a, 128 * KB, 64 * KB, 0);
+      DEVSHELL_CMD_ASSERT(r == a);
+   }
+
+   /* Grow, moving the mapping if needed */
+   r = sys_mremap(a, 64 * KB, 1 * MB, MREMAP_MAYMOVE);
+   DEVSHELL_CMD_ASSERT(r != MAP_FAILED);
+   DEVSHELL_CMD_ASSERT(check_pattern(r, 64 * KB, 'a'));
+   DEVSHELL_CMD_ASSERT(check_pattern(r + 64 * KB, 1 * MB - 64 * KB, 0));
+   DEVSHELL_CMD_ASSERT(check_pattern(b, 64 * KB, 'b'));
+
+   if (b == a + 64 * KB)
+      DEVSHELL_CMD_ASSERT(r != a); /* `b` was in the way: it had to move */
+
+   memset(r + 64 * KB, 'c', 1 * MB - 64 * KB);
+
+   /* The moved pages must be shared CoW with a child, like any other page */
+   child = fork();
+   DEVSHELL_CMD_ASSERT(child >= 0);
+
+   if (!child) {
+
+      char *r2 = sys_mremap(r, 1 * MB, 4 * MB, MREMAP_MAYMOVE);
+
+      if (r2 == MAP_FAILED)
+         exit(1);
+
+      if (!check_pattern(r2, 64 * KB, 'a'))
+         exit(2);
+
+      if (!check_pattern(r2 + 64 * KB, 1 * MB - 64 * KB, 'c'))
+         exit(3);
+
+      memset(r2, 'x', 4 * MB);
+      exit(0);
+   }
+
+   waitpid(child, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+   DEVSHELL_CMD_ASSERT(check_pattern(r, 64 * KB, 'a'));
+   DEVSHELL_CMD_ASSERT(check_pattern(r + 64 * KB, 1 * MB - 64 * KB, 'c'));
+
+   /* Shrink: always in place */
+   a = sys_mremap(r, 1 * MB, 32 * KB, 0);
+   DEVSHELL_CMD_ASSERT(a == r);
+   DEVSHELL_CMD_ASSERT(check_pattern(a, 32 * KB, 'a'));
+
+   /* Unsupported flags, bad addresses */
+   r = sys_mremap(a, 32 * KB, 64 * KB, MREMAP_FIXED);
+   DEVSHELL_CMD_ASSERT(r == MAP_FAILED && errno == EINVAL);
+
+   r = sys_mremap(a + 1, 4 * KB, 64 * KB, MREMAP_MAYMOVE);
+   DEVSHELL_CMD_ASSERT(r == MAP_FAILED && errno == EINVAL);
+
+   rc = munmap(a, 32 * KB);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = munmap(b, 64 * KB);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   r = sys_mremap(b, 64 * KB, 128 * KB, MREMAP_MAYMOVE);
+   DEVSHELL_CMD_ASSERT(r == MAP_FAILED && errno == EFAULT);
+   return 0;
+}
+
+/*
+ * Grow a buffer by doubling its size, like realloc() does, either with mremap()
+ * or with mmap() + memcpy() + munmap(). Only one byte per step is written.
+ */
+static ull_t realloc_doubling(size_t max_size, bool use_mremap, int *moves)
+{
+   size_t size = 64 * KB;
+   char *buf, *new_buf;
+   ull_t start, duration = 0;
+
+   *moves = 0;
+   buf = mmap_anon(size, PROT_READ | PROT_WRITE);
+
+   if (!buf)
+      return 0;
+
+   buf[0] = 1;
+
+   while (size < max_size) {
+
+      start = RDTSC();
+
+      if (use_mremap) {
+
+         new_buf = sys_mremap(buf, size, size * 2, MREMAP_MAYMOVE);
+
+         if (new_buf == MAP_FAILED)
+            new_buf = NULL;
+
+      } else {
+
+         if ((new_buf = mmap_anon(size * 2, PROT_READ | PROT_WRITE))) {
+            memcpy(new_buf, buf, size);
+            munmap(buf, size);
+         }
+      }
+
+      duration += RDTSC() - start;
+
+      if (!new_buf) {
+         printf("Unable to grow the buffer to %zu MB\n", size * 2 / MB);
+         munmap(buf, size);
+         return 0;
+      }
+
+      if (new_buf[0] != 1 || (size > 64 * KB && new_buf[size / 2] != 2)) {
+         printf("Lost data while growing the buffer to %zu KB\n",
+                size * 2 / KB);
+         munmap(new_buf, size * 2);
+         return 0;
+      }
+
+      *moves += (new_buf != buf);
+      buf = new_buf;
+      buf[size] = 2;
+      size *= 2;
+   }
+
+   munmap(buf, size);
+   return duration;
+}
+
+int cmd_mremap_perf(int argc, char **argv)
+{
+   const size_t copy_max = 16 * MB;
+   const size_t mremap_max = 256 * MB;
+   ull_t copy_c, mremap_c, mremap_big_c;
+   int moves;
+
+   copy_c = realloc_doubling(copy_max, false, &moves);
+   DEVSHELL_CMD_ASSERT(copy_c != 0);
+
+   mremap_c = realloc_doubling(copy_max, true, &moves);
+   DEVSHELL_CMD_ASSERT(mremap_c != 0);
+
+   mremap_big_c = realloc_doubling(mremap_max, true, &moves);
+   DEVSHELL_CMD_ASSERT(mremap_big_c != 0);
+
+   printf("realloc-doubling 64 KB -> %zu MB:\n", copy_max / MB);
+   printf("    mmap + memcpy + munmap: %llu K cycles\n", copy_c / 1000);
+   printf("    mremap:                 %llu K cycles\n", mremap_c / 1000);
+   printf("realloc-doubling 64 KB -> %zu MB with mremap: %llu K cycles, "
+          "%d moves\n", mremap_max / MB, mremap_big_c / 1000, moves);
+   return 0;
+}
+
+static void write_byte_child(void *arg)
+{
+   *(volatile char *)arg = 'w';
+}
+
+static void read_byte_child(void *arg)
+{
+   printf("read: %c [unexpected]\n", *(volatile char *)arg);
+}
+
+int cmd_mprotect(int argc, char **argv)
+{
+   const size_t pg = getpagesize();
+   int wstatus, rc;
+   pid_t child;
+   char *buf;
+
+   buf = mmap_anon(3 * pg, PROT_READ | PROT_WRITE);
+   DEVSHELL_CMD_ASSERT(buf != NULL);
+   memset(buf, 'a', 3 * pg);
+
+   /* Make the middle page read-only: the mapping has to be split */
+   rc = mprotect(buf + pg, pg, PROT_READ);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   DEVSHELL_CMD_ASSERT(check_pattern(buf + pg, pg, 'a'));
+
+   buf[0] = 'b';
+   buf[2 * pg] = 'b';
+   rc = test_sig(write_byte_child, buf + pg, SIGSEGV, 0, 0);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   /* PROT_NONE: not even reading is allowed */
+   rc = mprotect(buf + pg, pg, PROT_NONE);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   rc = test_sig(read_byte_child, buf + pg, SIGSEGV, 0, 0);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   /* Back to read-write, across the three mappings */
+   rc = mprotect(buf, 3 * pg, PROT_READ | PROT_WRITE);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   DEVSHELL_CMD_ASSERT(check_pattern(buf + pg, pg, 'a'));
+   buf[pg] = 'c';
+
+   /* A read-only page shared with a child must become a CoW page again */
+   rc = mprotect(buf, 3 * pg, PROT_READ);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   child = fork();
+   DEVSHELL_CMD_ASSERT(child >= 0);
+
+   if (!child) {
+      usleep(50 * 1000);
+      exit(buf[pg] == 'c' ? 0 : 1);
+   }
+
+   rc = mprotect(buf, 3 * pg, PROT_READ | PROT_WRITE);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   buf[pg] = 'd';
+
+   waitpid(child, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+
+   /* Errors */
+   rc = mprotect(buf + 1, pg, PROT_READ);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EINVAL);
+
+   rc = munmap(buf, 3 * pg);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = mprotect(buf, pg, PROT_READ);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == ENOMEM);
+
+   /* Guard pages, like the ones of thread stacks */
+   buf = mmap_anon(4 * pg, PROT_NONE);
+   DEVSHELL_CMD_ASSERT(buf != NULL);
+
+   rc = mprotect(buf + pg, 3 * pg, PROT_READ | PROT_WRITE);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   memset(buf + pg, 'g', 3 * pg);
+   rc = test_sig(write_byte_child, buf, SIGSEGV, 0, 0);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = munmap(buf, 4 * pg);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   return 0;
+}
+
+#ifndef MADV_FREE
+   #define MADV_FREE 8
+#endif
+
+int cmd_madvise(int argc, char **argv)
+{
+   const char *path = "/tmp/madvise_test";
+   const size_t pg = getpagesize();
+   char *buf, *fbuf, *orig_brk, *b;
+   int fd, rc;
+
+   buf = mmap_anon(16 * pg, PROT_READ | PROT_WRITE);
+   DEVSHELL_CMD_ASSERT(buf != NULL);
+   memset(buf, 'a', 16 * pg);
+
+   /* MADV_DONTNEED on private anonymous memory: the pages are zeroed */
+   rc = madvise(buf + 4 * pg, 4 * pg, MADV_DONTNEED);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   DEVSHELL_CMD_ASSERT(check_pattern(buf, 4 * pg, 'a'));
+   DEVSHELL_CMD_ASSERT(check_pattern(buf + 4 * pg, 4 * pg, 0));
+   DEVSHELL_CMD_ASSERT(check_pattern(buf + 8 * pg, 8 * pg, 'a'));
+   memset(buf + 4 * pg, 'b', pg);
+
+   /*
+    * MADV_FREE: the pages might be zeroed at any time, until they're written
+    * again. Written pages must keep their new content.
+    */
+   rc = madvise(buf + 8 * pg, 8 * pg, MADV_FREE);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   DEVSHELL_CMD_ASSERT(buf[8 * pg] == 'a' || buf[8 * pg] == 0);
+   memset(buf + 8 * pg, 'c', 8 * pg);
+   DEVSHELL_CMD_ASSERT(check_pattern(buf + 8 * pg, 8 * pg, 'c'));
+   DEVSHELL_CMD_ASSERT(check_pattern(buf + 4 * pg, pg, 'b'));
+
+   /* Read-only memory stays read-only after MADV_DONTNEED */
+   rc = mprotect(buf, 4 * pg, PROT_READ);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   rc = madvise(buf, 4 * pg, MADV_DONTNEED);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   DEVSHELL_CMD_ASSERT(check_pattern(buf, 4 * pg, 0));
+   rc = test_sig(write_byte_child, buf, SIGSEGV, 0, 0);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   /* Access pattern hints split the mapping, like mprotect() does */
+   rc = madvise(buf + pg, 2 * pg, MADV_SEQUENTIAL);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   rc = madvise(buf, 16 * pg, MADV_RANDOM);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   rc = madvise(buf, 16 * pg, MADV_WILLNEED);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   /* Errors */
+   rc = madvise(buf + 1, pg, MADV_DONTNEED);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EINVAL);
+
+   rc = munmap(buf, 16 * pg);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = madvise(buf, pg, MADV_DONTNEED);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == ENOMEM);
+
+   /* File mappings: MADV_DONTNEED just drops the pages, not the data */
+   fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+   DEVSHELL_CMD_ASSERT(fd >= 0);
+   rc = ftruncate(fd, (off_t)(8 * pg));
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   fbuf = mmap(NULL, 8 * pg, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   DEVSHELL_CMD_ASSERT(fbuf != MAP_FAILED);
+   memset(fbuf, 'f', 8 * pg);
+
+   rc = madvise(fbuf, 8 * pg, MADV_DONTNEED);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   DEVSHELL_CMD_ASSERT(check_pattern(fbuf, 8 * pg, 'f'));
+
+   rc = madvise(fbuf, 8 * pg, MADV_DONTNEED);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   rc = madvise(fbuf + 2 * pg, 4 * pg, MADV_WILLNEED);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   DEVSHELL_CMD_ASSERT(check_pattern(fbuf, 8 * pg, 'f'));
+
+   rc = madvise(fbuf, 8 * pg, MADV_SEQUENTIAL);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   rc = madvise(fbuf, 8 * pg, MADV_DONTNEED);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   DEVSHELL_CMD_ASSERT(check_pattern(fbuf, 8 * pg, 'f'));
+
+   /* MADV_FREE is valid only for private anonymous memory */
+   rc = madvise(fbuf, 8 * pg, MADV_FREE);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EINVAL);
+
+   rc = munmap(fbuf, 8 * pg);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   close(fd);
+   unlink(path);
+
+   /* brk() memory */
+   orig_brk = (void *)syscall(SYS_brk, 0);
+   b = (void *)syscall(SYS_brk, orig_brk + 64 * pg);
+   DEVSHELL_CMD_ASSERT(b == orig_brk + 64 * pg);
+
+   b = (char *)(((unsigned long)orig_brk + pg - 1) & ~(pg - 1));
+   memset(b, 'x', 32 * pg);
+   rc = madvise(b, 32 * pg, MADV_DONTNEED);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   DEVSHELL_CMD_ASSERT(check_pattern(b, 32 * pg, 0));
+
+   b = (void *)syscall(SYS_brk, orig_brk);
+   DEVSHELL_CMD_ASSERT(b == orig_brk);
+   return 0;
+}
+
+#ifndef MAP_FIXED_NOREPLACE
+   #define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+int cmd_mmap_fixed(int argc, char **argv)
+{
+   const size_t pg = getpagesize();
+   const int prot = PROT_READ | PROT_WRITE;
+   const int flags = MAP_ANONYMOUS | MAP_PRIVATE;
+   char *buf, *res;
+   int rc;
+
+   buf = mmap_anon(16 * pg, prot);
+   DEVSHELL_CMD_ASSERT(buf != NULL);
+   memset(buf, 'a', 16 * pg);
+
+   /* MAP_FIXED replaces the pages in the middle of an existing mapping */
+   res = mmap(buf + 4 * pg, 4 * pg, prot, flags | MAP_FIXED, -1, 0);
+   DEVSHELL_CMD_ASSERT(res == buf + 4 * pg);
+   DEVSHELL_CMD_ASSERT(check_pattern(buf, 4 * pg, 'a'));
+   DEVSHELL_CMD_ASSERT(check_pattern(buf + 4 * pg, 4 * pg, 0));
+   DEVSHELL_CMD_ASSERT(check_pattern(buf + 8 * pg, 8 * pg, 'a'));
+
+   /* MAP_FIXED_NOREPLACE fails on an overlap */
+   res = mmap(buf + 2 * pg, 4 * pg, prot, flags | MAP_FIXED_NOREPLACE, -1, 0);
+   DEVSHELL_CMD_ASSERT(res == MAP_FAILED && errno == EEXIST);
+   DEVSHELL_CMD_ASSERT(check_pattern(buf, 4 * pg, 'a'));
+
+   /* ... and succeeds on a free range */
+   rc = munmap(buf + 12 * pg, 4 * pg);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   res = mmap(buf + 12 * pg, 4 * pg, prot, flags | MAP_FIXED_NOREPLACE, -1, 0);
+   DEVSHELL_CMD_ASSERT(res == buf + 12 * pg);
+   DEVSHELL_CMD_ASSERT(check_pattern(res, 4 * pg, 0));
+
+   /* A hint pointing to a free range is honored */
+   rc = munmap(buf, 16 * pg);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   res = mmap(buf + 4 * pg, 4 * pg, prot, flags, -1, 0);
+   DEVSHELL_CMD_ASSERT(res == buf + 4 * pg);
+   rc = munmap(res, 4 * pg);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   /* Errors */
+   res = mmap(buf + 1, pg, prot, flags | MAP_FIXED, -1, 0);
+   DEVSHELL_CMD_ASSERT(res == MAP_FAILED && errno == EINVAL);
+   rc = munmap(buf + 1, pg);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EINVAL);
+   return 0;
+}
+
 static void no_munmap_bad_child(void)
 {
    const size_t alloc_size = 128 * KB;
@@ -391,3 +922,422 @@ int cmd_fork_oom(int argc, char **argv)
    free(buf);
    return rc;
 }
+
+/*
+ * Allocator-like stress: lots of mappings, all dirtied and then given back
+ * to the kernel with MADV_DONTNEED or MADV_FREE, without un-mapping them. The
+ * usable memory is measured before and after, as an estimate of the RSS.
+ */
+int cmd_madvise_rss(int argc, char **argv)
+{
+   const size_t chunk = 1 * MB;
+   size_t est, est_dirty, est_after, n;
+   char *chunks[256];
+   int rc;
+
+   if (!getenv("TILCK")) {
+      printf(PFX "[SKIP] because we're not running on Tilck\n");
+      return 0;
+   }
+
+   est = mm_estimate_usable_mem_int(1 * MB);
+   DEVSHELL_CMD_ASSERT(est != 0);
+
+   n = MIN(est / chunk / 2, (size_t)ARRAY_SIZE(chunks));
+   printf(PFX "Dirty %zu MB in %zu chunks\n", n * chunk / MB, n);
+
+   for (size_t i = 0; i < n; i++) {
+      chunks[i] = mmap_anon(chunk, PROT_READ | PROT_WRITE);
+      DEVSHELL_CMD_ASSERT(chunks[i] != NULL);
+      memset(chunks[i], 'a', chunk);
+   }
+
+   est_dirty = mm_estimate_usable_mem_int(1 * MB);
+
+   /* Half of the chunks released immediately, half lazily */
+   for (size_t i = 0; i < n; i++) {
+      rc = madvise(chunks[i], chunk, i % 2 ? MADV_FREE : MADV_DONTNEED);
+      DEVSHELL_CMD_ASSERT(rc == 0);
+   }
+
+   est_after = mm_estimate_usable_mem_int(1 * MB);
+
+   printf(PFX "Usable memory: %zu MB -> %zu MB (dirty) -> %zu MB (madvise)\n",
+          est / MB, est_dirty / MB, est_after / MB);
+
+   DEVSHELL_CMD_ASSERT(est_dirty + n * chunk / 2 <= est);
+   DEVSHELL_CMD_ASSERT(est_after >= est_dirty + n * chunk / 2);
+
+   /* The MADV_FREE chunks have been reclaimed, the other ones zeroed */
+   for (size_t i = 0; i < n; i++) {
+      DEVSHELL_CMD_ASSERT(chunks[i][0] == 0 || (i % 2 && chunks[i][0] == 'a'));
+      rc = munmap(chunks[i], chunk);
+      DEVSHELL_CMD_ASSERT(rc == 0);
+   }
+
+   return 0;
+}
+
+/*
+ * Big anonymous mappings, backed by 4 MB pages on Tilck: the content must
+ * survive fork + CoW and the partial munmap() and mprotect() calls that force
+ * the kernel to split the big pages.
+ */
+int cmd_big_pages(int argc, char **argv)
+{
+   const size_t pg = getpagesize();
+   const size_t sz = 12 * MB;
+   int wstatus, rc;
+   pid_t child;
+   char *buf;
+
+   buf = mmap_anon(sz, PROT_READ | PROT_WRITE);
+   DEVSHELL_CMD_ASSERT(buf != NULL);
+
+   for (size_t i = 0; i < sz; i += pg)
+      buf[i] = (char)(i / pg);
+
+   child = fork();
+   DEVSHELL_CMD_ASSERT(child >= 0);
+
+   if (!child) {
+
+      /* Our writes must not be visible to the parent and vice versa */
+      for (size_t i = 0; i < sz; i += pg) {
+
+         if (buf[i] != (char)(i / pg))
+            exit(1);
+
+         buf[i] = 'c';
+      }
+
+      exit(0);
+   }
+
+   buf[4 * MB] = 'p';
+   waitpid(child, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+
+   DEVSHELL_CMD_ASSERT(buf[4 * MB] == 'p');
+   buf[4 * MB] = (char)(4 * MB / pg);
+
+   for (size_t i = 0; i < sz; i += pg)
+      DEVSHELL_CMD_ASSERT(buf[i] == (char)(i / pg));
+
+   /* Punch a hole in the middle of a (possibly) big page */
+   rc = munmap(buf + 5 * MB, pg);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = test_sig(read_byte_child, buf + 5 * MB, SIGSEGV, 0, 0);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   /* Make a single page read-only in another one */
+   rc = mprotect(buf + 9 * MB, pg, PROT_READ);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = test_sig(write_byte_child, buf + 9 * MB, SIGSEGV, 0, 0);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   for (size_t i = 0; i < sz; i += pg) {
+      if (i != 5 * MB)
+         DEVSHELL_CMD_ASSERT(buf[i] == (char)(i / pg));
+   }
+
+   rc = munmap(buf, sz);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   return 0;
+}
+
+static ull_t
+random_reads(const char *buf, size_t sz, unsigned count, unsigned *sum)
+{
+   ull_t seed = 1234, start = RDTSC();
+   unsigned s = 0;
+
+   for (unsigned i = 0; i < count; i++) {
+      seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+      s += (unsigned char)buf[(seed >> 32) % sz];
+   }
+
+   *sum = s;
+   return RDTSC() - start;
+}
+
+/*
+ * Random reads over a big array, first backed by 4 MB pages, then by 4 KB
+ * pages. To get the same physical memory in both cases, the big pages are
+ * split by changing the protection of a single page in each one of them.
+ */
+int cmd_big_pages_perf(int argc, char **argv)
+{
+   const size_t pg = getpagesize();
+   const unsigned count = 4 * 1000 * 1000;
+   ull_t big_c, small_c;
+   size_t sz, est = 512 * MB;
+   unsigned sum1, sum2;
+   char *buf;
+   int rc;
+
+   if (getenv("TILCK")) {
+      est = mm_estimate_usable_mem_int(4 * MB);
+      DEVSHELL_CMD_ASSERT(est != 0);
+   }
+
+   sz = MIN(512 * MB, est / 2) & ~(4 * MB - 1);
+   DEVSHELL_CMD_ASSERT(sz != 0);
+
+   buf = mmap(NULL, sz, PROT_READ | PROT_WRITE,
+              MAP_ANONYMOUS | MAP_PRIVATE | MAP_POPULATE, -1, 0);
+   DEVSHELL_CMD_ASSERT(buf != MAP_FAILED);
+
+   for (size_t i = 0; i < sz; i += pg)
+      buf[i] = (char)i;
+
+   big_c = random_reads(buf, sz, count, &sum1);
+
+   for (size_t i = 0; i < sz; i += 4 * MB) {
+
+      rc = mprotect(buf + i, pg, PROT_READ);
+      DEVSHELL_CMD_ASSERT(rc == 0);
+
+      rc = mprotect(buf + i, pg, PROT_READ | PROT_WRITE);
+      DEVSHELL_CMD_ASSERT(rc == 0);
+   }
+
+   small_c = random_reads(buf, sz, count, &sum2);
+   DEVSHELL_CMD_ASSERT(sum1 == sum2);
+
+   printf("%u random reads over %zu MB:\n", count, sz / MB);
+   printf("    4 MB pages: %llu K cycles\n", big_c / 1000);
+   printf("    4 KB pages: %llu K cycles\n", small_c / 1000);
+
+   rc = munmap(buf, sz);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   return 0;
+}
+
+static bool write_chunk(int fd, const char *buf, size_t len)
+{
+   ssize_t rc;
+
+   for (size_t tot = 0; tot < len; tot += (size_t)rc) {
+      if ((rc = write(fd, buf + tot, len - tot)) <= 0)
+         return false;
+   }
+
+   return true;
+}
+
+/*
+ * Fill /tmp (ramfs) with more data than the free highmem: the file blocks go
+ * in highmem first and then in the linear mapping. Without highmem, just
+ * 16 MB are written. Meant to run also in a VM with more RAM than the linear
+ * mapping, like:
+ *
+ *    TILCK_VM_MEM=3072 ./tests/runners/single_test_run highmem
+ */
+int cmd_highmem(int argc, char **argv)
+{
+   const size_t chunk = 1 * MB;
+   long total, free_before, free_full, free_after;
+   size_t target, n, i;
+   char path[64];
+   char *buf;
+   int fd, rc;
+
+   if (!getenv("TILCK")) {
+      printf(PFX "[SKIP] because we're not running on Tilck\n");
+      return 0;
+   }
+
+   buf = malloc(chunk);
+   DEVSHELL_CMD_ASSERT(buf != NULL);
+   memset(buf, 0, chunk);
+
+   total = read_syst_prop("vm", "highmem_total_pages");
+   free_before = read_syst_prop("vm", "highmem_free_pages");
+   target = 16 * MB;
+
+   if (total > 0)
+      target += (size_t)free_before * getpagesize();
+
+   printf(PFX "Highmem: %ld pages, %ld free\n", total, free_before);
+   printf(PFX "Write %zu MB in /tmp\n", target / MB);
+
+   for (n = 0; n * chunk < target; n++) {
+
+      sprintf(path, "/tmp/highmem_%zu", n);
+      fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+      DEVSHELL_CMD_ASSERT(fd >= 0);
+
+      memset(buf, 'a' + (int)(n % 26), chunk);
+
+      if (!write_chunk(fd, buf, chunk)) {
+
+         /* Out of memory before the target: acceptable, but stop here */
+         printf(PFX "Stop writing after %zu MB: %s\n", n, strerror(errno));
+         close(fd);
+         unlink(path);
+         break;
+      }
+
+      close(fd);
+   }
+
+   free_full = read_syst_prop("vm", "highmem_free_pages");
+
+   if (total > 0) {
+      printf(PFX "Highmem free pages after filling /tmp: %ld\n", free_full);
+      DEVSHELL_CMD_ASSERT(free_full < free_before);
+   }
+
+   for (i = 0; i < n; i++) {
+
+      sprintf(path, "/tmp/highmem_%zu", i);
+      fd = open(path, O_RDONLY);
+      DEVSHELL_CMD_ASSERT(fd >= 0);
+
+      for (size_t tot = 0; tot < chunk; tot += (size_t)rc) {
+         rc = read(fd, buf + tot, chunk - tot);
+         DEVSHELL_CMD_ASSERT(rc > 0);
+      }
+
+      close(fd);
+      DEVSHELL_CMD_ASSERT(check_pattern(buf, chunk, 'a' + (int)(i % 26)));
+
+      rc = unlink(path);
+      DEVSHELL_CMD_ASSERT(rc == 0);
+   }
+
+   free(buf);
+   free_after = read_syst_prop("vm", "highmem_free_pages");
+
+   /* All the file blocks in highmem must have been freed */
+   if (total > 0)
+      DEVSHELL_CMD_ASSERT(free_after >= free_before - 16);
+
+   return 0;
+}
+
+/*
+ * Map and fill twice the usable memory with compressible data, forcing the
+ * kernel to swap out the pages to zram, then check all of them.
+ */
+int cmd_zram(int argc, char **argv)
+{
+   const size_t pg = getpagesize();
+   size_t est, sz, n;
+   long stored, stored_after;
+   char *buf;
+   int rc;
+
+   if (!getenv("TILCK")) {
+      printf(PFX "[SKIP] because we're not running on Tilck\n");
+      return 0;
+   }
+
+   if (!write_syst_prop("zram", "enabled", "0")) {
+      printf(PFX "[SKIP] because the zram module is not available\n");
+      return 0;
+   }
+
+   est = mm_estimate_usable_mem_int(1 * MB);
+   DEVSHELL_CMD_ASSERT(est != 0);
+
+   sz = 2 * est;
+   n = sz / pg;
+   DEVSHELL_CMD_ASSERT(write_syst_prop("zram", "enabled", "1"));
+
+   printf(PFX "Usable memory: %zu MB, fill %zu MB\n", est / MB, sz / MB);
+   buf = mmap_anon(sz, PROT_READ | PROT_WRITE);
+   DEVSHELL_CMD_ASSERT(buf != NULL);
+
+   for (size_t i = 0; i < n; i++) {
+      memset(buf + i * pg, 'a' + (int)(i % 26), pg);
+      memcpy(buf + i * pg, &i, sizeof(i));
+   }
+
+   for (size_t i = 0; i < n; i++) {
+
+      size_t val;
+      memcpy(&val, buf + i * pg, sizeof(val));
+
+      DEVSHELL_CMD_ASSERT(val == i);
+      DEVSHELL_CMD_ASSERT(check_pattern(buf + i * pg + sizeof(val),
+                                        pg - sizeof(val),
+                                        'a' + (int)(i % 26)));
+   }
+
+   stored = read_syst_prop("zram", "stored_pages");
+
+   printf(PFX "Stored pages:   %ld\n", stored);
+   printf(PFX "Pool pages:     %ld\n", read_syst_prop("zram", "pool_pages"));
+   printf(PFX "Compr. ratio:   %ld%%\n", read_syst_prop("zram", "compr_ratio"));
+   printf(PFX "Swap outs:      %ld\n", read_syst_prop("zram", "swap_outs"));
+   printf(PFX "Swap ins:       %ld\n", read_syst_prop("zram", "swap_ins"));
+   printf(PFX "Swap-in cycles: %ld avg, %ld max\n",
+          read_syst_prop("zram", "swapin_avg_cycles"),
+          read_syst_prop("zram", "swapin_max_cycles"));
+
+   DEVSHELL_CMD_ASSERT(stored > 0);
+   DEVSHELL_CMD_ASSERT(read_syst_prop("zram", "swap_ins") > 0);
+
+   rc = munmap(buf, sz);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   /* The slots of the unmapped pages must have been released */
+   stored_after = read_syst_prop("zram", "stored_pages");
+   DEVSHELL_CMD_ASSERT(stored_after < stored);
+
+   DEVSHELL_CMD_ASSERT(write_syst_prop("zram", "enabled", "0"));
+   return 0;
+}
+
+int cmd_reclaim(int argc, char **argv)
+{
+   long free_kb, low, high, bg;
+   char val[32];
+   int child, wstatus;
+
+   if (!getenv("TILCK")) {
+      printf(PFX "[SKIP] because we're not running on Tilck\n");
+      return 0;
+   }
+
+   free_kb = read_syst_prop("reclaim", "free_kb");
+   low = read_syst_prop("reclaim", "wmark_low_kb");
+   high = read_syst_prop("reclaim", "wmark_high_kb");
+   bg = read_syst_prop("reclaim", "bg_reclaims");
+
+   printf(PFX "Free: %ld KB, watermarks: %ld KB, %ld KB\n", free_kb, low, high);
+   DEVSHELL_CMD_ASSERT(free_kb > 0);
+   DEVSHELL_CMD_ASSERT(low > 0 && high >= low);
+   DEVSHELL_CMD_ASSERT(read_syst_prop("reclaim/lazyfree", "calls") >= 0);
+   DEVSHELL_CMD_ASSERT(read_syst_prop("reclaim/swap", "calls") >= 0);
+   DEVSHELL_CMD_ASSERT(read_syst_prop("reclaim/ramfs", "calls") >= 0);
+
+   /* Put the low watermark above the free memory: fork() must trigger it */
+   sprintf(val, "%ld", free_kb + 1024);
+   DEVSHELL_CMD_ASSERT(write_syst_prop("reclaim", "wmark_low_kb", val));
+   DEVSHELL_CMD_ASSERT(read_syst_prop("reclaim", "wmark_high_kb") >= free_kb);
+
+   if (!(child = fork()))
+      exit(0);
+
+   DEVSHELL_CMD_ASSERT(child > 0);
+   waitpid(child, &wstatus, 0);
+   usleep(100 * 1000);
+
+   sprintf(val, "%ld", low);
+   DEVSHELL_CMD_ASSERT(write_syst_prop("reclaim", "wmark_low_kb", val));
+   sprintf(val, "%ld", high);
+   DEVSHELL_CMD_ASSERT(write_syst_prop("reclaim", "wmark_high_kb", val));
+
+   printf(PFX "Background reclaims: %ld\n",
+          read_syst_prop("reclaim", "bg_reclaims"));
+   printf(PFX "ramfs shrinker: %ld bytes\n",
+          read_syst_prop("reclaim/ramfs", "reclaimed_bytes"));
+
+   DEVSHELL_CMD_ASSERT(read_syst_prop("reclaim", "bg_reclaims") > bg);
+   return 0;
+}
@@ -1,5 +1,6 @@
 /* SPDX-License-Identifier: BSD-2-Clause */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
@@ -10,6 +11,8 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
 
 #include "devshell.h"
 #include "test_common.h"
@@ -388,10 +391,8 @@ pipe_random_test(int readers, int writers)
       return 1;
    }
 
-   if (!getenv("TILCK")) {
-      fcntl(pipefd[0], F_SETPIPE_SZ, 4096);
-      fcntl(pipefd[1], F_SETPIPE_SZ, 4096);
-   }
+   rc = fcntl(pipefd[0], F_SETPIPE_SZ, 4096);
+   DEVSHELL_CMD_ASSERT(rc == 4096);
 
    for (int i = 0; i < writers; i++) {
 
@@ -469,3 +470,247 @@ int cmd_pipe5(int argc, char **argv)
 
    return 0;
 }
+
+/* Test F_SETPIPE_SZ, F_GETPIPE_SZ and vmsplice() */
+int cmd_pipe6(int argc, char **argv)
+{
+   const size_t pg_count = 4;
+   const size_t pg_size = (size_t)getpagesize();
+   char buf[64];
+   struct iovec iov;
+   int pipefd[2];
+   char *mem;
+   int rc;
+
+   rc = pipe(pipefd);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = fcntl(pipefd[0], F_GETPIPE_SZ);
+   printf("Default pipe size: %d\n", rc);
+   DEVSHELL_CMD_ASSERT(rc > 0);
+
+   printf("Set the pipe size to 3 pages, expecting it rounded up\n");
+   rc = fcntl(pipefd[1], F_SETPIPE_SZ, 3 * pg_size);
+   DEVSHELL_CMD_ASSERT(rc == (int)(4 * pg_size));
+   rc = fcntl(pipefd[0], F_GETPIPE_SZ);
+   DEVSHELL_CMD_ASSERT(rc == (int)(4 * pg_size));
+
+   printf("F_SETPIPE_SZ on a non-pipe must fail with EBADF\n");
+   rc = fcntl(0, F_SETPIPE_SZ, pg_size);
+   DEVSHELL_CMD_ASSERT(rc == -1 && errno == EBADF);
+
+   mem = mmap(NULL,
+              pg_count * pg_size,
+              PROT_READ | PROT_WRITE,
+              MAP_ANONYMOUS | MAP_PRIVATE,
+              -1, 0);
+
+   DEVSHELL_CMD_ASSERT(mem != (void *)-1);
+
+   for (size_t i = 0; i < pg_count; i++)
+      sprintf(mem + i * pg_size, "page %u", (unsigned)i);
+
+   printf("vmsplice() %u pages with SPLICE_F_GIFT\n", (unsigned)pg_count);
+   iov.iov_base = mem;
+   iov.iov_len = pg_count * pg_size;
+   rc = vmsplice(pipefd[1], &iov, 1, SPLICE_F_GIFT);
+   DEVSHELL_CMD_ASSERT(rc == (int)(pg_count * pg_size));
+
+   printf("Pipe full: shrinking it below its content must fail\n");
+   rc = fcntl(pipefd[0], F_SETPIPE_SZ, pg_size);
+   DEVSHELL_CMD_ASSERT(rc == -1 && errno == EBUSY);
+
+   printf("Overwrite the gifted pages: the pipe must not see that\n");
+
+   for (size_t i = 0; i < pg_count; i++)
+      strcpy(mem + i * pg_size, "overwritten");
+
+   for (size_t i = 0; i < pg_count; i++) {
+
+      char expected[32];
+      sprintf(expected, "page %u", (unsigned)i);
+
+      rc = read(pipefd[0], buf, strlen(expected) + 1);
+      DEVSHELL_CMD_ASSERT(rc == (int)strlen(expected) + 1);
+      DEVSHELL_CMD_ASSERT(!strcmp(buf, expected));
+
+      for (size_t tot = rc; tot < pg_size; tot += (size_t)rc) {
+         rc = read(pipefd[0], buf, MIN(sizeof(buf), pg_size - tot));
+         DEVSHELL_CMD_ASSERT(rc > 0);
+      }
+   }
+
+   printf("vmsplice() with unaligned data (plain copy)\n");
+   iov.iov_base = mem + 3;
+   iov.iov_len = 8;
+   rc = vmsplice(pipefd[1], &iov, 1, SPLICE_F_GIFT);
+   DEVSHELL_CMD_ASSERT(rc == 8);
+   rc = read(pipefd[0], buf, sizeof(buf));
+   DEVSHELL_CMD_ASSERT(rc == 8);
+   DEVSHELL_CMD_ASSERT(!memcmp(buf, mem + 3, 8));
+
+   printf("vmsplice() on the read side must fail with EBADF\n");
+   rc = vmsplice(pipefd[0], &iov, 1, 0);
+   DEVSHELL_CMD_ASSERT(rc == -1 && errno == EBADF);
+
+   rc = munmap(mem, pg_count * pg_size);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   close(pipefd[0]);
+   close(pipefd[1]);
+   return 0;
+}
+
+static void
+pipe_perf_writer(int wfd, char *buf, size_t bs, size_t tot, bool gift)
+{
+   struct iovec iov = { .iov_base = buf, .iov_len = bs };
+   size_t written = 0;
+   int rc;
+
+   while (written < tot) {
+
+      if (gift) {
+
+         iov.iov_base = buf + (written % bs);
+         iov.iov_len = bs - (written % bs);
+         rc = vmsplice(wfd, &iov, 1, SPLICE_F_GIFT);
+
+      } else {
+
+         rc = write(wfd, buf + (written % bs), bs - (written % bs));
+      }
+
+      if (rc <= 0) {
+         printf(STR_CHILD "write failed: %s\n", strerror(errno));
+         exit(1);
+      }
+
+      written += (size_t)rc;
+   }
+
+   exit(0);
+}
+
+static int pipe_perf_run(size_t bs, bool gift)
+{
+   const size_t tot = 32 * MB;
+   size_t tot_read = 0;
+   int pipefd[2];
+   int rc, wstatus;
+   ull_t start, duration;
+   pid_t childpid;
+   char *buf;
+
+   buf = mmap(NULL, bs, PROT_READ | PROT_WRITE,
+              MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+   DEVSHELL_CMD_ASSERT(buf != (void *)-1);
+   memset(buf, 'a', bs);
+
+   rc = pipe(pipefd);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = fcntl(pipefd[1], F_SETPIPE_SZ, bs);
+   DEVSHELL_CMD_ASSERT(rc >= (int)bs);
+
+   start = RDTSC();
+   childpid = fork();
+   DEVSHELL_CMD_ASSERT(childpid >= 0);
+
+   if (!childpid) {
+      close(pipefd[0]);
+      pipe_perf_writer(pipefd[1], buf, bs, tot, gift);
+   }
+
+   close(pipefd[1]);
+
+   while ((rc = read(pipefd[0], buf, bs)) > 0)
+      tot_read += (size_t)rc;
+
+   duration = RDTSC() - start;
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = waitpid(childpid, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(rc == childpid);
+   DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+   DEVSHELL_CMD_ASSERT(tot_read == tot);
+
+   printf("bs: %4u KB%s -> %6llu cycles/KB\n",
+          (unsigned)(bs / KB), gift ? " (vmsplice)" : "           ",
+          duration / (tot / KB));
+
+   close(pipefd[0]);
+   munmap(buf, bs);
+   return 0;
+}
+
+/*
+ * Pipe throughput, like `dd bs=N | dd bs=N` with a pipe of N bytes, for
+ * N = 4 KB and N = 1 MB. With 1 MB, also try vmsplice() with SPLICE_F_GIFT.
+ */
+int cmd_pipe_perf(int argc, char **argv)
+{
+   pipe_perf_run(4 * KB, false);
+   pipe_perf_run(1 * MB, false);
+   pipe_perf_run(1 * MB, true);
+   return 0;
+}
+
+/*
+ * Ping-pong latency between two processes over a pair of pipes: each round
+ * trip is made of two 1-byte transfers where the other side is (typically)
+ * already blocked in read(), waiting for data.
+ */
+int cmd_pipe_lat(int argc, char **argv)
+{
+   const int iters = 20000;
+   int p2c[2], c2p[2];
+   int rc, wstatus;
+   ull_t start, duration;
+   pid_t childpid;
+   char c = 'x';
+
+   rc = pipe(p2c);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   rc = pipe(c2p);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   childpid = fork();
+   DEVSHELL_CMD_ASSERT(childpid >= 0);
+
+   if (!childpid) {
+
+      close(p2c[1]);
+      close(c2p[0]);
+
+      while ((rc = read(p2c[0], &c, 1)) == 1) {
+         if (write(c2p[1], &c, 1) != 1)
+            exit(1);
+      }
+
+      exit(rc == 0 ? 0 : 1);
+   }
+
+   close(p2c[0]);
+   close(c2p[1]);
+   start = RDTSC();
+
+   for (int i = 0; i < iters; i++) {
+
+      rc = write(p2c[1], &c, 1);
+      DEVSHELL_CMD_ASSERT(rc == 1);
+
+      rc = read(c2p[0], &c, 1);
+      DEVSHELL_CMD_ASSERT(rc == 1);
+   }
+
+   duration = RDTSC() - start;
+   close(p2c[1]);
+
+   rc = waitpid(childpid, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(rc == childpid);
+   DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+   close(c2p[0]);
+
+   printf("Avg. round trip: %llu cycles\n", duration / iters);
+   return 0;
+}
@@ -0,0 +1,193 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+
+#include "devshell.h"
+#include "test_common.h"
+
+#ifndef MFD_CLOEXEC
+   #define MFD_CLOEXEC 0x0001U
+#endif
+
+static int sys_memfd_create(const char *name, unsigned flags)
+{
+   return (int)syscall(SYS_memfd_create, name, flags);
+}
+
+/*
+ * Check that the child's writes on the shared buffer are visible to the
+ * parent after waitpid(): that's the whole point of MAP_SHARED.
+ */
+static void shm_check_fork_sharing(char *buf, size_t size)
+{
+   int wstatus;
+   pid_t child;
+
+   memset(buf, 'p', size);
+   child = fork();
+   DEVSHELL_CMD_ASSERT(child >= 0);
+
+   if (!child) {
+
+      for (size_t i = 0; i < size; i++) {
+         if (buf[i] != 'p')
+            exit(1);
+      }
+
+      memset(buf, 'c', size);
+      exit(0);
+   }
+
+   waitpid(child, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+
+   for (size_t i = 0; i < size; i++)
+      DEVSHELL_CMD_ASSERT(buf[i] == 'c');
+}
+
+/* MAP_SHARED | MAP_ANONYMOUS memory survives fork() as shared */
+int cmd_shm1(int argc, char **argv)
+{
+   const size_t size = 64 * KB;
+   char *buf;
+   int rc;
+
+   buf = mmap(NULL, size,
+              PROT_READ | PROT_WRITE,
+              MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+   DEVSHELL_CMD_ASSERT(buf != MAP_FAILED);
+   shm_check_fork_sharing(buf, size);
+
+   /* Partial un-map in the middle: both the remaining parts must still work */
+   rc = munmap(buf + 16 * KB, 16 * KB);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   shm_check_fork_sharing(buf, 16 * KB);
+   shm_check_fork_sharing(buf + 32 * KB, 32 * KB);
+
+   rc = munmap(buf, 16 * KB);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = munmap(buf + 32 * KB, 32 * KB);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   return 0;
+}
+
+/* memfd_create(): read/write, mmap and mappings surviving close() */
+int cmd_shm2(int argc, char **argv)
+{
+   const size_t size = 128 * KB;
+   char rbuf[16];
+   struct stat statbuf;
+   char *buf;
+   int fd, rc;
+
+   fd = sys_memfd_create("shm2", MFD_CLOEXEC);
+   DEVSHELL_CMD_ASSERT(fd >= 0);
+   DEVSHELL_CMD_ASSERT(fcntl(fd, F_GETFD) & FD_CLOEXEC);
+
+   rc = ftruncate(fd, (off_t)size);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = fstat(fd, &statbuf);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   DEVSHELL_CMD_ASSERT(statbuf.st_size == (off_t)size);
+
+   rc = pwrite(fd, "hello", 5, 4096);
+   DEVSHELL_CMD_ASSERT(rc == 5);
+
+   buf = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   DEVSHELL_CMD_ASSERT(buf != MAP_FAILED);
+   DEVSHELL_CMD_ASSERT(!memcmp(buf + 4096, "hello", 5));
+
+   /* Writes through the mapping are visible through the fd */
+   memcpy(buf + 8192, "world", 5);
+   rc = pread(fd, rbuf, 5, 8192);
+   DEVSHELL_CMD_ASSERT(rc == 5);
+   DEVSHELL_CMD_ASSERT(!memcmp(rbuf, "world", 5));
+
+   /* The mapping must survive close(), like on Linux */
+   close(fd);
+   shm_check_fork_sharing(buf, size);
+
+   rc = munmap(buf, size);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   /* Unsupported flags */
+   rc = sys_memfd_create("x", 0x100);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EINVAL);
+   return 0;
+}
+
+/* /dev/shm: create, list, map and unlink while mapped */
+int cmd_shm3(int argc, char **argv)
+{
+   const char *path = "/dev/shm/shm3_test";
+   const size_t size = 32 * KB;
+   struct dirent *de;
+   bool found = false;
+   char *buf, *buf2;
+   DIR *d;
+   int fd, fd2, rc;
+
+   fd = open(path, O_CREAT | O_EXCL | O_RDWR, 0644);
+   DEVSHELL_CMD_ASSERT(fd >= 0);
+
+   rc = ftruncate(fd, (off_t)size);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   d = opendir("/dev/shm");
+   DEVSHELL_CMD_ASSERT(d != NULL);
+
+   while ((de = readdir(d))) {
+      if (!strcmp(de->d_name, "shm3_test"))
+         found = true;
+   }
+
+   closedir(d);
+   DEVSHELL_CMD_ASSERT(found);
+
+   buf = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   DEVSHELL_CMD_ASSERT(buf != MAP_FAILED);
+
+   /* A second, independent, open + mmap shares the same pages */
+   fd2 = open(path, O_RDONLY);
+   DEVSHELL_CMD_ASSERT(fd2 >= 0);
+
+   buf2 = mmap(NULL, size, PROT_READ, MAP_SHARED, fd2, 0);
+   DEVSHELL_CMD_ASSERT(buf2 != MAP_FAILED);
+
+   strcpy(buf + 1000, "shared!");
+   DEVSHELL_CMD_ASSERT(!strcmp(buf2 + 1000, "shared!"));
+
+   close(fd);
+   close(fd2);
+
+   /* Unlink while mapped: the pages must stay alive until munmap() */
+   rc = unlink(path);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   DEVSHELL_CMD_ASSERT(open(path, O_RDONLY) < 0 && errno == ENOENT);
+
+   shm_check_fork_sharing(buf, size);
+   DEVSHELL_CMD_ASSERT(buf2[0] == 'c');
+
+   rc = munmap(buf, size);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = munmap(buf2, size);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   return 0;
+}
@@ -113,6 +113,8 @@ void switch_to_task() { }
 void pdir_clone() { }
 void pdir_deep_clone() { }
 void pdir_destroy() { }
+size_t get_user_rss_pages() { return 0; }
+size_t stackwalk32() { return 0; }
 void set_curr_pdir() { }
 void set_current_task_in_user_mode() { }
 void arch_specific_new_task_setup() { NOT_REACHED(); }
@@ -122,6 +124,15 @@ void arch_specific_free_proc() { NOT_REACHED(); }
 void fpu_context_begin() { }
 void fpu_context_end() { }
 void map_zero_pages() { NOT_REACHED(); }
+void map_zero_page() { NOT_REACHED(); }
+void set_pages_prot() { NOT_REACHED(); }
+void swap_pages_mappings() { NOT_REACHED(); }
+void mark_pages_lazyfree() { NOT_REACHED(); }
+void reclaim_lazyfree_pages() { NOT_REACHED(); }
+void map_big_user_page() { NOT_REACHED(); }
+void split_big_user_pages() { NOT_REACHED(); }
+void swap_out_pages() { NOT_REACHED(); }
+void swap_in_pages() { NOT_REACHED(); }
 void dump_var_mtrrs() { }
 void set_page_rw() { }
 void poweroff() { NOT_REACHED(); }
@@ -129,6 +140,8 @@ int get_irq_num(void *ctx) { return -1; }
 int get_int_num(void *ctx) { return -1; }
 void retain_pageframes_mapped_at() { }
 void release_pageframes_mapped_at() { }
+int retain_user_page_cow() { return -1; }
+int get_mapping2() { return -1; }
 bool irq_is_masked() { NOT_REACHED(); return false; }
 
 void *hi_vmem_reserve(size_t size) { return NULL; }
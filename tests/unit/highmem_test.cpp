@@ -0,0 +1,88 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <set>
+#include <random>
+#include <vector>
+#include <algorithm>
+
+#include <gtest/gtest.h>
+#include "kernel_init_funcs.h"
+
+extern "C" {
+   #include <tilck_gen_headers/config_mm.h>
+   #include <tilck/common/basic_defs.h>
+   #include <tilck/kernel/system_mmap.h>
+   #include <tilck/kernel/highmem.h>
+
+   extern struct mem_region mem_regions[MAX_MEM_REGIONS];
+   extern int mem_regions_count;
+}
+
+using namespace std;
+
+TEST(highmem, alloc_and_free)
+{
+   const ulong lm = LINEAR_MAPPING_SIZE;
+   struct mem_region saved[3];
+   int saved_count;
+   vector<ulong> pages;
+   set<ulong> unique;
+   mt19937 e(1234);
+
+   if (!KERNEL_HIGHMEM)
+      GTEST_SKIP();
+
+   init_kmalloc_for_tests();
+   memcpy(saved, mem_regions, sizeof(saved));
+   saved_count = mem_regions_count;
+
+   /*
+    * A usable region crossing the end of the linear mapping and another one
+    * after a reserved hole: just their 8 + 16 MB above it count as highmem.
+    */
+   mem_regions[0] = { lm - 4 * MB, 12 * MB, MULTIBOOT_MEMORY_AVAILABLE, 0 };
+   mem_regions[1] = { lm + 8 * MB, 4 * MB, MULTIBOOT_MEMORY_RESERVED, 0 };
+   mem_regions[2] = { lm + 12 * MB, 16 * MB, MULTIBOOT_MEMORY_AVAILABLE, 0 };
+   mem_regions_count = 3;
+
+   init_highmem();
+
+   EXPECT_EQ(get_highmem_end(), lm + 28 * MB);
+   EXPECT_EQ(highmem_total_pages, (24 * MB) >> PAGE_SHIFT);
+   EXPECT_EQ(highmem_free_pages, highmem_total_pages);
+
+   for (ulong pa; (pa = highmem_alloc_page()) != INVALID_PADDR; ) {
+
+      ASSERT_TRUE(is_highmem_paddr(pa));
+      ASSERT_TRUE(IS_PAGE_ALIGNED(pa));
+      ASSERT_FALSE(IN_RANGE(pa, lm + 8 * MB, lm + 12 * MB));
+      ASSERT_TRUE(unique.insert(pa).second);
+      pages.push_back(pa);
+   }
+
+   EXPECT_EQ(pages.size(), highmem_total_pages);
+   EXPECT_EQ(highmem_free_pages, 0u);
+
+   /* Free half of the pages in random order and get them back */
+   shuffle(pages.begin(), pages.end(), e);
+
+   for (size_t i = 0; i < pages.size() / 2; i++)
+      highmem_free_page(pages[i]);
+
+   for (size_t i = 0; i < pages.size() / 2; i++) {
+      ulong pa = highmem_alloc_page();
+      ASSERT_NE(pa, INVALID_PADDR);
+      ASSERT_EQ(unique.count(pa), 1u);
+      pages[i] = pa;
+   }
+
+   EXPECT_EQ(highmem_alloc_page(), INVALID_PADDR);
+
+   for (ulong pa : pages)
+      highmem_free_page(pa);
+
+   EXPECT_EQ(highmem_free_pages, highmem_total_pages);
+
+   memcpy(mem_regions, saved, sizeof(saved));
+   mem_regions_count = saved_count;
+}
@@ -149,6 +149,33 @@ ulong get_mapping(pdir_t *, void *vaddrp)
    return mappings[(ulong)vaddrp];
 }
 
+/* No highmem and no ref-counting in the unit tests */
+ulong pageframe_alloc(bool zero)
+{
+   void *va = zero ? kzmalloc(PAGE_SIZE) : kmalloc(PAGE_SIZE);
+   return va ? KERNEL_VA_TO_PA(va) : INVALID_PADDR;
+}
+
+void pageframe_free(ulong paddr)
+{
+   kfree2(KERNEL_PA_TO_VA(paddr), PAGE_SIZE);
+}
+
+void retain_pageframe(ulong paddr) { }
+u32 get_pageframe_ref_count(ulong paddr) { return 1; }
+
+void release_pageframe(ulong paddr)
+{
+   pageframe_free(paddr);
+}
+
+void *kmap(ulong paddr)
+{
+   return KERNEL_PA_TO_VA(paddr);
+}
+
+void kunmap(void *vaddr) { }
+
 void *kmalloc(size_t size)
 {
    if (mock_kmalloc)
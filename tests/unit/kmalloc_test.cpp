@@ -807,3 +807,108 @@ TEST_F(kmalloc_test, partial_free)
 
    kmalloc_destroy_heap(&h);
 }
+
+TEST_F(kmalloc_test, alloc_at)
+{
+   void *ptr;
+   size_t s;
+   bool success;
+
+   struct kmalloc_heap h;
+   kmalloc_create_heap(&h,
+                       MB,                           /* vaddr */
+                       KMALLOC_MIN_HEAP_SIZE,        /* heap size */
+                       KMALLOC_MIN_HEAP_SIZE / 16,   /* min block size */
+                       KMALLOC_MIN_HEAP_SIZE / 8,    /* alloc block size */
+                       false,                        /* linear mapping */
+                       NULL,                         /* metadata_nodes */
+                       fake_alloc_and_map_func,
+                       fake_free_and_map_func);
+
+   struct block_node *nodes = (struct block_node *)h.metadata_nodes;
+   const size_t mbs = h.min_block_size;
+
+   ptr = (void *)(h.vaddr + 3 * mbs);
+   success = per_heap_kmalloc_at(&h, ptr, 6 * mbs, mbs);
+   ASSERT_TRUE(success);
+
+   dump_heap_subtree(&h, 0, 5);
+
+   check_metadata(nodes, {
+      "+---------------------------------------------------------------+",
+      "|                              -S-                              |",
+      "+-------------------------------+-------------------------------+",
+      "|              -S-              |              -S-              |",
+      "+---------------+---------------+---------------+---------------+",
+      "|      -S-      |      -SF      |      -S-      |      ---      |",
+      "+-------+-------+-------+-------+-------+-------+-------+-------+",
+      "|  ---  |  AS-  |  ASF  |  ASF  |  AS-  |  ---  |  ---  |  ---  |",
+      "+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+",
+      "|---|---|---|--F|--F|--F|--F|--F|--F|---|---|---|---|---|---|---|",
+      "+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+"
+   });
+
+   EXPECT_EQ(h.mem_allocated, 6 * mbs);
+
+   /* Overlapping ranges and ranges outside the heap must be rejected */
+   ptr = (void *)(h.vaddr + 8 * mbs);
+   EXPECT_FALSE(per_heap_kmalloc_at(&h, ptr, 2 * mbs, 0));
+
+   ptr = (void *)(h.vaddr + 2 * mbs);
+   EXPECT_FALSE(per_heap_kmalloc_at(&h, ptr, 2 * mbs, 0));
+
+   ptr = (void *)(h.vaddr + 15 * mbs);
+   EXPECT_FALSE(per_heap_kmalloc_at(&h, ptr, 2 * mbs, 0));
+   EXPECT_EQ(h.mem_allocated, 6 * mbs);
+
+   /* Extend the range up to the end of the heap */
+   ptr = (void *)(h.vaddr + 9 * mbs);
+   success = per_heap_kmalloc_at(&h, ptr, 7 * mbs, mbs);
+   ASSERT_TRUE(success);
+   EXPECT_EQ(h.mem_allocated, 13 * mbs);
+
+   /* Free it all at once: that requires naturally aligned sub-blocks */
+   ptr = (void *)(h.vaddr + 3 * mbs);
+   s = 13 * mbs;
+   per_heap_kfree(&h, ptr, &s, KFREE_FL_ALLOW_SPLIT | KFREE_FL_MULTI_STEP);
+   EXPECT_EQ(s, 13 * mbs);
+   EXPECT_EQ(h.mem_allocated, 0u);
+
+   /* The whole heap must be free again */
+   s = h.size;
+   ptr = per_heap_kmalloc(&h, &s, 0);
+   EXPECT_EQ(ptr, (void *)h.vaddr);
+
+   kmalloc_destroy_heap(&h);
+}
+
+TEST_F(kmalloc_test, big_aligned)
+{
+   const size_t sz = 4 * MB;
+   char *ptr, *ptr2;
+   size_t s;
+
+   ptr = (char *)kmalloc_big_aligned(sz, PAGE_SIZE);
+   ASSERT_TRUE(ptr != NULL);
+   EXPECT_EQ((ulong)ptr & (sz - 1), 0u);
+
+   ptr2 = (char *)kmalloc_big_aligned(sz, PAGE_SIZE);
+   ASSERT_TRUE(ptr2 != NULL);
+   EXPECT_EQ((ulong)ptr2 & (sz - 1), 0u);
+   EXPECT_NE(ptr, ptr2);
+
+   /* The first block gets freed page by page, the second all at once */
+   for (size_t i = 0; i < sz; i += PAGE_SIZE)
+      kfree2(ptr + i, PAGE_SIZE);
+
+   s = sz;
+   general_kfree(ptr2, &s, KFREE_FL_ALLOW_SPLIT | KFREE_FL_MULTI_STEP);
+   EXPECT_EQ(s, sz);
+
+   /* Same heap state: the same aligned address has to be found again */
+   ptr2 = (char *)kmalloc_big_aligned(sz, PAGE_SIZE);
+   EXPECT_EQ(ptr2, ptr);
+
+   s = sz;
+   general_kfree(ptr2, &s, KFREE_FL_ALLOW_SPLIT | KFREE_FL_MULTI_STEP);
+}
@@ -0,0 +1,136 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <random>
+#include <vector>
+#include <string>
+
+#include <gtest/gtest.h>
+
+extern "C" {
+   #include <tilck/common/basic_defs.h>
+   #include <tilck/common/page_size.h>
+   #include <tilck/kernel/lz4.h>
+   #include <tilck/kernel/errno.h>
+}
+
+using namespace std;
+
+static void check_round_trip(const vector<u8> &in, size_t *compr_size = nullptr)
+{
+   vector<u8> wrkmem(LZ4_WRKMEM_SIZE);
+   vector<u8> compr(in.size() + in.size() / 255 + 16);
+   vector<u8> out(in.size() + 1);
+   size_t clen;
+   long dlen;
+
+   clen = lz4_compress(in.data(), in.size(),
+                       compr.data(), compr.size(), wrkmem.data());
+   ASSERT_GT(clen, 0u);
+
+   dlen = lz4_decompress(compr.data(), clen, out.data(), out.size());
+   ASSERT_EQ(dlen, (long)in.size());
+   ASSERT_TRUE(equal(in.begin(), in.end(), out.begin()));
+
+   if (compr_size)
+      *compr_size = clen;
+}
+
+TEST(lz4, round_trip)
+{
+   mt19937 e(1234);
+   vector<u8> buf;
+   size_t clen;
+
+   /* Tiny inputs: just literals */
+   for (size_t len = 0; len <= 16; len++) {
+      buf.assign(len, 'x');
+      check_round_trip(buf);
+   }
+
+   /* Zeros: compress very well */
+   buf.assign(PAGE_SIZE, 0);
+   check_round_trip(buf, &clen);
+   EXPECT_LT(clen, 32u);
+
+   /* Random data: incompressible, but still fine */
+   buf.resize(PAGE_SIZE);
+
+   for (auto &c : buf)
+      c = (u8)e();
+
+   check_round_trip(buf, &clen);
+   EXPECT_GT(clen, (size_t)PAGE_SIZE);
+
+   /* Text-like data, with repeated words at random distances */
+   const char *words[] = { "page ", "fault ", "swap ", "tilck ", "zram " };
+   string text;
+
+   while (text.size() < LZ4_MAX_INPUT_SIZE)
+      text += words[e() % ARRAY_SIZE(words)];
+
+   buf.assign(text.begin(), text.begin() + LZ4_MAX_INPUT_SIZE);
+   check_round_trip(buf, &clen);
+   EXPECT_LT(clen, buf.size() / 2);
+
+   /* Random sizes with a mix of runs and random bytes */
+   for (int i = 0; i < 500; i++) {
+
+      buf.resize(e() % (2 * PAGE_SIZE));
+
+      for (size_t j = 0; j < buf.size(); j++)
+         buf[j] = (e() % 4) ? buf[j > 0 ? j - 1 : 0] : (u8)e();
+
+      check_round_trip(buf);
+   }
+}
+
+TEST(lz4, small_dst)
+{
+   vector<u8> wrkmem(LZ4_WRKMEM_SIZE);
+   vector<u8> in(PAGE_SIZE), out(PAGE_SIZE);
+   mt19937 e(1234);
+
+   for (auto &c : in)
+      c = (u8)e();
+
+   /* Random data does not fit in half of the size */
+   EXPECT_EQ(lz4_compress(in.data(), in.size(),
+                          out.data(), in.size() / 2, wrkmem.data()), 0u);
+
+   /* The decompressor must detect an output buffer too small */
+   in.assign(PAGE_SIZE, 'a');
+   size_t clen = lz4_compress(in.data(), in.size(),
+                              out.data(), out.size(), wrkmem.data());
+   ASSERT_GT(clen, 0u);
+
+   vector<u8> compr(out.begin(), out.begin() + (long)clen);
+   EXPECT_EQ(lz4_decompress(compr.data(), clen, out.data(), PAGE_SIZE - 1),
+             -EINVAL);
+}
+
+TEST(lz4, reference_format)
+{
+   /* "abc", then a 15-byte match at offset 3, then "abcab" as literals */
+   const u8 block[] = {
+      0x3B, 'a', 'b', 'c', 0x03, 0x00,
+      0x50, 'a', 'b', 'c', 'a', 'b',
+   };
+
+   const char *expected = "abcabcabcabcabcabc" "abcab";
+   char out[64];
+   long rc;
+
+   rc = lz4_decompress(block, sizeof(block), out, sizeof(out));
+   ASSERT_EQ(rc, (long)strlen(expected));
+   EXPECT_EQ(string(out, (size_t)rc), expected);
+
+   /* Offset pointing before the beginning of the output */
+   const u8 bad_off[] = { 0x10, 'a', 0x02, 0x00, 0x00 };
+   EXPECT_EQ(lz4_decompress(bad_off, sizeof(bad_off), out, sizeof(out)),
+             -EINVAL);
+
+   /* Truncated extra length */
+   const u8 truncated[] = { 0xF0, 0xFF };
+   EXPECT_EQ(lz4_decompress(truncated, sizeof(truncated), out, sizeof(out)),
+             -EINVAL);
+}
@@ -0,0 +1,158 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <random>
+#include <vector>
+#include <memory>
+
+#include <gtest/gtest.h>
+
+extern "C" {
+   #include <tilck/common/basic_defs.h>
+   #include <tilck/kernel/process_mm.h>
+}
+
+using namespace std;
+
+class user_vas_test : public ::testing::Test {
+
+protected:
+
+   struct mappings_info mi;
+   vector<unique_ptr<struct user_mapping>> ums;
+   ulong begin;
+   size_t max_sz;
+
+   void SetUp() override {
+      user_vas_init(&mi);
+      begin = mi.head_gap.start;
+      max_sz = mi.head_gap.size;
+   }
+
+   struct user_mapping *add(ulong vaddr, size_t len) {
+
+      ums.push_back(unique_ptr<struct user_mapping>(new user_mapping()));
+      struct user_mapping *um = ums.back().get();
+
+      um->vaddr = vaddr;
+      um->len = len;
+      user_vas_insert(&mi, um);
+      return um;
+   }
+
+   /* Reserve everything after `pages` pages: the tests use just that */
+   void limit_to(size_t pages) {
+
+      const ulong start = begin + pages * PAGE_SIZE;
+      add(start, mi.head_gap.size - pages * PAGE_SIZE);
+   }
+};
+
+TEST_F(user_vas_test, basic)
+{
+   const size_t pg = PAGE_SIZE;
+   struct user_mapping *a, *b;
+
+   EXPECT_EQ(user_vas_get_free_range(&mi, 16 * pg), begin);
+   EXPECT_EQ(user_vas_largest_gap(&mi), max_sz);
+
+   a = add(begin, 16 * pg);
+   b = add(begin + 32 * pg, 16 * pg);
+
+   /* Best fit: the hole between `a` and `b`, not the huge tail gap */
+   EXPECT_EQ(user_vas_get_free_range(&mi, 16 * pg), begin + 16 * pg);
+   EXPECT_EQ(user_vas_get_free_range(&mi, 8 * pg), begin + 16 * pg);
+   EXPECT_EQ(user_vas_get_free_range(&mi, 17 * pg), begin + 48 * pg);
+
+   EXPECT_EQ(user_vas_find(&mi, begin), a);
+   EXPECT_EQ(user_vas_find(&mi, begin + 16 * pg - 1), a);
+   EXPECT_EQ(user_vas_find(&mi, begin + 16 * pg), nullptr);
+   EXPECT_EQ(user_vas_find(&mi, begin + 40 * pg), b);
+
+   EXPECT_EQ(user_vas_find_next(&mi, begin + 20 * pg), b);
+   EXPECT_EQ(user_vas_find_next(&mi, begin + 8 * pg), a);
+   EXPECT_EQ(user_vas_find_next(&mi, begin + 48 * pg), nullptr);
+
+   EXPECT_TRUE(user_vas_is_range_free(&mi, begin + 16 * pg, 16 * pg));
+   EXPECT_FALSE(user_vas_is_range_free(&mi, begin + 16 * pg, 17 * pg));
+   EXPECT_FALSE(user_vas_is_range_free(&mi, begin + 8 * pg, pg));
+   EXPECT_FALSE(user_vas_is_range_free(&mi, begin - pg, pg));
+
+   /* Grow `a` in place, filling the hole */
+   user_vas_resize(&mi, a, a->vaddr, 32 * pg);
+   EXPECT_EQ(a->gap.size, 0u);
+   EXPECT_EQ(user_vas_get_free_range(&mi, pg), begin + 48 * pg);
+
+   /* Removing `b` merges the gaps before and after it */
+   user_vas_remove(&mi, b);
+   EXPECT_EQ(a->gap.start, begin + 32 * pg);
+   EXPECT_EQ(a->gap.size, max_sz - 32 * pg);
+
+   user_vas_remove(&mi, a);
+   EXPECT_EQ(mi.head_gap.size, max_sz);
+   EXPECT_EQ(mi.tree, nullptr);
+   EXPECT_EQ(mi.gaps_tree, &mi.head_gap);
+}
+
+TEST_F(user_vas_test, random_vs_bitmap)
+{
+   const size_t npages = 512;
+   vector<bool> used(npages, false);
+   vector<struct user_mapping *> live;
+   mt19937 e(1234);
+
+   limit_to(npages);
+
+   for (int iter = 0; iter < 20000; iter++) {
+
+      if (live.empty() || e() % 3) {
+
+         const size_t pages = 1 + e() % 24;
+         const ulong va = user_vas_get_free_range(&mi, pages * PAGE_SIZE);
+
+         /* Brute force: the smallest free run, at the lowest address */
+         size_t best = 0, best_len = 0;
+
+         for (size_t i = 0; i < npages; ) {
+
+            size_t j = i;
+
+            while (j < npages && !used[j])
+               j++;
+
+            if (j - i >= pages && (!best_len || j - i < best_len)) {
+               best = i;
+               best_len = j - i;
+            }
+
+            i = j + 1;
+         }
+
+         if (!best_len) {
+            ASSERT_EQ(va, 0u);
+            continue;
+         }
+
+         ASSERT_EQ(va, begin + best * PAGE_SIZE);
+         ASSERT_TRUE(user_vas_is_range_free(&mi, va, pages * PAGE_SIZE));
+
+         live.push_back(add(va, pages * PAGE_SIZE));
+
+         for (size_t i = 0; i < pages; i++)
+            used[best + i] = true;
+
+      } else {
+
+         const size_t idx = e() % live.size();
+         struct user_mapping *um = live[idx];
+         const size_t first = (um->vaddr - begin) / PAGE_SIZE;
+
+         ASSERT_EQ(user_vas_find(&mi, um->vaddr + um->len - 1), um);
+
+         for (size_t i = 0; i < um->len / PAGE_SIZE; i++)
+            used[first + i] = false;
+
+         user_vas_remove(&mi, um);
+         live.erase(live.begin() + (long)idx);
+      }
+   }
+}